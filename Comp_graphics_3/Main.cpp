@@ -1,4 +1,17 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <new>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -10,8 +23,11 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "auxiliary/ShaderProgram.h"
+#include "auxiliary/BufferArena.h"
 #include "auxiliary/Camera.h"
+#include "auxiliary/GeometryCache.h"
 #include "auxiliary/Model.h"
+#include "auxiliary/ModelLoader.h"
 
 #include "Cosmic.h"
 #include "CosmicValues.h"
@@ -59,6 +75,11 @@ float* currBg = bgBlue;
 
 constexpr bool clockwiseRotate = true;
 
+// Heap allocations made through operator new while counting is on, on any thread; see benchmarkAllocations
+std::atomic<bool> countAllocations(false);
+std::atomic<size_t> allocationCount(0);
+std::atomic<size_t> allocatedBytes(0);
+
 
 struct LightProperties {
 	glm::vec3 ambient;
@@ -79,6 +100,40 @@ void      drawCosmic(const ShaderProgram &objectSP, const ShaderProgram &stencil
 glm::vec3 getPerpendicularVector(const glm::vec3 &originalVector);
 void updateProjections();
 
+// Loads every model through Assimp and through the warm mesh cache and prints load times of both paths
+void benchmarkStartup(const std::vector<std::string> &modelPaths, unsigned int attributes);
+// Loads the given models with float and compact vertices and prints memory, quantization error and draw time of both
+void benchmarkVertexFormats(const std::vector<std::string> &modelPaths, const ShaderProgram &shaderProgram);
+// Imports every model under the directory with mesh optimization and prints ACMR/ATVR before and after
+void benchmarkMeshOptimizer(const std::string &objectsDirectory, unsigned int attributes);
+// Compares the native glTF loader with Assimp on the same scenes
+void benchmarkGltfLoader(const std::vector<std::string> &modelPaths, unsigned int attributes);
+void writeSyntheticObj(const std::string &path, int size);
+void benchmarkObjLoader(const std::vector<std::string> &modelPaths, unsigned int attributes);
+// Counts the heap allocations of importing each model and of building the Model from it, against the size of its geometry
+void benchmarkAllocations(const std::vector<std::string> &modelPaths, unsigned int attributes);
+
+
+// Replaced so that benchmarkAllocations can count; new[] and the nothrow forms go through these by default
+void* operator new(std::size_t size) {
+	if (countAllocations.load(std::memory_order_relaxed)) {
+		allocationCount.fetch_add(1, std::memory_order_relaxed);
+		allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+	}
+
+	if (void* ptr = std::malloc(size ? size : 1))
+		return ptr;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+	std::free(ptr);
+}
+
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xPos, double yPos);
@@ -86,7 +141,156 @@ void scroll_callback(GLFWwindow* window, double xOffset, double yOffset);
 void processInput(GLFWwindow* window);
 
 
-int main() {
+int main(int argc, char* argv[]) {
+	bool runStartupBenchmark = false;
+	bool runVertexFormatBenchmark = false;
+	bool runMeshOptimizerBenchmark = false;
+	bool runGltfBenchmark = false;
+	bool runObjBenchmark = false;
+	bool runAllocationBenchmark = false;
+	bool logLod = false;
+	bool logFileReads = false;
+	bool instancing = true;
+	bool stripAttributes = true;
+	bool parallelLoading = true;
+	bool mountAssetPack = true;
+	bool buildPack = false;
+	bool bakeImages = false;
+	bool streamTextures = true;
+	bool streamMipLevels = true;
+	bool logTextureStreaming = false;
+	bool virtualTextures = false;
+	bool logVirtualTextures = false;
+	size_t uploadBudgetMB = tu::DEFAULT_FRAME_BUDGET / (1024 * 1024);
+	size_t textureBudgetMB = ts::DEFAULT_BUDGET / (1024 * 1024);
+	for (int i = 1; i < argc; ++i) {
+		if (std::string(argv[i]) == "--bench-startup")
+			runStartupBenchmark = true;
+		else if (std::string(argv[i]) == "--no-mesh-cache")
+			mc::ENABLED = false;
+		else if (std::string(argv[i]) == "--serial-load")
+			parallelLoading = false;
+		else if (std::string(argv[i]) == "--log-decode")
+			imgdec::LOG_TIMINGS = true;
+		else if (std::string(argv[i]) == "--no-geometry-sharing")
+			gc::ENABLED = false;
+		else if (std::string(argv[i]) == "--no-buffer-arena")
+			ba::ENABLED = false;
+		else if (std::string(argv[i]) == "--texture-content-hash")
+			tc::HASH_CONTENTS = true;
+		else if (std::string(argv[i]) == "--sync-textures")
+			streamTextures = false;
+		else if (std::string(argv[i]) == "--upload-budget-mb" && i + 1 < argc)
+			uploadBudgetMB = std::stoul(argv[++i]);
+		else if (std::string(argv[i]) == "--no-texture-streaming")
+			streamMipLevels = false;
+		else if (std::string(argv[i]) == "--texture-budget-mb" && i + 1 < argc)
+			textureBudgetMB = std::stoul(argv[++i]);
+		else if (std::string(argv[i]) == "--log-texture-streaming")
+			logTextureStreaming = true;
+		else if (std::string(argv[i]) == "--virtual-textures")
+			virtualTextures = true;
+		else if (std::string(argv[i]) == "--virtual-min-size" && i + 1 < argc)
+			vt::MIN_SIZE = std::stoi(argv[++i]);
+		else if (std::string(argv[i]) == "--virtual-cache-tiles" && i + 1 < argc)
+			vt::CACHE_TILES = std::stoi(argv[++i]);
+		else if (std::string(argv[i]) == "--log-virtual-textures")
+			logVirtualTextures = true;
+		else if (std::string(argv[i]) == "--texture-arrays")
+			ta::ENABLED = true;
+		else if (std::string(argv[i]) == "--compact-vertices")
+			mdl::VERTEX_FORMAT = VertexFormat::COMPACT;
+		else if (std::string(argv[i]) == "--bench-vertex-format")
+			runVertexFormatBenchmark = true;
+		else if (std::string(argv[i]) == "--all-attributes")
+			stripAttributes = false;
+		else if (std::string(argv[i]) == "--no-mesh-optimization")
+			mdl::OPTIMIZE_MESHES = false;
+		else if (std::string(argv[i]) == "--no-lods")
+			mdl::GENERATE_LODS = false;
+		else if (std::string(argv[i]) == "--lod-pixel-error" && i + 1 < argc)
+			lod::PIXEL_ERROR = std::stof(argv[++i]);
+		else if (std::string(argv[i]) == "--no-meshlets")
+			mdl::BUILD_MESHLETS = false;
+		else if (std::string(argv[i]) == "--no-meshlet-culling")
+			mlt::CULLING = false;
+		else if (std::string(argv[i]) == "--no-instancing")
+			instancing = false;
+		else if (std::string(argv[i]) == "--log-lod")
+			logLod = true;
+		else if (std::string(argv[i]) == "--no-mesh-batching")
+			mdl::BATCH_MESHES = false;
+		else if (std::string(argv[i]) == "--bench-mesh-optimizer")
+			runMeshOptimizerBenchmark = true;
+		else if (std::string(argv[i]) == "--no-native-gltf")
+			mdl::NATIVE_GLTF = false;
+		else if (std::string(argv[i]) == "--bench-gltf")
+			runGltfBenchmark = true;
+		else if (std::string(argv[i]) == "--no-native-obj")
+			mdl::NATIVE_OBJ = false;
+		else if (std::string(argv[i]) == "--bench-obj")
+			runObjBenchmark = true;
+		else if (std::string(argv[i]) == "--bench-allocations")
+			runAllocationBenchmark = true;
+		else if (std::string(argv[i]) == "--no-mapped-io")
+			mio::ENABLED = false;
+		else if (std::string(argv[i]) == "--log-file-reads")
+			logFileReads = true;
+		else if (std::string(argv[i]) == "--pack-assets")
+			buildPack = true;
+		else if (std::string(argv[i]) == "--no-asset-pack")
+			mountAssetPack = false;
+		else if (std::string(argv[i]) == "--bake-textures")
+			bakeImages = true;
+		else if (std::string(argv[i]) == "--bake-uncompressed")
+			ktx::COMPRESS = false;
+		else if (std::string(argv[i]) == "--no-baked-textures")
+			ktx::ENABLED = false;
+		else if (std::string(argv[i]) == "--mesh-retention" && i + 1 < argc) {
+			std::string retention = argv[++i];
+			if (retention == "keep")
+				mdl::RETENTION = MeshRetention::KEEP;
+			else if (retention == "drop")
+				mdl::RETENTION = MeshRetention::DROP_AFTER_UPLOAD;
+			else if (retention == "positions")
+				mdl::RETENTION = MeshRetention::POSITIONS_ONLY;
+			else
+				std::cout << "ERROR::ARGS::UNKNOWN_MESH_RETENTION: " << retention << std::endl;
+		}
+	}
+
+	// Meshes sample either layers of texture arrays or virtual textures, there is no shader doing both
+	if (ta::ENABLED && virtualTextures) {
+		std::cout << "ERROR::ARGS::TEXTURE_ARRAYS_WITH_VIRTUAL_TEXTURES: --texture-arrays ignored" << std::endl;
+		ta::ENABLED = false;
+	}
+
+	// Images are baked before packing, so the pack carries their containers too
+	if (bakeImages)
+		bakeTextures("res", { mc::DIRECTORY });
+
+	// Everything under res\ is read through the VFS, from the pack if there is one. The mesh cache is written at runtime, so it stays loose.
+	if (buildPack) {
+		auto packStartTime = std::chrono::steady_clock::now();
+		std::string packError;
+		if (buildAssetPack("res", ap::PATH, { mc::DIRECTORY }, packError))
+			std::cout << "Packed res into " << ap::PATH << " in "
+				<< std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - packStartTime).count() << " ms" << std::endl;
+		else
+			std::cout << "ERROR::ASSET_PACK::" << packError << std::endl;
+	}
+	if (mountAssetPack && std::filesystem::exists(ap::PATH)) {
+		std::string packError;
+		if (AssetVfs::shared().mount(ap::PATH, packError)) {
+			std::cout << "Mounted " << ap::PATH << " (" << AssetVfs::shared().getFileCount() << " files)" << std::endl;
+			if (AssetVfs::shared().getStaleFileCount() > 0)
+				std::cout << "ERROR::ASSET_PACK::" << AssetVfs::shared().getStaleFileCount() << " files in " << ap::PATH
+					<< " changed on disk since packing and are read loose; rebuild it with --pack-assets" << std::endl;
+		}
+		else
+			std::cout << "ERROR::ASSET_PACK::" << packError << ", reading loose files" << std::endl;
+	}
+
 	// Initializing GLFW
 	glfwInit();
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -116,11 +320,56 @@ int main() {
 		return -1;
 	}
 
-	// Shaders
-	ShaderProgram starShaderProgram("res\\shaders\\starShader.vert", "res\\shaders\\starShader.frag");
-	ShaderProgram planetShaderProgram("res\\shaders\\planetShader.vert", "res\\shaders\\planetShader.frag");
+	// Model textures are streamed in over the first frames under a per-frame byte budget
+	std::unique_ptr<TextureUploader> textureUploader;
+	if (streamTextures) {
+		textureUploader = std::make_unique<TextureUploader>();
+		textureUploader->setFrameBudget(uploadBudgetMB * 1024 * 1024);
+		mdl::TEXTURE_UPLOADER = textureUploader.get();
+	}
+
+	// Unless disabled, model textures instead keep only the mip levels their size on screen needs, under one VRAM budget
+	std::unique_ptr<TextureStreamer> textureStreamer;
+	if (streamMipLevels) {
+		textureStreamer = std::make_unique<TextureStreamer>(textureBudgetMB * 1024 * 1024);
+		// Levels go up under the same per-frame budget as the uploader's, unless uploads were asked to be synchronous
+		textureStreamer->setFrameBudget(streamTextures ? uploadBudgetMB * 1024 * 1024 : SIZE_MAX);
+		mdl::TEXTURE_STREAMER = textureStreamer.get();
+	}
+
+	// Optionally, very large images become virtual textures: only the tiles seen are loaded, into one cache of fixed size
+	std::unique_ptr<VirtualTextureSystem> virtualTextureSystem;
+	if (virtualTextures) {
+		virtualTextureSystem = std::make_unique<VirtualTextureSystem>(vt::CACHE_TILES);
+		mdl::VIRTUAL_TEXTURES = virtualTextureSystem.get();
+	}
+
+	// Shaders. The variants are built from the same sources: with VIRTUAL_TEXTURES defined they sample virtual textures
+	// through their page tables, and ordinary ones like the others; with TEXTURE_ARRAYS defined they sample material
+	// textures from layers of texture arrays.
+	std::vector<std::string> shaderDefines;
+	if (virtualTextures)
+		shaderDefines.push_back("VIRTUAL_TEXTURES");
+	else if (ta::ENABLED)
+		shaderDefines.push_back("TEXTURE_ARRAYS");
+	ShaderProgram starShaderProgram("res\\shaders\\starShader.vert", "res\\shaders\\starShader.frag", shaderDefines);
+	ShaderProgram planetShaderProgram("res\\shaders\\planetShader.vert", "res\\shaders\\planetShader.frag", shaderDefines);
+	std::vector<std::string> instancedShaderDefines = shaderDefines;
+	instancedShaderDefines.push_back("INSTANCED");
+	ShaderProgram planetInstancedShaderProgram("res\\shaders\\planetShader.vert", "res\\shaders\\planetShader.frag", instancedShaderDefines);
 	ShaderProgram stencilShaderProgram("res\\shaders\\starShader.vert", "res\\shaders\\stencilShader.frag");
 	ShaderProgram skyboxShaderProgram("res\\shaders\\skyboxShader.vert", "res\\shaders\\skyboxShader.frag");
+
+	// Write which virtual texture tiles each pixel needs, see VirtualTextureSystem
+	std::unique_ptr<ShaderProgram> feedbackShaderProgram, feedbackInstancedShaderProgram;
+	if (virtualTextures) {
+		feedbackShaderProgram = std::make_unique<ShaderProgram>("res\\shaders\\planetShader.vert", "res\\shaders\\virtualFeedback.frag");
+		feedbackInstancedShaderProgram = std::make_unique<ShaderProgram>("res\\shaders\\planetShader.vert", "res\\shaders\\virtualFeedback.frag",
+			std::vector<std::string>{ "INSTANCED" });
+	}
+
+	if (runVertexFormatBenchmark)
+		benchmarkVertexFormats({ "res\\objects\\trex\\scene.gltf", "res\\objects\\sun\\scene.gltf" }, planetShaderProgram);
 	
 	// MOVEMENT INFO
 	// Stars, planets, moons and their movement information.
@@ -172,23 +421,89 @@ int main() {
 
 
 	// MODEL INFO
-	// All loaded models
-	Model loadedModels[] = {
+	// Paths of all loaded models
+	std::vector<std::string> modelPaths = {
 		// Stars
-		Model("res\\objects\\waltuh_star\\waltuh.obj"),
-		Model("res\\objects\\lava_planet\\scene.gltf"),
-		Model("res\\objects\\sirius\\scene.gltf"),
+		"res\\objects\\waltuh_star\\waltuh.obj",
+		"res\\objects\\lava_planet\\scene.gltf",
+		"res\\objects\\sirius\\scene.gltf",
 		// Planets
-		Model("res\\objects\\south_waltuh\\south_waltuh.obj"),
-		Model("res\\objects\\earth\\scene.gltf"),
-		Model("res\\objects\\earth_waltuh\\earth_waltuh.obj"),
-		Model("res\\objects\\cloudy_earth\\scene.gltf"),
+		"res\\objects\\south_waltuh\\south_waltuh.obj",
+		"res\\objects\\earth\\scene.gltf",
+		"res\\objects\\earth_waltuh\\earth_waltuh.obj",
+		"res\\objects\\cloudy_earth\\scene.gltf",
 		// Moons
-		Model("res\\objects\\mug_root_bear\\mug.obj"),
-		Model("res\\objects\\me_gusta_moon\\scene.gltf"),
-		Model("res\\objects\\trex\\scene.gltf"),
+		"res\\objects\\mug_root_bear\\mug.obj",
+		"res\\objects\\me_gusta_moon\\scene.gltf",
+		"res\\objects\\trex\\scene.gltf",
 	};
 
+	// Models are imported with just the vertex attributes their shaders read (tangents aren't used by any of them)
+	unsigned int modelAttributes = va::ALL;
+	if (stripAttributes) {
+		modelAttributes = starShaderProgram.getActiveAttributeMask() | planetShaderProgram.getActiveAttributeMask()
+			| stencilShaderProgram.getActiveAttributeMask();
+	}
+
+	if (runMeshOptimizerBenchmark)
+		benchmarkMeshOptimizer("res\\objects", modelAttributes);
+	if (runGltfBenchmark)
+		benchmarkGltfLoader({ "res\\objects\\trex\\scene.gltf", "res\\objects\\sun\\scene.gltf", "res\\objects\\cloudy_earth\\scene.gltf" }, modelAttributes);
+	if (runObjBenchmark) {
+		std::vector<std::string> objPaths;
+		for (const std::string &path : modelPaths) {
+			if (isObjPath(path))
+				objPaths.push_back(path);
+		}
+		benchmarkObjLoader(objPaths, modelAttributes);
+	}
+	if (runAllocationBenchmark)
+		benchmarkAllocations(modelPaths, modelAttributes);
+	if (runStartupBenchmark)
+		benchmarkStartup(modelPaths, modelAttributes);
+
+	// All loaded models, in the same order as modelPaths.
+	// In parallel mode imports and texture decoding run on worker threads, GL objects are created here as they finish.
+	auto loadStartTime = std::chrono::steady_clock::now();
+
+	std::vector<Model> loadedModels;
+	if (parallelLoading) {
+		ModelLoader loader;
+		loadedModels = loader.loadAll(modelPaths, mdl::DEFAULT_FLAGS, modelAttributes);
+	}
+	else {
+		for (const std::string &path : modelPaths)
+			loadedModels.push_back(Model(path, mdl::DEFAULT_FLAGS, modelAttributes));
+	}
+
+	std::cout << "Loaded " << loadedModels.size() << " models in "
+		<< std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStartTime).count() << " ms ("
+		<< (parallelLoading ? "parallel, " + std::to_string(ThreadPool::shared().getThreadCount()) + " threads" : "serial") << ")" << std::endl;
+
+	// What Assimp read per model; models from the mesh cache or the native loaders list nothing
+	if (logFileReads) {
+		for (size_t i = 0; i < loadedModels.size(); ++i) {
+			std::cout << "  " << modelPaths[i] << ":" << (loadedModels[i].getFileReads().empty() ? " no Assimp reads" : "") << std::endl;
+			logFileReadStats(loadedModels[i].getFileReads());
+		}
+		MappedFileCache::shared().logStats();
+	}
+
+	// Resident memory per model. Shared buffers and textures are counted by every model using them.
+	size_t totalCpuBytes = 0;
+	size_t totalGpuBytes = 0;
+	for (size_t i = 0; i < loadedModels.size(); ++i) {
+		std::cout << "  " << modelPaths[i] << ": CPU " << loadedModels[i].getCpuBytes() / (1024.0 * 1024.0) << " MB, GPU "
+			<< loadedModels[i].getGeometryGpuBytes() / (1024.0 * 1024.0) << " MB geometry + "
+			<< loadedModels[i].getTextureGpuBytes() / (1024.0 * 1024.0) << " MB textures, "
+			<< loadedModels[i].getShortIndexMeshCount() << "/" << loadedModels[i].getMeshes().size() << " meshes with 16-bit indices, "
+			<< loadedModels[i].getDrawCount() << " draw calls (" << loadedModels[i].getSourceMeshCount() << " unbatched)" << std::endl;
+
+		totalCpuBytes += loadedModels[i].getCpuBytes();
+		totalGpuBytes += loadedModels[i].getGpuBytes();
+	}
+	std::cout << "  Total: CPU " << totalCpuBytes / (1024.0 * 1024.0) << " MB, GPU " << totalGpuBytes / (1024.0 * 1024.0) << " MB" << std::endl;
+
 	// Loaded star, planet and moon models
 	Model *starModels[] = {
 		&loadedModels[0],
@@ -217,6 +532,16 @@ int main() {
 
 	bool drawStarOutlines[] = { true, false, true };
 
+	// Moons sharing a model are drawn together with Model::DrawInstanced; the transforms are gathered per model every frame.
+	// Stars and planets are drawn one by one: each has a model of its own, and the outlined stars need their own stencil pass.
+	std::map<Model*, std::vector<InstanceData>> moonInstances;
+	if (instancing) {
+		for (int i = 0; i < sizeof(moonModels) / sizeof(Model*); ++i) {
+			if (std::count(std::begin(moonModels), std::end(moonModels), moonModels[i]) > 1)
+				moonInstances[moonModels[i]];
+		}
+	}
+
 
 	// Skybox cubemap texture
 	std::string skyboxDir = "blue_sb";
@@ -230,6 +555,13 @@ int main() {
 	};
 	unsigned int cubemapTexture = loadCubemap(skyboxFaces);
 
+	TextureCache::shared().logStats();
+	if (ta::ENABLED)
+		TextureArrayManager::shared().logStats();
+	GeometryCache::shared().logStats();
+	AssetVfs::shared().logStats();
+	BufferArena::logAllStats();
+
 	unsigned int skyboxVAO, skyboxVBO;
 	glGenVertexArrays(1, &skyboxVAO);
 	glGenBuffers(1, &skyboxVBO);
@@ -248,6 +580,20 @@ int main() {
 	glStencilFunc(GL_NOTEQUAL, 1, 0xFF);
 	glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
 	
+	// Triangles drawn at the selected levels of detail and after meshlet culling against full detail, logged every few seconds with --log-lod
+	size_t drawnTriangles = 0, fullTriangles = 0, lodFrames = 0;
+	float lodLogTime = static_cast<float>(glfwGetTime());
+	float streamLogTime = lodLogTime;
+	float virtualLogTime = lodLogTime;
+
+	// Bodies drawn this frame, drawn again into the virtual texture feedback once the frame is done
+	std::vector<std::pair<Model*, glm::mat4>> feedbackDraws;
+	bool drawFeedback = false;
+	auto countTriangles = [&drawnTriangles, &fullTriangles](const Model *model) {
+		drawnTriangles += model->getDrawnTriangleCount();
+		fullTriangles += model->getTriangleCount();
+	};
+
 	// Render loop
 	while (!glfwWindowShouldClose(window)) {
 		// Input
@@ -257,6 +603,16 @@ int main() {
 		deltaTime = currentTime - lastTime;
 		lastTime = currentTime;
 
+		if (textureUploader)
+			textureUploader->update();
+		if (textureStreamer)
+			textureStreamer->update();
+		if (virtualTextureSystem)
+			virtualTextureSystem->update();
+
+		feedbackDraws.clear();
+		drawFeedback = virtualTextureSystem && virtualTextureSystem->getTextureCount() > 0;
+
 		// Rendering clear commands
 		glClearColor(currBg[0], currBg[1], currBg[2], currBg[3]);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
@@ -280,31 +636,40 @@ int main() {
 			stencilShaderProgram.setMat4("projection", usedProj == 'P' ? pProj : oProj);
 			stencilShaderProgram.setVec3("ourColor", (lightColors[i] - whitenessFactor) / (1.0f - whitenessFactor));
 
+			starModels[i]->selectLod(model, camera.getPosition(), usedProj == 'P' ? pProj : oProj, static_cast<float>(SCR_HEIGHT));
+			starModels[i]->requestTextureDetail(model, camera.getPosition(), usedProj == 'P' ? pProj : oProj, static_cast<float>(SCR_HEIGHT));
+			starModels[i]->cullMeshlets(model, camera.GetViewMatrix(), usedProj == 'P' ? pProj : oProj);
 			drawCosmic(starShaderProgram, stencilShaderProgram, starModels[i], drawStarOutlines[i]);
+			countTriangles(starModels[i]);
+			if (drawFeedback)
+				feedbackDraws.emplace_back(starModels[i], model);
 		}
 
-		planetShaderProgram.use();
+		// Both planet programs share the fragment shader and its lighting
+		for (const ShaderProgram *program : { &planetShaderProgram, &planetInstancedShaderProgram }) {
+			program->use();
 
-		planetShaderProgram.setFloat("material.shininess", shininess);
+			program->setFloat("material.shininess", shininess);
 
-		// Let's have only point lights - our stars
-		planetShaderProgram.setInt("NR_DIR_LIGHTS", 0);
-		planetShaderProgram.setInt("NR_POINT_LIGHTS", sizeof(starModels) / sizeof(Model*));
-		planetShaderProgram.setInt("NR_SPOT_LIGHTS", 0);
+			// Let's have only point lights - our stars
+			program->setInt("NR_DIR_LIGHTS", 0);
+			program->setInt("NR_POINT_LIGHTS", sizeof(starModels) / sizeof(Model*));
+			program->setInt("NR_SPOT_LIGHTS", 0);
 
-		planetShaderProgram.setVec3("viewPos", camera.getPosition());
+			program->setVec3("viewPos", camera.getPosition());
 
-		// Update light info (position to be more precise) in planet fragment shader for correct lighting
-		for (int i = 0; i < sizeof(starModels) / sizeof(Model*); ++i) {
-			planetShaderProgram.setVec3("pointLights[" + std::to_string(i) + "].ambient",  lightProps[i].ambient);
-			planetShaderProgram.setVec3("pointLights[" + std::to_string(i) + "].diffuse",  lightProps[i].diffuse);
-			planetShaderProgram.setVec3("pointLights[" + std::to_string(i) + "].specular", lightProps[i].specular);
+			// Update light info (position to be more precise) in planet fragment shader for correct lighting
+			for (int i = 0; i < sizeof(starModels) / sizeof(Model*); ++i) {
+				program->setVec3("pointLights[" + std::to_string(i) + "].ambient",  lightProps[i].ambient);
+				program->setVec3("pointLights[" + std::to_string(i) + "].diffuse",  lightProps[i].diffuse);
+				program->setVec3("pointLights[" + std::to_string(i) + "].specular", lightProps[i].specular);
 
-			planetShaderProgram.setVec3("pointLights[" + std::to_string(i) + "].position", stars[i].position);
+				program->setVec3("pointLights[" + std::to_string(i) + "].position", stars[i].position);
 
-			planetShaderProgram.setFloat("pointLights[" + std::to_string(i) + "].constant",  lightProps[i].constant);
-			planetShaderProgram.setFloat("pointLights[" + std::to_string(i) + "].linear",    lightProps[i].linear);
-			planetShaderProgram.setFloat("pointLights[" + std::to_string(i) + "].quadratic", lightProps[i].quadratic);
+				program->setFloat("pointLights[" + std::to_string(i) + "].constant",  lightProps[i].constant);
+				program->setFloat("pointLights[" + std::to_string(i) + "].linear",    lightProps[i].linear);
+				program->setFloat("pointLights[" + std::to_string(i) + "].quadratic", lightProps[i].quadratic);
+			}
 		}
 
 		// Moving and drawing planets
@@ -317,20 +682,55 @@ int main() {
 			planetShaderProgram.setMat4("projection", usedProj == 'P' ? pProj : oProj);
 			planetShaderProgram.setMat3("NormalMatrix", glm::mat3(glm::transpose(glm::inverse(model))));
 
+			planetModels[i]->selectLod(model, camera.getPosition(), usedProj == 'P' ? pProj : oProj, static_cast<float>(SCR_HEIGHT));
+			planetModels[i]->requestTextureDetail(model, camera.getPosition(), usedProj == 'P' ? pProj : oProj, static_cast<float>(SCR_HEIGHT));
+			planetModels[i]->cullMeshlets(model, camera.GetViewMatrix(), usedProj == 'P' ? pProj : oProj);
 			drawCosmic(planetShaderProgram, planetShaderProgram, planetModels[i]);
+			countTriangles(planetModels[i]);
+			if (drawFeedback)
+				feedbackDraws.emplace_back(planetModels[i], model);
 		}
 
 		// Moving and drawing moons
+		for (auto &group : moonInstances)
+			group.second.clear();
+
 		for (int i = 0; i < sizeof(moonModels) / sizeof(Model*); ++i) {
 			glm::mat4 model = moveCosmic(moons[i], moonScales[i]);
 
+			auto group = moonInstances.find(moonModels[i]);
+			if (group != moonInstances.end()) {
+				group->second.push_back({ model, glm::mat3(glm::transpose(glm::inverse(model))) });
+				continue;
+			}
+
 			planetShaderProgram.use();
 			planetShaderProgram.setMat4("model", model);
 			planetShaderProgram.setMat4("view", camera.GetViewMatrix());
 			planetShaderProgram.setMat4("projection", usedProj == 'P' ? pProj : oProj);
 			planetShaderProgram.setMat3("NormalMatrix", glm::mat3(glm::transpose(glm::inverse(model))));
 
+			moonModels[i]->selectLod(model, camera.getPosition(), usedProj == 'P' ? pProj : oProj, static_cast<float>(SCR_HEIGHT));
+			moonModels[i]->requestTextureDetail(model, camera.getPosition(), usedProj == 'P' ? pProj : oProj, static_cast<float>(SCR_HEIGHT));
+			moonModels[i]->cullMeshlets(model, camera.GetViewMatrix(), usedProj == 'P' ? pProj : oProj);
 			drawCosmic(planetShaderProgram, planetShaderProgram, moonModels[i]);
+			countTriangles(moonModels[i]);
+			if (drawFeedback)
+				feedbackDraws.emplace_back(moonModels[i], model);
+		}
+
+		for (auto &group : moonInstances) {
+			planetInstancedShaderProgram.use();
+			planetInstancedShaderProgram.setMat4("view", camera.GetViewMatrix());
+			planetInstancedShaderProgram.setMat4("projection", usedProj == 'P' ? pProj : oProj);
+
+			group.first->selectLod(group.second, camera.getPosition(), usedProj == 'P' ? pProj : oProj, static_cast<float>(SCR_HEIGHT));
+			group.first->requestTextureDetail(group.second, camera.getPosition(), usedProj == 'P' ? pProj : oProj, static_cast<float>(SCR_HEIGHT));
+			glStencilMask(0x00);
+			group.first->DrawInstanced(planetInstancedShaderProgram, group.second);
+
+			for (size_t i = 0; i < group.second.size(); ++i)
+				countTriangles(group.first);
 		}
 
 		// Drawing skybox
@@ -347,11 +747,65 @@ int main() {
 		glBindVertexArray(0);
 		glDepthFunc(GL_LESS);
 
+		// Virtual texture feedback: the same bodies at a fraction of the resolution, read back a frame or two later by update()
+		if (drawFeedback) {
+			int framebufferWidth, framebufferHeight;
+			glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+			virtualTextureSystem->beginFeedback(framebufferWidth, framebufferHeight);
+
+			feedbackShaderProgram->use();
+			feedbackShaderProgram->setMat4("view", camera.GetViewMatrix());
+			feedbackShaderProgram->setMat4("projection", usedProj == 'P' ? pProj : oProj);
+			feedbackShaderProgram->setFloat("feedbackScale", static_cast<float>(vt::FEEDBACK_SCALE));
+			for (const auto &draw : feedbackDraws) {
+				feedbackShaderProgram->setMat4("model", draw.second);
+				draw.first->Draw(*feedbackShaderProgram);
+			}
+
+			feedbackInstancedShaderProgram->use();
+			feedbackInstancedShaderProgram->setMat4("view", camera.GetViewMatrix());
+			feedbackInstancedShaderProgram->setMat4("projection", usedProj == 'P' ? pProj : oProj);
+			feedbackInstancedShaderProgram->setFloat("feedbackScale", static_cast<float>(vt::FEEDBACK_SCALE));
+			for (auto &group : moonInstances)
+				group.first->DrawInstanced(*feedbackInstancedShaderProgram, group.second);
+
+			virtualTextureSystem->endFeedback();
+		}
+
+		++lodFrames;
+		if (logLod && currentTime - lodLogTime >= 2.0f) {
+			std::cout << "LOD: " << drawnTriangles / lodFrames << " triangles per frame ("
+				<< fullTriangles / lodFrames << " at full detail)" << std::endl;
+
+			drawnTriangles = fullTriangles = lodFrames = 0;
+			lodLogTime = currentTime;
+		}
+		if (logTextureStreaming && textureStreamer && currentTime - streamLogTime >= 2.0f) {
+			textureStreamer->logStats();
+			streamLogTime = currentTime;
+		}
+		if (logVirtualTextures && virtualTextureSystem && currentTime - virtualLogTime >= 2.0f) {
+			virtualTextureSystem->logStats();
+			virtualLogTime = currentTime;
+		}
+
 		// Check and call events and swap the buffers
 		glfwSwapBuffers(window);
 		glfwPollEvents();
 	}
 
+	// GL objects have to be released while the context still exists
+	loadedModels.clear();
+	BufferArena::releaseAll();
+	TextureCache::shared().release(cubemapTexture);
+
+	mdl::TEXTURE_UPLOADER = nullptr;
+	textureUploader.reset();
+	mdl::TEXTURE_STREAMER = nullptr;
+	textureStreamer.reset();
+	mdl::VIRTUAL_TEXTURES = nullptr;
+	virtualTextureSystem.reset();
+
 	// Release all GLFW resources
 	glfwTerminate();
 
@@ -583,6 +1037,371 @@ glm::vec3 getPerpendicularVector(const glm::vec3 &originalVector) {
 	return glm::normalize(perpendicularVector);
 }
 
+void benchmarkStartup(const std::vector<std::string> &modelPaths, unsigned int attributes) {
+	bool wasCacheEnabled = mc::ENABLED;
+
+	// Benchmark models are thrown away right after loading, so their textures are uploaded synchronously
+	TextureUploader* uploader = mdl::TEXTURE_UPLOADER;
+	TextureStreamer* streamer = mdl::TEXTURE_STREAMER;
+	VirtualTextureSystem* virtualTextures = mdl::VIRTUAL_TEXTURES;
+	mdl::TEXTURE_UPLOADER = nullptr;
+	mdl::TEXTURE_STREAMER = nullptr;
+	mdl::VIRTUAL_TEXTURES = nullptr;
+
+	auto runPass = [&modelPaths, attributes](const char* passName, bool useCache) {
+		mc::ENABLED = useCache;
+
+		double totalMs = 0.0;
+		size_t cacheHits = 0;
+
+		std::cout << "STARTUP BENCHMARK: " << passName << std::endl;
+		for (const std::string &path : modelPaths) {
+			Model model(path, mdl::DEFAULT_FLAGS, attributes);
+
+			totalMs += model.getLoadTimeMs();
+			cacheHits += model.isLoadedFromCache() ? 1 : 0;
+
+			std::cout << "  " << path << ": " << model.getLoadTimeMs() << " ms" << (model.isLoadedFromCache() ? " (cache)" : "") << std::endl;
+		}
+		std::cout << "  Total: " << totalMs << " ms, cache hits: " << cacheHits << "/" << modelPaths.size() << std::endl;
+	};
+
+	// Times include texture loading, which is the same for both paths
+	runPass("assimp import (cold)", false);
+	runPass("mesh cache (priming)", true);
+	runPass("mesh cache (warm)", true);
+
+	// Wall-clock time of loading everything at once on the worker pool
+	auto runParallelPass = [&modelPaths, attributes](const char* passName, bool useCache) {
+		mc::ENABLED = useCache;
+
+		auto startTime = std::chrono::steady_clock::now();
+		ModelLoader loader;
+		std::vector<Model> models = loader.loadAll(modelPaths, mdl::DEFAULT_FLAGS, attributes);
+
+		std::cout << "STARTUP BENCHMARK: " << passName << std::endl;
+		std::cout << "  Total: " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count()
+			<< " ms on " << ThreadPool::shared().getThreadCount() << " threads" << std::endl;
+	};
+
+	runParallelPass("parallel assimp import (cold)", false);
+	runParallelPass("parallel mesh cache (warm)", true);
+
+	mc::ENABLED = wasCacheEnabled;
+	mdl::TEXTURE_UPLOADER = uploader;
+	mdl::TEXTURE_STREAMER = streamer;
+	mdl::VIRTUAL_TEXTURES = virtualTextures;
+}
+
+void benchmarkMeshOptimizer(const std::string &objectsDirectory, unsigned int attributes) {
+	bool wasCacheEnabled = mc::ENABLED;
+	bool wasOptimizing = mdl::OPTIMIZE_MESHES;
+
+	// Statistics are only gathered by a real import
+	mc::ENABLED = false;
+	mdl::OPTIMIZE_MESHES = true;
+
+	// One model per asset directory: its glTF scene or else its first OBJ file
+	std::vector<std::string> paths;
+	std::error_code error;
+	for (const auto &entry : std::filesystem::directory_iterator(objectsDirectory, error)) {
+		if (!entry.is_directory())
+			continue;
+
+		std::string modelPath;
+		for (const auto &file : std::filesystem::directory_iterator(entry.path(), error)) {
+			std::string extension = file.path().extension().string();
+			if (file.path().filename() == "scene.gltf" || (extension == ".obj" && modelPath.empty()))
+				modelPath = file.path().string();
+		}
+
+		if (!modelPath.empty())
+			paths.push_back(modelPath);
+	}
+	std::sort(paths.begin(), paths.end());
+
+	std::cout << "MESH OPTIMIZER BENCHMARK (FIFO cache of " << mopt::CACHE_SIZE << ")" << std::endl;
+	for (const std::string &path : paths) {
+		ModelData data = Model::importData(path, mdl::DEFAULT_FLAGS, attributes);
+		const MeshOptimizationStats &stats = data.optimizationStats;
+
+		std::cout << "  " << path << ": " << data.meshes.size() << " meshes, " << stats.before.triangles << " triangles, vertices "
+			<< stats.verticesBefore << " -> " << stats.verticesAfter << ", ACMR " << stats.before.getACMR() << " -> " << stats.after.getACMR()
+			<< ", ATVR " << stats.before.getATVR() << " -> " << stats.after.getATVR()
+			<< ", overdraw sorted " << stats.overdrawSorted << "/" << data.meshes.size() << std::endl;
+	}
+
+	mc::ENABLED = wasCacheEnabled;
+	mdl::OPTIMIZE_MESHES = wasOptimizing;
+}
+
+void benchmarkGltfLoader(const std::vector<std::string> &modelPaths, unsigned int attributes) {
+	constexpr int runs = 3;
+
+	bool wasCacheEnabled = mc::ENABLED;
+	bool wasNative = mdl::NATIVE_GLTF;
+
+	// Every run has to read the scene itself
+	mc::ENABLED = false;
+
+	std::cout << "GLTF LOADER BENCHMARK (best of " << runs << ", scene reading only)" << std::endl;
+	for (const std::string &path : modelPaths) {
+		double bestMs[2] = { 0.0, 0.0 };
+		size_t vertices[2] = { 0, 0 }, indices[2] = { 0, 0 }, meshes[2] = { 0, 0 };
+		bool native = false;
+
+		for (int loader = 0; loader < 2; ++loader) {
+			mdl::NATIVE_GLTF = loader == 1;
+
+			for (int run = 0; run < runs; ++run) {
+				ModelData data = Model::importData(path, mdl::DEFAULT_FLAGS, attributes);
+				if (run == 0 || data.sceneTimeMs < bestMs[loader])
+					bestMs[loader] = data.sceneTimeMs;
+
+				vertices[loader] = indices[loader] = 0;
+				for (const MeshData &meshData : data.meshes) {
+					vertices[loader] += meshData.getVertexCount();
+					indices[loader] += meshData.getIndexCount();
+				}
+				meshes[loader] = data.meshes.size();
+				native = native || data.nativeLoader;
+			}
+		}
+
+		std::cout << "  " << path << ": assimp " << bestMs[0] << " ms, native " << bestMs[1] << " ms"
+			<< (native ? "" : " (fell back to assimp)") << ", " << meshes[1] << " meshes, " << vertices[1] << " vertices, " << indices[1] << " indices";
+		if (vertices[0] != vertices[1] || indices[0] != indices[1] || meshes[0] != meshes[1])
+			std::cout << " (assimp: " << meshes[0] << " meshes, " << vertices[0] << " vertices, " << indices[0] << " indices)";
+		std::cout << std::endl;
+	}
+
+	mc::ENABLED = wasCacheEnabled;
+	mdl::NATIVE_GLTF = wasNative;
+}
+
+// Grid of 'size' x 'size' quads with positions, texture coordinates and normals, written the way Blender exports
+void writeSyntheticObj(const std::string &path, int size) {
+	std::ofstream file(path, std::ios::binary);
+	std::string text;
+	char line[128];
+
+	for (int y = 0; y <= size; ++y) {
+		for (int x = 0; x <= size; ++x) {
+			float u = static_cast<float>(x) / size, v = static_cast<float>(y) / size;
+			float height = 0.05f * std::sin(u * 40.0f) * std::cos(v * 40.0f);
+			text.append(line, std::snprintf(line, sizeof(line), "v %.6f %.6f %.6f\nvt %.6f %.6f\nvn 0.0000 1.0000 0.0000\n", u, height, v, u, v));
+		}
+		file << text;
+		text.clear();
+	}
+
+	for (int y = 0; y < size; ++y) {
+		for (int x = 0; x < size; ++x) {
+			int a = y * (size + 1) + x + 1, b = a + 1, c = a + size + 2, d = a + size + 1;
+			text.append(line, std::snprintf(line, sizeof(line), "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, b, b, b, c, c, c, d, d, d));
+		}
+		file << text;
+		text.clear();
+	}
+}
+
+void benchmarkObjLoader(const std::vector<std::string> &modelPaths, unsigned int attributes) {
+	constexpr int runs = 3;
+	constexpr int syntheticSize = 1200;
+
+	bool wasCacheEnabled = mc::ENABLED;
+	bool wasNative = mdl::NATIVE_OBJ;
+	bool wasOptimizing = mdl::OPTIMIZE_MESHES, wasBatching = mdl::BATCH_MESHES, wasGeneratingLods = mdl::GENERATE_LODS, wasBuildingMeshlets = mdl::BUILD_MESHLETS;
+
+	// Every run has to read the scene itself, and nothing after it is timed, so the rest of the import is skipped
+	mc::ENABLED = false;
+	mdl::OPTIMIZE_MESHES = mdl::BATCH_MESHES = mdl::GENERATE_LODS = mdl::BUILD_MESHLETS = false;
+
+	std::string syntheticPath = (std::filesystem::temp_directory_path() / "synthetic_grid.obj").string();
+	writeSyntheticObj(syntheticPath, syntheticSize);
+
+	std::vector<std::string> paths = modelPaths;
+	paths.push_back(syntheticPath);
+
+	std::cout << "OBJ LOADER BENCHMARK (best of " << runs << ", scene reading only, synthetic grid of "
+		<< 2 * syntheticSize * syntheticSize << " triangles)" << std::endl;
+	for (const std::string &path : paths) {
+		double bestMs[2] = { 0.0, 0.0 };
+		size_t vertices[2] = { 0, 0 }, indices[2] = { 0, 0 }, meshes[2] = { 0, 0 };
+		bool native = false;
+
+		for (int loader = 0; loader < 2; ++loader) {
+			mdl::NATIVE_OBJ = loader == 1;
+
+			for (int run = 0; run < runs; ++run) {
+				ModelData data = Model::importData(path, mdl::DEFAULT_FLAGS, attributes);
+				if (run == 0 || data.sceneTimeMs < bestMs[loader])
+					bestMs[loader] = data.sceneTimeMs;
+
+				vertices[loader] = indices[loader] = 0;
+				for (const MeshData &meshData : data.meshes) {
+					vertices[loader] += meshData.getVertexCount();
+					indices[loader] += meshData.getIndexCount();
+				}
+				meshes[loader] = data.meshes.size();
+				native = native || data.nativeLoader;
+			}
+		}
+
+		// Assimp keeps one vertex per face corner, the native loader one per distinct v/vt/vn triple
+		std::cout << "  " << path << ": assimp " << bestMs[0] << " ms, native " << bestMs[1] << " ms"
+			<< (native ? "" : " (fell back to assimp)") << ", " << meshes[1] << " meshes, " << vertices[1] << " vertices, " << indices[1] << " indices"
+			<< " (assimp: " << meshes[0] << " meshes, " << vertices[0] << " vertices, " << indices[0] << " indices)" << std::endl;
+	}
+
+	std::error_code error;
+	std::filesystem::remove(syntheticPath, error);
+
+	mc::ENABLED = wasCacheEnabled;
+	mdl::NATIVE_OBJ = wasNative;
+	mdl::OPTIMIZE_MESHES = wasOptimizing;
+	mdl::BATCH_MESHES = wasBatching;
+	mdl::GENERATE_LODS = wasGeneratingLods;
+	mdl::BUILD_MESHLETS = wasBuildingMeshlets;
+}
+
+void benchmarkAllocations(const std::vector<std::string> &modelPaths, unsigned int attributes) {
+	bool wasCacheEnabled = mc::ENABLED;
+
+	// Textures are uploaded synchronously, so that building the model does all of its work in the counted span
+	TextureUploader* uploader = mdl::TEXTURE_UPLOADER;
+	TextureStreamer* streamer = mdl::TEXTURE_STREAMER;
+	VirtualTextureSystem* virtualTextures = mdl::VIRTUAL_TEXTURES;
+	mdl::TEXTURE_UPLOADER = nullptr;
+	mdl::TEXTURE_STREAMER = nullptr;
+	mdl::VIRTUAL_TEXTURES = nullptr;
+
+	auto count = [](size_t &allocations, size_t &bytes, const auto &work) {
+		allocationCount = 0;
+		allocatedBytes = 0;
+		countAllocations = true;
+		work();
+		countAllocations = false;
+		allocations = allocationCount;
+		bytes = allocatedBytes;
+	};
+
+	// Imports read the scene into ModelData, once per vertex and index. Building the Model moves or maps that geometry,
+	// so its allocations stay far below the geometry's size; a copy would show up as at least as many bytes again.
+	auto runPass = [&modelPaths, attributes, &count](const char* passName, bool useCache) {
+		mc::ENABLED = useCache;
+
+		std::cout << "ALLOCATION BENCHMARK: " << passName << std::endl;
+		for (const std::string &path : modelPaths) {
+			ModelData data;
+			size_t importAllocations, importBytes;
+			count(importAllocations, importBytes, [&]() { data = Model::importData(path, mdl::DEFAULT_FLAGS, attributes); });
+
+			size_t geometryBytes = 0;
+			for (const MeshData &meshData : data.meshes)
+				geometryBytes += meshData.getVertexCount() * sizeof(Vertex) + meshData.getIndexCount() * sizeof(unsigned int);
+
+			std::unique_ptr<Model> model;
+			size_t buildAllocations, buildBytes;
+			count(buildAllocations, buildBytes, [&]() { model = std::make_unique<Model>(std::move(data)); });
+
+			std::cout << "  " << path << (model->isLoadedFromCache() ? " (cache)" : "") << ": geometry " << geometryBytes / 1024.0 << " KB, import "
+				<< importAllocations << " allocations / " << importBytes / 1024.0 << " KB, model " << buildAllocations << " allocations / "
+				<< buildBytes / 1024.0 << " KB" << std::endl;
+		}
+	};
+
+	runPass("import", false);
+	runPass("mesh cache (priming)", true);
+	runPass("mesh cache (warm)", true);
+
+	mc::ENABLED = wasCacheEnabled;
+	mdl::TEXTURE_UPLOADER = uploader;
+	mdl::TEXTURE_STREAMER = streamer;
+	mdl::VIRTUAL_TEXTURES = virtualTextures;
+}
+
+void benchmarkVertexFormats(const std::vector<std::string> &modelPaths, const ShaderProgram &shaderProgram) {
+	constexpr int drawCount = 100;
+	constexpr double MB = 1024.0 * 1024.0;
+
+	VertexFormat savedFormat = mdl::VERTEX_FORMAT;
+	MeshRetention savedRetention = mdl::RETENTION;
+	TextureUploader* uploader = mdl::TEXTURE_UPLOADER;
+	TextureStreamer* streamer = mdl::TEXTURE_STREAMER;
+	VirtualTextureSystem* virtualTextures = mdl::VIRTUAL_TEXTURES;
+
+	// The float vertices are needed on the CPU to measure the quantization error
+	mdl::RETENTION = MeshRetention::KEEP;
+	mdl::TEXTURE_UPLOADER = nullptr;
+	mdl::TEXTURE_STREAMER = nullptr;
+	mdl::VIRTUAL_TEXTURES = nullptr;
+
+	shaderProgram.use();
+	shaderProgram.setMat4("model", glm::mat4(1.0f));
+	shaderProgram.setMat4("view", glm::mat4(1.0f));
+	shaderProgram.setMat4("projection", glm::mat4(1.0f));
+	shaderProgram.setMat3("NormalMatrix", glm::mat3(1.0f));
+
+	unsigned int timerQuery;
+	glGenQueries(1, &timerQuery);
+
+	for (const std::string &path : modelPaths) {
+		std::cout << "VERTEX FORMAT BENCHMARK: " << path << std::endl;
+
+		for (VertexFormat format : { VertexFormat::FLOAT, VertexFormat::COMPACT }) {
+			mdl::VERTEX_FORMAT = format;
+			Model model(path);
+
+			size_t vertexCount = 0;
+			QuantizationError maxError;
+			for (const Mesh &mesh : model.getMeshes()) {
+				vertexCount += mesh.getVertexCount();
+
+				if (format == VertexFormat::COMPACT) {
+					std::vector<CompactVertex> compact;
+					encodeCompactVertices(mesh.getVertices().data(), mesh.getVertexCount(), mesh.getBoundsMin(), mesh.getBoundsMax(), compact);
+
+					QuantizationError error = measureQuantizationError(mesh.getVertices().data(), compact.data(), compact.size(),
+						mesh.getBoundsMin(), mesh.getBoundsMax());
+					maxError.position = std::max(maxError.position, error.position);
+					maxError.normalDegrees = std::max(maxError.normalDegrees, error.normalDegrees);
+					maxError.texCoord = std::max(maxError.texCoord, error.texCoord);
+				}
+			}
+
+			// GPU time of drawing the model repeatedly; every draw fetches each vertex at least once
+			glFinish();
+			glBeginQuery(GL_TIME_ELAPSED, timerQuery);
+			for (int i = 0; i < drawCount; ++i)
+				model.Draw(shaderProgram);
+			glEndQuery(GL_TIME_ELAPSED);
+
+			GLuint64 elapsedNs = 0;
+			glGetQueryObjectui64v(timerQuery, GL_QUERY_RESULT, &elapsedNs);
+
+			std::cout << "  " << (format == VertexFormat::COMPACT ? "compact" : "float  ") << ": "
+				<< vertexCount << " vertices x " << vertexStride(format) << " B = " << vertexCount * vertexStride(format) / MB << " MB vertex data, "
+				<< model.getGeometryGpuBytes() / MB << " MB geometry, "
+				<< elapsedNs / 1e6 / drawCount << " ms per draw" << std::endl;
+
+			if (format == VertexFormat::COMPACT) {
+				std::cout << "  max error: position " << maxError.position << ", normal " << maxError.normalDegrees
+					<< " deg, uv " << maxError.texCoord << std::endl;
+			}
+		}
+	}
+
+	glDeleteQueries(1, &timerQuery);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+	mdl::VERTEX_FORMAT = savedFormat;
+	mdl::RETENTION = savedRetention;
+	mdl::TEXTURE_UPLOADER = uploader;
+	mdl::TEXTURE_STREAMER = streamer;
+	mdl::VIRTUAL_TEXTURES = virtualTextures;
+}
+
 void updateProjections() {
 	pProj = glm::perspective(glm::radians(camera.getFov()), aspectRatio, 0.1f, 300.0f);
 	oProj = glm::ortho(
@@ -47,34 +47,57 @@ float skyboxVertices[] = {
 
 
 unsigned int loadCubemap(const std::vector<std::string> &faces) {
+    std::string key = "cubemap:";
+    for (const std::string &face : faces)
+        key += TextureCache::normalizePath(face) + '|';
+
+    return TextureCache::shared().acquire(key, 0, [&faces](size_t &byteSize) {
+        return uploadCubemap(faces, byteSize);
+    }, GL_TEXTURE_CUBE_MAP);
+}
+
+unsigned int uploadCubemap(const std::vector<std::string> &faces, size_t &byteSize) {
+    std::vector<DecodedImage> images = decodeImages(faces);
+    if (imgdec::LOG_TIMINGS)
+        logDecodeTimings("cubemap", images);
+
+    byteSize = 0;
+    for (const DecodedImage &image : images)
+        byteSize += image.getByteSize();
+
     unsigned int textureID;
     glGenTextures(1, &textureID);
     glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 
-    int width, height, nrComponents;
-    for (unsigned int i = 0; i < faces.size(); i++) {
-        unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrComponents, 0);
-        
-        if (data) {
+    // Faces decoded from images have no mip levels beyond the base one, so the cube map only uses as many as all faces have
+    GLint maxLevel = 1000;
+    for (unsigned int i = 0; i < images.size(); i++) {
+        const DecodedImage &image = images[i];
+
+        if (image.baked) {
+            uploadBakedLevels(*image.baked, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i);
+            maxLevel = std::min(maxLevel, static_cast<GLint>(image.baked->getLevels().size()) - 1);
+        }
+        else if (image.pixels) {
             GLenum format;
-            if (nrComponents == 1)
+            if (image.components == 1)
                 format = GL_RED;
-            else if (nrComponents == 3)
+            else if (image.components == 3)
                 format = GL_RGB;
-            else if (nrComponents == 4)
+            else if (image.components == 4)
                 format = GL_RGBA;
 
             glTexImage2D(
                 GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-                0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data
+                0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels.get()
             );
-            stbi_image_free(data);
+            maxLevel = 0;
         }
         else {
             std::cout << "Cubemap tex failed to load at path: " << faces[i] << std::endl;
-            stbi_image_free(data);
         }
     }
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, maxLevel);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
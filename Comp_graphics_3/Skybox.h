@@ -4,6 +4,10 @@
 
 #include "stb_image.h"
 
+#include "auxiliary/ImageDecoder.h"
+#include "auxiliary/TextureCache.h"
+
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -11,4 +15,8 @@
 extern float skyboxVertices[108];
 
 
-unsigned int loadCubemap(const std::vector<std::string> &faces);
\ No newline at end of file
+// Returns the cubemap from the shared texture cache, loading it on first use
+unsigned int loadCubemap(const std::vector<std::string> &faces);
+
+// All faces are decoded concurrently before being uploaded; baked faces are uploaded with their mip levels
+unsigned int uploadCubemap(const std::vector<std::string> &faces, size_t &byteSize);
\ No newline at end of file
@@ -2,6 +2,9 @@
 
 #version 330 core
 
+// ShaderProgram defines VIRTUAL_TEXTURES or TEXTURE_ARRAYS right after the version line for the virtual texturing or
+// texture array variant
+
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
@@ -10,10 +13,29 @@ out vec4 FragColor;
 
 
 struct Material {
+#ifdef TEXTURE_ARRAYS
+    sampler2DArray texture_diffuse1;
+    sampler2DArray texture_specular1;
+    sampler2DArray texture_emissive1;
+#else
     sampler2D texture_diffuse1;
     sampler2D texture_specular1;
     sampler2D texture_emissive1;
+#endif
     float     shininess;
+#if defined(VIRTUAL_TEXTURES)
+
+    // Width, height and level count of a virtual texture, whose sampler then holds its page table; zero for ordinary textures
+    vec3 texture_diffuse1_virtual;
+    vec3 texture_specular1_virtual;
+    vec3 texture_emissive1_virtual;
+#elif defined(TEXTURE_ARRAYS)
+
+    // Layer of the texture in its array, -1 if the mesh has none for the slot
+    int texture_diffuse1_layer;
+    int texture_specular1_layer;
+    int texture_emissive1_layer;
+#endif
 };
 
 
@@ -69,10 +91,28 @@ uniform DirLight dirLights[MAX_DIR_LIGHTS];
 uniform PointLight pointLights[MAX_POINT_LIGHTS];
 uniform SpotLight spotLights[MAX_SPOT_LIGHTS];
 
+#ifdef VIRTUAL_TEXTURES
+// Physical tile cache shared by all virtual textures; must match VirtualTexture.h
+uniform sampler2D virtualCache;
+
+#define VT_TILE_SIZE 120
+#define VT_BORDER 4
+#endif
+
+// Sampled once per fragment and used by every light
+vec3 diffuseColor;
+vec3 specularColor;
+
 // Function prototypes
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+#if defined(VIRTUAL_TEXTURES)
+vec4 sampleVirtual(sampler2D pageTable, vec3 info, vec2 uv);
+vec4 sampleMaterial(sampler2D tex, vec3 info, vec2 uv);
+#elif defined(TEXTURE_ARRAYS)
+vec4 sampleLayer(sampler2DArray tex, int layer, vec2 uv);
+#endif
 
  
 void main()
@@ -80,6 +120,17 @@ void main()
     vec3 norm = normalize(Normal);
     vec3 viewDir = normalize(viewPos - FragPos);
 
+#if defined(VIRTUAL_TEXTURES)
+    diffuseColor = vec3(sampleMaterial(material.texture_diffuse1, material.texture_diffuse1_virtual, TexCoords));
+    specularColor = vec3(sampleMaterial(material.texture_specular1, material.texture_specular1_virtual, TexCoords));
+#elif defined(TEXTURE_ARRAYS)
+    diffuseColor = vec3(sampleLayer(material.texture_diffuse1, material.texture_diffuse1_layer, TexCoords));
+    specularColor = vec3(sampleLayer(material.texture_specular1, material.texture_specular1_layer, TexCoords));
+#else
+    diffuseColor = vec3(texture(material.texture_diffuse1, TexCoords));
+    specularColor = vec3(texture(material.texture_specular1, TexCoords));
+#endif
+
     vec3 result = vec3(0.0);
 
     for(int i = 0; i < NR_DIR_LIGHTS; ++i)
@@ -93,7 +144,13 @@ void main()
 
     vec3 emission = vec3(0.0);
     if (useEmission)
+#if defined(VIRTUAL_TEXTURES)
+        emission = vec3(sampleMaterial(material.texture_emissive1, material.texture_emissive1_virtual, TexCoords));
+#elif defined(TEXTURE_ARRAYS)
+        emission = vec3(sampleLayer(material.texture_emissive1, material.texture_emissive1_layer, TexCoords));
+#else
         emission = vec3(texture(material.texture_emissive1, TexCoords));
+#endif
 
     FragColor = vec4(result + emission, 1.0);
 }
@@ -122,9 +179,9 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir) {
     //vec3 diffuse = light.diffuse * diff * texture_diffuse_combined;
     //vec3 specular = light.specular * spec * texture_specular_combined;
 
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords));
+    vec3 ambient = light.ambient * diffuseColor;
+    vec3 diffuse = light.diffuse * diff * diffuseColor;
+    vec3 specular = light.specular * spec * specularColor;
     
     return (ambient + diffuse + specular);
 }
@@ -157,9 +214,9 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir) {
     //vec3 diffuse = light.diffuse * diff * texture_diffuse_combined;
     //vec3 specular = light.specular * spec * texture_specular_combined;
 
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords));
+    vec3 ambient = light.ambient * diffuseColor;
+    vec3 diffuse = light.diffuse * diff * diffuseColor;
+    vec3 specular = light.specular * spec * specularColor;
 
     ambient *= attenuation;
     diffuse *= attenuation;
@@ -200,13 +257,55 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir) {
     //vec3 diffuse = light.diffuse * diff * texture_diffuse_combined;
     //vec3 specular = light.specular * spec * texture_specular_combined;
 
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords));
+    vec3 ambient = light.ambient * diffuseColor;
+    vec3 diffuse = light.diffuse * diff * diffuseColor;
+    vec3 specular = light.specular * spec * specularColor;
 
     ambient *= attenuation * intensity;
     diffuse *= attenuation * intensity;
     specular *= attenuation * intensity;
 
     return (ambient + diffuse + specular);
-}
\ No newline at end of file
+}
+
+#if defined(VIRTUAL_TEXTURES)
+vec4 sampleMaterial(sampler2D tex, vec3 info, vec2 uv) {
+    return info.z > 0.0 ? sampleVirtual(tex, info, uv) : texture(tex, uv);
+}
+
+// Looks up the tile covering 'uv' at the level the screen footprint calls for in the page table, which points at that tile
+// in the cache, or at the closest coarser one that is resident
+vec4 sampleVirtual(sampler2D pageTable, vec3 info, vec2 uv) {
+    vec2 size = info.xy;
+    int levelCount = int(info.z);
+
+    vec2 texels = uv * max(size.x, size.y);
+    float footprint = max(dot(dFdx(texels), dFdx(texels)), dot(dFdy(texels), dFdy(texels)));
+    int lod = clamp(int(floor(0.5 * log2(max(footprint, 1e-8)))), 0, levelCount - 1);
+
+    vec2 wrapped = fract(uv);
+    ivec2 levelSize = max(ivec2(size) >> lod, ivec2(1));
+    ivec2 pages = (levelSize + VT_TILE_SIZE - 1) / VT_TILE_SIZE;
+    ivec2 page = min(ivec2(wrapped * vec2(levelSize)) / VT_TILE_SIZE, pages - 1);
+
+    ivec4 entry = ivec4(texelFetch(pageTable, page, lod) * 255.0 + 0.5);
+    if (entry.a == 0)
+        return vec4(0.0, 0.0, 0.0, 1.0);
+
+    // The entry may be for a coarser level than asked for: find the page of that level covering this one
+    int residentLevel = entry.b;
+    ivec2 residentSize = max(ivec2(size) >> residentLevel, ivec2(1));
+    ivec2 residentPages = (residentSize + VT_TILE_SIZE - 1) / VT_TILE_SIZE;
+    ivec2 residentPage = min(page >> (residentLevel - lod), residentPages - 1);
+
+    vec2 inTile = wrapped * vec2(residentSize) - vec2(residentPage * VT_TILE_SIZE);
+    vec2 cacheTexel = vec2(entry.rg * (VT_TILE_SIZE + 2 * VT_BORDER) + VT_BORDER) + inTile;
+    return textureLod(virtualCache, cacheTexel / vec2(textureSize(virtualCache, 0)), 0.0);
+}
+#elif defined(TEXTURE_ARRAYS)
+
+// A slot the mesh has no texture for reads black; the sampler2D variants read whatever texture its unit holds
+vec4 sampleLayer(sampler2DArray tex, int layer, vec2 uv) {
+    return layer >= 0 ? texture(tex, vec3(uv, float(layer))) : vec4(0.0, 0.0, 0.0, 1.0);
+}
+#endif
\ No newline at end of file
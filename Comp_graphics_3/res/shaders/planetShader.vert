@@ -2,24 +2,59 @@
 
 #version 330 core
 
+// ShaderProgram defines INSTANCED right after the version line for Model::DrawInstanced
+
 layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
+layout (location = 1) in vec3 aNormal; // vec2 octahedral if octNormals
 layout (location = 2) in vec2 aTexCoords;
+#ifdef INSTANCED
+// Per instance, in place of the model and NormalMatrix uniforms
+layout (location = 5) in mat4 instanceModel;
+layout (location = 9) in mat3 instanceNormalMatrix;
+#endif
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
  
+#ifndef INSTANCED
 uniform mat4 model;
+#endif
 uniform mat4 view;
 uniform mat4 projection;
+#ifndef INSTANCED
 uniform mat3 NormalMatrix;
+#endif
+
+// Set per mesh by Mesh::Draw: compact vertices store positions relative to the mesh bounds and octahedral normals
+uniform vec3 positionScale = vec3(1.0);
+uniform vec3 positionOffset = vec3(0.0);
+uniform bool octNormals = false;
+
+vec3 octDecode(vec2 e)
+{
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-v.z, 0.0);
+    v.xy += mix(vec2(t), vec2(-t), greaterThanEqual(v.xy, vec2(0.0)));
+    return normalize(v);
+}
  
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = NormalMatrix * aNormal;
+    vec3 position = aPos * positionScale + positionOffset;
+    vec3 normal = octNormals ? octDecode(aNormal.xy) : aNormal;
+
+#ifdef INSTANCED
+    FragPos = vec3(instanceModel * vec4(position, 1.0));
+    Normal = instanceNormalMatrix * normal;
+    TexCoords = aTexCoords;
+
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+#else
+    FragPos = vec3(model * vec4(position, 1.0));
+    Normal = NormalMatrix * normal;
     TexCoords = aTexCoords;
 
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = projection * view * model * vec4(position, 1.0);
+#endif
 }
\ No newline at end of file
@@ -12,11 +12,17 @@ out vec2 TexCoords;
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+
+// Set per mesh by Mesh::Draw: compact vertices store positions relative to the mesh bounds
+uniform vec3 positionScale = vec3(1.0);
+uniform vec3 positionOffset = vec3(0.0);
  
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
+    vec3 position = aPos * positionScale + positionOffset;
+
+    FragPos = vec3(model * vec4(position, 1.0));
     TexCoords = aTexCoords;
 
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = projection * view * model * vec4(position, 1.0);
 } 
\ No newline at end of file
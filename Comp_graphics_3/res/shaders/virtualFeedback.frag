@@ -0,0 +1,23 @@
+//FRAGMENT SHADER
+
+#version 330 core
+
+in vec2 TexCoords;
+
+// Read back by VirtualTextureSystem to decide which tiles to load
+out uvec4 Feedback;
+
+// Set of virtual textures the mesh samples (see VirtualTextureSystem::getMaterial); 0 for none, whose meshes are still drawn to hide what's behind them
+uniform int virtualMaterial;
+// How many screen pixels a feedback pixel covers in each dimension
+uniform float feedbackScale;
+
+
+void main()
+{
+    // UV footprint of a screen pixel; the CPU turns it into a level of each texture from its size
+    float footprint = sqrt(max(dot(dFdx(TexCoords), dFdx(TexCoords)), dot(dFdy(TexCoords), dFdy(TexCoords)))) / feedbackScale;
+    float lodBias = clamp(-log2(max(footprint, 1e-8)) * 256.0, 0.0, 65535.0);
+
+    Feedback = uvec4(uvec2(fract(TexCoords) * 65535.0), uint(lodBias), uint(virtualMaterial));
+}
\ No newline at end of file
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+
+// Non-owning read-only view over contiguous elements (a vector, a mapped file region, ...)
+template <typename T>
+class ArrayView {
+private:
+    const T* ptr = nullptr;
+    size_t count = 0;
+
+public:
+    ArrayView() = default;
+    inline ArrayView(const T *data, size_t size) : ptr(data), count(size) {}
+    inline ArrayView(const std::vector<T> &vector) : ptr(vector.data()), count(vector.size()) {}
+
+    inline const T* data()  const { return this->ptr; }
+    inline size_t   size()  const { return this->count; }
+    inline bool     empty() const { return this->count == 0; }
+
+    inline const T* begin() const { return this->ptr; }
+    inline const T* end()   const { return this->ptr + this->count; }
+
+    inline const T& operator[](size_t index) const { return this->ptr[index]; }
+
+    // Explicit copy, for the rare caller that really needs one
+    inline std::vector<T> toVector() const { return std::vector<T>(begin(), end()); }
+};
\ No newline at end of file
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "MappedFile.h"
+#include "ThreadPool.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+// Single-file pack of the res directory: a header, the files' chunks back to back, then the table of contents.
+// Every chunk is LZ4-compressed on its own (see Lz4Block.h), or stored as is if that doesn't pay off.
+namespace ap {
+    constexpr uint32_t MAGIC = 0x4B415041; // "APAK"
+    constexpr uint32_t VERSION = 2;
+
+    // Files are cut into chunks of this size, so a big file decompresses on several threads
+    constexpr size_t CHUNK_BYTES = 256 * 1024;
+
+    // Pack mounted at startup if it exists, built by --pack-assets
+    extern std::string PATH;
+}
+
+
+// A file read through AssetVfs: either a view into a mapping (a loose file, or a pack entry stored uncompressed)
+// or the decompressed bytes of a pack entry. Keeps whatever it points into alive.
+class VfsFile {
+private:
+    std::shared_ptr<const MappedFile> mapping;
+    std::vector<unsigned char> bytes;
+    const unsigned char *data = nullptr;
+    size_t size = 0;
+
+    friend class AssetVfs;
+
+public:
+    inline const unsigned char* getData() const { return this->data; }
+    inline size_t               getSize() const { return this->size; }
+};
+
+
+// Virtual file system over the program's resources: files found in the mounted pack are read from it, all others from disk.
+// Paths are the usual ones relative to the working directory, matched case-insensitively and with either separator.
+// Mount before the first read; reads are safe from any thread.
+class AssetVfs {
+private:
+    struct Entry {
+        uint64_t size = 0;
+        uint32_t firstChunk = 0;
+        uint32_t chunkCount = 0;
+        // Every chunk is stored uncompressed, so the entry can be handed out as a view into the pack
+        bool stored = false;
+    };
+
+    struct Chunk {
+        uint64_t offset;
+        uint32_t storedSize;
+        uint32_t size;
+    };
+
+    std::shared_ptr<const MappedFile> pack;
+    std::unordered_map<std::string, Entry> entries;
+    std::vector<Chunk> chunks;
+    // Entries left out at mount because the loose file changed since packing
+    size_t staleFileCount = 0;
+
+    // Statistics
+    mutable std::mutex statsMutex;
+    mutable size_t packedReadCount = 0;
+    mutable size_t looseReadCount = 0;
+    mutable size_t decompressedBytes = 0;
+    mutable double decompressTimeMs = 0.0;
+
+    const Entry* findEntry(const std::string &path) const;
+
+public:
+    // Lower case, '/' separators, relative to the working directory and lexically normalized: the key of a file in the pack
+    static std::string normalizePath(const std::string &path);
+
+    // Maps the pack and reads its table of contents. On failure returns false with the reason in 'error' and leaves nothing mounted.
+    // Entries whose loose file exists with another size or modification time than when it was packed are left out, so edits
+    // under res are read from disk instead of being shadowed by a stale pack.
+    bool mount(const std::string &packPath, std::string &error);
+    inline bool   isMounted()          const { return this->pack != nullptr; }
+    inline size_t getFileCount()       const { return this->entries.size(); }
+    inline size_t getStaleFileCount()  const { return this->staleFileCount; }
+
+    // Null if the file is neither in the pack nor on disk, or its pack entry doesn't decompress.
+    // Entries of several chunks are decompressed on the pool, with the calling thread taking part.
+    std::shared_ptr<const VfsFile> read(const std::string &path, ThreadPool &pool = ThreadPool::shared()) const;
+
+    bool exists(const std::string &path) const;
+    inline bool isPacked(const std::string &path) const { return findEntry(path) != nullptr; }
+
+    void logStats() const;
+
+    static AssetVfs& shared();
+};
+
+
+// Packs every file under 'directory' into 'packPath', keyed by its path relative to the working directory.
+// Files under the 'excluded' directories are left out. Chunks are compressed on the pool, so don't call this from one of its jobs.
+// On failure returns false with the reason in 'error'.
+bool buildAssetPack(const std::string &directory, const std::string &packPath, const std::vector<std::string> &excluded, std::string &error,
+                    ThreadPool &pool = ThreadPool::shared());
\ No newline at end of file
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "VertexFormat.h"
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+
+namespace ba {
+    // Sub-allocate mesh buffers from shared arenas instead of giving every mesh its own VAO/VBO/EBO
+    extern bool ENABLED;
+
+    constexpr size_t BLOCK_VERTEX_BYTES = 32 * 1024 * 1024;
+    constexpr size_t BLOCK_INDEX_BYTES = 8 * 1024 * 1024;
+
+    // A block is compacted once this share of its capacity is lost in holes between allocations
+    constexpr float COMPACT_THRESHOLD = 0.25f;
+}
+
+
+class BufferArena;
+
+// A mesh's range inside a BufferArena. The arena moves ranges when it compacts,
+// so the offsets must be read at draw time rather than copied.
+struct ArenaAllocation {
+    BufferArena *arena = nullptr;
+    size_t block = 0;
+    unsigned int VAO = 0;
+
+    size_t baseVertex = 0;
+    size_t vertexCount = 0;
+    size_t indexOffset = 0;     // in bytes
+    size_t indexBytes = 0;
+};
+
+
+// Large vertex and index buffers shared by all meshes with one vertex layout.
+// Every block has a single VAO, meshes draw with glDrawElementsBaseVertex at their offsets.
+// Freed ranges go back to a free list; a fragmented block is compacted by copying its live ranges
+// into fresh buffers, so models can be loaded and unloaded at runtime.
+// All methods call OpenGL and must run on the GL context thread.
+class BufferArena {
+private:
+    // Free ranges by offset, merged with their neighbours on release
+    using FreeList = std::map<size_t, size_t>;
+
+    struct Block {
+        unsigned int VAO = 0;
+        unsigned int VBO = 0;
+        unsigned int EBO = 0;
+
+        size_t vertexCapacity = 0;  // in vertices
+        size_t indexCapacity = 0;   // in bytes
+
+        FreeList freeVertices;
+        FreeList freeIndices;
+        size_t usedVertices = 0;
+        size_t usedIndexBytes = 0;
+
+        std::unordered_map<ArenaAllocation*, std::unique_ptr<ArenaAllocation>> allocations;
+    };
+
+    VertexLayout layout;
+    std::vector<Block> blocks;
+
+    // Statistics
+    size_t compactionCount = 0;
+
+    size_t createBlock(size_t vertexCapacity, size_t indexCapacity);
+    void setupVertexArray(const Block &block) const;
+    ArenaAllocation* allocateInBlock(size_t blockIndex, size_t vertexCount, size_t indexBytes);
+
+    static bool takeRange(FreeList &freeList, size_t size, size_t &offset);
+    static void returnRange(FreeList &freeList, size_t offset, size_t size);
+    static size_t largestRange(const FreeList &freeList);
+
+    // Share of the block lost in holes that a new allocation can't use as one range
+    float getFragmentation(const Block &block) const;
+
+public:
+    explicit BufferArena(const VertexLayout &layout);
+    ~BufferArena();
+
+    BufferArena(const BufferArena&) = delete;
+    BufferArena& operator=(const BufferArena&) = delete;
+
+    // Copies the vertices (already in the arena's layout) and indices into the arena.
+    // Indices are relative to the allocation's first vertex and may be 16- or 32-bit.
+    ArenaAllocation* allocate(const void *vertexData, size_t vertexCount, const void *indexData, size_t indexBytes);
+
+    // Returns the range to the free list and compacts the block if it got too fragmented
+    void release(ArenaAllocation *allocation);
+
+    // Moves all live ranges of every block to the front of fresh buffers
+    void compact();
+
+    inline const VertexLayout& getLayout() const { return this->layout; }
+    inline unsigned int getVBO(size_t block) const { return this->blocks[block].VBO; }
+    inline unsigned int getEBO(size_t block) const { return this->blocks[block].EBO; }
+
+    // Statistics
+    inline size_t getBlockCount()      const { return this->blocks.size(); }
+    inline size_t getCompactionCount() const { return this->compactionCount; }
+    size_t getAllocationCount() const;
+    size_t getUsedBytes() const;
+    size_t getCapacityBytes() const;
+
+    void logStats() const;
+
+    // One arena per vertex layout, created on first use
+    static BufferArena& forLayout(VertexFormat format, unsigned int attributes);
+    static void logAllStats();
+    // Deletes every arena's GL objects; call before the context is destroyed, after all meshes are gone
+    static void releaseAll();
+};
\ No newline at end of file
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "BufferArena.h"
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+
+
+namespace gc {
+    // Share GPU buffers between meshes with identical vertex and index data
+    extern bool ENABLED;
+}
+
+
+// GL objects holding the geometry of one mesh, or its range in a shared BufferArena
+struct GpuGeometry {
+    unsigned int VAO = 0;
+    unsigned int VBO = 0;
+    unsigned int EBO = 0;
+    ArenaAllocation *allocation = nullptr;
+};
+
+
+// Process-wide registry of mesh geometry keyed by a hash of the vertex and index payload.
+// Meshes with identical geometry get the same VAO/VBO/EBO and keep their own textures.
+// acquire and release create and delete GL objects, so they must be called on the GL context thread.
+class GeometryCache {
+private:
+    struct Entry {
+        GpuGeometry geometry;
+        size_t refCount = 0;
+        uint64_t checkHash = 0;
+        size_t vertexCount = 0;
+        size_t indexCount = 0;
+        size_t byteSize = 0;
+    };
+
+    mutable std::mutex mutex;
+    std::unordered_map<uint64_t, Entry> entries;
+    // Arena geometry shares its VAO with other meshes, so entries are found by allocation instead
+    std::unordered_map<uintptr_t, uint64_t> hashByGeometry;
+
+    // Statistics
+    size_t uploadCount = 0;
+    size_t uploadedBytes = 0;
+    size_t savedUploadCount = 0;
+    size_t savedBytes = 0;
+
+public:
+    // Returns shared buffers for this geometry, or calls create() to upload them.
+    // checkHash is a second hash of the same payload, independent of the key, and guards against collisions together with
+    // the counts: a mismatch just gets its own unshared buffers.
+    GpuGeometry acquire(uint64_t hash, uint64_t checkHash, size_t vertexCount, size_t indexCount, size_t byteSize,
+                        const std::function<GpuGeometry()> &create);
+
+    // Drops one reference and deletes the buffers when none are left. Unshared geometry is deleted right away.
+    void release(const GpuGeometry &geometry);
+
+    // Statistics
+    inline size_t getUploadCount()      const { return this->uploadCount; }
+    inline size_t getUploadedBytes()    const { return this->uploadedBytes; }
+    inline size_t getSavedUploadCount() const { return this->savedUploadCount; }
+    inline size_t getSavedBytes()       const { return this->savedBytes; }
+
+    void logStats() const;
+
+    static GeometryCache& shared();
+};
\ No newline at end of file
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "AssetPack.h"
+#include "Json.h"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+// glTF component types
+namespace gltf {
+    constexpr int BYTE           = 5120;
+    constexpr int UNSIGNED_BYTE  = 5121;
+    constexpr int SHORT          = 5122;
+    constexpr int UNSIGNED_SHORT = 5123;
+    constexpr int UNSIGNED_INT   = 5125;
+    constexpr int FLOAT          = 5126;
+
+    constexpr int MODE_TRIANGLES = 4;
+}
+
+
+// Elements of one accessor as they lie in a mapped buffer
+struct GltfAccessor {
+    const unsigned char *data = nullptr;
+    size_t count = 0;
+    size_t stride = 0;          // bytes between elements, the element size if the view is tightly packed
+    int componentType = 0;
+    int components = 0;         // 1 for SCALAR up to 16 for MAT4
+    bool normalized = false;
+
+    // Copies the first 'floats' components of every element into 'out', 'outStride' bytes apart.
+    // Only FLOAT accessors with at least that many components can be read this way.
+    bool readFloats(int floats, unsigned char *out, size_t outStride) const;
+
+    // Widens any unsigned index type into 'out'. Tightly packed 32-bit indices are copied in one go.
+    bool readIndices(std::vector<unsigned int> &out) const;
+};
+
+
+// A .gltf document with its external buffers read through the VFS, which maps them (or the asset pack) into memory.
+// Accessors point straight into the buffers, so vertex data is read once, by whoever consumes it.
+// .glb files, embedded (data URI) buffers and sparse accessors aren't supported; callers are expected to fall back to another importer.
+class GltfAsset {
+private:
+    JsonValue document;
+    std::vector<std::shared_ptr<const VfsFile>> buffers;
+    std::string directory;
+
+public:
+    // Parses the JSON and maps every buffer. On failure returns false with the reason in 'error'.
+    bool open(const std::string &path, std::string &error);
+
+    inline const JsonValue& getDocument() const { return this->document; }
+
+    // Resolves an accessor to its buffer range, checking that every element lies inside the buffer view
+    bool getAccessor(size_t index, GltfAccessor &accessor, std::string &error) const;
+
+    // File of the image a texture uses, relative to the document and with %XX escapes decoded. Empty for embedded images.
+    std::string getTexturePath(size_t textureIndex) const;
+};
+
+// Files of the external buffers a .gltf document references, in the same form as 'path'. Parses the JSON but reads no buffer.
+std::vector<std::string> getGltfBufferPaths(const std::string &path);
+
+inline bool isGltfPath(const std::string &path) {
+    return path.size() >= 5 && path.compare(path.size() - 5, 5, ".gltf") == 0;
+}
\ No newline at end of file
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "stb_image.h"
+
+#include "TextureContainer.h"
+#include "ThreadPool.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+
+namespace imgdec {
+    // Print per-image decode timings after every batch
+    extern bool LOG_TIMINGS;
+}
+
+
+// Image decoded on the CPU and waiting to be uploaded to the GPU, or the container baked from it
+struct DecodedImage {
+    std::string path;
+    int width = 0;
+    int height = 0;
+    int components = 0;
+    std::unique_ptr<unsigned char, void(*)(void*)> pixels { nullptr, stbi_image_free };
+    // Set instead of pixels when the image was baked; its levels are uploaded as they are
+    std::shared_ptr<const BakedTexture> baked;
+
+    double decodeTimeMs = 0.0;
+
+    inline bool   isLoaded()    const { return this->pixels || this->baked; }
+    inline size_t getByteSize() const { return this->baked ? this->baked->getByteSize() : static_cast<size_t>(width) * height * components; }
+};
+
+
+// Loads the image's baked container if there is one (see TextureContainer.h), else decodes the image with stb_image.
+// On failure the returned image is not loaded.
+DecodedImage decodeImage(const std::string &path);
+
+// Decodes all images concurrently and returns them in the order of paths.
+// The calling thread takes part in decoding, so this is safe to call from a job running on the same pool.
+std::vector<DecodedImage> decodeImages(const std::vector<std::string> &paths, ThreadPool &pool = ThreadPool::shared());
+
+// Prints decode time and size of every image, slowest first
+void logDecodeTimings(const std::string &title, const std::vector<DecodedImage> &images);
\ No newline at end of file
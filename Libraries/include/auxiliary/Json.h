@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+// Read-only JSON document tree, enough for asset formats like glTF. Numbers are doubles, objects keep their key order.
+// Missing members and out of range elements read as null, so lookups can be chained without checks.
+class JsonValue {
+public:
+    enum class Type {
+        NUL,
+        BOOLEAN,
+        NUMBER,
+        STRING,
+        ARRAY,
+        OBJECT
+    };
+
+private:
+    Type type = Type::NUL;
+    bool boolean = false;
+    double number = 0.0;
+    std::string string;
+    std::vector<JsonValue> elements;
+    std::vector<std::pair<std::string, JsonValue>> members;
+
+    friend class JsonParser;
+
+public:
+    inline Type getType()   const { return this->type; }
+    inline bool isNull()    const { return this->type == Type::NUL; }
+    inline bool isNumber()  const { return this->type == Type::NUMBER; }
+    inline bool isString()  const { return this->type == Type::STRING; }
+    inline bool isArray()   const { return this->type == Type::ARRAY; }
+    inline bool isObject()  const { return this->type == Type::OBJECT; }
+
+    // Values of the wrong type read as the fallback
+    inline bool               asBool(bool fallback = false)       const { return this->type == Type::BOOLEAN ? this->boolean : fallback; }
+    inline double             asNumber(double fallback = 0.0)     const { return this->type == Type::NUMBER ? this->number : fallback; }
+    inline const std::string& asString()                          const { return this->string; }
+    size_t                    asIndex(size_t fallback)            const;
+
+    // Elements of an array or members of an object, 0 for anything else
+    inline size_t size() const { return this->type == Type::ARRAY ? this->elements.size() : this->members.size(); }
+
+    const JsonValue& operator[](size_t index) const;
+    const JsonValue& operator[](const char *key) const;
+    // Literal indices would be ambiguous between the two above
+    inline const JsonValue& operator[](int index) const { return (*this)[static_cast<size_t>(index)]; }
+    inline bool has(const char *key) const { return !(*this)[key].isNull(); }
+
+    inline const std::vector<JsonValue>& getElements() const { return this->elements; }
+    inline const std::vector<std::pair<std::string, JsonValue>>& getMembers() const { return this->members; }
+};
+
+// Parses a whole document. On failure returns false and describes the problem and its offset in 'error'.
+bool parseJson(const char *text, size_t length, JsonValue &result, std::string &error);
\ No newline at end of file
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+
+
+// Compression in the LZ4 block format: byte-aligned literal runs and back references, no entropy coding,
+// so decompression runs at memory speed. Blocks are self-contained and carry no sizes; callers store them.
+
+// Largest compressed size of 'size' bytes, for incompressible input
+inline size_t lz4CompressBound(size_t size) {
+    return size + size / 255 + 16;
+}
+
+// Greedy single-pass compression. Returns the compressed size, or 0 if it doesn't fit into 'capacity'.
+size_t lz4Compress(const unsigned char *source, size_t size, unsigned char *destination, size_t capacity);
+
+// Decompresses a whole block that must expand to exactly 'size' bytes. Returns false on malformed or truncated input;
+// it never reads or writes out of the given ranges.
+bool lz4Decompress(const unsigned char *source, size_t sourceSize, unsigned char *destination, size_t size);
\ No newline at end of file
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+// Read-only memory mapping of a whole file. The mapping lives as long as the object does.
+class MappedFile {
+private:
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#else
+    int fileDescriptor = -1;
+#endif
+
+    void release();
+
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string &path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile& operator=(MappedFile &&other) noexcept;
+
+    // Returns false if the file doesn't exist or can't be mapped. An empty file opens with a size of 0.
+    bool open(const std::string &path);
+
+    inline bool isOpen() const { return this->data != nullptr; }
+
+    inline const unsigned char* getData() const { return this->data; }
+    inline size_t               getSize() const { return this->size; }
+};
\ No newline at end of file
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <assimp/IOStream.hpp>
+#include <assimp/IOSystem.hpp>
+
+#include "MappedFile.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace mio {
+    // Serve Assimp's file reads from memory mappings (see MappedIOSystem) instead of its stdio streams
+    extern bool ENABLED;
+
+    // Mappings kept alive between imports, least recently used ones are dropped beyond this
+    extern size_t CACHE_BYTES;
+}
+
+
+// What one import read of one file
+struct FileReadStats {
+    std::string path;
+    size_t fileSize = 0;
+    size_t bytesRead = 0;
+    size_t openCount = 0;
+    // Mapping the file or reading it out of the asset pack, 0 if every open was served by the cache
+    double mapTimeMs = 0.0;
+    // Inside Read, i.e. copying out of the mapping and the page faults that come with it
+    double readTimeMs = 0.0;
+    bool cached = false;
+};
+
+
+// Process-wide cache of read-only file mappings, so that side files shared by several models (.bin, .mtl) and models imported again
+// are mapped once.
+// Safe to use from any thread. A mapping handed out stays valid for as long as its holder keeps it, even if the cache drops it.
+class MappedFileCache {
+private:
+    struct Entry {
+        std::shared_ptr<const MappedFile> file;
+        std::filesystem::file_time_type writeTime;
+        uint64_t lastUse = 0;
+    };
+
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, Entry> entries;
+    size_t cachedBytes = 0;
+    uint64_t useCounter = 0;
+
+    // Statistics
+    size_t hitCount = 0;
+    size_t missCount = 0;
+
+    // Caller must hold the mutex
+    void evictLocked();
+
+public:
+    // Mapping of the file, mapped now if it isn't cached or has changed on disk since. Null if it can't be mapped.
+    // 'cached' tells whether an existing mapping was returned.
+    std::shared_ptr<const MappedFile> acquire(const std::string &path, bool &cached);
+
+    void clear();
+
+    size_t getCachedBytes() const;
+    inline size_t getHitCount()  const { return this->hitCount; }
+    inline size_t getMissCount() const { return this->missCount; }
+
+    void logStats() const;
+
+    static MappedFileCache& shared();
+};
+
+
+class MappedIOSystem;
+
+// Read-only stream over a cached mapping or a file from the asset pack. Reads still copy into Assimp's buffers,
+// but straight from memory, without stdio's buffer in between.
+class MappedIOStream : public Assimp::IOStream {
+private:
+    // Keeps 'data' alive
+    std::shared_ptr<const void> owner;
+    const unsigned char *data;
+    size_t size;
+    size_t position = 0;
+
+    MappedIOSystem *system;
+    size_t statsIndex;
+
+public:
+    MappedIOStream(std::shared_ptr<const void> owner, const unsigned char *data, size_t size, MappedIOSystem *system, size_t statsIndex);
+
+    size_t   Read(void *buffer, size_t elementSize, size_t count) override;
+    size_t   Write(const void *buffer, size_t elementSize, size_t count) override;
+    aiReturn Seek(size_t offset, aiOrigin origin) override;
+    size_t   Tell() const override;
+    size_t   FileSize() const override;
+    void     Flush() override;
+};
+
+
+// Assimp file system reading through MappedFileCache, or from the asset pack for files it contains (see AssetVfs),
+// and recording per-file statistics of one import.
+// Give a new one to every Assimp::Importer (it takes ownership), and copy the statistics out before the importer is destroyed.
+// Opening for writing isn't supported.
+class MappedIOSystem : public Assimp::IOSystem {
+private:
+    MappedFileCache &cache;
+    std::vector<FileReadStats> fileStats;
+    std::unordered_map<std::string, size_t> statsIndexByPath;
+
+    friend class MappedIOStream;
+
+public:
+    explicit MappedIOSystem(MappedFileCache &cache = MappedFileCache::shared());
+
+    bool              Exists(const char *path) const override;
+    char              getOsSeparator() const override;
+    Assimp::IOStream* Open(const char *path, const char *mode = "rb") override;
+    void              Close(Assimp::IOStream *stream) override;
+
+    // In order of first open
+    inline const std::vector<FileReadStats>& getFileStats() const { return this->fileStats; }
+};
+
+// One line per file, indented under whatever the caller printed before
+void logFileReadStats(const std::vector<FileReadStats> &fileStats);
\ No newline at end of file
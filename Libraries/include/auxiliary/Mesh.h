@@ -5,11 +5,19 @@
 
 #include "stb_image.h"
 
+#include "ArrayView.h"
+#include "BufferArena.h"
+#include "MappedFile.h"
 #include "ShaderProgram.h"
+#include "VertexFormat.h"
 
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
+class VirtualTexture;
+
 struct Vertex {
     glm::vec3 Position;
     glm::vec3 Normal;
@@ -22,36 +30,197 @@ struct Texture {
     unsigned int id;
     std::string type;
     std::string path;
+    // Set if 'id' is the page table of a virtual texture rather than the image itself
+    const VirtualTexture *virtualTexture = nullptr;
+    // Layer of a material texture packed into a texture array, whose TextureArrayManager handle 'id' is then; -1 for 2D textures
+    int layer = -1;
+};
+
+// Texture referenced by a material before it's loaded: 'type' is the sampler name prefix, 'path' is relative to the model directory
+struct TextureRef {
+    std::string type;
+    std::string path;
+};
+
+
+// One level of detail: a range of the mesh's index buffer over the shared vertices
+struct MeshLod {
+    size_t indexOffset = 0;     // in indices
+    size_t indexCount = 0;
+    float  error = 0.0f;        // object space distance from the full-detail surface
+};
+
+
+// A cluster of a few dozen triangles: a range of the mesh's index buffer with the bounds to cull it on the CPU
+struct Meshlet {
+    size_t indexOffset = 0;     // in indices
+    size_t indexCount = 0;
+
+    // Object space bounding sphere
+    glm::vec3 center = glm::vec3(0.0f);
+    float     radius = 0.0f;
+
+    // All triangle normals lie within the cone around coneAxis; coneCutoff is the sine of its half angle.
+    // A cutoff of 1 means the normals spread too far for the cluster to ever be entirely back-facing.
+    glm::vec3 coneAxis = glm::vec3(0.0f);
+    float     coneCutoff = 1.0f;
+};
+
+struct MeshletCullView;
+
+
+// Per-instance attributes of Model::DrawInstanced, read by the instanced shaders at va::INSTANCE_*_LOCATION
+struct InstanceData {
+    glm::mat4 model;
+    glm::mat3 normalMatrix;
+};
+
+
+// What a mesh keeps in RAM once its buffers are on the GPU
+enum class MeshRetention {
+    KEEP,               // the full vertex and index data
+    DROP_AFTER_UPLOAD,  // nothing, only the counts and bounds remain
+    POSITIONS_ONLY      // positions and indices, enough for picking and bounds
 };
 
 
 class Mesh {
 protected:
-    // Mesh data
+    // Mesh data. Owned vectors, or empty if the geometry lives in mappedSource.
     std::vector<Vertex>       vertices;
     std::vector<unsigned int> indices;
     std::vector<Texture>      textures;
 
-    // Rendering data
-    unsigned int VAO, VBO, EBO;
+    std::shared_ptr<const MappedFile> mappedSource;
+
+    // Filled only by MeshRetention::POSITIONS_ONLY
+    std::vector<glm::vec3> positions;
+
+    // Point at whichever of the two holds the geometry, null once it's dropped. The counts always stay valid.
+    const Vertex       *vertexData = nullptr;
+    size_t              vertexCount = 0;
+    const unsigned int *indexData = nullptr;
+    size_t              indexCount = 0;
+
+    // Object space bounding box
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+
+    // Layout of the GPU vertex buffer and the attributes (va:: bits) it holds. The CPU copy is always Vertex.
+    VertexFormat format = VertexFormat::FLOAT;
+    unsigned int attributes = va::ALL;
+    // GL_UNSIGNED_SHORT if every index fits into 16 bits, the CPU copy always keeps 32-bit indices
+    GLenum indexType = GL_UNSIGNED_INT;
+
+    // Levels of detail, full detail first, all in the one index buffer. Empty if the mesh has a single level.
+    std::vector<MeshLod> lods;
+    size_t lodLevel = 0;
+
+    // Clusters of every level, in index order. lodMeshlets holds the first meshlet and the count of each level.
+    std::vector<Meshlet> meshlets;
+    std::vector<std::pair<size_t, size_t>> lodMeshlets;
+
+    // Index ranges (first index, count) that survived the last cullMeshlets, merged where they touch.
+    // Used by Draw while visibleLevel is the selected level.
+    std::vector<std::pair<size_t, size_t>> visibleRanges;
+    size_t visibleLevel = NOT_CULLED;
+
+    // Scratch arrays for glMultiDrawElements
+    std::vector<GLsizei> drawCounts;
+    std::vector<const void*> drawOffsets;
+    std::vector<GLint> drawBaseVertices;
+
+    // Feedback id of the virtual textures among the mesh's textures, 0 if there are none (see VirtualTextureSystem::getMaterial)
+    unsigned int virtualMaterial = 0;
+
+    // Rendering data, owned through the geometry cache
+    unsigned int VAO = 0, VBO = 0, EBO = 0;
+    // Set if the buffers are a range of a shared BufferArena; VAO is then the arena block's
+    ArenaAllocation *allocation = nullptr;
+
+    static constexpr size_t NOT_CULLED = ~static_cast<size_t>(0);
 
     void setupMesh();
+    void setupMeshlets();
+    // Binds the textures and sets the material and vertex decoding uniforms; unbindTextures undoes the bindings
+    void bindMaterial(const ShaderProgram &shaderProgram);
+    void unbindTextures();
+    void computeBounds();
+    void releaseBuffers();
 
 public:
-    explicit inline Mesh(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices, const std::vector<Texture> &textures)
-        : vertices(vertices), indices(indices), textures(textures)
-    {
-        setupMesh();
-    }
+    // Takes the vectors over, nothing is copied
+    explicit Mesh(std::vector<Vertex> &&vertices, std::vector<unsigned int> &&indices, std::vector<Texture> &&textures,
+                  VertexFormat format = VertexFormat::FLOAT, unsigned int attributes = va::ALL, std::vector<MeshLod> &&lods = {},
+                  std::vector<Meshlet> &&meshlets = {});
+
+    // Uses the geometry straight from a mapped mesh cache, which is kept alive as long as the mesh
+    explicit Mesh(std::shared_ptr<const MappedFile> source, const Vertex *vertexData, size_t vertexCount,
+                  const unsigned int *indexData, size_t indexCount, std::vector<Texture> &&textures,
+                  VertexFormat format = VertexFormat::FLOAT, unsigned int attributes = va::ALL, std::vector<MeshLod> &&lods = {},
+                  std::vector<Meshlet> &&meshlets = {});
+
+    ~Mesh();
 
+    // A mesh owns its GL buffers, so it can only be moved
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+    Mesh(Mesh &&other) noexcept;
+    Mesh& operator=(Mesh &&other) noexcept;
+
+    // Draws the selected level of detail, only its visible meshlets if they were culled for it
     void Draw(const ShaderProgram &shaderProgram);
 
-    // Get mesh data
-    inline std::vector<Vertex>       getVertices() const { return this->vertices; }
-    inline std::vector<unsigned int> getIndices()  const { return this->indices; }
-    inline std::vector<Texture>      getTextures() const { return this->textures; }
+    // Draws the whole selected level once per instance, with the instance attributes read from instanceBuffer.
+    // Meshlet culling results are ignored, they only hold for one transform.
+    void DrawInstanced(const ShaderProgram &shaderProgram, unsigned int instanceBuffer, size_t instanceCount);
+
+    // Culls the meshlets of the selected level against the view; the next draws submit just the visible ones.
+    // Meshes without meshlets are left alone.
+    void cullMeshlets(const MeshletCullView &view);
+
+    // Picks the coarsest level whose error stays within maxPixelError, given how many pixels an object space unit covers
+    void selectLod(float pixelsPerUnit, float maxPixelError);
+
+    // Frees the CPU copy of the geometry the policy doesn't keep. Dropped data can't be brought back.
+    void applyRetention(MeshRetention retention);
+
+    // Get mesh data. Views are empty if the retention policy dropped that data.
+    inline ArrayView<Vertex>           getVertices()  const { return ArrayView<Vertex>(this->vertexData, this->vertexData ? this->vertexCount : 0); }
+    inline ArrayView<unsigned int>     getIndices()   const { return ArrayView<unsigned int>(this->indexData, this->indexData ? getLodIndexCount(0) : 0); }
+    inline ArrayView<glm::vec3>        getPositions() const { return ArrayView<glm::vec3>(this->positions); }
+    inline const std::vector<Texture>& getTextures()  const { return this->textures; }
+
+    inline size_t       getVertexCount()  const { return this->vertexCount; }
+    // Indices of all levels of detail together
+    inline size_t       getIndexCount()   const { return this->indexCount; }
+    inline glm::vec3    getBoundsMin()    const { return this->boundsMin; }
+    inline glm::vec3    getBoundsMax()    const { return this->boundsMax; }
+    inline VertexFormat getVertexFormat() const { return this->format; }
+    inline unsigned int getAttributes()   const { return this->attributes; }
+    inline GLenum       getIndexType()    const { return this->indexType; }
+    inline size_t       getIndexSize()    const { return this->indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int); }
+
+    inline const std::vector<MeshLod>& getLods() const { return this->lods; }
+    inline size_t getLodCount()  const { return this->lods.empty() ? 1 : this->lods.size(); }
+    inline size_t getLodLevel()  const { return this->lodLevel; }
+    inline void   setLodLevel(size_t level) { this->lodLevel = level < getLodCount() ? level : getLodCount() - 1; }
+    inline size_t getLodIndexCount(size_t level) const { return this->lods.empty() ? this->indexCount : this->lods[level].indexCount; }
+
+    inline const std::vector<Meshlet>& getMeshlets() const { return this->meshlets; }
+
+    inline unsigned int getVirtualMaterial() const { return this->virtualMaterial; }
+    inline void         setVirtualMaterial(unsigned int material) { this->virtualMaterial = material; }
+    // Indices the next Draw submits, after level selection and meshlet culling
+    size_t getDrawnIndexCount() const;
+
+    // Memory accounting. CPU bytes include the part of a mapped mesh cache this mesh references.
+    // GPU bytes are the size of the mesh's buffers, also when they're shared with other meshes.
+    size_t getCpuBytes() const;
+    size_t getGpuBytes() const;
 
     inline unsigned int getVAO() const { return this->VAO; }
-    inline unsigned int getVBO() const { return this->VBO; }
-    inline unsigned int getEBO() const { return this->EBO; }
+    inline unsigned int getVBO() const { return this->allocation ? this->allocation->arena->getVBO(this->allocation->block) : this->VBO; }
+    inline unsigned int getEBO() const { return this->allocation ? this->allocation->arena->getEBO(this->allocation->block) : this->EBO; }
+    inline bool         isInArena() const { return this->allocation != nullptr; }
 };
\ No newline at end of file
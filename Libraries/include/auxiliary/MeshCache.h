@@ -0,0 +1,86 @@
+#pragma once
+
+#include "Mesh.h"
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+// On-disk cache of post-processed meshes, so that warm starts can skip Assimp entirely.
+// A cache file is valid only for the same MeshCacheKey and format version.
+namespace mc {
+    constexpr uint32_t MAGIC = 0x48534D41; // "AMSH"
+    constexpr uint32_t VERSION = 8;
+
+    // Processing done after the Assimp import, and the importer used, as MeshCacheKey::options bits
+    constexpr uint32_t OPTION_OPTIMIZED   = 1 << 0;
+    constexpr uint32_t OPTION_BATCHED     = 1 << 1;
+    constexpr uint32_t OPTION_LODS        = 1 << 2;
+    constexpr uint32_t OPTION_MESHLETS    = 1 << 3;
+    constexpr uint32_t OPTION_NATIVE_OBJ  = 1 << 4; // an .obj read by loadObj, which welds corners Assimp keeps apart
+    constexpr uint32_t OPTION_NATIVE_GLTF = 1 << 5; // a .gltf read by GltfAsset instead of Assimp
+
+    extern bool ENABLED;
+    extern std::string DIRECTORY;
+}
+
+
+// Everything the cached meshes depend on
+struct MeshCacheKey {
+    uint64_t sourceHash = 0;    // of the model file and the buffers and material libraries it references
+    uint32_t flags = 0;         // Assimp post-processing flags
+    uint32_t attributes = 0;    // va:: bits
+    uint32_t options = 0;       // mc::OPTION_* bits
+};
+
+
+// Mesh data that points straight into a mapped cache file
+struct CachedMeshView {
+    const Vertex       *vertices;
+    uint32_t            vertexCount;
+    const unsigned int *indices;
+    uint32_t            indexCount;
+    // Number of source meshes merged into this one by static batching
+    uint32_t            sourceMeshCount;
+
+    std::vector<TextureRef> textures;
+    // Ranges of the indices above, empty for single-level meshes
+    std::vector<MeshLod>    lods;
+    std::vector<Meshlet>    meshlets;
+};
+
+
+// 64-bit FNV-1a hash of the whole file contents. Returns 0 if the file can't be read.
+uint64_t hashFileContents(const std::string &path);
+
+uint64_t hashBytes(const void *data, size_t size, uint64_t seed = 0xcbf29ce484222325ULL);
+
+// A 64-bit hash unrelated to hashBytes, over 8-byte words with a murmur3 finalizer. Data that collides in one
+// almost certainly doesn't in the other, so a pair of them stands in for comparing the bytes.
+uint64_t hashBytesMixed(const void *data, size_t size, uint64_t seed = 0);
+
+// Cache file location for the given source model path and key. The source hash isn't part of the name,
+// so a changed source file overwrites its stale cache.
+std::string meshCachePath(const std::string &sourcePath, const MeshCacheKey &key);
+
+// Validates the cache header against the key and fills mesh views pointing into the mapping.
+// Returns false if the cache is stale, truncated or was written by another version.
+bool readMeshCache(const MappedFile &file, const MeshCacheKey &key, std::vector<CachedMeshView> &meshes);
+
+
+class MeshCacheWriter {
+private:
+    std::vector<unsigned char> buffer;
+    uint32_t meshCount = 0;
+
+    void append(const void *data, size_t size);
+    void pad();
+
+public:
+    void addMesh(const Vertex *vertices, size_t vertexCount, const unsigned int *indices, size_t indexCount, const std::vector<TextureRef> &textures,
+                 size_t sourceMeshCount = 1, const std::vector<MeshLod> &lods = {}, const std::vector<Meshlet> &meshlets = {});
+
+    bool save(const std::string &cachePath, const MeshCacheKey &key) const;
+};
\ No newline at end of file
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "Mesh.h"
+
+#include <cstddef>
+#include <vector>
+
+
+namespace mopt {
+    // FIFO cache size used to measure ACMR/ATVR, close to the post-transform caches of current GPUs
+    constexpr size_t CACHE_SIZE = 32;
+
+    // The overdraw sort may cost at most this much ACMR relative to the cache-optimized order
+    constexpr float OVERDRAW_THRESHOLD = 1.05f;
+
+    // Smallest cluster of triangles the overdraw sort moves as a whole
+    constexpr size_t MIN_CLUSTER_SIZE = 64;
+}
+
+
+// Post-transform cache efficiency of an index buffer, from a FIFO cache simulation.
+// ACMR is cache misses per triangle (0.5 is ideal for large grids, 3 is the worst case),
+// ATVR is misses per referenced vertex (1 is ideal).
+struct VertexCacheStats {
+    size_t triangles = 0;
+    size_t vertices = 0;
+    size_t misses = 0;
+
+    inline float getACMR() const { return triangles ? static_cast<float>(misses) / triangles : 0.0f; }
+    inline float getATVR() const { return vertices ? static_cast<float>(misses) / vertices : 0.0f; }
+
+    inline void add(const VertexCacheStats &other) {
+        triangles += other.triangles;
+        vertices += other.vertices;
+        misses += other.misses;
+    }
+};
+
+// What optimizeMesh did to one mesh or, summed up, to a whole model
+struct MeshOptimizationStats {
+    size_t verticesBefore = 0;
+    size_t verticesAfter = 0;
+    VertexCacheStats before;
+    VertexCacheStats after;
+    size_t overdrawSorted = 0;  // meshes whose overdraw-sorted order was kept
+
+    inline void add(const MeshOptimizationStats &other) {
+        verticesBefore += other.verticesBefore;
+        verticesAfter += other.verticesAfter;
+        before.add(other.before);
+        after.add(other.after);
+        overdrawSorted += other.overdrawSorted;
+    }
+};
+
+
+VertexCacheStats analyzeVertexCache(const unsigned int *indices, size_t indexCount, size_t vertexCount, size_t cacheSize = mopt::CACHE_SIZE);
+
+// Merges bit-identical vertices and rewrites the indices
+void weldVertices(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices);
+
+// Reorders triangles for post-transform cache reuse (Forsyth's linear-speed vertex cache optimization)
+void optimizeVertexCache(std::vector<unsigned int> &indices, size_t vertexCount);
+
+// Splits the cache-optimized order into clusters that don't depend on each other's cache contents and sorts them
+// from the outside of the mesh inwards (Sander et al., "Fast triangle reordering for vertex locality and reduced overdraw").
+// Returns false and leaves the indices alone if the sorted order would cost more than 'threshold' times the ACMR.
+bool optimizeOverdraw(std::vector<unsigned int> &indices, const std::vector<Vertex> &vertices, float threshold = mopt::OVERDRAW_THRESHOLD);
+
+// Renumbers vertices in the order the indices first use them, so that vertex fetch walks memory linearly.
+// Unreferenced vertices are dropped.
+void optimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices);
+
+// Runs all of the above in order on a triangle list
+MeshOptimizationStats optimizeMesh(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices);
\ No newline at end of file
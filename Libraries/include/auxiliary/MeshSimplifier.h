@@ -0,0 +1,37 @@
+#pragma once
+
+#include "Mesh.h"
+
+#include <cstddef>
+#include <vector>
+
+
+namespace lod {
+    // Levels per mesh, the full-detail one included
+    constexpr size_t MAX_LEVELS = 5;
+
+    // Triangle count of each level relative to the previous one
+    constexpr float REDUCTION = 0.5f;
+
+    // Meshes and levels below this many triangles aren't simplified further
+    constexpr size_t MIN_TRIANGLES = 64;
+
+    // Weight of the planes that keep borders and seams in place, relative to the surface
+    constexpr float BORDER_WEIGHT = 10.0f;
+
+    // Coarsest level whose error projects to at most this many pixels is drawn
+    extern float PIXEL_ERROR;
+}
+
+
+// Quadric error edge collapse (Garland & Heckbert) of a triangle list down to at most targetIndexCount indices.
+// Vertices only collapse onto existing neighbours, so the result indexes the same vertex array and keeps its attributes.
+// Mesh borders and UV/normal seams (vertices split at one position) only collapse along themselves, both sides of a seam together;
+// vertices where that isn't well defined stay locked. Stops early when nothing can collapse without flipping a triangle.
+// Returns the error of the result as an object space distance.
+float simplifyMesh(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices, size_t targetIndexCount,
+                   std::vector<unsigned int> &result);
+
+// Appends coarser levels of the mesh to 'indices' and describes all of them, the full-detail one first, in 'lods'.
+// 'lods' is left empty if the mesh is too small or can't be simplified.
+void generateLods(const std::vector<Vertex> &vertices, std::vector<unsigned int> &indices, std::vector<MeshLod> &lods);
\ No newline at end of file
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+
+#include <cstddef>
+#include <vector>
+
+
+namespace mlt {
+    // Cluster size limits, the usual ones for mesh shader hardware
+    constexpr size_t MAX_VERTICES = 64;
+    constexpr size_t MAX_TRIANGLES = 124;
+
+    // Normal cones wider than this (cosine of the half angle to the axis) can never be entirely back-facing
+    constexpr float MIN_CONE_COSINE = 0.1f;
+
+    // Cull meshlets against the view frustum and by their normal cones before drawing
+    extern bool CULLING;
+}
+
+
+// The view of one draw in a model's object space, so that meshlet bounds can be tested without transforming them.
+// Plane and back-facing tests are invariant under the model transform, non-uniform scale included.
+struct MeshletCullView {
+    glm::vec4 planes[6];            // frustum planes, normals pointing inwards and normalized
+    glm::vec3 cameraPosition;       // for perspective projections
+    glm::vec3 viewDirection;        // for orthographic ones
+    bool orthographic = false;
+    bool coneCulling = true;        // off for mirroring transforms, which turn front faces around
+
+    static MeshletCullView make(const glm::mat4 &modelMatrix, const glm::mat4 &view, const glm::mat4 &projection);
+};
+
+
+// Splits indices [indexOffset, indexOffset + indexCount) into meshlets and reorders the range so that each one is contiguous.
+// Meshlets grow greedily over neighbouring triangles, preferring those that add the fewest vertices and lie closest,
+// which keeps them compact enough for tight normal cones.
+void buildMeshlets(const std::vector<Vertex> &vertices, std::vector<unsigned int> &indices, size_t indexOffset, size_t indexCount,
+                   std::vector<Meshlet> &meshlets);
+
+bool isMeshletVisible(const Meshlet &meshlet, const MeshletCullView &view);
\ No newline at end of file
@@ -1,6 +1,6 @@
 #pragma once
 
-#include <glad/glad.h> 
+#include <glad/glad.h>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -11,37 +11,255 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include "GltfLoader.h"
+#include "ObjLoader.h"
+#include "ImageDecoder.h"
+#include "MappedIO.h"
 #include "Mesh.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "Meshlets.h"
 #include "ShaderProgram.h"
+#include "TextureArrayManager.h"
+#include "TextureCache.h"
+#include "TextureStreamer.h"
+#include "TextureUploader.h"
+#include "VirtualTexture.h"
 
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 
+namespace mdl {
+    constexpr unsigned int DEFAULT_FLAGS = aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+
+    // If set, model textures are streamed through it over the next frames instead of being uploaded synchronously
+    extern TextureUploader *TEXTURE_UPLOADER;
+
+    // If set, model textures keep only the mip levels resident that their size on screen needs, see TextureStreamer.
+    // Takes precedence over TEXTURE_UPLOADER.
+    extern TextureStreamer *TEXTURE_STREAMER;
+
+    // If set, images of at least vt::MIN_SIZE texels become virtual textures, loaded tile by tile as they're seen.
+    // Takes precedence over the others for those images.
+    extern VirtualTextureSystem *VIRTUAL_TEXTURES;
+
+    // What new models keep of their geometry in RAM after it's uploaded
+    extern MeshRetention RETENTION;
+
+    // GPU vertex layout of new models. COMPACT needs shaders that decode it, see CompactVertex.
+    extern VertexFormat VERTEX_FORMAT;
+
+    // Weld, reorder for the vertex cache and overdraw, and remap for fetch (see optimizeMesh) while importing
+    extern bool OPTIMIZE_MESHES;
+
+    // Merge triangle meshes with the same textures into one mesh per material while importing. Like the unbatched
+    // meshes, they keep the space their vertices were authored in: node transforms aren't applied by either path.
+    extern bool BATCH_MESHES;
+
+    // Build a chain of simplified levels per mesh while importing, see generateLods. Model::selectLod picks one per draw.
+    extern bool GENERATE_LODS;
+
+    // Split every level into meshlets while importing, for Model::cullMeshlets
+    extern bool BUILD_MESHLETS;
+
+    // Read .gltf scenes with the built-in loader (see GltfAsset) instead of Assimp. Files it doesn't handle still go through Assimp.
+    extern bool NATIVE_GLTF;
+
+    // Read .obj files with the built-in parallel parser (see loadObj) instead of Assimp, unless tangents are needed
+    extern bool NATIVE_OBJ;
+}
+
+
+// Mesh data before it's uploaded to the GPU. Either owns its geometry or points into a mapped mesh cache.
+struct MeshData {
+    std::vector<Vertex>       vertices;
+    std::vector<unsigned int> indices;
+
+    // Set only when the geometry lives in ModelData::cacheFile
+    const Vertex       *vertexData = nullptr;
+    size_t              vertexCount = 0;
+    const unsigned int *indexData = nullptr;
+    size_t              indexCount = 0;
+
+    // Indices into ModelData::textures
+    std::vector<size_t> textureIndices;
+
+    // Only pure triangle lists can be reordered and batched
+    bool trianglesOnly = true;
+    // Number of source meshes (node mesh references) merged into this one
+    size_t sourceMeshCount = 1;
+
+    // Levels of detail over the indices above, empty for single-level meshes
+    std::vector<MeshLod> lods;
+    std::vector<Meshlet> meshlets;
+
+    inline const Vertex*       getVertices()    const { return vertexData ? vertexData : vertices.data(); }
+    inline size_t              getVertexCount() const { return vertexData ? vertexCount : vertices.size(); }
+    inline const unsigned int* getIndices()     const { return indexData ? indexData : indices.data(); }
+    inline size_t              getIndexCount()  const { return indexData ? indexCount : indices.size(); }
+};
+
+// Everything Model needs from disk, produced without touching OpenGL, so it can be built on any thread
+struct ModelData {
+    std::string path;
+    std::string directory;
+    // Assimp flags actually used, after dropping steps for attributes nobody reads
+    unsigned int flags = 0;
+    // Vertex attributes (va:: bits) that are imported and uploaded
+    unsigned int attributes = va::ALL;
+    bool valid = false;
+
+    std::vector<MeshData>     meshes;
+    std::vector<TextureRef>   textures;
+
+    // Parallel to textures. Images already resident in the texture cache are left undecoded.
+    std::vector<std::string>  textureKeys;
+    std::vector<uint64_t>     textureHashes;
+    std::vector<DecodedImage> images;
+    // Images left undecoded because they become virtual textures
+    std::vector<bool>         virtualImages;
+
+    std::unordered_map<std::string, size_t> textureIndexByPath;
+
+    // Summed over all meshes if they were optimized during this import (not when served from the mesh cache)
+    MeshOptimizationStats optimizationStats;
+
+    // Keeps mesh data alive if it was served from the mesh cache. Shared with the meshes built from it.
+    std::shared_ptr<const MappedFile> cacheFile;
+    bool fromCache = false;
+
+    double importTimeMs = 0.0;
+    // Part of the import spent reading the scene into meshes, and whether a native loader (glTF, OBJ) did it rather than Assimp
+    double sceneTimeMs = 0.0;
+    bool nativeLoader = false;
+    // Files Assimp read through MappedIOSystem, empty for the native loaders and the mesh cache
+    std::vector<FileReadStats> fileReads;
+};
+
+
 class Model {
 public:
     // if there're slashes in path, they should be '\\', NOT '/'!
-    explicit inline Model(const std::string &path, unsigned int flags = aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace) {
-        loadModel(path, flags);
-    }
+    // 'attributes' are the vertex attributes the model will be drawn with, e.g. ShaderProgram::getActiveAttributeMask()
+    explicit inline Model(const std::string &path, unsigned int flags = mdl::DEFAULT_FLAGS, unsigned int attributes = va::ALL)
+        : Model(importData(path, flags, attributes))
+    {}
+
+    // Creates GPU buffers and textures from already imported data. Must run on the thread owning the GL context.
+    // Geometry is moved out of the data (or keeps referencing the mapped mesh cache), never copied.
+    explicit Model(ModelData &&data);
+
+    // Releases the model's textures and buffers, so it must be destroyed while the GL context exists
+    ~Model();
+
+    // A model owns its GL objects, so it can only be moved
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
+    Model(Model &&other) noexcept;
+    Model& operator=(Model &&other) noexcept;
+
+    // CPU part of loading: mesh cache lookup or Assimp import, and texture decoding. Doesn't touch OpenGL.
+    // Post-processing steps that only produce attributes outside 'attributes' are skipped.
+    static ModelData importData(const std::string &path, unsigned int flags = mdl::DEFAULT_FLAGS, unsigned int attributes = va::ALL);
+
+    // Assimp flags and components to remove (AI_CONFIG_PP_RVC_FLAGS) for importing just the given attributes
+    static unsigned int importFlags(unsigned int flags, unsigned int attributes, int &removedComponents);
 
     void Draw(const ShaderProgram &shaderProgram);
 
-    inline std::string getDirectory() const { return this->directory; }
+    // Draws the model once per instance with one instanced draw call per mesh. The transforms go into an instance buffer
+    // that the shader reads at va::INSTANCE_MODEL_LOCATION and va::INSTANCE_NORMAL_LOCATION instead of model/NormalMatrix uniforms.
+    void DrawInstanced(const ShaderProgram &shaderProgram, ArrayView<InstanceData> instances);
+
+    // Selects every mesh's level of detail for the next draws from how large its bounding sphere is on screen.
+    // Works with perspective and orthographic projections; lod::PIXEL_ERROR is the error allowed on screen.
+    void selectLod(const glm::mat4 &modelMatrix, const glm::vec3 &cameraPosition, const glm::mat4 &projection, float viewportHeight);
+    // Same for all instances of an instanced draw: every mesh gets the finest level any of the instances needs
+    void selectLod(ArrayView<InstanceData> instances, const glm::vec3 &cameraPosition, const glm::mat4 &projection, float viewportHeight);
+
+    // Asks mdl::TEXTURE_STREAMER for the texture detail the model's bounding sphere needs on screen, if there is a streamer
+    void requestTextureDetail(const glm::mat4 &modelMatrix, const glm::vec3 &cameraPosition, const glm::mat4 &projection, float viewportHeight);
+    // Same for all instances of an instanced draw
+    void requestTextureDetail(ArrayView<InstanceData> instances, const glm::vec3 &cameraPosition, const glm::mat4 &projection, float viewportHeight);
+
+    // Culls the meshlets of the selected levels against the frustum and by their normal cones, so that the next draws
+    // submit only the clusters that can be visible. Call after selectLod. Does nothing unless mlt::CULLING is set.
+    void cullMeshlets(const glm::mat4 &modelMatrix, const glm::mat4 &view, const glm::mat4 &projection);
+
+    // Frees CPU geometry the policy doesn't keep, see MeshRetention. New models apply mdl::RETENTION on their own.
+    void applyRetention(MeshRetention retention);
+
+    inline const std::string&       getDirectory() const { return this->directory; }
+    inline const std::vector<Mesh>& getMeshes()    const { return this->meshes; }
+
+    // Load statistics
+    inline bool   isLoadedFromCache() const { return this->loadedFromCache; }
+    inline double getLoadTimeMs()     const { return this->loadTimeMs; }
+    inline double getImportTimeMs()   const { return this->importTimeMs; }
+    inline const std::vector<FileReadStats>& getFileReads() const { return this->fileReads; }
+
+    // Memory accounting. Buffers and textures shared with other models are counted by each of them.
+    size_t getCpuBytes() const;
+    size_t getGeometryGpuBytes() const;
+    size_t getTextureGpuBytes() const;
+    inline size_t getGpuBytes() const { return getGeometryGpuBytes() + getTextureGpuBytes(); }
+
+    // Number of meshes drawn with 16-bit indices
+    size_t getShortIndexMeshCount() const;
+
+    // Draw calls per Draw(), and how many it would take without batching
+    inline size_t getDrawCount()       const { return this->meshes.size(); }
+    inline size_t getSourceMeshCount() const { return this->sourceMeshCount; }
+
+    // Triangles per Draw() at the selected levels of detail after meshlet culling, and at full detail
+    size_t getDrawnTriangleCount() const;
+    size_t getTriangleCount() const;
 
 protected:
     // Model data
     std::vector<Mesh> meshes;
     std::string directory;
+    // References held in the shared texture cache
     std::vector<Texture> texturesLoaded;
+    size_t sourceMeshCount = 0;
+
+    // Per-instance attributes of DrawInstanced, created on its first call and refilled by every call
+    unsigned int instanceBuffer = 0;
+    size_t instanceBufferCapacity = 0;
 
-    void loadModel(const std::string &path, unsigned int flags);
-    void processNode(aiNode *node, const aiScene *scene);
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene);
-    std::vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, const std::string &typeName);
+    // Load statistics
+    bool loadedFromCache = false;
+    double importTimeMs = 0.0;
+    double loadTimeMs = 0.0;
+    std::vector<FileReadStats> fileReads;
+
+    void releaseTextures();
+
+    static bool loadFromCache(ModelData &data, const std::string &cachePath, const MeshCacheKey &key);
+    // Hash of the model file and of the files its meshes are read from with it (glTF buffers, OBJ material libraries), 0 if it can't be read
+    static uint64_t hashSourceFiles(const std::string &path);
+    static void processNode(ModelData &data, aiNode *node, const aiScene *scene);
+    static MeshData processMesh(ModelData &data, aiMesh *mesh, const aiScene *scene);
+    // The same for a glTF scene read without Assimp. Fails on anything Assimp would have to post-process, leaving 'data' without meshes.
+    static bool importGltf(ModelData &data, std::string &error);
+    static bool processGltfNode(ModelData &data, const GltfAsset &asset, size_t nodeIndex, int depth, std::string &error);
+    static bool processGltfPrimitive(ModelData &data, const GltfAsset &asset, const JsonValue &primitive, std::string &error);
+    // The same for an OBJ file
+    static bool importObj(ModelData &data, std::string &error);
+    // Merges triangle meshes with identical texture sets, keeping the order of first use
+    static void batchMeshes(std::vector<MeshData> &meshes);
+    static void loadMaterialTextures(ModelData &data, MeshData &meshData, aiMaterial *mat, aiTextureType type, const std::string &typeName);
+    static size_t addTextureRef(ModelData &data, const std::string &relPath, const std::string &typeName);
 };
 
 
+// Uploads a decoded image as a mipmapped 2D texture and returns its id; baked images bring their own mip levels
+unsigned int uploadTexture(const DecodedImage &image);
+
 unsigned int TextureFromFile(const std::string &path);
 
 unsigned int inline TextureFromFile(const std::string& relPath, const std::string& directory) {
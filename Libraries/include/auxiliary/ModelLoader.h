@@ -0,0 +1,57 @@
+#pragma once
+
+#include "Model.h"
+#include "ThreadPool.h"
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+// Runs the CPU part of model loading (import, conversion, texture decoding) on a thread pool.
+// Finished imports wait in a completion queue until the thread owning the GL context turns them into Models.
+class ModelLoader {
+public:
+    // Receives the ticket returned by enqueue() and the finished model
+    using LoadedCallback = std::function<void(size_t, Model&&)>;
+
+private:
+    ThreadPool &pool;
+
+    std::mutex completedMutex;
+    std::condition_variable completedCondition;
+    std::queue<std::pair<size_t, ModelData>> completed;
+    // Results workers have put in the queue, guarded by completedMutex
+    size_t pushedCount = 0;
+
+    size_t enqueuedCount = 0;
+    size_t finishedCount = 0;
+
+    void finish(std::pair<size_t, ModelData> &&entry, const LoadedCallback &onLoaded);
+
+public:
+    explicit ModelLoader(ThreadPool &pool = ThreadPool::shared());
+
+    // Jobs refer to the loader, so this blocks until every enqueued import has finished. Results nobody polled are dropped.
+    ~ModelLoader();
+
+    // Starts importing the model on a worker thread and returns its ticket
+    size_t enqueue(const std::string &path, unsigned int flags = mdl::DEFAULT_FLAGS, unsigned int attributes = va::ALL);
+
+    // Creates GPU objects for every import that has already completed, without waiting for the rest.
+    // Must be called on the GL context thread. Returns the number of finished models.
+    size_t pollCompleted(const LoadedCallback &onLoaded);
+
+    // Same as pollCompleted(), but blocks until everything enqueued so far is finished
+    void waitAll(const LoadedCallback &onLoaded);
+
+    inline size_t getPendingCount() const { return this->enqueuedCount - this->finishedCount; }
+
+    // Loads all models in parallel and returns them in the order of paths
+    std::vector<Model> loadAll(const std::vector<std::string> &paths, unsigned int flags = mdl::DEFAULT_FLAGS,
+                               unsigned int attributes = va::ALL);
+};
\ No newline at end of file
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "Mesh.h"
+#include "ThreadPool.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+
+namespace obj {
+    // Files are split into chunks of about this size, cut at line ends, and the chunks are parsed concurrently
+    constexpr size_t CHUNK_BYTES = 1 << 20;
+}
+
+
+// Texture maps of one MTL material. Paths are as written in the file, relative to it.
+struct ObjMaterial {
+    std::string name;
+    std::string diffuseMap;     // map_Kd
+    std::string specularMap;    // map_Ks
+    std::string ambientMap;     // map_Ka
+    std::string emissiveMap;    // map_Ke
+    std::string bumpMap;        // map_bump, bump
+};
+
+// Faces of one object or group that share a material, triangulated as fans, with one vertex per distinct v/vt/vn corner
+struct ObjMesh {
+    std::vector<Vertex>       vertices;
+    std::vector<unsigned int> indices;
+    // Into ObjScene::materials, or -1 for faces without a usemtl
+    int material = -1;
+};
+
+struct ObjScene {
+    std::vector<ObjMesh>     meshes;
+    std::vector<ObjMaterial> materials;
+
+    // Streams the file actually has, as va:: bits
+    unsigned int attributes = 0;
+};
+
+
+// Reads an OBJ file and the MTL libraries it references through the VFS. The file's chunks are parsed on the pool;
+// the calling thread takes part, so this is safe to call from a job running on the same pool.
+// Only the streams in 'attributes' (va::POSITION, NORMAL and TEXCOORDS) are kept, and only they tell corners apart.
+// Texture coordinates get V flipped if 'flipUVs' is set. Lines, points, curves and surfaces aren't supported:
+// on those, and on malformed input, returns false with the reason in 'error'.
+bool loadObj(const std::string &path, unsigned int attributes, bool flipUVs, ObjScene &scene, std::string &error,
+             ThreadPool &pool = ThreadPool::shared());
+
+// Files of the MTL libraries an OBJ file references, in the same form as 'path'. Scans the file without parsing its geometry.
+std::vector<std::string> getObjLibraryPaths(const std::string &path);
+
+inline bool isObjPath(const std::string &path) {
+    return path.size() >= 4 && (path.compare(path.size() - 4, 4, ".obj") == 0 || path.compare(path.size() - 4, 4, ".OBJ") == 0);
+}
\ No newline at end of file
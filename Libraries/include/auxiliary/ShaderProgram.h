@@ -3,9 +3,11 @@
 #include <glad/glad.h> // Include glad to activate the required OpenGL headers
 #include <glm/glm.hpp>
 
+#include "AssetPack.h"
+
+#include <memory>
 #include <string>
-#include <fstream>
-#include <sstream>
+#include <vector>
 #include <iostream>
 
 
@@ -18,14 +20,18 @@ class ShaderProgram {
 public:
 	unsigned int programID;
 
-	// Constructor reads and builds the shader
-	ShaderProgram(const char* vertexPath, const char* fragmentPath);
+	// Constructor reads and builds the shader; each of 'defines' is #defined in both stages right after their #version line,
+	// so that one source can hold several variants
+	ShaderProgram(const char* vertexPath, const char* fragmentPath, const std::vector<std::string> &defines = {});
 
 	// Use/activate the shader
 	inline void use() const {
 		glUseProgram(programID);
 	}
 
+	// Bit i is set if the program reads the vertex attribute at location i
+	unsigned int getActiveAttributeMask() const;
+
 	// Utility uniform functions
 	inline void setBool(const std::string &name, bool value) const {
 		glUniform1i(glGetUniformLocation(programID, name.c_str()), (int)value);
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "ImageDecoder.h"
+#include "TextureContainer.h"
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace ta {
+    // Pack diffuse, specular and emissive textures of models into texture arrays instead of a 2D texture each
+    extern bool ENABLED;
+
+    // Material slots with arrays, in the order of their texture units
+    enum MaterialSlot {
+        DIFFUSE,
+        SPECULAR,
+        EMISSIVE,
+        SLOT_COUNT
+    };
+
+    // Texture unit of the first slot's array. Above the units Mesh binds its own textures to, so both can be bound at once.
+    constexpr int FIRST_UNIT = 8;
+
+    // Layers of a new array; full arrays double, up to GL_MAX_ARRAY_TEXTURE_LAYERS, before another one is started
+    constexpr int INITIAL_LAYERS = 4;
+}
+
+// Slot of a material texture type ("texture_diffuse", ...), -1 for types that aren't packed into arrays
+int materialSlotFromType(const std::string &type);
+
+
+// A texture packed into an array: the array's handle (not a GL texture, see TextureArrayManager) and its layer there
+struct TextureLayer {
+    unsigned int array = 0;
+    int layer = -1;
+};
+
+
+// Packs material textures of the same slot, size, level count and format as layers of one GL_TEXTURE_2D_ARRAY, so that meshes
+// sharing an array are drawn without binding anything in between. Layers are reference counted like TextureCache entries and
+// shared between models by path (or content hash). Arrays are referred to by stable handles, as growing an array replaces its texture.
+// Lookups (contains) are safe from any thread; everything else must run on the thread owning the GL context.
+class TextureArrayManager {
+private:
+    struct TextureArray {
+        unsigned int texture = 0;
+        int slot = 0;
+        int width = 0;
+        int height = 0;
+        GLenum internalFormat = 0;
+        // Client format levels are read and written in, 0 if they're block-compressed
+        GLenum pixelFormat = 0;
+        // Bytes of every level of one layer
+        std::vector<size_t> levelSizes;
+
+        int capacity = 0;
+        // Layers handed out so far; freed ones below that are reused first
+        int layerCount = 0;
+        std::vector<int> freeLayers;
+
+        size_t getLayerBytes() const;
+    };
+
+    struct LayerEntry {
+        size_t refCount = 0;
+        std::vector<std::string> keys;
+    };
+
+    mutable std::mutex mutex;
+    std::unordered_map<unsigned int, TextureArray> arrays;
+    unsigned int nextHandle = 1;
+    // Keys are prefixed by the slot; layers by (array handle << 32) | layer
+    std::unordered_map<std::string, uint64_t> layerByKey;
+    std::unordered_map<uint64_t, LayerEntry> layers;
+
+    // Array bound to each slot's unit, so that rebinding it is skipped
+    unsigned int boundArrays[ta::SLOT_COUNT] = {};
+
+    // Statistics
+    size_t uploadCount = 0;
+    size_t uploadedBytes = 0;
+    size_t grownCount = 0;
+    size_t bindCount = 0;
+    size_t skippedBindCount = 0;
+
+    static std::string makeKey(int slot, const std::string &key);
+    static std::string makeHashKey(int slot, uint64_t contentHash);
+    // Caller must hold the mutex. Returns false if nothing matches.
+    bool findLocked(int slot, const std::string &key, uint64_t contentHash, uint64_t &found) const;
+
+    // Handle of an array for the texture with a free layer, grown or created if needed
+    unsigned int findArray(int slot, const BakedTexture &texture);
+    // Defines the array's levels for 'capacity' layers on a new texture
+    void allocate(TextureArray &array, unsigned int texture, int capacity);
+    // Moves the array to a texture with more layers, copying the layers it has on the GPU
+    void grow(TextureArray &array, int capacity);
+
+public:
+    TextureArrayManager() = default;
+
+    TextureArrayManager(const TextureArrayManager&) = delete;
+    TextureArrayManager& operator=(const TextureArrayManager&) = delete;
+
+    // True if a layer for this path (or content hash, if non-zero) in this slot is already resident
+    bool contains(int slot, const std::string &key, uint64_t contentHash = 0) const;
+
+    // Returns the resident layer for the key and adds a reference, or uploads the image into a new one, decoding it if it isn't yet.
+    // Returns an empty layer if the image can't be loaded.
+    TextureLayer acquire(int slot, const std::string &key, uint64_t contentHash, DecodedImage &image);
+
+    // Drops one reference and frees the layer when none are left; arrays without layers are deleted
+    void release(const TextureLayer &layer);
+
+    // Binds the array to its slot's texture unit unless it's bound already. Leaves the active unit changed.
+    void bind(int slot, unsigned int array);
+
+    // GPU memory of one layer of the array, with its levels
+    size_t getLayerBytes(unsigned int array) const;
+
+    // Statistics
+    size_t getArrayCount() const;
+    size_t getResidentBytes() const;
+    inline size_t getBindCount()        const { return this->bindCount; }
+    inline size_t getSkippedBindCount() const { return this->skippedBindCount; }
+
+    void logStats() const;
+
+    static TextureArrayManager& shared();
+};
\ No newline at end of file
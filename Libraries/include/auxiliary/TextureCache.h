@@ -0,0 +1,76 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace tc {
+    // Also identify textures by a hash of the image file, so that copies of one image under different paths share a texture
+    extern bool HASH_CONTENTS;
+}
+
+
+// Process-wide registry of loaded textures with reference counting.
+// Lookups (contains) are safe from any thread; acquire and release create and delete GL objects,
+// so they must be called on the thread owning the GL context.
+class TextureCache {
+private:
+    struct Entry {
+        size_t refCount = 0;
+        size_t byteSize = 0;
+        uint64_t contentHash = 0;
+        GLenum target = GL_TEXTURE_2D;
+        std::vector<std::string> keys;
+    };
+
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, unsigned int> idByKey;
+    std::unordered_map<uint64_t, unsigned int> idByHash;
+    std::unordered_map<unsigned int, Entry> entries;
+
+    // Statistics
+    size_t uploadCount = 0;
+    size_t uploadedBytes = 0;
+    size_t savedUploadCount = 0;
+    size_t savedBytes = 0;
+
+    // Caller must hold the mutex. Returns 0 if nothing matches.
+    unsigned int findLocked(const std::string &key, uint64_t contentHash) const;
+
+public:
+    // Absolute, lexically normalized path; case-insensitive on Windows
+    static std::string normalizePath(const std::string &path);
+
+    // True if a texture for this path (or content hash, if non-zero) is already resident
+    bool contains(const std::string &path, uint64_t contentHash = 0) const;
+
+    // Returns the resident texture for the key and adds a reference, or calls upload() to create it.
+    // 'key' is either a normalized file path or any other unique name (e.g. of a cubemap).
+    // upload() returns the new texture id and reports how many bytes it uploaded.
+    unsigned int acquire(const std::string &key, uint64_t contentHash,
+                         const std::function<unsigned int(size_t &byteSize)> &upload, GLenum target = GL_TEXTURE_2D);
+
+    // Drops one reference and deletes the texture when none are left. Returns true if it was deleted.
+    bool release(unsigned int textureID);
+
+    // Bytes uploaded for a resident texture, 0 if it's unknown
+    size_t getByteSize(unsigned int textureID) const;
+
+    // Statistics
+    size_t getResidentCount() const;
+    size_t getResidentBytes() const;
+    inline size_t getUploadCount()      const { return this->uploadCount; }
+    inline size_t getUploadedBytes()    const { return this->uploadedBytes; }
+    inline size_t getSavedUploadCount() const { return this->savedUploadCount; }
+    inline size_t getSavedBytes()       const { return this->savedBytes; }
+
+    void logStats() const;
+
+    static TextureCache& shared();
+};
\ No newline at end of file
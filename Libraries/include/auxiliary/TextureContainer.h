@@ -0,0 +1,125 @@
+#pragma once
+
+#include "AssetPack.h"
+#include "ThreadPool.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+// Textures baked offline into KTX 1.1 containers: every mip level stored in the format the GPU samples,
+// so loading one is a read and an upload instead of a decode, an upload and glGenerateMipmap.
+// A baked texture sits next to its source image as "<image>.ktx" and is picked up through the VFS.
+namespace ktx {
+    constexpr const char *EXTENSION = ".ktx";
+
+    // Load "<image>.ktx" instead of decoding the image, when there is one
+    extern bool ENABLED;
+    // Bake to BC1 (opaque) or BC3 (with alpha); off bakes uncompressed levels, which any GL implementation samples.
+    // One- and two-channel images are always baked uncompressed, BC1 would turn them into greyscale RGB.
+    extern bool COMPRESS;
+}
+
+
+enum class BakedFormat {
+    BC1,
+    BC3,
+    UNCOMPRESSED
+};
+
+
+// A parsed container, or the mip chain built from a decoded image. Levels point into the file or storage, which it keeps alive.
+class BakedTexture {
+public:
+    struct Level {
+        int width;
+        int height;
+        const unsigned char *data;
+        size_t size;
+    };
+
+private:
+    std::shared_ptr<const VfsFile> file;
+    std::vector<unsigned char> storage;
+    BakedFormat format = BakedFormat::UNCOMPRESSED;
+    uint32_t internalFormat = 0;
+    uint32_t pixelFormat = 0;
+    int components = 0;
+    std::vector<Level> levels;
+
+public:
+    // Checks the header and that every level holds exactly the bytes its size and format call for.
+    // Returns null with the reason in 'error' for anything the loader can't upload as it is.
+    static std::shared_ptr<const BakedTexture> parse(std::shared_ptr<const VfsFile> file, std::string &error);
+
+    // Uncompressed levels down to 1x1, filtered like the bake does, for images that weren't baked
+    static std::shared_ptr<const BakedTexture> fromImage(const unsigned char *pixels, int width, int height, int components);
+
+    inline BakedFormat               getFormat()         const { return this->format; }
+    inline uint32_t                  getInternalFormat() const { return this->internalFormat; }
+    // Client format of uncompressed levels (GL_RED to GL_RGBA), 0 for block-compressed ones
+    inline uint32_t                  getPixelFormat()    const { return this->pixelFormat; }
+    inline int                       getComponents()     const { return this->components; }
+    inline const std::vector<Level>& getLevels()         const { return this->levels; }
+    inline int                       getWidth()          const { return this->levels.front().width; }
+    inline int                       getHeight()         const { return this->levels.front().height; }
+
+    // GPU memory of all levels
+    size_t getByteSize() const;
+    const char* getFormatName() const;
+};
+
+
+// The container baked from 'imagePath', or null if there is none, it is older than the image, or it can't be parsed
+std::shared_ptr<const BakedTexture> loadBakedTexture(const std::string &imagePath);
+
+// Uploads levels firstLevel to lastLevel, clamped to the chain, to 'target' of the bound texture object: GL_TEXTURE_2D or a cube map face.
+// Block-compressed levels are decoded to RGBA8 first if the driver lacks S3TC. Call on the GL context thread.
+void uploadBakedLevels(const BakedTexture &texture, unsigned int target, size_t firstLevel = 0, size_t lastLevel = SIZE_MAX);
+
+// Internal format uploadBakedLevels gives the texture: its own, or RGB8/RGBA8 for block-compressed levels the driver can't sample
+uint32_t getUploadFormat(const BakedTexture &texture);
+
+// Uploads every level into layer 'layer' of the bound GL_TEXTURE_2D_ARRAY, which must have been allocated with getUploadFormat,
+// the texture's size and at least its level count. Call on the GL context thread.
+void uploadBakedLayer(const BakedTexture &texture, int layer);
+
+// Whether the driver samples S3TC (BC1-BC3) textures; queried once, on the GL context thread
+bool isS3tcSupported();
+
+
+// Box-filters an image to half its size in each dimension, rounded down and at least 1, like glGenerateMipmap does
+std::vector<unsigned char> downsampleImage(const unsigned char *pixels, int width, int height, int components, int &outWidth, int &outHeight);
+
+// Block compression of one 4x4 block of RGBA pixels, row by row. BC1 blocks are 8 bytes, BC3 blocks 16.
+void encodeBc1Block(const unsigned char *rgba, unsigned char *block);
+void encodeBc3Block(const unsigned char *rgba, unsigned char *block);
+void decodeBc1Block(const unsigned char *block, unsigned char *rgba);
+void decodeBc3Block(const unsigned char *block, unsigned char *rgba);
+
+
+// Numbers of one baked image: what the runtime path would have cost and what the container costs instead
+struct BakeStats {
+    std::string path;
+    int width = 0;
+    int height = 0;
+    int levelCount = 0;
+    const char *formatName = "";
+    size_t sourceBytes = 0;
+    size_t rawGpuBytes = 0;     // the decoded image plus the mip chain glGenerateMipmap would have allocated
+    size_t bakedBytes = 0;
+    double decodeTimeMs = 0.0;
+    double loadTimeMs = 0.0;    // reading and parsing the written container
+    double bakeTimeMs = 0.0;
+    bool failed = false;
+};
+
+// Bakes the image at 'imagePath' into "<imagePath>.ktx". On failure the stats say so and 'error' holds the reason.
+BakeStats bakeTexture(const std::string &imagePath, std::string &error);
+
+// Bakes every image under 'directory' but the 'excluded' directories, one image per job on the pool, and prints the numbers of each.
+// Don't call this from one of the pool's jobs. Returns the number of images baked.
+size_t bakeTextures(const std::string &directory, const std::vector<std::string> &excluded, ThreadPool &pool = ThreadPool::shared());
\ No newline at end of file
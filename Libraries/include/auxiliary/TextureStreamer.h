@@ -0,0 +1,139 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "ImageDecoder.h"
+#include "TextureContainer.h"
+#include "TextureUploader.h"
+#include "ThreadPool.h"
+
+#include <future>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace ts {
+    constexpr size_t DEFAULT_BUDGET = 256 * 1024 * 1024;
+
+    // Levels no larger than this are loaded with every texture and never evicted, so there's always something to sample
+    constexpr int MIN_RESIDENT_SIZE = 64;
+
+    // Texels of a texture needed per pixel of its body's projected diameter. A sphere shows half of a wrapped-around map.
+    constexpr float TEXELS_PER_PIXEL = 2.0f;
+
+    // First loads running on the pool at once; each holds a decoded image with its mip chain
+    constexpr size_t MAX_LOADS_IN_FLIGHT = 4;
+}
+
+
+// Keeps only the mip levels of model textures resident that their bodies' size on screen calls for.
+// Bodies request texture detail every frame (see Model::requestTextureDetail). The first update() after creation loads the
+// texture's mip chain in the background, from the baked container or by decoding the image, and the chain is kept from then on.
+// Missing levels are uploaded from it coarsest first, under a per-frame byte budget like TextureUploader's, and made visible
+// through GL_TEXTURE_BASE_LEVEL.
+// The levels of all textures share one VRAM budget. To make room, the finest levels of the least recently requested
+// textures are evicted first. Levels still needed by the last frame are only evicted when the budget is lowered below what
+// is in use, and a load that doesn't fit gets coarser ones.
+class TextureStreamer {
+private:
+    struct StreamedTexture {
+        std::string path;
+        // Held from creation until the first load takes it, so an image decoded at import isn't decoded twice
+        DecodedImage image;
+        // Every level, kept once the first load completes, so that later detail increases only upload
+        std::shared_ptr<const BakedTexture> chain;
+
+        // Unknown until the first load completes
+        std::vector<size_t> levelSizes;
+        int width = 0;
+        int height = 0;
+        int tailLevel = 0;
+
+        // Finest level uploaded and set as GL_TEXTURE_BASE_LEVEL; the level count while nothing is resident
+        int residentLevel = 0;
+        size_t residentBytes = 0;
+
+        // Largest detail requested during the last frame, in texels across, and the frame it was requested in
+        float wantedTexels = 0.0f;
+        uint64_t lastUse = 0;
+
+        std::future<std::shared_ptr<const BakedTexture>> load;
+        bool loading = false;
+        bool failed = false;
+
+        inline int getLevelCount() const { return static_cast<int>(this->levelSizes.size()); }
+    };
+
+    std::unordered_map<unsigned int, StreamedTexture> textures;
+    size_t budget;
+    size_t frameBudget;
+    ThreadPool &pool;
+
+    uint64_t frame = 1;
+    size_t residentBytes = 0;
+    size_t loadsInFlight = 0;
+
+    // Statistics
+    size_t loadCount = 0;
+    size_t uploadedBytes = 0;
+    size_t evictedLevelCount = 0;
+
+    // Finest level the texture needs for what was requested of it last frame; its tail if nothing was
+    int getWantedLevel(const StreamedTexture &texture) const;
+    // Finest level the texture can be given without dropping below its tail: what the others hold beyond their needs is reclaimable
+    int getAffordableLevel(const StreamedTexture &texture, int wantedLevel) const;
+    size_t getLevelBytes(const StreamedTexture &texture, int firstLevel, int endLevel) const;
+
+    // Evicts least recently requested levels until 'bytes' more fit into the budget or nothing else may go. Never touches 'except'.
+    // Levels the last frame needed only go with 'evictWanted', tails never do.
+    void makeRoom(size_t bytes, const StreamedTexture *except, bool evictWanted);
+    void evictLevel(unsigned int textureID, StreamedTexture &texture);
+
+    void startLoad(StreamedTexture &texture);
+    void finishLoad(unsigned int textureID, StreamedTexture &texture);
+    // Uploads the missing levels the texture can have now, coarsest first, until 'frameBytes' reaches the frame budget
+    void uploadLevels(unsigned int textureID, StreamedTexture &texture, size_t &frameBytes);
+
+public:
+    explicit TextureStreamer(size_t budget = ts::DEFAULT_BUDGET, ThreadPool &pool = ThreadPool::shared(),
+                             size_t frameBudget = tu::DEFAULT_FRAME_BUDGET);
+
+    TextureStreamer(const TextureStreamer&) = delete;
+    TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+    // Creates an empty texture that is filled by the next updates. The image may be decoded already, or just carry its path.
+    unsigned int create(DecodedImage &&image);
+
+    // Asks for enough detail to cover 'pixels' of projected diameter. Takes the most detailed request per frame; unknown ids are ignored.
+    void request(unsigned int textureID, float pixels);
+
+    // Call once per frame on the GL context thread, after the last frame's requests: uploads missing levels, starts new loads
+    void update();
+
+    // Forgets a texture that is being deleted; a load still running for it is discarded when it completes
+    void release(unsigned int textureID);
+
+    inline bool isStreamed(unsigned int textureID) const { return this->textures.count(textureID) != 0; }
+    // Bytes of the levels resident for a streamed texture, 0 for others
+    size_t getResidentBytes(unsigned int textureID) const;
+
+    inline void   setBudget(size_t bytes) { this->budget = bytes; }
+    inline size_t getBudget() const { return this->budget; }
+
+    // Level bytes uploaded per update. The first level of a frame always goes, however large, so every level eventually fits.
+    inline void   setFrameBudget(size_t bytes) { this->frameBudget = bytes; }
+    inline size_t getFrameBudget() const { return this->frameBudget; }
+
+    inline size_t getResidentBytes()     const { return this->residentBytes; }
+    inline size_t getTextureCount()      const { return this->textures.size(); }
+    inline size_t getLoadCount()         const { return this->loadCount; }
+    inline size_t getUploadedBytes()     const { return this->uploadedBytes; }
+    inline size_t getEvictedLevelCount() const { return this->evictedLevelCount; }
+    // CPU memory of the mip chains kept for uploads
+    size_t getChainBytes() const;
+
+    // Resident level and memory of every texture against its full size
+    void logStats() const;
+};
\ No newline at end of file
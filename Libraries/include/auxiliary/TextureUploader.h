@@ -0,0 +1,82 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "ImageDecoder.h"
+
+#include <deque>
+#include <vector>
+
+
+namespace tu {
+    constexpr size_t DEFAULT_STAGING_SIZE = 8 * 1024 * 1024;
+    constexpr size_t DEFAULT_RING_SIZE = 3;
+    constexpr size_t DEFAULT_FRAME_BUDGET = 16 * 1024 * 1024;
+}
+
+
+// Streams decoded images into GL textures through a ring of pixel buffer objects.
+// Each update() copies at most frameBudget bytes into mapped PBOs and lets the driver pull them asynchronously,
+// so large textures arrive over several frames instead of stalling one. A PBO is reused only after
+// the fence placed behind its last upload has signaled, so the render thread never waits on the GPU.
+class TextureUploader {
+private:
+    struct StagingBuffer {
+        unsigned int pbo = 0;
+        GLsync fence = nullptr;
+    };
+
+    struct PendingUpload {
+        DecodedImage image;
+        unsigned int textureID;
+        GLenum format;
+        int nextRow = 0;
+    };
+
+    std::vector<StagingBuffer> ring;
+    size_t ringIndex = 0;
+    size_t stagingSize;
+    size_t frameBudget;
+
+    std::deque<PendingUpload> pending;
+
+    // Statistics
+    size_t bytesUploaded = 0;
+    size_t texturesCompleted = 0;
+    size_t fenceStalls = 0;
+
+    // Returns false if the PBO is still in use by the GPU
+    bool isStagingFree(StagingBuffer &staging);
+    void finishUpload(PendingUpload &upload);
+
+public:
+    explicit TextureUploader(size_t stagingSize = tu::DEFAULT_STAGING_SIZE, size_t ringSize = tu::DEFAULT_RING_SIZE,
+                             size_t frameBudget = tu::DEFAULT_FRAME_BUDGET);
+    ~TextureUploader();
+
+    TextureUploader(const TextureUploader&) = delete;
+    TextureUploader& operator=(const TextureUploader&) = delete;
+
+    // Creates the texture object right away and schedules its pixels for streaming. The texture has
+    // undefined contents until the upload completes. Failed images get an empty texture, as TextureFromFile does.
+    // Baked images are uploaded right away.
+    unsigned int enqueue(DecodedImage &&image);
+
+    // Call once per frame on the GL context thread
+    void update();
+
+    // Uploads everything still pending, waiting on fences if necessary
+    void flush();
+
+    // Drops the pending upload of a texture that is being deleted
+    void cancel(unsigned int textureID);
+
+    inline void   setFrameBudget(size_t bytes) { this->frameBudget = bytes; }
+    inline size_t getFrameBudget() const { return this->frameBudget; }
+
+    inline bool   isIdle()               const { return this->pending.empty(); }
+    inline size_t getPendingCount()      const { return this->pending.size(); }
+    inline size_t getBytesUploaded()     const { return this->bytesUploaded; }
+    inline size_t getTexturesCompleted() const { return this->texturesCompleted; }
+    inline size_t getFenceStalls()       const { return this->fenceStalls; }
+};
\ No newline at end of file
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+
+// Fixed-size pool of worker threads executing submitted jobs in FIFO order.
+// Jobs must not touch OpenGL: the context is current only on the thread that created it.
+class ThreadPool {
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> jobs;
+
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    bool stopping = false;
+
+    void workerLoop();
+
+public:
+    // 0 threads means "one per hardware thread"
+    explicit ThreadPool(size_t threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    inline size_t getThreadCount() const { return this->workers.size(); }
+
+    template <typename F>
+    std::future<typename std::invoke_result<std::decay_t<F>>::type> submit(F &&job) {
+        using Result = typename std::invoke_result<std::decay_t<F>>::type;
+
+        // std::function requires copyable callables, so the packaged task is shared
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(job));
+        std::future<Result> result = task->get_future();
+
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            jobs.emplace([task]() { (*task)(); });
+        }
+        queueCondition.notify_one();
+
+        return result;
+    }
+
+    // Pool shared by the loaders of the auxiliary library
+    static ThreadPool& shared();
+};
\ No newline at end of file
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+struct Vertex;
+
+
+// Vertex attributes as bits of an attribute mask; bit i is the attribute at location i, as in ShaderProgram::getActiveAttributeMask
+namespace va {
+    constexpr unsigned int POSITION  = 1 << 0;
+    constexpr unsigned int NORMAL    = 1 << 1;
+    constexpr unsigned int TEXCOORDS = 1 << 2;
+    constexpr unsigned int TANGENT   = 1 << 3;
+    constexpr unsigned int BITANGENT = 1 << 4;
+
+    constexpr unsigned int ALL = POSITION | NORMAL | TEXCOORDS | TANGENT | BITANGENT;
+
+    // Per-instance attributes of instanced draws, after the vertex ones: a mat4 takes four locations, a mat3 three
+    constexpr unsigned int INSTANCE_MODEL_LOCATION  = 5;
+    constexpr unsigned int INSTANCE_NORMAL_LOCATION = 9;
+}
+
+
+// GPU layout of mesh vertices
+enum class VertexFormat {
+    FLOAT,      // Vertex as is, 56 bytes
+    COMPACT     // CompactVertex, 20 bytes
+};
+
+
+// Quantized vertex. Attribute locations match Vertex, but shaders have to decode some of them:
+//   0 Position       unorm16 x3 relative to the mesh bounds: pos = aPos * positionScale + positionOffset
+//   1 Normal         octahedral snorm16 x2, see octDecode in the shaders
+//   2 TexCoords      half x2
+//   3 Tangent        octahedral snorm16 x2
+//   4 BitangentSign  unorm16 0 or 1: bitangent = (sign * 2 - 1) * cross(normal, tangent)
+struct CompactVertex {
+    uint16_t Position[3];
+    uint16_t BitangentSign;
+    int16_t  Normal[2];
+    uint16_t TexCoords[2];
+    int16_t  Tangent[2];
+};
+
+static_assert(sizeof(CompactVertex) == 20, "CompactVertex must stay tightly packed");
+
+
+// Where one attribute sits in an interleaved vertex buffer
+struct VertexAttributeLayout {
+    unsigned int location;
+    int components;
+    GLenum type;
+    bool normalized;
+    size_t offset;
+};
+
+// Interleaved GPU vertex holding only some of the attributes of a format.
+// Attributes keep their locations, unused ones are left out of the buffer.
+struct VertexLayout {
+    size_t stride = 0;
+    std::vector<VertexAttributeLayout> attributes;
+};
+
+VertexLayout makeVertexLayout(VertexFormat format, unsigned int attributes = va::ALL);
+
+inline size_t vertexStride(VertexFormat format, unsigned int attributes = va::ALL) {
+    return makeVertexLayout(format, attributes).stride;
+}
+
+// Converts vertices into the GPU layout of the format with just the given attributes.
+// The bounds are used by the compact format to quantize positions.
+void packVertices(const Vertex *vertices, size_t count, VertexFormat format, unsigned int attributes,
+                  const glm::vec3 &boundsMin, const glm::vec3 &boundsMax, std::vector<unsigned char> &out);
+
+// Octahedral encoding of a unit vector into two snorm16 values, and back
+void      octEncode(const glm::vec3 &n, int16_t out[2]);
+glm::vec3 octDecode(const int16_t in[2]);
+
+// Quantizes vertices against the given bounds (the mesh's bounding box)
+void encodeCompactVertices(const Vertex *vertices, size_t count, const glm::vec3 &boundsMin, const glm::vec3 &boundsMax,
+                           std::vector<CompactVertex> &out);
+
+// Dequantization parameters for the position attribute
+glm::vec3 compactPositionScale(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax);
+
+// Largest differences introduced by quantization, for benchmarks
+struct QuantizationError {
+    float position = 0.0f;      // in model units
+    float normalDegrees = 0.0f;
+    float texCoord = 0.0f;
+};
+
+QuantizationError measureQuantizationError(const Vertex *vertices, const CompactVertex *compact, size_t count,
+                                           const glm::vec3 &boundsMin, const glm::vec3 &boundsMax);
\ No newline at end of file
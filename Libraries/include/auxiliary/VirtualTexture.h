@@ -0,0 +1,239 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "AssetPack.h"
+#include "TextureContainer.h"
+#include "ThreadPool.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+
+// Sparse virtual texturing for images too large to keep resident: every mip level is cut into fixed-size tiles
+// that are stored in a tile file ("<image>.vtex", built on first use) and loaded on demand into one shared physical cache.
+// The tile and border sizes are also defined in the virtual sampling shaders (VT_TILE_SIZE, VT_BORDER).
+namespace vt {
+    constexpr const char *EXTENSION = ".vtex";
+    constexpr uint32_t MAGIC = 0x58455456; // "VTEX"
+    constexpr uint32_t VERSION = 1;
+
+    // Texels of a level a tile covers, and how many texels of its neighbours it repeats on each side, so that bilinear
+    // filtering never reads another tile. A tile takes TILE_SIZE + 2 * BORDER = 128 texels square in the cache.
+    constexpr int TILE_SIZE = 120;
+    constexpr int BORDER = 4;
+    constexpr int CACHE_TILE_SIZE = TILE_SIZE + 2 * BORDER;
+
+    // Images this large in either dimension are made virtual by Model, if there is a VirtualTextureSystem
+    extern int MIN_SIZE;
+
+    // Tiles along each side of the physical cache: its VRAM use, whatever the size of the virtual textures
+    extern int CACHE_TILES;
+
+    // The feedback pass renders at 1/FEEDBACK_SCALE of the screen resolution in each dimension
+    constexpr int FEEDBACK_SCALE = 8;
+
+    // Tile loads running on the pool at once; finished ones are uploaded by the next update
+    constexpr size_t MAX_LOADS_IN_FLIGHT = 32;
+}
+
+
+// Layout of a tile file: the header, then the tiles of every level, finest first, row by row. All tiles have the same size.
+struct VirtualTextureHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t levelCount;
+    uint32_t tileSize;
+    uint32_t border;
+    uint32_t format;    // BakedFormat::BC1 or BakedFormat::UNCOMPRESSED (RGBA8)
+};
+
+
+class VirtualTextureSystem;
+
+// One virtual texture: its page table and which of its tiles are in the physical cache.
+// The page table has a texel per tile of every level, pointing at the cache tile to sample for it: the tile itself
+// if it's resident, the closest coarser one covering it otherwise. The coarsest level is a single tile that stays resident.
+class VirtualTexture {
+private:
+    friend class VirtualTextureSystem;
+
+    std::string path;
+    VirtualTextureSystem *system = nullptr;
+    unsigned int pageTable = 0;
+
+    // Known from the image header at creation
+    int width = 0;
+    int height = 0;
+    int levelCount = 0;
+
+    // Set once the tile file is open
+    std::shared_ptr<const VfsFile> file;
+    BakedFormat fileFormat = BakedFormat::UNCOMPRESSED;
+    size_t tileBytes = 0;
+    std::vector<size_t> levelFirstTile;
+
+    // Built in the background if there was no up-to-date tile file
+    std::future<std::string> build;
+    bool building = false;
+    bool failed = false;
+
+    // Tile key (see makeTileKey) -> cache slot of the resident tiles, and the keys being loaded
+    std::unordered_map<uint32_t, size_t> residentTiles;
+    std::unordered_set<uint32_t> loadingTiles;
+
+    // CPU copy of every page table level, (pageTableWidth >> level) x (pageTableHeight >> level) RGBA8 texels
+    int pageTableWidth = 0;
+    int pageTableHeight = 0;
+    std::vector<std::vector<uint32_t>> pageEntries;
+    bool pageTableDirty = false;
+
+    // Tiles across and down a level
+    int getTilesX(int level) const;
+    int getTilesY(int level) const;
+
+public:
+    inline const std::string& getPath()       const { return this->path; }
+    inline unsigned int       getPageTable()  const { return this->pageTable; }
+    inline int                getWidth()      const { return this->width; }
+    inline int                getHeight()     const { return this->height; }
+    inline int                getLevelCount() const { return this->levelCount; }
+    inline bool               isReady()       const { return this->file != nullptr; }
+    inline size_t             getResidentTileCount() const { return this->residentTiles.size(); }
+
+    unsigned int getCacheTexture() const;
+    // GPU memory of the page table; the tiles live in the shared cache
+    size_t getPageTableBytes() const;
+};
+
+
+// Owns the virtual textures, the physical tile cache they share and the feedback pass telling which tiles to load.
+// Per frame: update() reads back the feedback of an earlier frame, requests the tiles it names, uploads finished loads and
+// refreshes page tables; between beginFeedback() and endFeedback() the caller draws the scene with the feedback shaders.
+// Everything but the tile loads runs on the GL context thread.
+class VirtualTextureSystem {
+private:
+    struct CacheSlot {
+        unsigned int owner = 0;     // page table of the virtual texture holding the slot, 0 if it's free
+        uint32_t key = 0;
+        uint64_t lastUse = 0;
+        bool pinned = false;
+    };
+
+    struct PendingTile {
+        unsigned int owner;
+        uint32_t key;
+        bool pinned;
+        std::future<std::vector<unsigned char>> data;
+    };
+
+    std::unordered_map<unsigned int, VirtualTexture> textures;
+    ThreadPool &pool;
+
+    // Physical cache
+    unsigned int cacheTexture = 0;
+    BakedFormat cacheFormat = BakedFormat::UNCOMPRESSED;
+    int cacheTiles = 0;
+    std::vector<CacheSlot> slots;
+    std::vector<PendingTile> pendingTiles;
+
+    // Sets of virtual page tables sampled together by a mesh; feedback names the set, index + 1
+    std::vector<std::vector<unsigned int>> materials;
+
+    // Feedback target and the pixel pack buffers it is read back through; a buffer is reused once its fence has passed and it was read
+    unsigned int feedbackFramebuffer = 0;
+    unsigned int feedbackColor = 0;
+    unsigned int feedbackDepth = 0;
+    int feedbackWidth = 0;
+    int feedbackHeight = 0;
+    unsigned int readbackBuffers[2] = { 0, 0 };
+    GLsync readbackFences[2] = { nullptr, nullptr };
+    int readbackSizes[2][2] = {};
+    int savedViewport[4] = {};
+    int savedFramebuffer = 0;
+
+    // Advanced by every feedback read back; tiles named by the latest one aren't evicted
+    uint64_t feedbackFrame = 1;
+
+    // Scratch of processFeedback: tiles already handled (page table << 32 | key), and the missing ones by level
+    std::unordered_set<uint64_t> touchedTiles;
+    std::vector<std::pair<int, uint64_t>> missingTiles;
+
+    // Statistics
+    size_t loadedTileCount = 0;
+    size_t evictedTileCount = 0;
+    size_t visibleTileCount = 0;
+
+    static uint32_t makeTileKey(int level, int x, int y);
+    static void     splitTileKey(uint32_t key, int &level, int &x, int &y);
+
+    bool openTileFile(VirtualTexture &texture);
+    void resizeFeedback(int width, int height);
+    void processFeedback(const uint16_t *pixels, size_t pixelCount);
+    // Marks the tile and its coarser ancestors as used; those missing go into missingTiles
+    void touchTile(VirtualTexture &texture, int level, int x, int y);
+    void startLoad(VirtualTexture &texture, uint32_t key, bool pinned);
+    void finishLoad(PendingTile &tile);
+    // A free slot, or the least recently used one no longer needed, emptied. SIZE_MAX if every slot is needed.
+    size_t allocateSlot();
+    void updatePageTable(VirtualTexture &texture);
+
+public:
+    // 'cacheTiles' tiles along each side of the physical cache. Call on the GL context thread.
+    explicit VirtualTextureSystem(int cacheTiles = vt::CACHE_TILES, ThreadPool &pool = ThreadPool::shared());
+    ~VirtualTextureSystem();
+
+    VirtualTextureSystem(const VirtualTextureSystem&) = delete;
+    VirtualTextureSystem& operator=(const VirtualTextureSystem&) = delete;
+
+    // Creates the virtual texture of an image and returns its page table texture, or 0 if the image can't be read.
+    // The tile file is built on the pool if it's missing or older than the image; until then the texture samples black.
+    unsigned int create(const std::string &imagePath);
+
+    // Forgets a texture whose page table is being deleted, freeing its cache slots
+    void release(unsigned int pageTable);
+
+    // Null for textures that aren't virtual
+    const VirtualTexture* find(unsigned int pageTable) const;
+
+    // Feedback id of the virtual textures among these ids, registered on first use; 0 if there are none
+    unsigned int getMaterial(const std::vector<unsigned int> &textureIDs);
+
+    // Call once per frame on the GL context thread, before drawing
+    void update();
+
+    // Redirects drawing into the feedback target, at 1/vt::FEEDBACK_SCALE of the given screen size; endFeedback restores
+    // the framebuffer and viewport and starts reading the result back
+    void beginFeedback(int screenWidth, int screenHeight);
+    void endFeedback();
+
+    inline unsigned int getCacheTexture()   const { return this->cacheTexture; }
+    inline size_t       getTextureCount()   const { return this->textures.size(); }
+    inline size_t       getCacheSlotCount() const { return this->slots.size(); }
+    size_t getCacheBytes() const;
+    size_t getUsedSlotCount() const;
+
+    inline size_t getLoadedTileCount()    const { return this->loadedTileCount; }
+    inline size_t getEvictedTileCount()   const { return this->evictedTileCount; }
+    // Tiles named by the latest feedback, with their ancestors
+    inline size_t getVisibleTileCount()   const { return this->visibleTileCount; }
+
+    void logStats() const;
+};
+
+
+// True if 'imagePath' should become a virtual texture: it's at least vt::MIN_SIZE texels in either dimension, judged
+// from the image header or an existing tile file. Reads no pixels, so it's cheap on any thread.
+bool isVirtualTextureCandidate(const std::string &imagePath);
+
+// Cuts the image at 'imagePath' into the tile file "<imagePath>.vtex": BC1 tiles if ktx::COMPRESS is set, RGBA8 otherwise.
+// Decodes the whole image once. On failure returns false with the reason in 'error'.
+bool bakeVirtualTexture(const std::string &imagePath, std::string &error);
\ No newline at end of file
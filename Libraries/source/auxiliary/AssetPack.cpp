@@ -0,0 +1,451 @@
+#include "auxiliary/AssetPack.h"
+#include "auxiliary/Lz4Block.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iostream>
+
+
+namespace ap {
+    std::string PATH = "res.pak";
+}
+
+
+namespace {
+    struct PackHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t fileCount;
+        uint32_t chunkCount;
+        uint64_t tocOffset;
+        uint64_t tocSize;
+    };
+
+    // Followed by pathLength bytes of the normalized path
+    struct FileRecord {
+        uint64_t size;
+        int64_t modifiedTime;   // of the loose file when it was packed, see getModifiedTime
+        uint32_t firstChunk;
+        uint32_t chunkCount;
+        uint32_t pathLength;
+        uint32_t reserved;
+    };
+
+    struct ChunkRecord {
+        uint64_t offset;
+        uint32_t storedSize;    // equal to size if the chunk is stored uncompressed
+        uint32_t size;
+    };
+
+    // Last write time in the file system clock's ticks; only ever compared with another value from the same clock
+    int64_t getModifiedTime(const std::filesystem::path &path, std::error_code &error) {
+        return static_cast<int64_t>(std::filesystem::last_write_time(path, error).time_since_epoch().count());
+    }
+
+    // File data starts on this boundary, so stored entries are as aligned as a fresh allocation would be
+    constexpr size_t DATA_ALIGNMENT = 16;
+
+    struct DecompressBatch {
+        const unsigned char *packData = nullptr;
+        std::vector<ChunkRecord> chunks;
+        unsigned char *out = nullptr;
+
+        std::atomic<size_t> nextIndex { 0 };
+        std::atomic<bool> failed { false };
+        size_t doneCount = 0;
+        std::mutex doneMutex;
+        std::condition_variable doneCondition;
+
+        void work() {
+            while (true) {
+                size_t index = nextIndex.fetch_add(1);
+                if (index >= chunks.size())
+                    return;
+
+                // Chunks are full-size except the last, so each one's place in the file follows from its index
+                const ChunkRecord &chunk = chunks[index];
+                unsigned char *destination = out + index * ap::CHUNK_BYTES;
+                if (chunk.storedSize == chunk.size)
+                    std::memcpy(destination, packData + chunk.offset, chunk.size);
+                else if (!lz4Decompress(packData + chunk.offset, chunk.storedSize, destination, chunk.size))
+                    failed = true;
+
+                {
+                    std::lock_guard<std::mutex> lock(doneMutex);
+                    ++doneCount;
+                }
+                doneCondition.notify_all();
+            }
+        }
+    };
+}
+
+
+std::string AssetVfs::normalizePath(const std::string &path) {
+    std::string generic = path;
+    std::replace(generic.begin(), generic.end(), '\\', '/');
+
+    std::filesystem::path normalized = std::filesystem::path(generic).lexically_normal();
+    if (normalized.is_absolute()) {
+        std::error_code error;
+        std::filesystem::path relative = normalized.lexically_relative(std::filesystem::current_path(error));
+        if (!error && !relative.empty())
+            normalized = relative;
+    }
+
+    std::string key = normalized.generic_string();
+    std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) {
+        return static_cast<char>(std::tolower(c));
+    });
+
+    return key;
+}
+
+bool AssetVfs::mount(const std::string &packPath, std::string &error) {
+    error.clear();
+    pack.reset();
+    entries.clear();
+    chunks.clear();
+    staleFileCount = 0;
+
+    auto file = std::make_shared<MappedFile>();
+    if (!file->open(packPath)) {
+        error = "can't open " + packPath;
+        return false;
+    }
+
+    PackHeader header;
+    if (file->getSize() < sizeof(header)) {
+        error = packPath + " is truncated";
+        return false;
+    }
+    std::memcpy(&header, file->getData(), sizeof(header));
+
+    if (header.magic != ap::MAGIC || header.version != ap::VERSION) {
+        error = packPath + " isn't a pack of this version";
+        return false;
+    }
+    if (header.tocOffset > file->getSize() || header.tocSize > file->getSize() - header.tocOffset ||
+        header.tocSize < static_cast<uint64_t>(header.chunkCount) * sizeof(ChunkRecord)) {
+        error = packPath + " has its table of contents out of the file";
+        return false;
+    }
+
+    // Chunk records close the table, after the variable-length file records
+    const unsigned char *toc = file->getData() + header.tocOffset;
+    size_t chunkBytes = static_cast<size_t>(header.chunkCount) * sizeof(ChunkRecord);
+    size_t fileBytes = header.tocSize - chunkBytes;
+
+    chunks.resize(header.chunkCount);
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        ChunkRecord record;
+        std::memcpy(&record, toc + fileBytes + i * sizeof(ChunkRecord), sizeof(record));
+
+        Chunk &chunk = chunks[i];
+        chunk = { record.offset, record.storedSize, record.size };
+        if (chunk.offset > header.tocOffset || chunk.storedSize > header.tocOffset - chunk.offset || chunk.size > ap::CHUNK_BYTES ||
+            chunk.storedSize > chunk.size) {
+            error = packPath + " has a chunk out of the file";
+            chunks.clear();
+            return false;
+        }
+    }
+
+    size_t offset = 0;
+    for (uint32_t i = 0; i < header.fileCount; ++i) {
+        FileRecord record;
+        if (fileBytes - offset < sizeof(record)) {
+            error = packPath + " has a truncated table of contents";
+            break;
+        }
+        std::memcpy(&record, toc + offset, sizeof(record));
+        offset += sizeof(record);
+
+        if (fileBytes - offset < record.pathLength || record.firstChunk > chunks.size() || record.chunkCount > chunks.size() - record.firstChunk) {
+            error = packPath + " has a truncated table of contents";
+            break;
+        }
+
+        Entry entry;
+        entry.size = record.size;
+        entry.firstChunk = record.firstChunk;
+        entry.chunkCount = record.chunkCount;
+        entry.stored = true;
+
+        // Every chunk but the last is full. Chunks stored uncompressed lie back to back, so a file of only those is contiguous.
+        uint64_t total = 0;
+        bool full = true;
+        for (uint32_t c = 0; c < record.chunkCount; ++c) {
+            const Chunk &chunk = chunks[record.firstChunk + c];
+            full = full && (c + 1 == record.chunkCount || chunk.size == ap::CHUNK_BYTES);
+            total += chunk.size;
+            entry.stored = entry.stored && chunk.storedSize == chunk.size &&
+                           chunk.offset == chunks[record.firstChunk].offset + static_cast<uint64_t>(c) * ap::CHUNK_BYTES;
+        }
+        if (!full || total != record.size) {
+            error = packPath + " has a file whose chunks don't add up";
+            break;
+        }
+
+        std::string key(reinterpret_cast<const char*>(toc + offset), record.pathLength);
+        offset += record.pathLength;
+
+        // A loose copy that differs from what was packed wins. Without one (a pack shipped without res) the entry is used as is.
+        std::error_code fsError;
+        uintmax_t looseSize = std::filesystem::file_size(key, fsError);
+        if (!fsError) {
+            int64_t looseTime = getModifiedTime(key, fsError);
+            if (fsError || looseSize != record.size || looseTime != record.modifiedTime) {
+                ++staleFileCount;
+                continue;
+            }
+        }
+
+        entries.emplace(std::move(key), entry);
+    }
+
+    if (!error.empty()) {
+        entries.clear();
+        chunks.clear();
+        staleFileCount = 0;
+        return false;
+    }
+
+    pack = std::move(file);
+    return true;
+}
+
+const AssetVfs::Entry* AssetVfs::findEntry(const std::string &path) const {
+    if (!pack)
+        return nullptr;
+
+    auto found = entries.find(normalizePath(path));
+    return found == entries.end() ? nullptr : &found->second;
+}
+
+std::shared_ptr<const VfsFile> AssetVfs::read(const std::string &path, ThreadPool &pool) const {
+    auto file = std::make_shared<VfsFile>();
+
+    const Entry *entry = findEntry(path);
+    if (!entry) {
+        auto mapping = std::make_shared<MappedFile>();
+        if (!mapping->open(path))
+            return nullptr;
+
+        file->data = mapping->getData();
+        file->size = mapping->getSize();
+        file->mapping = std::move(mapping);
+
+        std::lock_guard<std::mutex> lock(statsMutex);
+        ++looseReadCount;
+        return file;
+    }
+
+    file->size = static_cast<size_t>(entry->size);
+
+    if (entry->stored) {
+        file->mapping = pack;
+        file->data = entry->chunkCount > 0 ? pack->getData() + chunks[entry->firstChunk].offset : pack->getData();
+
+        std::lock_guard<std::mutex> lock(statsMutex);
+        ++packedReadCount;
+        return file;
+    }
+
+    auto startTime = std::chrono::steady_clock::now();
+
+    file->bytes.resize(file->size);
+    file->data = file->bytes.data();
+
+    auto batch = std::make_shared<DecompressBatch>();
+    batch->packData = pack->getData();
+    batch->out = file->bytes.data();
+    for (uint32_t c = 0; c < entry->chunkCount; ++c) {
+        const Chunk &chunk = chunks[entry->firstChunk + c];
+        batch->chunks.push_back({ chunk.offset, chunk.storedSize, chunk.size });
+    }
+
+    // The caller decompresses too, so one helper less than there are chunks is enough
+    size_t helperCount = std::min<size_t>(entry->chunkCount - 1, pool.getThreadCount());
+    for (size_t i = 0; i < helperCount; ++i)
+        pool.submit([batch]() { batch->work(); });
+
+    batch->work();
+
+    {
+        std::unique_lock<std::mutex> lock(batch->doneMutex);
+        batch->doneCondition.wait(lock, [&batch]() { return batch->doneCount == batch->chunks.size(); });
+    }
+
+    if (batch->failed) {
+        std::cout << "ERROR::ASSET_PACK::Corrupt chunk in " << path << std::endl;
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(statsMutex);
+    ++packedReadCount;
+    decompressedBytes += file->size;
+    decompressTimeMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+    return file;
+}
+
+bool AssetVfs::exists(const std::string &path) const {
+    if (findEntry(path))
+        return true;
+
+    std::error_code error;
+    return std::filesystem::is_regular_file(path, error);
+}
+
+void AssetVfs::logStats() const {
+    constexpr double MB = 1024.0 * 1024.0;
+
+    std::lock_guard<std::mutex> lock(statsMutex);
+    std::cout << "ASSET PACK: " << (pack ? std::to_string(entries.size()) + " files mounted" : std::string("not mounted")) << ", "
+        << packedReadCount << " reads from the pack (" << decompressedBytes / MB << " MB decompressed in " << decompressTimeMs << " ms), "
+        << looseReadCount << " from disk" << std::endl;
+}
+
+AssetVfs& AssetVfs::shared() {
+    static AssetVfs vfs;
+    return vfs;
+}
+
+
+bool buildAssetPack(const std::string &directory, const std::string &packPath, const std::vector<std::string> &excluded, std::string &error,
+                    ThreadPool &pool) {
+    std::string packKey = AssetVfs::normalizePath(packPath);
+    std::vector<std::string> excludedKeys;
+    for (const std::string &path : excluded)
+        excludedKeys.push_back(AssetVfs::normalizePath(path) + '/');
+
+    // Sorted by path, so the files of one model lie next to each other and are read in one sweep
+    std::vector<std::pair<std::string, std::string>> files;
+    std::error_code fsError;
+    for (auto it = std::filesystem::recursive_directory_iterator(directory, fsError); !fsError && it != std::filesystem::recursive_directory_iterator();
+         it.increment(fsError)) {
+        if (!it->is_regular_file(fsError))
+            continue;
+
+        std::string path = it->path().string();
+        std::string key = AssetVfs::normalizePath(path);
+        bool skip = key == packKey || std::any_of(excludedKeys.begin(), excludedKeys.end(), [&key](const std::string &prefix) {
+            return key.compare(0, prefix.size(), prefix) == 0;
+        });
+        if (!skip)
+            files.emplace_back(key, path);
+    }
+    if (fsError) {
+        error = "can't list " + directory + ": " + fsError.message();
+        return false;
+    }
+    std::sort(files.begin(), files.end());
+
+    std::string tempPath = packPath + ".tmp";
+    std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        error = "can't write " + tempPath;
+        return false;
+    }
+
+    PackHeader header = { ap::MAGIC, ap::VERSION, static_cast<uint32_t>(files.size()), 0, 0, 0 };
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    uint64_t offset = sizeof(header);
+
+    std::vector<unsigned char> fileRecords;
+    std::vector<ChunkRecord> chunkRecords;
+
+    for (const auto &file : files) {
+        MappedFile source(file.second);
+        if (!source.isOpen()) {
+            error = "can't read " + file.second;
+            break;
+        }
+
+        int64_t modifiedTime = getModifiedTime(file.second, fsError);
+        if (fsError) {
+            error = "can't read the modification time of " + file.second;
+            break;
+        }
+
+        size_t size = source.getSize();
+        size_t chunkCount = (size + ap::CHUNK_BYTES - 1) / ap::CHUNK_BYTES;
+
+        // Compress all chunks of the file at once; a chunk that saves less than an eighth is kept as it is
+        std::vector<std::future<std::vector<unsigned char>>> compressed;
+        for (size_t c = 0; c < chunkCount; ++c) {
+            const unsigned char *chunk = source.getData() + c * ap::CHUNK_BYTES;
+            size_t chunkSize = std::min(ap::CHUNK_BYTES, size - c * ap::CHUNK_BYTES);
+
+            compressed.push_back(pool.submit([chunk, chunkSize]() {
+                std::vector<unsigned char> result(lz4CompressBound(chunkSize));
+                size_t resultSize = lz4Compress(chunk, chunkSize, result.data(), result.size());
+                if (resultSize == 0 || resultSize > chunkSize - chunkSize / 8)
+                    return std::vector<unsigned char>();
+
+                result.resize(resultSize);
+                return result;
+            }));
+        }
+
+        // Padding before the file, so stored files start aligned
+        size_t padding = (DATA_ALIGNMENT - offset % DATA_ALIGNMENT) % DATA_ALIGNMENT;
+        const char zeros[DATA_ALIGNMENT] = {};
+        out.write(zeros, padding);
+        offset += padding;
+
+        FileRecord record = { size, modifiedTime, static_cast<uint32_t>(chunkRecords.size()), static_cast<uint32_t>(chunkCount),
+                              static_cast<uint32_t>(file.first.size()), 0 };
+        const unsigned char *recordBytes = reinterpret_cast<const unsigned char*>(&record);
+        fileRecords.insert(fileRecords.end(), recordBytes, recordBytes + sizeof(record));
+        fileRecords.insert(fileRecords.end(), file.first.begin(), file.first.end());
+
+        for (size_t c = 0; c < chunkCount; ++c) {
+            std::vector<unsigned char> chunk = compressed[c].get();
+            uint32_t chunkSize = static_cast<uint32_t>(std::min(ap::CHUNK_BYTES, size - c * ap::CHUNK_BYTES));
+
+            ChunkRecord chunkRecord = { offset, chunk.empty() ? chunkSize : static_cast<uint32_t>(chunk.size()), chunkSize };
+            chunkRecords.push_back(chunkRecord);
+
+            if (chunk.empty())
+                out.write(reinterpret_cast<const char*>(source.getData() + c * ap::CHUNK_BYTES), chunkSize);
+            else
+                out.write(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+            offset += chunkRecord.storedSize;
+        }
+    }
+
+    if (error.empty()) {
+        header.chunkCount = static_cast<uint32_t>(chunkRecords.size());
+        header.tocOffset = offset;
+        header.tocSize = fileRecords.size() + chunkRecords.size() * sizeof(ChunkRecord);
+
+        out.write(reinterpret_cast<const char*>(fileRecords.data()), fileRecords.size());
+        out.write(reinterpret_cast<const char*>(chunkRecords.data()), chunkRecords.size() * sizeof(ChunkRecord));
+        out.seekp(0);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        if (!out)
+            error = "can't write " + tempPath;
+    }
+    out.close();
+
+    if (error.empty())
+        std::filesystem::rename(tempPath, packPath, fsError);
+    if (!error.empty() || fsError) {
+        if (error.empty())
+            error = "can't replace " + packPath + ": " + fsError.message();
+        std::filesystem::remove(tempPath, fsError);
+        return false;
+    }
+
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,328 @@
+#include "auxiliary/BufferArena.h"
+
+#include <algorithm>
+#include <iostream>
+#include <utility>
+
+
+namespace ba {
+    bool ENABLED = true;
+}
+
+
+namespace {
+    inline size_t alignUp(size_t value) {
+        return (value + 3) & ~static_cast<size_t>(3);
+    }
+
+    size_t freeTotal(const std::map<size_t, size_t> &freeList) {
+        size_t total = 0;
+        for (const auto &range : freeList)
+            total += range.second;
+
+        return total;
+    }
+
+    std::map<std::pair<int, unsigned int>, std::unique_ptr<BufferArena>>& arenaRegistry() {
+        static std::map<std::pair<int, unsigned int>, std::unique_ptr<BufferArena>> arenas;
+        return arenas;
+    }
+}
+
+
+BufferArena::BufferArena(const VertexLayout &layout)
+    : layout(layout)
+{}
+
+BufferArena::~BufferArena() {
+    for (Block &block : blocks) {
+        glDeleteVertexArrays(1, &block.VAO);
+        glDeleteBuffers(1, &block.VBO);
+        glDeleteBuffers(1, &block.EBO);
+    }
+}
+
+size_t BufferArena::createBlock(size_t vertexCapacity, size_t indexCapacity) {
+    Block block;
+    block.vertexCapacity = vertexCapacity;
+    block.indexCapacity = indexCapacity;
+    block.freeVertices[0] = vertexCapacity;
+    block.freeIndices[0] = indexCapacity;
+
+    // Uploads go through the copy targets, so that no VAO's element buffer binding is touched
+    glGenBuffers(1, &block.VBO);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, block.VBO);
+    glBufferData(GL_COPY_WRITE_BUFFER, vertexCapacity * layout.stride, nullptr, GL_STATIC_DRAW);
+
+    glGenBuffers(1, &block.EBO);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, block.EBO);
+    glBufferData(GL_COPY_WRITE_BUFFER, indexCapacity, nullptr, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    glGenVertexArrays(1, &block.VAO);
+    setupVertexArray(block);
+
+    blocks.push_back(std::move(block));
+    return blocks.size() - 1;
+}
+
+void BufferArena::setupVertexArray(const Block &block) const {
+    glBindVertexArray(block.VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, block.VBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, block.EBO);
+
+    for (const VertexAttributeLayout &attribute : layout.attributes) {
+        glEnableVertexAttribArray(attribute.location);
+        glVertexAttribPointer(attribute.location, attribute.components, attribute.type, attribute.normalized ? GL_TRUE : GL_FALSE,
+                              static_cast<GLsizei>(layout.stride), (void*)attribute.offset);
+    }
+
+    glBindVertexArray(0);
+}
+
+bool BufferArena::takeRange(FreeList &freeList, size_t size, size_t &offset) {
+    // First fit keeps allocations packed towards the start of the block
+    for (auto it = freeList.begin(); it != freeList.end(); ++it) {
+        if (it->second < size)
+            continue;
+
+        offset = it->first;
+        size_t remaining = it->second - size;
+        freeList.erase(it);
+
+        if (remaining > 0)
+            freeList[offset + size] = remaining;
+
+        return true;
+    }
+
+    return false;
+}
+
+void BufferArena::returnRange(FreeList &freeList, size_t offset, size_t size) {
+    if (size == 0)
+        return;
+
+    auto it = freeList.emplace(offset, size).first;
+
+    // Merge with the following range
+    auto next = std::next(it);
+    if (next != freeList.end() && it->first + it->second == next->first) {
+        it->second += next->second;
+        freeList.erase(next);
+    }
+
+    // And with the preceding one
+    if (it != freeList.begin()) {
+        auto prev = std::prev(it);
+        if (prev->first + prev->second == it->first) {
+            prev->second += it->second;
+            freeList.erase(it);
+        }
+    }
+}
+
+size_t BufferArena::largestRange(const FreeList &freeList) {
+    size_t largest = 0;
+    for (const auto &range : freeList)
+        largest = std::max(largest, range.second);
+
+    return largest;
+}
+
+float BufferArena::getFragmentation(const Block &block) const {
+    float vertexHoles = static_cast<float>(freeTotal(block.freeVertices) - largestRange(block.freeVertices)) / block.vertexCapacity;
+    float indexHoles = static_cast<float>(freeTotal(block.freeIndices) - largestRange(block.freeIndices)) / block.indexCapacity;
+
+    return std::max(vertexHoles, indexHoles);
+}
+
+ArenaAllocation* BufferArena::allocateInBlock(size_t blockIndex, size_t vertexCount, size_t indexBytes) {
+    Block &block = blocks[blockIndex];
+
+    size_t baseVertex, indexOffset;
+    if (!takeRange(block.freeVertices, vertexCount, baseVertex))
+        return nullptr;
+
+    if (!takeRange(block.freeIndices, alignUp(indexBytes), indexOffset)) {
+        returnRange(block.freeVertices, baseVertex, vertexCount);
+        return nullptr;
+    }
+
+    std::unique_ptr<ArenaAllocation> allocation(new ArenaAllocation());
+    allocation->arena = this;
+    allocation->block = blockIndex;
+    allocation->VAO = block.VAO;
+    allocation->baseVertex = baseVertex;
+    allocation->vertexCount = vertexCount;
+    allocation->indexOffset = indexOffset;
+    allocation->indexBytes = indexBytes;
+
+    block.usedVertices += vertexCount;
+    block.usedIndexBytes += alignUp(indexBytes);
+
+    ArenaAllocation* result = allocation.get();
+    block.allocations.emplace(result, std::move(allocation));
+
+    return result;
+}
+
+ArenaAllocation* BufferArena::allocate(const void *vertexData, size_t vertexCount, const void *indexData, size_t indexBytes) {
+    ArenaAllocation* allocation = nullptr;
+
+    for (size_t i = 0; i < blocks.size() && !allocation; ++i)
+        allocation = allocateInBlock(i, vertexCount, indexBytes);
+
+    // Enough space in total but no hole big enough: compacting is cheaper than another block
+    for (size_t i = 0; i < blocks.size() && !allocation; ++i) {
+        if (freeTotal(blocks[i].freeVertices) >= vertexCount && freeTotal(blocks[i].freeIndices) >= alignUp(indexBytes)) {
+            compact();
+            allocation = allocateInBlock(i, vertexCount, indexBytes);
+        }
+    }
+
+    if (!allocation) {
+        size_t block = createBlock(std::max(ba::BLOCK_VERTEX_BYTES / layout.stride, vertexCount),
+                                   std::max(ba::BLOCK_INDEX_BYTES, alignUp(indexBytes)));
+        allocation = allocateInBlock(block, vertexCount, indexBytes);
+    }
+
+    const Block &block = blocks[allocation->block];
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, block.VBO);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, allocation->baseVertex * layout.stride, vertexCount * layout.stride, vertexData);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, block.EBO);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, allocation->indexOffset, indexBytes, indexData);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    return allocation;
+}
+
+void BufferArena::release(ArenaAllocation *allocation) {
+    Block &block = blocks[allocation->block];
+
+    returnRange(block.freeVertices, allocation->baseVertex, allocation->vertexCount);
+    returnRange(block.freeIndices, allocation->indexOffset, alignUp(allocation->indexBytes));
+    block.usedVertices -= allocation->vertexCount;
+    block.usedIndexBytes -= alignUp(allocation->indexBytes);
+
+    block.allocations.erase(allocation);
+
+    if (getFragmentation(block) > ba::COMPACT_THRESHOLD)
+        compact();
+}
+
+void BufferArena::compact() {
+    for (Block &block : blocks) {
+        // Nothing to gain if the free space is already one range per buffer
+        if (block.freeVertices.size() <= 1 && block.freeIndices.size() <= 1)
+            continue;
+
+        std::vector<ArenaAllocation*> live;
+        live.reserve(block.allocations.size());
+        for (const auto &entry : block.allocations)
+            live.push_back(entry.first);
+
+        unsigned int newVBO, newEBO;
+        glGenBuffers(1, &newVBO);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, newVBO);
+        glBufferData(GL_COPY_WRITE_BUFFER, block.vertexCapacity * layout.stride, nullptr, GL_STATIC_DRAW);
+
+        // Copying in offset order keeps ranges that were adjacent adjacent
+        std::sort(live.begin(), live.end(), [](const ArenaAllocation *a, const ArenaAllocation *b) {
+            return a->baseVertex < b->baseVertex;
+        });
+
+        glBindBuffer(GL_COPY_READ_BUFFER, block.VBO);
+        size_t vertexCursor = 0;
+        for (ArenaAllocation *allocation : live) {
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, allocation->baseVertex * layout.stride,
+                                vertexCursor * layout.stride, allocation->vertexCount * layout.stride);
+            allocation->baseVertex = vertexCursor;
+            vertexCursor += allocation->vertexCount;
+        }
+
+        glGenBuffers(1, &newEBO);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, newEBO);
+        glBufferData(GL_COPY_WRITE_BUFFER, block.indexCapacity, nullptr, GL_STATIC_DRAW);
+
+        std::sort(live.begin(), live.end(), [](const ArenaAllocation *a, const ArenaAllocation *b) {
+            return a->indexOffset < b->indexOffset;
+        });
+
+        glBindBuffer(GL_COPY_READ_BUFFER, block.EBO);
+        size_t indexCursor = 0;
+        for (ArenaAllocation *allocation : live) {
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, allocation->indexOffset, indexCursor, allocation->indexBytes);
+            allocation->indexOffset = indexCursor;
+            indexCursor += alignUp(allocation->indexBytes);
+        }
+
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        glDeleteBuffers(1, &block.VBO);
+        glDeleteBuffers(1, &block.EBO);
+        block.VBO = newVBO;
+        block.EBO = newEBO;
+
+        // The VAO stays, so meshes keep drawing with it; only its buffers change
+        setupVertexArray(block);
+
+        block.freeVertices.clear();
+        block.freeIndices.clear();
+        returnRange(block.freeVertices, vertexCursor, block.vertexCapacity - vertexCursor);
+        returnRange(block.freeIndices, indexCursor, block.indexCapacity - indexCursor);
+
+        ++compactionCount;
+    }
+}
+
+size_t BufferArena::getAllocationCount() const {
+    size_t count = 0;
+    for (const Block &block : blocks)
+        count += block.allocations.size();
+
+    return count;
+}
+
+size_t BufferArena::getUsedBytes() const {
+    size_t bytes = 0;
+    for (const Block &block : blocks)
+        bytes += block.usedVertices * layout.stride + block.usedIndexBytes;
+
+    return bytes;
+}
+
+size_t BufferArena::getCapacityBytes() const {
+    size_t bytes = 0;
+    for (const Block &block : blocks)
+        bytes += block.vertexCapacity * layout.stride + block.indexCapacity;
+
+    return bytes;
+}
+
+void BufferArena::logStats() const {
+    constexpr double MB = 1024.0 * 1024.0;
+
+    std::cout << "BUFFER ARENA (" << layout.stride << " B vertices): " << blocks.size() << " blocks, "
+        << getAllocationCount() << " allocations, " << getUsedBytes() / MB << " / " << getCapacityBytes() / MB << " MB used, "
+        << compactionCount << " compactions" << std::endl;
+}
+
+BufferArena& BufferArena::forLayout(VertexFormat format, unsigned int attributes) {
+    std::unique_ptr<BufferArena> &arena = arenaRegistry()[std::make_pair(static_cast<int>(format), attributes)];
+    if (!arena)
+        arena.reset(new BufferArena(makeVertexLayout(format, attributes)));
+
+    return *arena;
+}
+
+void BufferArena::logAllStats() {
+    for (const auto &entry : arenaRegistry())
+        entry.second->logStats();
+}
+
+void BufferArena::releaseAll() {
+    arenaRegistry().clear();
+}
\ No newline at end of file
@@ -0,0 +1,93 @@
+#include "auxiliary/GeometryCache.h"
+
+#include <iostream>
+
+
+namespace gc {
+    bool ENABLED = true;
+}
+
+
+namespace {
+    uintptr_t geometryKey(const GpuGeometry &geometry) {
+        return geometry.allocation ? reinterpret_cast<uintptr_t>(geometry.allocation) : geometry.VAO;
+    }
+
+    void deleteGeometry(const GpuGeometry &geometry) {
+        if (geometry.allocation) {
+            geometry.allocation->arena->release(geometry.allocation);
+            return;
+        }
+
+        glDeleteVertexArrays(1, &geometry.VAO);
+        glDeleteBuffers(1, &geometry.VBO);
+        glDeleteBuffers(1, &geometry.EBO);
+    }
+}
+
+
+GpuGeometry GeometryCache::acquire(uint64_t hash, uint64_t checkHash, size_t vertexCount, size_t indexCount, size_t byteSize,
+                                   const std::function<GpuGeometry()> &create) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = entries.find(hash);
+    if (it != entries.end() && it->second.checkHash == checkHash && it->second.vertexCount == vertexCount && it->second.indexCount == indexCount) {
+        ++it->second.refCount;
+
+        ++savedUploadCount;
+        savedBytes += byteSize;
+        return it->second.geometry;
+    }
+
+    GpuGeometry geometry = create();
+
+    ++uploadCount;
+    uploadedBytes += byteSize;
+
+    // A colliding hash keeps the first geometry registered; the new one stays private to its mesh
+    if (it == entries.end()) {
+        Entry &entry = entries[hash];
+        entry.geometry = geometry;
+        entry.refCount = 1;
+        entry.checkHash = checkHash;
+        entry.vertexCount = vertexCount;
+        entry.indexCount = indexCount;
+        entry.byteSize = byteSize;
+
+        hashByGeometry[geometryKey(geometry)] = hash;
+    }
+
+    return geometry;
+}
+
+void GeometryCache::release(const GpuGeometry &geometry) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto byGeometry = hashByGeometry.find(geometryKey(geometry));
+    if (byGeometry == hashByGeometry.end()) {
+        deleteGeometry(geometry);
+        return;
+    }
+
+    auto it = entries.find(byGeometry->second);
+    if (--it->second.refCount > 0)
+        return;
+
+    deleteGeometry(it->second.geometry);
+    entries.erase(it);
+    hashByGeometry.erase(byGeometry);
+}
+
+void GeometryCache::logStats() const {
+    constexpr double MB = 1024.0 * 1024.0;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::cout << "GEOMETRY CACHE: " << entries.size() << " shared geometries, "
+        << uploadCount << " uploads (" << uploadedBytes / MB << " MB), "
+        << savedUploadCount << " uploads saved (" << savedBytes / MB << " MB)" << std::endl;
+}
+
+GeometryCache& GeometryCache::shared() {
+    static GeometryCache cache;
+    return cache;
+}
\ No newline at end of file
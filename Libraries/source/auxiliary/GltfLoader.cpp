@@ -0,0 +1,234 @@
+#include "auxiliary/GltfLoader.h"
+
+#include <cstdint>
+#include <cstring>
+
+
+namespace {
+    size_t componentSize(int componentType) {
+        switch (componentType) {
+            case gltf::BYTE:
+            case gltf::UNSIGNED_BYTE:  return 1;
+            case gltf::SHORT:
+            case gltf::UNSIGNED_SHORT: return 2;
+            case gltf::UNSIGNED_INT:
+            case gltf::FLOAT:          return 4;
+            default:                   return 0;
+        }
+    }
+
+    int componentCount(const std::string &type) {
+        if (type == "SCALAR") return 1;
+        if (type == "VEC2")   return 2;
+        if (type == "VEC3")   return 3;
+        if (type == "VEC4")   return 4;
+        if (type == "MAT2")   return 4;
+        if (type == "MAT3")   return 9;
+        if (type == "MAT4")   return 16;
+        return 0;
+    }
+
+    int hexDigit(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    std::string decodeUri(const std::string &uri) {
+        std::string path;
+        path.reserve(uri.size());
+
+        for (size_t i = 0; i < uri.size(); ++i) {
+            if (uri[i] == '%' && i + 2 < uri.size() && hexDigit(uri[i + 1]) >= 0 && hexDigit(uri[i + 2]) >= 0) {
+                path += static_cast<char>(hexDigit(uri[i + 1]) * 16 + hexDigit(uri[i + 2]));
+                i += 2;
+            }
+            else
+                path += uri[i];
+        }
+
+        return path;
+    }
+}
+
+
+bool GltfAccessor::readFloats(int floats, unsigned char *out, size_t outStride) const {
+    if (componentType != gltf::FLOAT || components < floats)
+        return false;
+
+    size_t bytes = floats * sizeof(float);
+    const unsigned char *source = data;
+
+    // Fixed-size copies, so the compiler turns each into a couple of vector moves
+    if (floats == 2) {
+        for (size_t i = 0; i < count; ++i, source += stride, out += outStride)
+            std::memcpy(out, source, 2 * sizeof(float));
+    }
+    else if (floats == 3) {
+        for (size_t i = 0; i < count; ++i, source += stride, out += outStride)
+            std::memcpy(out, source, 3 * sizeof(float));
+    }
+    else if (floats == 4) {
+        for (size_t i = 0; i < count; ++i, source += stride, out += outStride)
+            std::memcpy(out, source, 4 * sizeof(float));
+    }
+    else {
+        for (size_t i = 0; i < count; ++i, source += stride, out += outStride)
+            std::memcpy(out, source, bytes);
+    }
+
+    return true;
+}
+
+bool GltfAccessor::readIndices(std::vector<unsigned int> &out) const {
+    if (components != 1)
+        return false;
+
+    out.resize(count);
+
+    if (componentType == gltf::UNSIGNED_INT && stride == sizeof(unsigned int)) {
+        std::memcpy(out.data(), data, count * sizeof(unsigned int));
+        return true;
+    }
+
+    const unsigned char *source = data;
+    for (size_t i = 0; i < count; ++i, source += stride) {
+        if (componentType == gltf::UNSIGNED_BYTE)
+            out[i] = *source;
+        else if (componentType == gltf::UNSIGNED_SHORT) {
+            uint16_t index;
+            std::memcpy(&index, source, sizeof(index));
+            out[i] = index;
+        }
+        else if (componentType == gltf::UNSIGNED_INT)
+            std::memcpy(&out[i], source, sizeof(unsigned int));
+        else
+            return false;
+    }
+
+    return true;
+}
+
+
+bool GltfAsset::open(const std::string &path, std::string &error) {
+    size_t slash = path.find_last_of("\\/");
+    directory = slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+
+    std::shared_ptr<const VfsFile> file = AssetVfs::shared().read(path);
+    if (!file) {
+        error = "can't open " + path;
+        return false;
+    }
+
+    // The file is dropped right after parsing, the tree keeps copies of the few strings glTF has
+    if (!parseJson(reinterpret_cast<const char*>(file->getData()), file->getSize(), document, error)) {
+        error = "invalid JSON: " + error;
+        return false;
+    }
+
+    const JsonValue &buffersJson = document["buffers"];
+    buffers.clear();
+    buffers.resize(buffersJson.size());
+
+    for (size_t i = 0; i < buffersJson.size(); ++i) {
+        const std::string &uri = buffersJson[i]["uri"].asString();
+        if (uri.empty() || uri.compare(0, 5, "data:") == 0) {
+            error = "buffer " + std::to_string(i) + " isn't an external file";
+            return false;
+        }
+
+        std::string bufferPath = directory + decodeUri(uri);
+        buffers[i] = AssetVfs::shared().read(bufferPath);
+        if (!buffers[i]) {
+            error = "can't open " + bufferPath;
+            return false;
+        }
+
+        if (buffers[i]->getSize() < buffersJson[i]["byteLength"].asIndex(0)) {
+            error = bufferPath + " is shorter than its byteLength";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool GltfAsset::getAccessor(size_t index, GltfAccessor &accessor, std::string &error) const {
+    const JsonValue &accessorJson = document["accessors"][index];
+    if (!accessorJson.isObject()) {
+        error = "no accessor " + std::to_string(index);
+        return false;
+    }
+    if (accessorJson.has("sparse") || !accessorJson.has("bufferView")) {
+        error = "accessor " + std::to_string(index) + " is sparse or has no buffer view";
+        return false;
+    }
+
+    accessor.componentType = static_cast<int>(accessorJson["componentType"].asNumber());
+    accessor.components = componentCount(accessorJson["type"].asString());
+    accessor.normalized = accessorJson["normalized"].asBool();
+    accessor.count = accessorJson["count"].asIndex(0);
+
+    size_t elementSize = componentSize(accessor.componentType) * accessor.components;
+    if (elementSize == 0) {
+        error = "accessor " + std::to_string(index) + " has an unknown type";
+        return false;
+    }
+
+    const JsonValue &view = document["bufferViews"][accessorJson["bufferView"].asIndex(~static_cast<size_t>(0))];
+    size_t bufferIndex = view["buffer"].asIndex(~static_cast<size_t>(0));
+    if (!view.isObject() || bufferIndex >= buffers.size()) {
+        error = "accessor " + std::to_string(index) + " has an invalid buffer view";
+        return false;
+    }
+
+    size_t viewOffset = view["byteOffset"].asIndex(0);
+    size_t viewLength = view["byteLength"].asIndex(0);
+    size_t offset = accessorJson["byteOffset"].asIndex(0);
+    accessor.stride = view["byteStride"].asIndex(elementSize);
+
+    // Every element has to lie inside the view, and the view inside the mapped buffer
+    const VfsFile &buffer = *buffers[bufferIndex];
+    bool fits = viewOffset + viewLength <= buffer.getSize() &&
+                (accessor.count == 0 || offset + accessor.stride * (accessor.count - 1) + elementSize <= viewLength);
+    if (!fits || accessor.stride < elementSize) {
+        error = "accessor " + std::to_string(index) + " is out of its buffer view";
+        return false;
+    }
+
+    accessor.data = buffer.getData() + viewOffset + offset;
+    return true;
+}
+
+std::string GltfAsset::getTexturePath(size_t textureIndex) const {
+    const JsonValue &texture = document["textures"][textureIndex];
+    const JsonValue &image = document["images"][texture["source"].asIndex(~static_cast<size_t>(0))];
+
+    const std::string &uri = image["uri"].asString();
+    if (uri.empty() || uri.compare(0, 5, "data:") == 0)
+        return std::string();
+
+    return decodeUri(uri);
+}
+
+std::vector<std::string> getGltfBufferPaths(const std::string &path) {
+    std::vector<std::string> paths;
+    std::shared_ptr<const VfsFile> file = AssetVfs::shared().read(path);
+
+    JsonValue document;
+    std::string error;
+    if (!file || !parseJson(reinterpret_cast<const char*>(file->getData()), file->getSize(), document, error))
+        return paths;
+
+    size_t slash = path.find_last_of("\\/");
+    std::string directory = slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+
+    for (const JsonValue &buffer : document["buffers"].getElements()) {
+        const std::string &uri = buffer["uri"].asString();
+        if (!uri.empty() && uri.compare(0, 5, "data:") != 0)
+            paths.push_back(directory + decodeUri(uri));
+    }
+
+    return paths;
+}
\ No newline at end of file
@@ -0,0 +1,131 @@
+#include "auxiliary/ImageDecoder.h"
+#include "auxiliary/AssetPack.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <iostream>
+#include <sstream>
+
+
+namespace imgdec {
+    bool LOG_TIMINGS = false;
+}
+
+
+namespace {
+    // Shared between the caller and helper jobs; helpers that start after all images are claimed just return
+    struct DecodeBatch {
+        std::vector<std::string> paths;
+        std::vector<DecodedImage> images;
+
+        std::atomic<size_t> nextIndex { 0 };
+        size_t doneCount = 0;
+        std::mutex doneMutex;
+        std::condition_variable doneCondition;
+
+        // Claims and decodes images until none are left
+        void work() {
+            while (true) {
+                size_t index = nextIndex.fetch_add(1);
+                if (index >= paths.size())
+                    return;
+
+                images[index] = decodeImage(paths[index]);
+
+                {
+                    std::lock_guard<std::mutex> lock(doneMutex);
+                    ++doneCount;
+                }
+                doneCondition.notify_all();
+            }
+        }
+    };
+}
+
+
+DecodedImage decodeImage(const std::string &path) {
+    auto startTime = std::chrono::steady_clock::now();
+
+    DecodedImage image;
+    image.path = path;
+
+    if (ktx::ENABLED) {
+        image.baked = loadBakedTexture(path);
+        if (image.baked) {
+            image.width = image.baked->getWidth();
+            image.height = image.baked->getHeight();
+            image.components = image.baked->getComponents();
+            image.decodeTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+            return image;
+        }
+    }
+
+    // Through the VFS, so images come out of the asset pack when one is mounted
+    std::shared_ptr<const VfsFile> file = AssetVfs::shared().read(path);
+    if (file && file->getSize() <= INT_MAX)
+        image.pixels.reset(stbi_load_from_memory(file->getData(), static_cast<int>(file->getSize()), &image.width, &image.height, &image.components, 0));
+
+    image.decodeTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+    return image;
+}
+
+std::vector<DecodedImage> decodeImages(const std::vector<std::string> &paths, ThreadPool &pool) {
+    if (paths.size() <= 1) {
+        std::vector<DecodedImage> images;
+        for (const std::string &path : paths)
+            images.push_back(decodeImage(path));
+
+        return images;
+    }
+
+    auto batch = std::make_shared<DecodeBatch>();
+    batch->paths = paths;
+    batch->images.resize(paths.size());
+
+    // The caller decodes too, so one helper less than there are images is enough
+    size_t helperCount = std::min(paths.size() - 1, pool.getThreadCount());
+    for (size_t i = 0; i < helperCount; ++i)
+        pool.submit([batch]() { batch->work(); });
+
+    batch->work();
+
+    // Every image is claimed at this point, so the remaining ones are being decoded right now
+    std::unique_lock<std::mutex> lock(batch->doneMutex);
+    batch->doneCondition.wait(lock, [&batch]() { return batch->doneCount == batch->paths.size(); });
+
+    return std::move(batch->images);
+}
+
+void logDecodeTimings(const std::string &title, const std::vector<DecodedImage> &images) {
+    std::vector<const DecodedImage*> sorted;
+    double totalMs = 0.0;
+    size_t totalBytes = 0;
+
+    for (const DecodedImage &image : images) {
+        sorted.push_back(&image);
+        totalMs += image.decodeTimeMs;
+        totalBytes += image.getByteSize();
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const DecodedImage *a, const DecodedImage *b) {
+        return a->decodeTimeMs > b->decodeTimeMs;
+    });
+
+    // Built as one string, so that output of batches decoded on different threads doesn't interleave
+    std::ostringstream out;
+    out << "IMAGE DECODE: " << title << " (" << images.size() << " images, " << totalMs << " ms, "
+        << totalBytes / (1024.0 * 1024.0) << " MB loaded)\n";
+    for (const DecodedImage *image : sorted) {
+        out << "  " << image->decodeTimeMs << " ms  " << image->width << "x" << image->height << "x" << image->components
+            << "  " << image->path;
+        if (image->baked)
+            out << "  (baked " << image->baked->getFormatName() << ", " << image->baked->getLevels().size() << " levels, " << image->getByteSize() / 1024.0 << " KB)";
+        else if (!image->pixels)
+            out << "  (FAILED)";
+        out << "\n";
+    }
+
+    std::cout << out.str() << std::flush;
+}
\ No newline at end of file
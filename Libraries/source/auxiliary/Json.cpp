@@ -0,0 +1,310 @@
+#include "auxiliary/Json.h"
+
+#include <cmath>
+#include <cstdlib>
+
+
+namespace {
+    // Deeper documents are rejected instead of overflowing the stack
+    constexpr int MAX_DEPTH = 256;
+
+    const JsonValue& nullValue() {
+        static const JsonValue value;
+        return value;
+    }
+
+    void appendUtf8(std::string &out, unsigned int codepoint) {
+        if (codepoint < 0x80) {
+            out += static_cast<char>(codepoint);
+        }
+        else if (codepoint < 0x800) {
+            out += static_cast<char>(0xC0 | (codepoint >> 6));
+            out += static_cast<char>(0x80 | (codepoint & 0x3F));
+        }
+        else if (codepoint < 0x10000) {
+            out += static_cast<char>(0xE0 | (codepoint >> 12));
+            out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (codepoint & 0x3F));
+        }
+        else {
+            out += static_cast<char>(0xF0 | (codepoint >> 18));
+            out += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (codepoint & 0x3F));
+        }
+    }
+}
+
+
+class JsonParser {
+private:
+    const char *text;
+    size_t length;
+    size_t position = 0;
+    std::string error;
+
+    bool fail(const char *message) {
+        if (error.empty())
+            error = std::string(message) + " at offset " + std::to_string(position);
+        return false;
+    }
+
+    void skipWhitespace() {
+        while (position < length && (text[position] == ' ' || text[position] == '\t' || text[position] == '\n' || text[position] == '\r'))
+            ++position;
+    }
+
+    bool expect(const char *literal) {
+        for (size_t i = 0; literal[i]; ++i, ++position) {
+            if (position >= length || text[position] != literal[i])
+                return fail("invalid literal");
+        }
+        return true;
+    }
+
+    bool parseHex4(unsigned int &value) {
+        if (position + 4 > length)
+            return fail("truncated escape");
+
+        value = 0;
+        for (int i = 0; i < 4; ++i) {
+            char c = text[position++];
+            value <<= 4;
+            if (c >= '0' && c <= '9')
+                value |= c - '0';
+            else if (c >= 'a' && c <= 'f')
+                value |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F')
+                value |= c - 'A' + 10;
+            else
+                return fail("invalid escape");
+        }
+        return true;
+    }
+
+    bool parseString(std::string &out) {
+        // The opening quote was checked by the caller
+        ++position;
+
+        while (position < length) {
+            char c = text[position++];
+            if (c == '"')
+                return true;
+
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+
+            if (position >= length)
+                break;
+
+            switch (text[position++]) {
+                case '"':  out += '"';  break;
+                case '\\': out += '\\'; break;
+                case '/':  out += '/';  break;
+                case 'b':  out += '\b'; break;
+                case 'f':  out += '\f'; break;
+                case 'n':  out += '\n'; break;
+                case 'r':  out += '\r'; break;
+                case 't':  out += '\t'; break;
+                case 'u': {
+                    unsigned int codepoint;
+                    if (!parseHex4(codepoint))
+                        return false;
+
+                    // A surrogate pair encodes one codepoint above the basic plane
+                    if (codepoint >= 0xD800 && codepoint < 0xDC00 && position + 1 < length && text[position] == '\\' && text[position + 1] == 'u') {
+                        position += 2;
+                        unsigned int low;
+                        if (!parseHex4(low))
+                            return false;
+                        codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+                    }
+
+                    appendUtf8(out, codepoint);
+                    break;
+                }
+                default:
+                    return fail("invalid escape");
+            }
+        }
+
+        return fail("unterminated string");
+    }
+
+    bool parseNumber(double &out) {
+        size_t start = position;
+        if (position < length && text[position] == '-')
+            ++position;
+        while (position < length && ((text[position] >= '0' && text[position] <= '9') || text[position] == '.' ||
+                                     text[position] == 'e' || text[position] == 'E' || text[position] == '+' || text[position] == '-'))
+            ++position;
+
+        // The text isn't null-terminated, so strtod gets a copy of the token
+        char buffer[64];
+        size_t tokenLength = position - start;
+        if (tokenLength == 0 || tokenLength >= sizeof(buffer))
+            return fail("invalid number");
+
+        for (size_t i = 0; i < tokenLength; ++i)
+            buffer[i] = text[start + i];
+        buffer[tokenLength] = '\0';
+
+        char *end = nullptr;
+        out = std::strtod(buffer, &end);
+        if (end != buffer + tokenLength || !std::isfinite(out))
+            return fail("invalid number");
+
+        return true;
+    }
+
+    bool parseValue(JsonValue &value, int depth) {
+        if (depth > MAX_DEPTH)
+            return fail("nesting too deep");
+
+        skipWhitespace();
+        if (position >= length)
+            return fail("unexpected end");
+
+        char c = text[position];
+        if (c == '{') {
+            value.type = JsonValue::Type::OBJECT;
+            ++position;
+
+            skipWhitespace();
+            if (position < length && text[position] == '}') {
+                ++position;
+                return true;
+            }
+
+            while (true) {
+                skipWhitespace();
+                if (position >= length || text[position] != '"')
+                    return fail("expected a key");
+
+                value.members.emplace_back();
+                if (!parseString(value.members.back().first))
+                    return false;
+
+                skipWhitespace();
+                if (position >= length || text[position] != ':')
+                    return fail("expected ':'");
+                ++position;
+
+                if (!parseValue(value.members.back().second, depth + 1))
+                    return false;
+
+                skipWhitespace();
+                if (position < length && text[position] == ',') {
+                    ++position;
+                    continue;
+                }
+                if (position < length && text[position] == '}') {
+                    ++position;
+                    return true;
+                }
+                return fail("expected ',' or '}'");
+            }
+        }
+        if (c == '[') {
+            value.type = JsonValue::Type::ARRAY;
+            ++position;
+
+            skipWhitespace();
+            if (position < length && text[position] == ']') {
+                ++position;
+                return true;
+            }
+
+            while (true) {
+                value.elements.emplace_back();
+                if (!parseValue(value.elements.back(), depth + 1))
+                    return false;
+
+                skipWhitespace();
+                if (position < length && text[position] == ',') {
+                    ++position;
+                    continue;
+                }
+                if (position < length && text[position] == ']') {
+                    ++position;
+                    return true;
+                }
+                return fail("expected ',' or ']'");
+            }
+        }
+        if (c == '"') {
+            value.type = JsonValue::Type::STRING;
+            return parseString(value.string);
+        }
+        if (c == 't' || c == 'f') {
+            value.type = JsonValue::Type::BOOLEAN;
+            value.boolean = c == 't';
+            return expect(value.boolean ? "true" : "false");
+        }
+        if (c == 'n') {
+            value.type = JsonValue::Type::NUL;
+            return expect("null");
+        }
+
+        value.type = JsonValue::Type::NUMBER;
+        return parseNumber(value.number);
+    }
+
+public:
+    JsonParser(const char *text, size_t length)
+        : text(text), length(length)
+    {}
+
+    bool parse(JsonValue &result, std::string &errorOut) {
+        // A UTF-8 byte order mark is allowed before the document
+        if (length >= 3 && static_cast<unsigned char>(text[0]) == 0xEF && static_cast<unsigned char>(text[1]) == 0xBB &&
+            static_cast<unsigned char>(text[2]) == 0xBF)
+            position = 3;
+
+        bool parsed = parseValue(result, 0);
+        if (parsed) {
+            skipWhitespace();
+            if (position != length)
+                parsed = fail("trailing characters");
+        }
+
+        errorOut = error;
+        return parsed;
+    }
+};
+
+
+size_t JsonValue::asIndex(size_t fallback) const {
+    if (type != Type::NUMBER || number < 0.0 || number != std::floor(number))
+        return fallback;
+
+    return static_cast<size_t>(number);
+}
+
+const JsonValue& JsonValue::operator[](size_t index) const {
+    if (type != Type::ARRAY || index >= elements.size())
+        return nullValue();
+
+    return elements[index];
+}
+
+const JsonValue& JsonValue::operator[](const char *key) const {
+    if (type != Type::OBJECT)
+        return nullValue();
+
+    for (const auto &member : members) {
+        if (member.first == key)
+            return member.second;
+    }
+
+    return nullValue();
+}
+
+bool parseJson(const char *text, size_t length, JsonValue &result, std::string &error) {
+    result = JsonValue();
+
+    JsonParser parser(text, length);
+    return parser.parse(result, error);
+}
\ No newline at end of file
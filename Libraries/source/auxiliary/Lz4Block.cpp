@@ -0,0 +1,180 @@
+#include "auxiliary/Lz4Block.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+
+namespace {
+    constexpr size_t MIN_MATCH = 4;
+    // The format ends every block with literals: a match can't reach the last 5 bytes, nor start in the last 12
+    constexpr size_t LAST_LITERALS = 5;
+    constexpr size_t MATCH_START_LIMIT = 12;
+    constexpr size_t MAX_OFFSET = 65535;
+    constexpr int HASH_BITS = 16;
+
+    inline uint32_t read32(const unsigned char *p) {
+        uint32_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    inline uint32_t hash4(uint32_t sequence) {
+        return (sequence * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    // Lengths of 15 and more continue in bytes of 255 and a final remainder
+    inline bool writeLength(size_t length, unsigned char *&out, const unsigned char *end) {
+        for (; length >= 255; length -= 255) {
+            if (out >= end)
+                return false;
+            *out++ = 255;
+        }
+        if (out >= end)
+            return false;
+        *out++ = static_cast<unsigned char>(length);
+        return true;
+    }
+
+    inline bool readLength(size_t &length, const unsigned char *&in, const unsigned char *end) {
+        unsigned char byte;
+        do {
+            if (in >= end)
+                return false;
+            byte = *in++;
+            length += byte;
+        } while (byte == 255);
+        return true;
+    }
+
+    bool writeSequence(const unsigned char *literals, size_t literalLength, size_t offset, size_t matchLength,
+                       unsigned char *&out, const unsigned char *end) {
+        if (out >= end)
+            return false;
+
+        unsigned char *token = out++;
+        *token = static_cast<unsigned char>((literalLength < 15 ? literalLength : 15) << 4);
+        if (literalLength >= 15 && !writeLength(literalLength - 15, out, end))
+            return false;
+
+        if (static_cast<size_t>(end - out) < literalLength)
+            return false;
+        if (literalLength > 0)
+            std::memcpy(out, literals, literalLength);
+        out += literalLength;
+
+        // The last sequence has literals only
+        if (matchLength == 0)
+            return true;
+
+        if (end - out < 2)
+            return false;
+        *out++ = static_cast<unsigned char>(offset & 0xFF);
+        *out++ = static_cast<unsigned char>(offset >> 8);
+
+        size_t extra = matchLength - MIN_MATCH;
+        *token |= static_cast<unsigned char>(extra < 15 ? extra : 15);
+        return extra < 15 || writeLength(extra - 15, out, end);
+    }
+}
+
+
+size_t lz4Compress(const unsigned char *source, size_t size, unsigned char *destination, size_t capacity) {
+    unsigned char *out = destination;
+    const unsigned char *outEnd = destination + capacity;
+
+    const unsigned char *in = source;
+    const unsigned char *anchor = source;
+    const unsigned char *end = source + size;
+
+    if (size > MATCH_START_LIMIT) {
+        // Last position of every 4-byte hash, relative to the source
+        std::vector<uint32_t> table(size_t(1) << HASH_BITS, 0);
+
+        const unsigned char *matchStartLimit = end - MATCH_START_LIMIT;
+        const unsigned char *matchEndLimit = end - LAST_LITERALS;
+
+        while (in < matchStartLimit) {
+            uint32_t sequence = read32(in);
+            uint32_t &slot = table[hash4(sequence)];
+            const unsigned char *candidate = source + slot;
+            slot = static_cast<uint32_t>(in - source);
+
+            if (candidate >= in || static_cast<size_t>(in - candidate) > MAX_OFFSET || read32(candidate) != sequence) {
+                ++in;
+                continue;
+            }
+
+            // Grow the match backwards into the pending literals, then forwards as far as the format allows
+            while (in > anchor && candidate > source && in[-1] == candidate[-1]) {
+                --in;
+                --candidate;
+            }
+            size_t length = MIN_MATCH;
+            while (in + length < matchEndLimit && in[length] == candidate[length])
+                ++length;
+
+            if (!writeSequence(anchor, in - anchor, in - candidate, length, out, outEnd))
+                return 0;
+
+            in += length;
+            anchor = in;
+        }
+    }
+
+    if (!writeSequence(anchor, end - anchor, 0, 0, out, outEnd))
+        return 0;
+
+    return out - destination;
+}
+
+bool lz4Decompress(const unsigned char *source, size_t sourceSize, unsigned char *destination, size_t size) {
+    const unsigned char *in = source;
+    const unsigned char *inEnd = source + sourceSize;
+    unsigned char *out = destination;
+    unsigned char *outEnd = destination + size;
+
+    while (in < inEnd) {
+        unsigned char token = *in++;
+
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !readLength(literalLength, in, inEnd))
+            return false;
+        if (static_cast<size_t>(inEnd - in) < literalLength || static_cast<size_t>(outEnd - out) < literalLength)
+            return false;
+
+        if (literalLength > 0)
+            std::memcpy(out, in, literalLength);
+        in += literalLength;
+        out += literalLength;
+
+        if (in == inEnd)
+            break;
+
+        if (inEnd - in < 2)
+            return false;
+        size_t offset = in[0] | (static_cast<size_t>(in[1]) << 8);
+        in += 2;
+        if (offset == 0 || offset > static_cast<size_t>(out - destination))
+            return false;
+
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !readLength(matchLength, in, inEnd))
+            return false;
+        matchLength += MIN_MATCH;
+        if (static_cast<size_t>(outEnd - out) < matchLength)
+            return false;
+
+        // Overlapping references repeat the bytes they've just produced, so those are copied one at a time
+        const unsigned char *match = out - offset;
+        if (offset >= matchLength)
+            std::memcpy(out, match, matchLength);
+        else {
+            for (size_t i = 0; i < matchLength; ++i)
+                out[i] = match[i];
+        }
+        out += matchLength;
+    }
+
+    return out == outEnd;
+}
\ No newline at end of file
@@ -0,0 +1,150 @@
+#include "auxiliary/MappedFile.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <utility>
+
+
+namespace {
+    // What an empty file maps to: a valid pointer, so isOpen() holds, but no bytes of it are ever read
+    const unsigned char EMPTY[1] = {};
+}
+
+
+MappedFile::MappedFile(const std::string &path) {
+    open(path);
+}
+
+MappedFile::~MappedFile() {
+    release();
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept {
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile &&other) noexcept {
+    if (this != &other) {
+        release();
+
+        std::swap(data, other.data);
+        std::swap(size, other.size);
+#ifdef _WIN32
+        std::swap(fileHandle, other.fileHandle);
+        std::swap(mappingHandle, other.mappingHandle);
+#else
+        std::swap(fileDescriptor, other.fileDescriptor);
+#endif
+    }
+
+    return *this;
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string &path) {
+    release();
+
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    fileHandle = file;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize)) {
+        release();
+        return false;
+    }
+
+    // A file mapping can't be created for an empty file
+    if (fileSize.QuadPart == 0) {
+        data = EMPTY;
+        return true;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping) {
+        release();
+        return false;
+    }
+    mappingHandle = mapping;
+
+    data = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!data) {
+        release();
+        return false;
+    }
+    size = static_cast<size_t>(fileSize.QuadPart);
+
+    return true;
+}
+
+void MappedFile::release() {
+    if (data && size > 0)
+        UnmapViewOfFile(data);
+    if (mappingHandle)
+        CloseHandle(mappingHandle);
+    if (fileHandle)
+        CloseHandle(fileHandle);
+
+    data = nullptr;
+    size = 0;
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+}
+
+#else
+
+bool MappedFile::open(const std::string &path) {
+    release();
+
+    fileDescriptor = ::open(path.c_str(), O_RDONLY);
+    if (fileDescriptor < 0)
+        return false;
+
+    struct stat fileStat;
+    if (fstat(fileDescriptor, &fileStat) != 0) {
+        release();
+        return false;
+    }
+
+    // mmap rejects a length of zero
+    if (fileStat.st_size == 0) {
+        data = EMPTY;
+        return true;
+    }
+
+    void* mapped = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+    if (mapped == MAP_FAILED) {
+        release();
+        return false;
+    }
+    data = static_cast<const unsigned char*>(mapped);
+    size = static_cast<size_t>(fileStat.st_size);
+
+    return true;
+}
+
+void MappedFile::release() {
+    if (data && size > 0)
+        munmap(const_cast<unsigned char*>(data), size);
+    if (fileDescriptor >= 0)
+        close(fileDescriptor);
+
+    data = nullptr;
+    size = 0;
+    fileDescriptor = -1;
+}
+
+#endif
\ No newline at end of file
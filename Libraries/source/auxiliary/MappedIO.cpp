@@ -0,0 +1,223 @@
+#include "auxiliary/MappedIO.h"
+#include "auxiliary/AssetPack.h"
+#include "auxiliary/TextureCache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+
+namespace mio {
+    bool ENABLED = true;
+    size_t CACHE_BYTES = 256 * 1024 * 1024;
+}
+
+
+std::shared_ptr<const MappedFile> MappedFileCache::acquire(const std::string &path, bool &cached) {
+    std::string key = TextureCache::normalizePath(path);
+
+    std::error_code error;
+    std::filesystem::file_time_type writeTime = std::filesystem::last_write_time(key, error);
+    if (error)
+        return nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto found = entries.find(key);
+        if (found != entries.end() && found->second.writeTime == writeTime) {
+            found->second.lastUse = ++useCounter;
+            ++hitCount;
+            cached = true;
+            return found->second.file;
+        }
+    }
+
+    // Mapped outside the lock, so imports on other threads aren't held up. If two map the same file at once, the later one is kept.
+    auto file = std::make_shared<MappedFile>();
+    if (!file->open(key))
+        return nullptr;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    Entry &entry = entries[key];
+    if (entry.file)
+        cachedBytes -= entry.file->getSize();
+
+    entry.file = file;
+    entry.writeTime = writeTime;
+    entry.lastUse = ++useCounter;
+    cachedBytes += file->getSize();
+    ++missCount;
+
+    evictLocked();
+
+    cached = false;
+    return file;
+}
+
+void MappedFileCache::evictLocked() {
+    while (cachedBytes > mio::CACHE_BYTES && !entries.empty()) {
+        auto oldest = std::min_element(entries.begin(), entries.end(), [](const auto &a, const auto &b) {
+            return a.second.lastUse < b.second.lastUse;
+        });
+
+        cachedBytes -= oldest->second.file->getSize();
+        entries.erase(oldest);
+    }
+}
+
+void MappedFileCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    cachedBytes = 0;
+}
+
+size_t MappedFileCache::getCachedBytes() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return cachedBytes;
+}
+
+void MappedFileCache::logStats() const {
+    constexpr double MB = 1024.0 * 1024.0;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::cout << "MAPPED FILE CACHE: " << entries.size() << " files mapped (" << cachedBytes / MB << " MB), "
+        << hitCount << " hits, " << missCount << " misses" << std::endl;
+}
+
+MappedFileCache& MappedFileCache::shared() {
+    static MappedFileCache cache;
+    return cache;
+}
+
+
+MappedIOStream::MappedIOStream(std::shared_ptr<const void> owner, const unsigned char *data, size_t size, MappedIOSystem *system, size_t statsIndex)
+    : owner(std::move(owner)), data(data), size(size), system(system), statsIndex(statsIndex)
+{}
+
+size_t MappedIOStream::Read(void *buffer, size_t elementSize, size_t count) {
+    if (elementSize == 0 || count == 0)
+        return 0;
+
+    auto startTime = std::chrono::steady_clock::now();
+
+    // Whole elements only, like fread
+    count = std::min(count, (size - position) / elementSize);
+    std::memcpy(buffer, data + position, elementSize * count);
+    position += elementSize * count;
+
+    FileReadStats &stats = system->fileStats[statsIndex];
+    stats.bytesRead += elementSize * count;
+    stats.readTimeMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+    return count;
+}
+
+size_t MappedIOStream::Write(const void*, size_t, size_t) {
+    return 0;
+}
+
+aiReturn MappedIOStream::Seek(size_t offset, aiOrigin origin) {
+    // Offsets from the end are negative, wrapped around into a size_t
+    size_t target = offset;
+    if (origin == aiOrigin_CUR)
+        target = position + offset;
+    else if (origin == aiOrigin_END)
+        target = size + offset;
+
+    if (target > size)
+        return aiReturn_FAILURE;
+
+    position = target;
+    return aiReturn_SUCCESS;
+}
+
+size_t MappedIOStream::Tell() const {
+    return position;
+}
+
+size_t MappedIOStream::FileSize() const {
+    return size;
+}
+
+void MappedIOStream::Flush() {}
+
+
+MappedIOSystem::MappedIOSystem(MappedFileCache &cache)
+    : cache(cache)
+{}
+
+bool MappedIOSystem::Exists(const char *path) const {
+    return AssetVfs::shared().exists(path);
+}
+
+char MappedIOSystem::getOsSeparator() const {
+#ifdef _WIN32
+    return '\\';
+#else
+    return '/';
+#endif
+}
+
+Assimp::IOStream* MappedIOSystem::Open(const char *path, const char *mode) {
+    if (std::strchr(mode, 'w') || std::strchr(mode, 'a') || std::strchr(mode, '+'))
+        return nullptr;
+
+    auto startTime = std::chrono::steady_clock::now();
+
+    // Packed files are already mapped with the pack, only their decompression is redone per open
+    bool cached = false;
+    std::shared_ptr<const void> owner;
+    const unsigned char *data = nullptr;
+    size_t size = 0;
+
+    if (AssetVfs::shared().isPacked(path)) {
+        std::shared_ptr<const VfsFile> file = AssetVfs::shared().read(path);
+        if (file) {
+            data = file->getData();
+            size = file->getSize();
+            owner = std::move(file);
+        }
+    }
+    else {
+        std::shared_ptr<const MappedFile> file = cache.acquire(path, cached);
+        if (file) {
+            data = file->getData();
+            size = file->getSize();
+            owner = std::move(file);
+        }
+    }
+    if (!owner)
+        return nullptr;
+
+    auto inserted = statsIndexByPath.emplace(path, fileStats.size());
+    if (inserted.second) {
+        fileStats.emplace_back();
+        fileStats.back().path = path;
+        fileStats.back().cached = true;
+    }
+
+    FileReadStats &stats = fileStats[inserted.first->second];
+    stats.fileSize = size;
+    ++stats.openCount;
+    stats.cached = stats.cached && cached;
+    if (!cached)
+        stats.mapTimeMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+    return new MappedIOStream(std::move(owner), data, size, this, inserted.first->second);
+}
+
+void MappedIOSystem::Close(Assimp::IOStream *stream) {
+    delete stream;
+}
+
+
+void logFileReadStats(const std::vector<FileReadStats> &fileStats) {
+    for (const FileReadStats &stats : fileStats) {
+        std::cout << "    " << stats.path << ": " << stats.bytesRead << "/" << stats.fileSize << " bytes read in " << stats.openCount
+            << (stats.openCount == 1 ? " open, " : " opens, ") << stats.readTimeMs << " ms reading"
+            << (stats.cached ? ", cached mapping" : ", " + std::to_string(stats.mapTimeMs) + " ms mapping") << std::endl;
+    }
+}
\ No newline at end of file
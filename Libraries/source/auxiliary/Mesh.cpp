@@ -1,34 +1,316 @@
 #include "auxiliary/Mesh.h"
+#include "auxiliary/GeometryCache.h"
+#include "auxiliary/MeshCache.h"
+#include "auxiliary/Meshlets.h"
+#include "auxiliary/TextureArrayManager.h"
+#include "auxiliary/VirtualTexture.h"
 
+#include <cstddef>
+
+
+Mesh::Mesh(std::vector<Vertex> &&vertices, std::vector<unsigned int> &&indices, std::vector<Texture> &&textures,
+           VertexFormat format, unsigned int attributes, std::vector<MeshLod> &&lods, std::vector<Meshlet> &&meshlets)
+    : vertices(std::move(vertices)), indices(std::move(indices)), textures(std::move(textures)), format(format), attributes(attributes),
+      lods(std::move(lods)), meshlets(std::move(meshlets))
+{
+    vertexData = this->vertices.data();
+    vertexCount = this->vertices.size();
+    indexData = this->indices.data();
+    indexCount = this->indices.size();
+
+    setupMesh();
+    setupMeshlets();
+}
+
+Mesh::Mesh(std::shared_ptr<const MappedFile> source, const Vertex *vertexData, size_t vertexCount,
+           const unsigned int *indexData, size_t indexCount, std::vector<Texture> &&textures,
+           VertexFormat format, unsigned int attributes, std::vector<MeshLod> &&lods, std::vector<Meshlet> &&meshlets)
+    : textures(std::move(textures)), mappedSource(std::move(source)),
+      vertexData(vertexData), vertexCount(vertexCount), indexData(indexData), indexCount(indexCount), format(format), attributes(attributes),
+      lods(std::move(lods)), meshlets(std::move(meshlets))
+{
+    setupMesh();
+    setupMeshlets();
+}
+
+Mesh::~Mesh() {
+    releaseBuffers();
+}
+
+Mesh::Mesh(Mesh &&other) noexcept
+    : vertices(std::move(other.vertices)), indices(std::move(other.indices)), textures(std::move(other.textures)),
+      mappedSource(std::move(other.mappedSource)), positions(std::move(other.positions)),
+      vertexData(other.vertexData), vertexCount(other.vertexCount), indexData(other.indexData), indexCount(other.indexCount),
+      boundsMin(other.boundsMin), boundsMax(other.boundsMax), format(other.format), attributes(other.attributes), indexType(other.indexType),
+      lods(std::move(other.lods)), lodLevel(other.lodLevel), meshlets(std::move(other.meshlets)), lodMeshlets(std::move(other.lodMeshlets)),
+      visibleRanges(std::move(other.visibleRanges)), visibleLevel(other.visibleLevel), virtualMaterial(other.virtualMaterial), VAO(other.VAO), VBO(other.VBO), EBO(other.EBO), allocation(other.allocation)
+{
+    other.vertexData = nullptr;
+    other.vertexCount = 0;
+    other.indexData = nullptr;
+    other.indexCount = 0;
+    other.VAO = other.VBO = other.EBO = 0;
+    other.allocation = nullptr;
+}
+
+Mesh& Mesh::operator=(Mesh &&other) noexcept {
+    if (this != &other) {
+        releaseBuffers();
+
+        vertices = std::move(other.vertices);
+        indices = std::move(other.indices);
+        textures = std::move(other.textures);
+        mappedSource = std::move(other.mappedSource);
+        positions = std::move(other.positions);
+
+        vertexData = other.vertexData;
+        vertexCount = other.vertexCount;
+        indexData = other.indexData;
+        indexCount = other.indexCount;
+        boundsMin = other.boundsMin;
+        boundsMax = other.boundsMax;
+        format = other.format;
+        attributes = other.attributes;
+        indexType = other.indexType;
+        lods = std::move(other.lods);
+        lodLevel = other.lodLevel;
+        meshlets = std::move(other.meshlets);
+        lodMeshlets = std::move(other.lodMeshlets);
+        visibleRanges = std::move(other.visibleRanges);
+        visibleLevel = other.visibleLevel;
+        virtualMaterial = other.virtualMaterial;
+        VAO = other.VAO;
+        VBO = other.VBO;
+        EBO = other.EBO;
+        allocation = other.allocation;
+
+        other.vertexData = nullptr;
+        other.vertexCount = 0;
+        other.indexData = nullptr;
+        other.indexCount = 0;
+        other.VAO = other.VBO = other.EBO = 0;
+        other.allocation = nullptr;
+    }
+
+    return *this;
+}
+
+
+void Mesh::applyRetention(MeshRetention retention) {
+    if (retention == MeshRetention::KEEP)
+        return;
+
+    if (retention == MeshRetention::POSITIONS_ONLY && positions.empty() && vertexData) {
+        positions.resize(vertexCount);
+        for (size_t i = 0; i < vertexCount; ++i)
+            positions[i] = vertexData[i].Position;
+
+        // Indices stay for picking; take them out of the mapping so it can be closed
+        if (indices.empty() && indexData)
+            indices.assign(indexData, indexData + indexCount);
+    }
+
+    // swap() rather than clear() to really give the memory back
+    std::vector<Vertex>().swap(vertices);
+    vertexData = nullptr;
+
+    if (retention == MeshRetention::DROP_AFTER_UPLOAD) {
+        std::vector<unsigned int>().swap(indices);
+        std::vector<glm::vec3>().swap(positions);
+    }
+    indexData = indices.empty() ? nullptr : indices.data();
+
+    mappedSource.reset();
+}
+
+size_t Mesh::getCpuBytes() const {
+    size_t bytes = vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(unsigned int)
+                 + positions.capacity() * sizeof(glm::vec3) + meshlets.capacity() * sizeof(Meshlet);
+
+    if (mappedSource) {
+        if (vertexData && vertices.empty())
+            bytes += vertexCount * sizeof(Vertex);
+        if (indexData && indices.empty())
+            bytes += indexCount * sizeof(unsigned int);
+    }
+
+    return bytes;
+}
+
+size_t Mesh::getGpuBytes() const {
+    return vertexCount * vertexStride(format, attributes) + indexCount * getIndexSize();
+}
+
+
+void Mesh::computeBounds() {
+    if (vertexCount == 0)
+        return;
+
+    boundsMin = boundsMax = vertexData[0].Position;
+    for (size_t i = 1; i < vertexCount; ++i) {
+        boundsMin = glm::min(boundsMin, vertexData[i].Position);
+        boundsMax = glm::max(boundsMax, vertexData[i].Position);
+    }
+}
+
+void Mesh::releaseBuffers() {
+    if (VAO == 0)
+        return;
+
+    GpuGeometry geometry;
+    geometry.VAO = VAO;
+    geometry.VBO = VBO;
+    geometry.EBO = EBO;
+    geometry.allocation = allocation;
+    GeometryCache::shared().release(geometry);
+
+    VAO = VBO = EBO = 0;
+    allocation = nullptr;
+}
 
 void Mesh::setupMesh() {
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
+    computeBounds();
 
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+    // Indices can't exceed vertexCount - 1, so small meshes get half-size index buffers
+    indexType = vertexCount <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+    auto createBuffers = [&]() {
+        GpuGeometry geometry;
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        std::vector<unsigned char> packed;
+        packVertices(vertexData, vertexCount, format, attributes, boundsMin, boundsMax, packed);
 
+        std::vector<uint16_t> shortIndices;
+        const void *indexUpload = indexData;
+        size_t indexUploadBytes = indexCount * sizeof(unsigned int);
+        if (indexType == GL_UNSIGNED_SHORT) {
+            shortIndices.assign(indexData, indexData + indexCount);
+            indexUpload = shortIndices.data();
+            indexUploadBytes = shortIndices.size() * sizeof(uint16_t);
+        }
 
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-    glEnableVertexAttribArray(2);
-    glEnableVertexAttribArray(3);
-    glEnableVertexAttribArray(4);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Position));
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+        if (ba::ENABLED) {
+            // All meshes with this layout share a few large buffers and one VAO per buffer block
+            geometry.allocation = BufferArena::forLayout(format, attributes).allocate(packed.data(), vertexCount, indexUpload, indexUploadBytes);
+            geometry.VAO = geometry.allocation->VAO;
+            return geometry;
+        }
 
-    glBindVertexArray(0);
+        glGenVertexArrays(1, &geometry.VAO);
+        glGenBuffers(1, &geometry.VBO);
+        glGenBuffers(1, &geometry.EBO);
+
+        glBindVertexArray(geometry.VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, geometry.VBO);
+        glBufferData(GL_ARRAY_BUFFER, packed.size(), packed.data(), GL_STATIC_DRAW);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry.EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexUploadBytes, indexUpload, GL_STATIC_DRAW);
+
+        // Only the attributes the mesh was built for are in the buffer; the others stay disabled
+        VertexLayout layout = makeVertexLayout(format, attributes);
+        for (const VertexAttributeLayout &attribute : layout.attributes) {
+            glEnableVertexAttribArray(attribute.location);
+            glVertexAttribPointer(attribute.location, attribute.components, attribute.type, attribute.normalized ? GL_TRUE : GL_FALSE,
+                                  static_cast<GLsizei>(layout.stride), (void*)attribute.offset);
+        }
+
+        glBindVertexArray(0);
+
+        return geometry;
+    };
+
+    GpuGeometry geometry;
+    if (gc::ENABLED) {
+        // Identical meshes (e.g. the same sphere with different textures) share one set of buffers.
+        // The format and attribute set are part of the key, the same source data gives different buffers in each.
+        size_t vertexBytes = vertexCount * sizeof(Vertex);
+        size_t indexBytes = indexCount * sizeof(unsigned int);
+        uint64_t hash = hashBytes(indexData, indexBytes, hashBytes(vertexData, vertexBytes));
+        hash = hashBytes(&format, sizeof(format), hash);
+        hash = hashBytes(&attributes, sizeof(attributes), hash);
+
+        uint64_t checkHash = hashBytesMixed(indexData, indexBytes, hashBytesMixed(vertexData, vertexBytes));
+        checkHash = hashBytesMixed(&format, sizeof(format), checkHash);
+        checkHash = hashBytesMixed(&attributes, sizeof(attributes), checkHash);
+
+        geometry = GeometryCache::shared().acquire(hash, checkHash, vertexCount, indexCount, getGpuBytes(), createBuffers);
+    }
+    else {
+        geometry = createBuffers();
+    }
+
+    VAO = geometry.VAO;
+    VBO = geometry.VBO;
+    EBO = geometry.EBO;
+    allocation = geometry.allocation;
 }
 
-void Mesh::Draw(const ShaderProgram &shaderProgram) {
+void Mesh::setupMeshlets() {
+    lodMeshlets.assign(getLodCount(), std::make_pair(meshlets.size(), static_cast<size_t>(0)));
+
+    // Meshlets are in index order and never straddle levels, so each level's meshlets are one run
+    for (size_t level = 0, m = 0; level < getLodCount(); ++level) {
+        size_t levelStart = lods.empty() ? 0 : lods[level].indexOffset;
+        size_t levelEnd = levelStart + getLodIndexCount(level);
+
+        while (m < meshlets.size() && meshlets[m].indexOffset < levelStart)
+            ++m;
+
+        lodMeshlets[level].first = m;
+        while (m < meshlets.size() && meshlets[m].indexOffset < levelEnd)
+            ++m;
+        lodMeshlets[level].second = m - lodMeshlets[level].first;
+    }
+}
+
+void Mesh::cullMeshlets(const MeshletCullView &view) {
+    const std::pair<size_t, size_t> &range = lodMeshlets[lodLevel];
+    if (range.second == 0) {
+        visibleLevel = NOT_CULLED;
+        return;
+    }
+
+    visibleRanges.clear();
+    for (size_t i = range.first; i < range.first + range.second; ++i) {
+        const Meshlet &meshlet = meshlets[i];
+        if (!isMeshletVisible(meshlet, view))
+            continue;
+
+        // Neighbouring visible meshlets are drawn as one range
+        if (!visibleRanges.empty() && visibleRanges.back().first + visibleRanges.back().second == meshlet.indexOffset)
+            visibleRanges.back().second += meshlet.indexCount;
+        else
+            visibleRanges.push_back(std::make_pair(meshlet.indexOffset, meshlet.indexCount));
+    }
+
+    visibleLevel = lodLevel;
+}
+
+size_t Mesh::getDrawnIndexCount() const {
+    if (visibleLevel != lodLevel)
+        return getLodIndexCount(lodLevel);
+
+    size_t count = 0;
+    for (const auto &range : visibleRanges)
+        count += range.second;
+
+    return count;
+}
+
+void Mesh::selectLod(float pixelsPerUnit, float maxPixelError) {
+    lodLevel = 0;
+
+    // Errors grow with the level, so the last level within the limit is the coarsest acceptable one
+    for (size_t level = 1; level < lods.size(); ++level) {
+        if (lods[level].error * pixelsPerUnit > maxPixelError)
+            break;
+
+        lodLevel = level;
+    }
+}
+
+void Mesh::bindMaterial(const ShaderProgram &shaderProgram) {
     unsigned int diffuseNr = 1;
     unsigned int specularNr = 1;
     unsigned int emissiveNr = 1;
@@ -36,6 +318,18 @@ void Mesh::Draw(const ShaderProgram &shaderProgram) {
     unsigned int heightNr = 1;
 
     bool useEmission;
+    unsigned int virtualCache = 0;
+
+    // Slots the mesh has no layer for sample black in the array shaders. Their samplers stay on the slot units all the same,
+    // as samplers of different types must never share a unit.
+    if (ta::ENABLED) {
+        shaderProgram.setInt("material.texture_diffuse1", ta::FIRST_UNIT + ta::DIFFUSE);
+        shaderProgram.setInt("material.texture_specular1", ta::FIRST_UNIT + ta::SPECULAR);
+        shaderProgram.setInt("material.texture_emissive1", ta::FIRST_UNIT + ta::EMISSIVE);
+        shaderProgram.setInt("material.texture_diffuse1_layer", -1);
+        shaderProgram.setInt("material.texture_specular1_layer", -1);
+        shaderProgram.setInt("material.texture_emissive1_layer", -1);
+    }
 
     for (int i = 0; i < textures.size(); ++i) {
         glActiveTexture(GL_TEXTURE0 + i);
@@ -54,27 +348,68 @@ void Mesh::Draw(const ShaderProgram &shaderProgram) {
         else if (name == "texture_height")
             number = std::to_string(heightNr++);
 
+        // Array layers sample their slot's unit, where the array stays bound for the next mesh using it; only the layer changes.
+        // The shaders only sample the first texture of a slot, and binding another would replace its array. Textures that
+        // failed to load have no layer and keep the slot black.
+        int slot = ta::ENABLED ? materialSlotFromType(name) : -1;
+        if (slot >= 0) {
+            if (textures[i].layer < 0 || number != "1")
+                continue;
+
+            TextureArrayManager::shared().bind(slot, textures[i].id);
+            shaderProgram.setInt(("material." + name + number + "_layer").c_str(), textures[i].layer);
+            continue;
+        }
+
         shaderProgram.setInt(("material." + name + number).c_str(), i);
         glBindTexture(GL_TEXTURE_2D, textures[i].id);
+
+        // Virtual textures bind their page table in place of the image; the virtual shaders tell them apart by the level count
+        const VirtualTexture *virtualTexture = textures[i].virtualTexture;
+        if (virtualTexture) {
+            shaderProgram.setVec3(("material." + name + number + "_virtual").c_str(),
+                                  glm::vec3(virtualTexture->getWidth(), virtualTexture->getHeight(), virtualTexture->getLevelCount()));
+            virtualCache = virtualTexture->getCacheTexture();
+        }
+        else
+            shaderProgram.setVec3(("material." + name + number + "_virtual").c_str(), glm::vec3(0.0f));
+    }
+
+    // The tile cache shared by the virtual textures goes on the unit after the mesh's own
+    if (virtualCache) {
+        glActiveTexture(GL_TEXTURE0 + static_cast<GLenum>(textures.size()));
+        glBindTexture(GL_TEXTURE_2D, virtualCache);
+        shaderProgram.setInt("virtualCache", static_cast<int>(textures.size()));
     }
     glActiveTexture(GL_TEXTURE0);
+    shaderProgram.setInt("virtualMaterial", static_cast<int>(virtualMaterial));
 
     if (emissiveNr > 1)
         shaderProgram.setBool("useEmission", true);
     else
         shaderProgram.setBool("useEmission", false);
 
-    // Draw mesh
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
-
-    int maxTextureUnits;
-    glGetIntegerv(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, &maxTextureUnits);
-    
-    // We should unbind textures from units after drawing a model
-    for (int i = 0; i < maxTextureUnits; ++i) {
-        glActiveTexture(GL_TEXTURE0 + i);
+    // Compact vertices are decoded in the vertex shader
+    if (format == VertexFormat::COMPACT) {
+        shaderProgram.setVec3("positionScale", compactPositionScale(boundsMin, boundsMax));
+        shaderProgram.setVec3("positionOffset", boundsMin);
+        shaderProgram.setBool("octNormals", true);
+    }
+    else {
+        shaderProgram.setVec3("positionScale", glm::vec3(1.0f));
+        shaderProgram.setVec3("positionOffset", glm::vec3(0.0f));
+        shaderProgram.setBool("octNormals", false);
+    }
+}
+
+void Mesh::unbindTextures() {
+    // We should unbind textures from units after drawing a model: the units bindMaterial bound 2D textures to, up to the virtual
+    // texture cache's after them. Texture arrays stay bound.
+    for (size_t i = 0; i <= textures.size(); ++i) {
+        if (i < textures.size() && textures[i].layer >= 0)
+            continue;
+
+        glActiveTexture(GL_TEXTURE0 + static_cast<GLenum>(i));
         glBindTexture(GL_TEXTURE_2D, 0);
     }
     glActiveTexture(GL_TEXTURE0);
@@ -84,4 +419,84 @@ void Mesh::Draw(const ShaderProgram &shaderProgram) {
     //for (int i = 1; i < emissiveNr; ++i) shaderProgram.setInt(("material.texture_emissive" + std::to_string(i)).c_str(), -1);
     //for (int i = 1; i < normalNr; ++i) shaderProgram.setInt(("material.texture_normal" + std::to_string(i)).c_str(), -1);
     //for (int i = 1; i < heightNr; ++i) shaderProgram.setInt(("material.texture_height" + std::to_string(i)).c_str(), -1);
+}
+
+void Mesh::Draw(const ShaderProgram &shaderProgram) {
+    bindMaterial(shaderProgram);
+
+    // Without culling results for this level the whole level is one range
+    if (visibleLevel != lodLevel) {
+        visibleRanges.clear();
+        visibleRanges.push_back(std::make_pair(lods.empty() ? 0 : lods[lodLevel].indexOffset, getLodIndexCount(lodLevel)));
+        visibleLevel = NOT_CULLED;
+    }
+
+    // Arena offsets are read here because compaction may have moved the range since the last frame
+    size_t bufferOffset = allocation ? allocation->indexOffset : 0;
+    GLint baseVertex = allocation ? static_cast<GLint>(allocation->baseVertex) : 0;
+
+    drawCounts.clear();
+    drawOffsets.clear();
+    for (const auto &range : visibleRanges) {
+        drawCounts.push_back(static_cast<GLsizei>(range.second));
+        drawOffsets.push_back((const void*)(bufferOffset + range.first * getIndexSize()));
+    }
+    drawBaseVertices.assign(drawCounts.size(), baseVertex);
+
+    // Draw mesh. Model::Draw unbinds the VAO once after all meshes, consecutive meshes in one arena block then share the binding.
+    // Everything culled: nothing to submit
+    if (!drawCounts.empty()) {
+        glBindVertexArray(VAO);
+        if (drawCounts.size() == 1)
+            glDrawElementsBaseVertex(GL_TRIANGLES, drawCounts[0], indexType, drawOffsets[0], baseVertex);
+        else
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, drawCounts.data(), indexType, drawOffsets.data(),
+                                          static_cast<GLsizei>(drawCounts.size()), drawBaseVertices.data());
+    }
+
+    unbindTextures();
+}
+
+void Mesh::DrawInstanced(const ShaderProgram &shaderProgram, unsigned int instanceBuffer, size_t instanceCount) {
+    if (instanceCount == 0)
+        return;
+
+    bindMaterial(shaderProgram);
+
+    // The whole level is drawn, so any culling results are stale now
+    visibleLevel = NOT_CULLED;
+
+    size_t first = lods.empty() ? 0 : lods[lodLevel].indexOffset;
+    size_t bufferOffset = (allocation ? allocation->indexOffset : 0) + first * getIndexSize();
+    GLint baseVertex = allocation ? static_cast<GLint>(allocation->baseVertex) : 0;
+
+    // The VAO may be shared with other meshes of an arena block, so the instance attributes are only enabled for this draw
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+
+    for (unsigned int column = 0; column < 4; ++column) {
+        unsigned int location = va::INSTANCE_MODEL_LOCATION + column;
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                              (void*)(offsetof(InstanceData, model) + column * sizeof(glm::vec4)));
+        glVertexAttribDivisor(location, 1);
+    }
+    for (unsigned int column = 0; column < 3; ++column) {
+        unsigned int location = va::INSTANCE_NORMAL_LOCATION + column;
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                              (void*)(offsetof(InstanceData, normalMatrix) + column * sizeof(glm::vec3)));
+        glVertexAttribDivisor(location, 1);
+    }
+
+    glDrawElementsInstancedBaseVertex(GL_TRIANGLES, static_cast<GLsizei>(getLodIndexCount(lodLevel)), indexType,
+                                      (const void*)bufferOffset, static_cast<GLsizei>(instanceCount), baseVertex);
+
+    for (unsigned int location = va::INSTANCE_MODEL_LOCATION; location < va::INSTANCE_NORMAL_LOCATION + 3; ++location) {
+        glVertexAttribDivisor(location, 0);
+        glDisableVertexAttribArray(location);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    unbindTextures();
 }
\ No newline at end of file
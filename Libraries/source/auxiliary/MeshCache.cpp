@@ -0,0 +1,336 @@
+#include "auxiliary/MeshCache.h"
+#include "auxiliary/AssetPack.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+
+namespace mc {
+    bool ENABLED = true;
+    std::string DIRECTORY = "res\\cache";
+}
+
+
+namespace {
+    struct CacheHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t flags;
+        uint32_t vertexSize;
+        uint64_t sourceHash;
+        uint32_t meshCount;
+        uint32_t attributes;
+        uint32_t options;
+        uint32_t reserved;
+    };
+
+    struct MeshRecord {
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        uint32_t textureCount;
+        uint32_t sourceMeshCount;
+    };
+
+    struct LodRecord {
+        uint32_t indexOffset;
+        uint32_t indexCount;
+        float    error;
+    };
+
+    struct MeshletRecord {
+        uint32_t indexOffset;
+        uint32_t indexCount;
+        float    center[3];
+        float    radius;
+        float    coneAxis[3];
+        float    coneCutoff;
+    };
+
+    inline size_t alignUp(size_t value) {
+        return (value + 3) & ~static_cast<size_t>(3);
+    }
+
+    // Bounds-checked cursor over the mapped file
+    struct Reader {
+        const unsigned char *data;
+        size_t size;
+        size_t offset;
+
+        const unsigned char* take(size_t count) {
+            if (count > size - offset)
+                return nullptr;
+
+            const unsigned char* ptr = data + offset;
+            offset = alignUp(offset + count);
+            if (offset > size)
+                offset = size;
+
+            return ptr;
+        }
+    };
+}
+
+
+uint64_t hashBytes(const void *data, size_t size, uint64_t seed) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint64_t hash = seed;
+
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+uint64_t hashBytesMixed(const void *data, size_t size, uint64_t seed) {
+    constexpr uint64_t MULTIPLIER = 0x9e3779b97f4a7c15ULL;
+
+    auto mix = [](uint64_t value) {
+        value ^= value >> 33;
+        value *= 0xff51afd7ed558ccdULL;
+        value ^= value >> 33;
+        value *= 0xc4ceb9fe1a85ec53ULL;
+        value ^= value >> 33;
+        return value;
+    };
+
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint64_t hash = seed ^ (size * MULTIPLIER);
+
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, bytes + i, sizeof(word));
+        hash = (hash ^ mix(word)) * MULTIPLIER;
+    }
+
+    if (i < size) {
+        uint64_t word = 0;
+        std::memcpy(&word, bytes + i, size - i);
+        hash = (hash ^ mix(word)) * MULTIPLIER;
+    }
+
+    return mix(hash);
+}
+
+uint64_t hashFileContents(const std::string &path) {
+    std::shared_ptr<const VfsFile> file = AssetVfs::shared().read(path);
+    if (!file)
+        return 0;
+
+    return hashBytes(file->getData(), file->getSize());
+}
+
+std::string meshCachePath(const std::string &sourcePath, const MeshCacheKey &key) {
+    char name[64];
+    std::snprintf(name, sizeof(name), "%016llx_%08x_%02x_%02x.meshcache",
+        static_cast<unsigned long long>(hashBytes(sourcePath.data(), sourcePath.size())), key.flags, key.attributes, key.options);
+
+    return mc::DIRECTORY + '\\' + name;
+}
+
+bool readMeshCache(const MappedFile &file, const MeshCacheKey &key, std::vector<CachedMeshView> &meshes) {
+    meshes.clear();
+
+    if (!file.isOpen() || file.getSize() < sizeof(CacheHeader))
+        return false;
+
+    CacheHeader header;
+    std::memcpy(&header, file.getData(), sizeof(header));
+
+    if (header.magic != mc::MAGIC || header.version != mc::VERSION || header.vertexSize != sizeof(Vertex) ||
+        header.flags != key.flags || header.attributes != key.attributes || header.options != key.options ||
+        header.sourceHash != key.sourceHash)
+        return false;
+
+    Reader reader = { file.getData(), file.getSize(), sizeof(CacheHeader) };
+    meshes.reserve(header.meshCount);
+
+    for (uint32_t i = 0; i < header.meshCount; ++i) {
+        const unsigned char* recordPtr = reader.take(sizeof(MeshRecord));
+        if (!recordPtr)
+            return false;
+
+        MeshRecord record;
+        std::memcpy(&record, recordPtr, sizeof(record));
+
+        CachedMeshView view;
+        view.vertexCount = record.vertexCount;
+        view.indexCount = record.indexCount;
+        view.sourceMeshCount = record.sourceMeshCount;
+        view.vertices = reinterpret_cast<const Vertex*>(reader.take(static_cast<size_t>(record.vertexCount) * sizeof(Vertex)));
+        view.indices = reinterpret_cast<const unsigned int*>(reader.take(static_cast<size_t>(record.indexCount) * sizeof(unsigned int)));
+
+        if (!view.vertices || !view.indices)
+            return false;
+
+        for (uint32_t t = 0; t < record.textureCount; ++t) {
+            const unsigned char* lengths = reader.take(2 * sizeof(uint32_t));
+            if (!lengths)
+                return false;
+
+            uint32_t typeLength, pathLength;
+            std::memcpy(&typeLength, lengths, sizeof(uint32_t));
+            std::memcpy(&pathLength, lengths + sizeof(uint32_t), sizeof(uint32_t));
+
+            const unsigned char* typeChars = reader.take(typeLength);
+            const unsigned char* pathChars = reader.take(pathLength);
+            if (!typeChars || !pathChars)
+                return false;
+
+            TextureRef texture;
+            texture.type.assign(reinterpret_cast<const char*>(typeChars), typeLength);
+            texture.path.assign(reinterpret_cast<const char*>(pathChars), pathLength);
+            view.textures.push_back(std::move(texture));
+        }
+
+        const unsigned char* lodCountPtr = reader.take(sizeof(uint32_t));
+        if (!lodCountPtr)
+            return false;
+
+        uint32_t lodCount;
+        std::memcpy(&lodCount, lodCountPtr, sizeof(uint32_t));
+
+        const unsigned char* lodRecords = reader.take(static_cast<size_t>(lodCount) * sizeof(LodRecord));
+        if (!lodRecords)
+            return false;
+
+        for (uint32_t l = 0; l < lodCount; ++l) {
+            LodRecord lodRecord;
+            std::memcpy(&lodRecord, lodRecords + l * sizeof(LodRecord), sizeof(LodRecord));
+
+            // A level outside the mesh's indices means the file is corrupt
+            if (static_cast<size_t>(lodRecord.indexOffset) + lodRecord.indexCount > record.indexCount)
+                return false;
+
+            MeshLod lod;
+            lod.indexOffset = lodRecord.indexOffset;
+            lod.indexCount = lodRecord.indexCount;
+            lod.error = lodRecord.error;
+            view.lods.push_back(lod);
+        }
+
+        const unsigned char* meshletCountPtr = reader.take(sizeof(uint32_t));
+        if (!meshletCountPtr)
+            return false;
+
+        uint32_t meshletCount;
+        std::memcpy(&meshletCount, meshletCountPtr, sizeof(uint32_t));
+
+        const unsigned char* meshletRecords = reader.take(static_cast<size_t>(meshletCount) * sizeof(MeshletRecord));
+        if (!meshletRecords)
+            return false;
+
+        view.meshlets.reserve(meshletCount);
+        for (uint32_t m = 0; m < meshletCount; ++m) {
+            MeshletRecord meshletRecord;
+            std::memcpy(&meshletRecord, meshletRecords + m * sizeof(MeshletRecord), sizeof(MeshletRecord));
+
+            if (static_cast<size_t>(meshletRecord.indexOffset) + meshletRecord.indexCount > record.indexCount)
+                return false;
+
+            Meshlet meshlet;
+            meshlet.indexOffset = meshletRecord.indexOffset;
+            meshlet.indexCount = meshletRecord.indexCount;
+            meshlet.center = glm::vec3(meshletRecord.center[0], meshletRecord.center[1], meshletRecord.center[2]);
+            meshlet.radius = meshletRecord.radius;
+            meshlet.coneAxis = glm::vec3(meshletRecord.coneAxis[0], meshletRecord.coneAxis[1], meshletRecord.coneAxis[2]);
+            meshlet.coneCutoff = meshletRecord.coneCutoff;
+            view.meshlets.push_back(meshlet);
+        }
+
+        meshes.push_back(std::move(view));
+    }
+
+    return true;
+}
+
+
+void MeshCacheWriter::append(const void *data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    buffer.insert(buffer.end(), bytes, bytes + size);
+}
+
+void MeshCacheWriter::pad() {
+    buffer.resize(alignUp(buffer.size()), 0);
+}
+
+void MeshCacheWriter::addMesh(const Vertex *vertices, size_t vertexCount, const unsigned int *indices, size_t indexCount, const std::vector<TextureRef> &textures,
+                              size_t sourceMeshCount, const std::vector<MeshLod> &lods, const std::vector<Meshlet> &meshlets) {
+    MeshRecord record = {
+        static_cast<uint32_t>(vertexCount),
+        static_cast<uint32_t>(indexCount),
+        static_cast<uint32_t>(textures.size()),
+        static_cast<uint32_t>(sourceMeshCount)
+    };
+    append(&record, sizeof(record));
+
+    append(vertices, vertexCount * sizeof(Vertex));
+    pad();
+    append(indices, indexCount * sizeof(unsigned int));
+    pad();
+
+    for (const TextureRef &texture : textures) {
+        uint32_t lengths[2] = { static_cast<uint32_t>(texture.type.size()), static_cast<uint32_t>(texture.path.size()) };
+        append(lengths, sizeof(lengths));
+        append(texture.type.data(), texture.type.size());
+        pad();
+        append(texture.path.data(), texture.path.size());
+        pad();
+    }
+
+    uint32_t lodCount = static_cast<uint32_t>(lods.size());
+    append(&lodCount, sizeof(lodCount));
+    for (const MeshLod &lod : lods) {
+        LodRecord lodRecord = { static_cast<uint32_t>(lod.indexOffset), static_cast<uint32_t>(lod.indexCount), lod.error };
+        append(&lodRecord, sizeof(lodRecord));
+    }
+
+    uint32_t meshletCount = static_cast<uint32_t>(meshlets.size());
+    append(&meshletCount, sizeof(meshletCount));
+    for (const Meshlet &meshlet : meshlets) {
+        MeshletRecord meshletRecord = {
+            static_cast<uint32_t>(meshlet.indexOffset), static_cast<uint32_t>(meshlet.indexCount),
+            { meshlet.center.x, meshlet.center.y, meshlet.center.z }, meshlet.radius,
+            { meshlet.coneAxis.x, meshlet.coneAxis.y, meshlet.coneAxis.z }, meshlet.coneCutoff
+        };
+        append(&meshletRecord, sizeof(meshletRecord));
+    }
+
+    ++meshCount;
+}
+
+bool MeshCacheWriter::save(const std::string &cachePath, const MeshCacheKey &key) const {
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(cachePath).parent_path(), error);
+
+    CacheHeader header = { mc::MAGIC, mc::VERSION, key.flags, static_cast<uint32_t>(sizeof(Vertex)), key.sourceHash, meshCount,
+                           key.attributes, key.options, 0 };
+
+    // Write to a temporary file first, so that an interrupted run never leaves a half-written cache behind
+    std::string tempPath = cachePath + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cout << "ERROR::MESH_CACHE::Can't write cache file: " << tempPath << std::endl;
+            return false;
+        }
+
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+        if (!out)
+            return false;
+    }
+
+    std::filesystem::rename(tempPath, cachePath, error);
+    if (error) {
+        std::filesystem::remove(tempPath, error);
+        return false;
+    }
+
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,385 @@
+#include "auxiliary/MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+
+
+namespace {
+    constexpr unsigned int INVALID = ~0u;
+
+    // Scoring constants of Forsyth's algorithm
+    constexpr size_t FORSYTH_CACHE_SIZE = 32;
+    constexpr float CACHE_DECAY_POWER = 1.5f;
+    constexpr float LAST_TRIANGLE_SCORE = 0.75f;
+    constexpr float VALENCE_BOOST_SCALE = 2.0f;
+    constexpr float VALENCE_BOOST_POWER = 0.5f;
+
+    float vertexScore(int cachePosition, unsigned int liveTriangles) {
+        // Nothing left to draw with this vertex
+        if (liveTriangles == 0)
+            return -1.0f;
+
+        float score = 0.0f;
+        if (cachePosition >= 0) {
+            // The last triangle's vertices get a fixed score, so that it isn't simply continued as a strip
+            if (cachePosition < 3)
+                score = LAST_TRIANGLE_SCORE;
+            else
+                score = std::pow(1.0f - (cachePosition - 3) / static_cast<float>(FORSYTH_CACHE_SIZE - 3), CACHE_DECAY_POWER);
+        }
+
+        // Prefer vertices with few triangles left, so that lone triangles don't get stranded
+        return score + VALENCE_BOOST_SCALE * std::pow(static_cast<float>(liveTriangles), -VALENCE_BOOST_POWER);
+    }
+
+    uint32_t hashVertex(const Vertex &vertex) {
+        // MurmurHash2 mixing over the raw bits; welding is exact, so bitwise equality is what counts
+        constexpr uint32_t m = 0x5bd1e995;
+
+        uint32_t words[sizeof(Vertex) / sizeof(uint32_t)];
+        std::memcpy(words, &vertex, sizeof(Vertex));
+
+        uint32_t hash = 0;
+        for (uint32_t k : words) {
+            k *= m;
+            k ^= k >> 24;
+            k *= m;
+            hash = hash * m ^ k;
+        }
+
+        return hash ^ (hash >> 15);
+    }
+}
+
+
+VertexCacheStats analyzeVertexCache(const unsigned int *indices, size_t indexCount, size_t vertexCount, size_t cacheSize) {
+    VertexCacheStats stats;
+    stats.triangles = indexCount / 3;
+
+    // A vertex is in the FIFO if fewer than cacheSize misses happened since it was last loaded
+    std::vector<size_t> loadedAt(vertexCount, 0);
+    std::vector<bool> seen(vertexCount, false);
+
+    for (size_t i = 0; i < indexCount; ++i) {
+        unsigned int index = indices[i];
+
+        if (!seen[index]) {
+            seen[index] = true;
+            ++stats.vertices;
+        }
+        else if (stats.misses - loadedAt[index] < cacheSize) {
+            continue;
+        }
+
+        loadedAt[index] = stats.misses++;
+    }
+
+    return stats;
+}
+
+void weldVertices(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices) {
+    size_t tableSize = 16;
+    while (tableSize < vertices.size() * 2)
+        tableSize *= 2;
+
+    // Open addressing table of indices into 'unique'
+    std::vector<unsigned int> table(tableSize, INVALID);
+    std::vector<unsigned int> remap(vertices.size());
+    std::vector<Vertex> unique;
+    unique.reserve(vertices.size());
+
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        size_t slot = hashVertex(vertices[i]) & (tableSize - 1);
+
+        while (table[slot] != INVALID && std::memcmp(&unique[table[slot]], &vertices[i], sizeof(Vertex)) != 0)
+            slot = (slot + 1) & (tableSize - 1);
+
+        if (table[slot] == INVALID) {
+            table[slot] = static_cast<unsigned int>(unique.size());
+            unique.push_back(vertices[i]);
+        }
+
+        remap[i] = table[slot];
+    }
+
+    if (unique.size() == vertices.size())
+        return;
+
+    for (unsigned int &index : indices)
+        index = remap[index];
+
+    vertices = std::move(unique);
+}
+
+void optimizeVertexCache(std::vector<unsigned int> &indices, size_t vertexCount) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    // Triangles using each vertex, in compressed rows. The first liveCount entries of a row are still undrawn.
+    std::vector<unsigned int> liveCount(vertexCount, 0);
+    for (unsigned int index : indices)
+        ++liveCount[index];
+
+    std::vector<size_t> rowStart(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v)
+        rowStart[v + 1] = rowStart[v] + liveCount[v];
+
+    std::vector<unsigned int> adjacency(indices.size());
+    {
+        std::vector<size_t> fill(rowStart.begin(), rowStart.end() - 1);
+        for (size_t i = 0; i < indices.size(); ++i)
+            adjacency[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> scores(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v)
+        scores[v] = vertexScore(-1, liveCount[v]);
+
+    std::vector<float> triangleScores(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    for (size_t t = 0; t < triangleCount; ++t)
+        triangleScores[t] = scores[indices[t * 3]] + scores[indices[t * 3 + 1]] + scores[indices[t * 3 + 2]];
+
+    unsigned int bestTriangle = static_cast<unsigned int>(
+        std::max_element(triangleScores.begin(), triangleScores.end()) - triangleScores.begin());
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+
+    std::vector<unsigned int> cache, newCache;
+    cache.reserve(FORSYTH_CACHE_SIZE + 3);
+    newCache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+    size_t cursor = 0;
+    for (size_t drawn = 0; drawn < triangleCount; ++drawn) {
+        // Nothing in the cache has triangles left: continue with the next undrawn triangle in input order
+        if (bestTriangle == INVALID) {
+            while (emitted[cursor])
+                ++cursor;
+            bestTriangle = static_cast<unsigned int>(cursor);
+        }
+
+        const unsigned int* triangle = &indices[static_cast<size_t>(bestTriangle) * 3];
+        result.insert(result.end(), triangle, triangle + 3);
+        emitted[bestTriangle] = true;
+
+        // Take the triangle out of its vertices' live lists
+        for (int k = 0; k < 3; ++k) {
+            unsigned int v = triangle[k];
+            unsigned int* row = &adjacency[rowStart[v]];
+
+            for (unsigned int j = 0; j < liveCount[v]; ++j) {
+                if (row[j] == bestTriangle) {
+                    std::swap(row[j], row[liveCount[v] - 1]);
+                    --liveCount[v];
+                    break;
+                }
+            }
+        }
+
+        // The triangle's vertices move to the front of the LRU cache
+        newCache.assign(triangle, triangle + 3);
+        for (unsigned int v : cache) {
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+                newCache.push_back(v);
+        }
+
+        for (size_t i = 0; i < newCache.size(); ++i) {
+            unsigned int v = newCache[i];
+            cachePosition[v] = i < FORSYTH_CACHE_SIZE ? static_cast<int>(i) : -1;
+            scores[v] = vertexScore(cachePosition[v], liveCount[v]);
+        }
+
+        // Rescore the triangles around everything that moved (including evicted vertices) and pick the best
+        bestTriangle = INVALID;
+        float bestScore = -1.0f;
+        for (unsigned int v : newCache) {
+            const unsigned int* row = &adjacency[rowStart[v]];
+
+            for (unsigned int j = 0; j < liveCount[v]; ++j) {
+                unsigned int t = row[j];
+                const unsigned int* other = &indices[static_cast<size_t>(t) * 3];
+
+                triangleScores[t] = scores[other[0]] + scores[other[1]] + scores[other[2]];
+                if (triangleScores[t] > bestScore) {
+                    bestScore = triangleScores[t];
+                    bestTriangle = t;
+                }
+            }
+        }
+
+        if (newCache.size() > FORSYTH_CACHE_SIZE)
+            newCache.resize(FORSYTH_CACHE_SIZE);
+        std::swap(cache, newCache);
+    }
+
+    indices = std::move(result);
+}
+
+bool optimizeOverdraw(std::vector<unsigned int> &indices, const std::vector<Vertex> &vertices, float threshold) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount < 2)
+        return false;
+
+    float baseACMR = analyzeVertexCache(indices.data(), indices.size(), vertices.size()).getACMR();
+
+    // FIFO cache simulation over the triangles; flush() empties the cache
+    std::vector<size_t> loadedAt(vertices.size(), 0);
+    std::vector<bool> seen(vertices.size(), false);
+    size_t misses = 0;
+
+    auto flush = [&misses]() { misses += mopt::CACHE_SIZE; };
+    auto triangleMisses = [&](size_t t) {
+        int count = 0;
+        for (int k = 0; k < 3; ++k) {
+            unsigned int v = indices[t * 3 + k];
+            if (seen[v] && misses - loadedAt[v] < mopt::CACHE_SIZE)
+                continue;
+
+            seen[v] = true;
+            loadedAt[v] = misses++;
+            ++count;
+        }
+        return count;
+    };
+
+    // Hard boundaries are the triangles that miss the cache with all three vertices
+    std::vector<int> missesPerTriangle(triangleCount);
+    std::vector<size_t> hardStart;
+    for (size_t t = 0; t < triangleCount; ++t) {
+        missesPerTriangle[t] = triangleMisses(t);
+        if (t == 0 || missesPerTriangle[t] == 3)
+            hardStart.push_back(t);
+    }
+    hardStart.push_back(triangleCount);
+
+    // Soft boundaries split a hard cluster wherever the piece so far, starting with a cold cache,
+    // already reaches the ACMR of the whole hard cluster (within the threshold)
+    std::vector<size_t> clusterStart;
+    for (size_t h = 0; h + 1 < hardStart.size(); ++h) {
+        size_t begin = hardStart[h], end = hardStart[h + 1];
+
+        size_t hardMisses = 0;
+        for (size_t t = begin; t < end; ++t)
+            hardMisses += missesPerTriangle[t];
+        float hardACMR = static_cast<float>(hardMisses) / (end - begin);
+
+        flush();
+        clusterStart.push_back(begin);
+
+        size_t softMisses = 0, softTriangles = 0;
+        for (size_t t = begin; t < end; ++t) {
+            softMisses += triangleMisses(t);
+            ++softTriangles;
+
+            if (t + 1 < end && softTriangles >= mopt::MIN_CLUSTER_SIZE &&
+                static_cast<float>(softMisses) / softTriangles <= hardACMR * threshold) {
+                flush();
+                clusterStart.push_back(t + 1);
+                softMisses = softTriangles = 0;
+            }
+        }
+    }
+    clusterStart.push_back(triangleCount);
+
+    size_t clusterCount = clusterStart.size() - 1;
+    if (clusterCount < 2)
+        return false;
+
+    // Area weighted centroid and normal of each cluster
+    std::vector<glm::vec3> centroids(clusterCount, glm::vec3(0.0f));
+    std::vector<glm::vec3> normals(clusterCount, glm::vec3(0.0f));
+    std::vector<float> areas(clusterCount, 0.0f);
+
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+
+    for (size_t c = 0; c < clusterCount; ++c) {
+        for (size_t t = clusterStart[c]; t < clusterStart[c + 1]; ++t) {
+            const glm::vec3 &a = vertices[indices[t * 3]].Position;
+            const glm::vec3 &b = vertices[indices[t * 3 + 1]].Position;
+            const glm::vec3 &p = vertices[indices[t * 3 + 2]].Position;
+
+            glm::vec3 normal = glm::cross(b - a, p - a);
+            float area = glm::length(normal);
+
+            centroids[c] += (a + b + p) * (area / 3.0f);
+            normals[c] += normal;
+            areas[c] += area;
+        }
+
+        meshCentroid += centroids[c];
+        meshArea += areas[c];
+
+        if (areas[c] > 0.0f)
+            centroids[c] /= areas[c];
+    }
+
+    if (meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    // Clusters facing away from the center are likely to occlude the rest, so they go first
+    std::vector<float> sortKey(clusterCount);
+    for (size_t c = 0; c < clusterCount; ++c) {
+        float length = glm::length(normals[c]);
+        sortKey[c] = length > 0.0f ? glm::dot(centroids[c] - meshCentroid, normals[c] / length) : 0.0f;
+    }
+
+    std::vector<size_t> order(clusterCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&sortKey](size_t a, size_t b) {
+        return sortKey[a] > sortKey[b];
+    });
+
+    std::vector<unsigned int> sorted;
+    sorted.reserve(indices.size());
+    for (size_t c : order)
+        sorted.insert(sorted.end(), indices.begin() + clusterStart[c] * 3, indices.begin() + clusterStart[c + 1] * 3);
+
+    // The sort breaks cache locality at cluster seams; keep it only if that stays cheap
+    float sortedACMR = analyzeVertexCache(sorted.data(), sorted.size(), vertices.size()).getACMR();
+    if (sortedACMR > baseACMR * threshold)
+        return false;
+
+    indices = std::move(sorted);
+    return true;
+}
+
+void optimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices) {
+    std::vector<unsigned int> remap(vertices.size(), INVALID);
+    std::vector<Vertex> ordered;
+    ordered.reserve(vertices.size());
+
+    for (unsigned int &index : indices) {
+        if (remap[index] == INVALID) {
+            remap[index] = static_cast<unsigned int>(ordered.size());
+            ordered.push_back(vertices[index]);
+        }
+
+        index = remap[index];
+    }
+
+    vertices = std::move(ordered);
+}
+
+MeshOptimizationStats optimizeMesh(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices) {
+    MeshOptimizationStats stats;
+    stats.verticesBefore = vertices.size();
+    stats.before = analyzeVertexCache(indices.data(), indices.size(), vertices.size());
+
+    weldVertices(vertices, indices);
+    optimizeVertexCache(indices, vertices.size());
+    if (optimizeOverdraw(indices, vertices))
+        stats.overdrawSorted = 1;
+    optimizeVertexFetch(vertices, indices);
+
+    stats.verticesAfter = vertices.size();
+    stats.after = analyzeVertexCache(indices.data(), indices.size(), vertices.size());
+
+    return stats;
+}
\ No newline at end of file
@@ -0,0 +1,485 @@
+#include "auxiliary/MeshSimplifier.h"
+#include "auxiliary/MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <tuple>
+
+
+namespace lod {
+    float PIXEL_ERROR = 1.0f;
+}
+
+
+namespace {
+    constexpr unsigned int NONE = ~0u;
+    constexpr unsigned int MULTIPLE = ~0u - 1;
+
+    // Up to this much of a pass's collapse goal is taken past its error goal, so that passes keep making progress
+    constexpr double PASS_ERROR_BOUND = 1.5;
+
+    // Normals of the triangles around a collapse may turn by at most ~75 degrees
+    constexpr float MIN_NORMAL_COSINE = 0.25f;
+
+    enum VertexKind : unsigned char {
+        MANIFOLD,   // interior vertex, collapses anywhere
+        BORDER,     // on exactly one open edge loop, collapses along it
+        SEAM,       // split in two at one position, both sides collapse along the seam together
+        LOCKED      // anything else: corners, seam ends, non-manifold fans
+    };
+
+    // Sum of squared distances to a set of weighted planes, Q(p) = p^T A p + 2 b.p + c
+    struct Quadric {
+        double a00 = 0.0, a01 = 0.0, a02 = 0.0, a11 = 0.0, a12 = 0.0, a22 = 0.0;
+        double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+        double c = 0.0;
+        double weight = 0.0;
+
+        void addPlane(const glm::vec3 &normal, float distance, double planeWeight) {
+            double x = normal.x, y = normal.y, z = normal.z, d = distance;
+
+            a00 += planeWeight * x * x;
+            a01 += planeWeight * x * y;
+            a02 += planeWeight * x * z;
+            a11 += planeWeight * y * y;
+            a12 += planeWeight * y * z;
+            a22 += planeWeight * z * z;
+            b0 += planeWeight * x * d;
+            b1 += planeWeight * y * d;
+            b2 += planeWeight * z * d;
+            c += planeWeight * d * d;
+            weight += planeWeight;
+        }
+
+        void add(const Quadric &other) {
+            a00 += other.a00; a01 += other.a01; a02 += other.a02;
+            a11 += other.a11; a12 += other.a12; a22 += other.a22;
+            b0 += other.b0; b1 += other.b1; b2 += other.b2;
+            c += other.c;
+            weight += other.weight;
+        }
+
+        // Weighted mean squared distance, so that the error doesn't grow with the area behind it
+        double error(const glm::vec3 &point) const {
+            double x = point.x, y = point.y, z = point.z;
+            double r = a00 * x * x + a11 * y * y + a22 * z * z + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z)
+                     + 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+
+            return weight > 0.0 ? std::fabs(r) / weight : 0.0;
+        }
+    };
+
+    // Outgoing half-edges of every vertex, CSR style
+    struct EdgeAdjacency {
+        std::vector<unsigned int> offsets;
+        std::vector<unsigned int> targets;
+
+        void build(const std::vector<unsigned int> &indices, size_t vertexCount) {
+            offsets.assign(vertexCount + 1, 0);
+            for (unsigned int index : indices)
+                ++offsets[index + 1];
+            for (size_t i = 0; i < vertexCount; ++i)
+                offsets[i + 1] += offsets[i];
+
+            targets.resize(indices.size());
+            std::vector<unsigned int> cursor(offsets.begin(), offsets.end() - 1);
+            for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+                for (int e = 0; e < 3; ++e)
+                    targets[cursor[indices[i + e]]++] = indices[i + (e + 1) % 3];
+            }
+        }
+
+        bool hasEdge(unsigned int from, unsigned int to) const {
+            for (unsigned int i = offsets[from]; i < offsets[from + 1]; ++i) {
+                if (targets[i] == to)
+                    return true;
+            }
+
+            return false;
+        }
+    };
+
+    // Triangles using every vertex, CSR style
+    struct TriangleAdjacency {
+        std::vector<unsigned int> offsets;
+        std::vector<unsigned int> triangles;
+
+        void build(const std::vector<unsigned int> &indices, size_t vertexCount) {
+            offsets.assign(vertexCount + 1, 0);
+            for (unsigned int index : indices)
+                ++offsets[index + 1];
+            for (size_t i = 0; i < vertexCount; ++i)
+                offsets[i + 1] += offsets[i];
+
+            triangles.resize(indices.size());
+            std::vector<unsigned int> cursor(offsets.begin(), offsets.end() - 1);
+            for (size_t i = 0; i < indices.size(); ++i)
+                triangles[cursor[indices[i]]++] = static_cast<unsigned int>(i / 3);
+        }
+    };
+
+    struct Collapse {
+        unsigned int from;
+        unsigned int to;
+        double cost;
+    };
+
+    // remap: first vertex at the same position; wedges: ring of all vertices at that position
+    void buildPositionRemap(const std::vector<Vertex> &vertices, std::vector<unsigned int> &remap, std::vector<unsigned int> &wedges) {
+        size_t vertexCount = vertices.size();
+
+        // Positions are compared by their bits, like weldVertices does
+        std::vector<std::tuple<uint32_t, uint32_t, uint32_t, unsigned int>> keys(vertexCount);
+        for (size_t i = 0; i < vertexCount; ++i) {
+            uint32_t bits[3];
+            std::memcpy(bits, &vertices[i].Position, sizeof(bits));
+            keys[i] = std::make_tuple(bits[0], bits[1], bits[2], static_cast<unsigned int>(i));
+        }
+        std::sort(keys.begin(), keys.end());
+
+        remap.resize(vertexCount);
+        wedges.resize(vertexCount);
+
+        for (size_t start = 0; start < vertexCount; ) {
+            size_t end = start + 1;
+            while (end < vertexCount && std::get<0>(keys[end]) == std::get<0>(keys[start]) &&
+                   std::get<1>(keys[end]) == std::get<1>(keys[start]) && std::get<2>(keys[end]) == std::get<2>(keys[start]))
+                ++end;
+
+            unsigned int canonical = std::get<3>(keys[start]);
+            for (size_t i = start; i < end; ++i) {
+                unsigned int vertex = std::get<3>(keys[i]);
+                remap[vertex] = canonical;
+                wedges[vertex] = std::get<3>(keys[i + 1 < end ? i + 1 : start]);
+            }
+
+            start = end;
+        }
+    }
+
+    bool isSingle(unsigned int vertex) {
+        return vertex != NONE && vertex != MULTIPLE;
+    }
+
+    // Is there an edge between the positions of 'from' and 'to', through any of their wedges
+    bool hasPositionEdge(const EdgeAdjacency &adjacency, const std::vector<unsigned int> &wedges, unsigned int from, unsigned int to) {
+        unsigned int f = from;
+        do {
+            unsigned int t = to;
+            do {
+                if (adjacency.hasEdge(f, t))
+                    return true;
+                t = wedges[t];
+            } while (t != to);
+
+            f = wedges[f];
+        } while (f != from);
+
+        return false;
+    }
+
+    void classifyVertices(const EdgeAdjacency &adjacency, const std::vector<unsigned int> &remap, const std::vector<unsigned int> &wedges,
+                          const std::vector<unsigned int> &openIn, const std::vector<unsigned int> &openOut, std::vector<VertexKind> &kinds) {
+        size_t vertexCount = remap.size();
+        kinds.assign(vertexCount, LOCKED);
+
+        for (unsigned int i = 0; i < vertexCount; ++i) {
+            if (remap[i] != i)
+                continue;
+
+            VertexKind kind = LOCKED;
+
+            if (wedges[i] == i) {
+                if (openIn[i] == NONE && openOut[i] == NONE)
+                    kind = MANIFOLD;
+                // Open at the attribute level but closed at the position level is where a seam ends
+                else if (isSingle(openIn[i]) && isSingle(openOut[i]) &&
+                         !hasPositionEdge(adjacency, wedges, i, openIn[i]) && !hasPositionEdge(adjacency, wedges, openOut[i], i))
+                    kind = BORDER;
+            }
+            else if (wedges[wedges[i]] == i) {
+                // Both sides of a seam run between the same positions in opposite directions
+                unsigned int w = wedges[i];
+                if (isSingle(openIn[i]) && isSingle(openOut[i]) && isSingle(openIn[w]) && isSingle(openOut[w]) &&
+                    remap[openIn[i]] == remap[openOut[w]] && remap[openOut[i]] == remap[openIn[w]])
+                    kind = SEAM;
+            }
+
+            unsigned int v = i;
+            do {
+                kinds[v] = kind;
+                v = wedges[v];
+            } while (v != i);
+        }
+    }
+
+    bool canCollapse(const std::vector<VertexKind> &kinds, const std::vector<unsigned int> &openIn, const std::vector<unsigned int> &openOut,
+                     unsigned int from, unsigned int to) {
+        switch (kinds[from]) {
+        case MANIFOLD:
+            return true;
+        case BORDER:
+            return (kinds[to] == BORDER || kinds[to] == LOCKED) && (openIn[from] == to || openOut[from] == to);
+        case SEAM:
+            return (kinds[to] == SEAM || kinds[to] == LOCKED) && (openIn[from] == to || openOut[from] == to);
+        default:
+            return false;
+        }
+    }
+
+    // Would moving 'from' onto 'to' turn any of its other triangles over
+    bool flipsTriangles(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices, const TriangleAdjacency &adjacency,
+                        const std::vector<unsigned int> &remap, unsigned int from, unsigned int to) {
+        const glm::vec3 &target = vertices[to].Position;
+
+        for (unsigned int i = adjacency.offsets[from]; i < adjacency.offsets[from + 1]; ++i) {
+            const unsigned int* triangle = &indices[adjacency.triangles[i] * 3];
+
+            // Triangles on the collapsed edge disappear
+            if (remap[triangle[0]] == remap[to] || remap[triangle[1]] == remap[to] || remap[triangle[2]] == remap[to])
+                continue;
+
+            glm::vec3 corners[3], moved[3];
+            for (int c = 0; c < 3; ++c) {
+                corners[c] = vertices[triangle[c]].Position;
+                moved[c] = triangle[c] == from ? target : corners[c];
+            }
+
+            glm::vec3 before = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+            glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+
+            if (glm::dot(before, after) <= MIN_NORMAL_COSINE * glm::length(before) * glm::length(after))
+                return true;
+        }
+
+        return false;
+    }
+}
+
+
+float simplifyMesh(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices, size_t targetIndexCount,
+                   std::vector<unsigned int> &result) {
+    result = indices;
+
+    size_t vertexCount = vertices.size();
+    if (result.size() <= targetIndexCount || vertexCount == 0)
+        return 0.0f;
+
+    std::vector<unsigned int> remap, wedges;
+    buildPositionRemap(vertices, remap, wedges);
+
+    EdgeAdjacency edges;
+    edges.build(result, vertexCount);
+
+    // Open half-edges have no opposite at the attribute level: mesh borders and both sides of every seam
+    std::vector<unsigned int> openIn(vertexCount, NONE), openOut(vertexCount, NONE);
+    std::vector<Quadric> quadrics(vertexCount);
+
+    for (size_t i = 0; i + 2 < result.size(); i += 3) {
+        const glm::vec3 &p0 = vertices[result[i]].Position;
+        const glm::vec3 &p1 = vertices[result[i + 1]].Position;
+        const glm::vec3 &p2 = vertices[result[i + 2]].Position;
+
+        glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+        float length = glm::length(normal);
+        if (length == 0.0f)
+            continue;
+        normal /= length;
+
+        // Area weighted, so that many small triangles don't outweigh one large one
+        for (int c = 0; c < 3; ++c)
+            quadrics[remap[result[i + c]]].addPlane(normal, -glm::dot(normal, p0), 0.5 * length);
+
+        for (int e = 0; e < 3; ++e) {
+            unsigned int from = result[i + e], to = result[i + (e + 1) % 3];
+            if (edges.hasEdge(to, from))
+                continue;
+
+            openOut[from] = openOut[from] == NONE ? to : MULTIPLE;
+            openIn[to] = openIn[to] == NONE ? from : MULTIPLE;
+
+            // A plane through the open edge, perpendicular to the surface, keeps borders and seams from drifting
+            glm::vec3 edge = vertices[to].Position - vertices[from].Position;
+            glm::vec3 edgeNormal = glm::cross(edge, normal);
+            float edgeLength = glm::length(edgeNormal);
+            if (edgeLength == 0.0f)
+                continue;
+            edgeNormal /= edgeLength;
+
+            float distance = -glm::dot(edgeNormal, vertices[from].Position);
+            double weight = glm::dot(edge, edge) * lod::BORDER_WEIGHT;
+            quadrics[remap[from]].addPlane(edgeNormal, distance, weight);
+            quadrics[remap[to]].addPlane(edgeNormal, distance, weight);
+        }
+    }
+
+    std::vector<VertexKind> kinds;
+    classifyVertices(edges, remap, wedges, openIn, openOut, kinds);
+
+    TriangleAdjacency triangles;
+    std::vector<std::pair<unsigned int, unsigned int>> candidates;
+    std::vector<Collapse> collapses;
+    std::vector<unsigned int> collapseRemap(vertexCount);
+    std::vector<unsigned char> collapseLocked(vertexCount);
+
+    double maxError = 0.0;
+
+    while (result.size() > targetIndexCount) {
+        triangles.build(result, vertexCount);
+
+        // Every edge once, both collapse directions are weighed below
+        candidates.clear();
+        for (size_t i = 0; i + 2 < result.size(); i += 3) {
+            for (int e = 0; e < 3; ++e) {
+                unsigned int a = result[i + e], b = result[i + (e + 1) % 3];
+                if (remap[a] != remap[b])
+                    candidates.push_back(std::make_pair(std::min(a, b), std::max(a, b)));
+            }
+        }
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+        collapses.clear();
+        for (const auto &edge : candidates) {
+            bool forward = canCollapse(kinds, openIn, openOut, edge.first, edge.second);
+            bool backward = canCollapse(kinds, openIn, openOut, edge.second, edge.first);
+
+            double forwardCost = forward ? quadrics[remap[edge.first]].error(vertices[edge.second].Position) : 0.0;
+            double backwardCost = backward ? quadrics[remap[edge.second]].error(vertices[edge.first].Position) : 0.0;
+
+            if (forward && (!backward || forwardCost <= backwardCost))
+                collapses.push_back({ edge.first, edge.second, forwardCost });
+            else if (backward)
+                collapses.push_back({ edge.second, edge.first, backwardCost });
+        }
+
+        if (collapses.empty())
+            break;
+
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse &a, const Collapse &b) {
+            return a.cost < b.cost;
+        });
+
+        // An interior collapse removes two triangles. Only the cheap part of the edges is used per pass,
+        // the rest are re-evaluated with the updated quadrics next time.
+        size_t trianglesToRemove = (result.size() - targetIndexCount) / 3;
+        size_t collapseGoal = std::max<size_t>(trianglesToRemove / 2, 1);
+        double errorGoal = collapseGoal < collapses.size() ? collapses[collapseGoal].cost * PASS_ERROR_BOUND : collapses.back().cost;
+
+        std::iota(collapseRemap.begin(), collapseRemap.end(), 0u);
+        std::fill(collapseLocked.begin(), collapseLocked.end(), 0);
+
+        size_t removed = 0;
+        size_t collapseCount = 0;
+        for (const Collapse &collapse : collapses) {
+            if (removed >= trianglesToRemove)
+                break;
+            if (collapse.cost > errorGoal && removed > trianglesToRemove / 10)
+                break;
+
+            unsigned int from = collapse.from, to = collapse.to;
+            unsigned int fromPosition = remap[from], toPosition = remap[to];
+
+            // Vertices next to a collapse this pass have stale quadrics and triangles
+            if (collapseLocked[fromPosition] || collapseLocked[toPosition])
+                continue;
+
+            // The other side of a seam follows along its own open edge to the matching wedge of 'to'
+            unsigned int sibling = NONE, siblingTo = NONE;
+            if (kinds[from] == SEAM) {
+                sibling = wedges[from];
+                siblingTo = to == openOut[from] ? openIn[sibling] : openOut[sibling];
+            }
+
+            if (flipsTriangles(vertices, result, triangles, remap, from, to) ||
+                (sibling != NONE && flipsTriangles(vertices, result, triangles, remap, sibling, siblingTo)))
+                continue;
+
+            collapseRemap[from] = to;
+            if (sibling != NONE)
+                collapseRemap[sibling] = siblingTo;
+
+            // Keep the open edge links of borders and seams pointing at vertices that still exist
+            auto relink = [&](unsigned int vertex, unsigned int target) {
+                if (target == openOut[vertex]) {
+                    unsigned int previous = openIn[vertex];
+                    openIn[target] = previous;
+                    if (isSingle(previous) && kinds[previous] != LOCKED)
+                        openOut[previous] = target;
+                }
+                else {
+                    unsigned int next = openOut[vertex];
+                    openOut[target] = next;
+                    if (isSingle(next) && kinds[next] != LOCKED)
+                        openIn[next] = target;
+                }
+            };
+            if (kinds[from] == BORDER || kinds[from] == SEAM)
+                relink(from, to);
+            if (sibling != NONE)
+                relink(sibling, siblingTo);
+
+            collapseLocked[fromPosition] = collapseLocked[toPosition] = 1;
+            quadrics[toPosition].add(quadrics[fromPosition]);
+
+            maxError = std::max(maxError, collapse.cost);
+            removed += kinds[from] == BORDER ? 1 : 2;
+            ++collapseCount;
+        }
+
+        if (collapseCount == 0)
+            break;
+
+        // Apply the collapses and drop the triangles that became degenerate
+        size_t write = 0;
+        for (size_t i = 0; i + 2 < result.size(); i += 3) {
+            unsigned int a = collapseRemap[result[i]], b = collapseRemap[result[i + 1]], c = collapseRemap[result[i + 2]];
+            if (remap[a] == remap[b] || remap[b] == remap[c] || remap[c] == remap[a])
+                continue;
+
+            result[write++] = a;
+            result[write++] = b;
+            result[write++] = c;
+        }
+        result.resize(write);
+    }
+
+    return static_cast<float>(std::sqrt(maxError));
+}
+
+void generateLods(const std::vector<Vertex> &vertices, std::vector<unsigned int> &indices, std::vector<MeshLod> &lods) {
+    lods.clear();
+
+    if (indices.size() / 3 < 2 * lod::MIN_TRIANGLES)
+        return;
+
+    // Every level is simplified from full detail, so that its error is measured against the real surface
+    std::vector<unsigned int> base(indices);
+    std::vector<unsigned int> level;
+
+    lods.push_back({ 0, indices.size(), 0.0f });
+
+    while (lods.size() < lod::MAX_LEVELS) {
+        size_t target = static_cast<size_t>(lods.back().indexCount / 3 * lod::REDUCTION) * 3;
+        if (target / 3 < lod::MIN_TRIANGLES)
+            break;
+
+        float error = simplifyMesh(vertices, base, target, level);
+
+        // Stuck on locked borders and seams: a level that saves little isn't worth its index range
+        if (level.size() > lods.back().indexCount * 9 / 10)
+            break;
+
+        optimizeVertexCache(level, vertices.size());
+
+        // Selection walks the levels expecting the error to grow
+        lods.push_back({ indices.size(), level.size(), std::max(error, lods.back().error) });
+        indices.insert(indices.end(), level.begin(), level.end());
+    }
+
+    if (lods.size() == 1)
+        lods.clear();
+}
\ No newline at end of file
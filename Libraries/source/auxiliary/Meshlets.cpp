@@ -0,0 +1,235 @@
+#include "auxiliary/Meshlets.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace mlt {
+    bool CULLING = true;
+}
+
+
+namespace {
+    void computeBounds(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices, Meshlet &meshlet) {
+        glm::vec3 boundsMin = vertices[indices[meshlet.indexOffset]].Position;
+        glm::vec3 boundsMax = boundsMin;
+
+        for (size_t i = meshlet.indexOffset; i < meshlet.indexOffset + meshlet.indexCount; ++i) {
+            boundsMin = glm::min(boundsMin, vertices[indices[i]].Position);
+            boundsMax = glm::max(boundsMax, vertices[indices[i]].Position);
+        }
+
+        // Centered on the box; a little looser than the minimal sphere, but cheap
+        meshlet.center = 0.5f * (boundsMin + boundsMax);
+        meshlet.radius = 0.0f;
+        for (size_t i = meshlet.indexOffset; i < meshlet.indexOffset + meshlet.indexCount; ++i)
+            meshlet.radius = std::max(meshlet.radius, glm::length(vertices[indices[i]].Position - meshlet.center));
+
+        // Normal cone from the unit triangle normals
+        glm::vec3 axis(0.0f);
+        std::vector<glm::vec3> normals;
+        normals.reserve(meshlet.indexCount / 3);
+
+        for (size_t i = meshlet.indexOffset; i + 2 < meshlet.indexOffset + meshlet.indexCount; i += 3) {
+            const glm::vec3 &p0 = vertices[indices[i]].Position;
+            glm::vec3 normal = glm::cross(vertices[indices[i + 1]].Position - p0, vertices[indices[i + 2]].Position - p0);
+
+            float length = glm::length(normal);
+            if (length == 0.0f)
+                continue;
+
+            normals.push_back(normal / length);
+            axis += normals.back();
+        }
+
+        meshlet.coneAxis = glm::vec3(0.0f);
+        meshlet.coneCutoff = 1.0f;
+
+        float axisLength = glm::length(axis);
+        if (axisLength == 0.0f)
+            return;
+        axis /= axisLength;
+
+        float minCosine = 1.0f;
+        for (const glm::vec3 &normal : normals)
+            minCosine = std::min(minCosine, glm::dot(normal, axis));
+
+        if (minCosine <= mlt::MIN_CONE_COSINE)
+            return;
+
+        meshlet.coneAxis = axis;
+        meshlet.coneCutoff = std::sqrt(1.0f - minCosine * minCosine);
+    }
+}
+
+
+MeshletCullView MeshletCullView::make(const glm::mat4 &modelMatrix, const glm::mat4 &view, const glm::mat4 &projection) {
+    MeshletCullView cullView;
+
+    // Gribb-Hartmann: the planes of the clip volume in the space the matrix starts from
+    glm::mat4 clip = projection * view * modelMatrix;
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; ++i)
+        rows[i] = glm::vec4(clip[0][i], clip[1][i], clip[2][i], clip[3][i]);
+
+    cullView.planes[0] = rows[3] + rows[0];
+    cullView.planes[1] = rows[3] - rows[0];
+    cullView.planes[2] = rows[3] + rows[1];
+    cullView.planes[3] = rows[3] - rows[1];
+    cullView.planes[4] = rows[3] + rows[2];
+    cullView.planes[5] = rows[3] - rows[2];
+    for (glm::vec4 &plane : cullView.planes)
+        plane /= glm::length(glm::vec3(plane));
+
+    glm::mat4 toObject = glm::inverse(modelMatrix);
+    glm::mat4 cameraToWorld = glm::inverse(view);
+
+    cullView.cameraPosition = glm::vec3(toObject * cameraToWorld[3]);
+    cullView.viewDirection = glm::vec3(toObject * -cameraToWorld[2]);
+    cullView.orthographic = projection[2][3] == 0.0f;
+    cullView.coneCulling = glm::determinant(glm::mat3(modelMatrix)) > 0.0f;
+
+    return cullView;
+}
+
+void buildMeshlets(const std::vector<Vertex> &vertices, std::vector<unsigned int> &indices, size_t indexOffset, size_t indexCount,
+                   std::vector<Meshlet> &meshlets) {
+    size_t triangleCount = indexCount / 3;
+    size_t firstMeshlet = meshlets.size();
+    if (triangleCount == 0)
+        return;
+
+    const unsigned int* source = &indices[indexOffset];
+
+    // Triangles using each vertex, CSR style
+    std::vector<unsigned int> offsets(vertices.size() + 1, 0);
+    for (size_t i = 0; i < triangleCount * 3; ++i)
+        ++offsets[source[i] + 1];
+    for (size_t i = 0; i < vertices.size(); ++i)
+        offsets[i + 1] += offsets[i];
+
+    std::vector<unsigned int> vertexTriangles(triangleCount * 3);
+    std::vector<unsigned int> cursor(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < triangleCount * 3; ++i)
+        vertexTriangles[cursor[source[i]]++] = static_cast<unsigned int>(i / 3);
+
+    std::vector<glm::vec3> centroids(triangleCount);
+    for (size_t t = 0; t < triangleCount; ++t)
+        centroids[t] = (vertices[source[t * 3]].Position + vertices[source[t * 3 + 1]].Position + vertices[source[t * 3 + 2]].Position) / 3.0f;
+
+    std::vector<unsigned char> emitted(triangleCount, 0);
+    // Meshlet number + 1 that last used each vertex, so the set doesn't have to be cleared
+    std::vector<size_t> usedBy(vertices.size(), 0);
+
+    std::vector<unsigned int> ordered;
+    ordered.reserve(triangleCount * 3);
+    std::vector<unsigned int> meshletVertices;
+    meshletVertices.reserve(mlt::MAX_VERTICES);
+
+    size_t stamp = 0;
+    size_t nextSeed = 0;
+    unsigned int seed = ~0u;
+
+    while (ordered.size() < triangleCount * 3) {
+        if (seed == ~0u) {
+            while (emitted[nextSeed])
+                ++nextSeed;
+            seed = static_cast<unsigned int>(nextSeed);
+        }
+
+        Meshlet meshlet;
+        meshlet.indexOffset = indexOffset + ordered.size();
+        meshletVertices.clear();
+        ++stamp;
+
+        glm::vec3 centroidSum(0.0f);
+        unsigned int triangle = seed;
+
+        // Grow the meshlet over its neighbours: first by how few vertices a triangle adds, then by how close it is
+        while (triangle != ~0u) {
+            emitted[triangle] = 1;
+            for (int c = 0; c < 3; ++c) {
+                unsigned int vertex = source[triangle * 3 + c];
+                ordered.push_back(vertex);
+
+                if (usedBy[vertex] != stamp) {
+                    usedBy[vertex] = stamp;
+                    meshletVertices.push_back(vertex);
+                }
+            }
+            meshlet.indexCount += 3;
+            centroidSum += centroids[triangle];
+
+            triangle = ~0u;
+            if (meshlet.indexCount / 3 >= mlt::MAX_TRIANGLES)
+                break;
+
+            glm::vec3 center = centroidSum / static_cast<float>(meshlet.indexCount / 3);
+            int bestExtra = 3;
+            float bestDistance = 0.0f;
+
+            for (unsigned int vertex : meshletVertices) {
+                for (unsigned int i = offsets[vertex]; i < offsets[vertex + 1]; ++i) {
+                    unsigned int candidate = vertexTriangles[i];
+                    if (emitted[candidate])
+                        continue;
+
+                    int extra = 0;
+                    for (int c = 0; c < 3; ++c)
+                        extra += usedBy[source[candidate * 3 + c]] != stamp ? 1 : 0;
+
+                    if (meshletVertices.size() + extra > mlt::MAX_VERTICES)
+                        continue;
+
+                    float distance = glm::length(centroids[candidate] - center);
+                    if (triangle == ~0u || extra < bestExtra || (extra == bestExtra && distance < bestDistance)) {
+                        triangle = candidate;
+                        bestExtra = extra;
+                        bestDistance = distance;
+                    }
+                }
+            }
+        }
+
+        // The next meshlet starts next to this one, so that the order stays spatially coherent
+        seed = ~0u;
+        float seedDistance = 0.0f;
+        glm::vec3 center = centroidSum / static_cast<float>(meshlet.indexCount / 3);
+        for (unsigned int vertex : meshletVertices) {
+            for (unsigned int i = offsets[vertex]; i < offsets[vertex + 1]; ++i) {
+                unsigned int candidate = vertexTriangles[i];
+                float distance = glm::length(centroids[candidate] - center);
+                if (!emitted[candidate] && (seed == ~0u || distance < seedDistance)) {
+                    seed = candidate;
+                    seedDistance = distance;
+                }
+            }
+        }
+
+        meshlets.push_back(meshlet);
+    }
+
+    std::copy(ordered.begin(), ordered.end(), indices.begin() + indexOffset);
+
+    for (size_t m = firstMeshlet; m < meshlets.size(); ++m)
+        computeBounds(vertices, indices, meshlets[m]);
+}
+
+bool isMeshletVisible(const Meshlet &meshlet, const MeshletCullView &view) {
+    for (const glm::vec4 &plane : view.planes) {
+        if (glm::dot(glm::vec3(plane), meshlet.center) + plane.w < -meshlet.radius)
+            return false;
+    }
+
+    if (!view.coneCulling || meshlet.coneCutoff >= 1.0f)
+        return true;
+
+    // Back-facing if every direction from the eye to the sphere lies inside the cone's complement
+    if (view.orthographic) {
+        glm::vec3 direction = glm::normalize(view.viewDirection);
+        return glm::dot(direction, meshlet.coneAxis) < meshlet.coneCutoff;
+    }
+
+    glm::vec3 toCenter = meshlet.center - view.cameraPosition;
+    return glm::dot(toCenter, meshlet.coneAxis) < meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius;
+}
\ No newline at end of file
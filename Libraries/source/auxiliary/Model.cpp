@@ -1,153 +1,1015 @@
 #include "auxiliary/Model.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <limits>
+#include <map>
+#include <utility>
+
+
+namespace mdl {
+    TextureUploader *TEXTURE_UPLOADER = nullptr;
+    TextureStreamer *TEXTURE_STREAMER = nullptr;
+    VirtualTextureSystem *VIRTUAL_TEXTURES = nullptr;
+    MeshRetention RETENTION = MeshRetention::KEEP;
+    VertexFormat VERTEX_FORMAT = VertexFormat::FLOAT;
+    bool OPTIMIZE_MESHES = true;
+    bool BATCH_MESHES = true;
+    bool GENERATE_LODS = true;
+    bool BUILD_MESHLETS = true;
+    bool NATIVE_GLTF = true;
+    bool NATIVE_OBJ = true;
+}
+
+
+namespace {
+    // Why a native importer hands a model to Assimp when it is asked for post-processing it doesn't do
+    std::string unsupportedFlagsError(unsigned int flags) {
+        char hex[16];
+        std::snprintf(hex, sizeof(hex), "%#x", flags);
+        return std::string("unsupported post-processing flags ") + hex;
+    }
+}
+
+
+Model::Model(ModelData &&data) {
+    auto startTime = std::chrono::steady_clock::now();
+
+    directory = std::move(data.directory);
+    loadedFromCache = data.fromCache;
+    importTimeMs = data.importTimeMs;
+    fileReads = std::move(data.fileReads);
+
+    // Textures are shared between meshes and models through the texture cache; only the first user uploads them
+    TextureCache &textureCache = TextureCache::shared();
+    TextureArrayManager &textureArrays = TextureArrayManager::shared();
+
+    texturesLoaded.reserve(data.textures.size());
+    for (size_t i = 0; i < data.textures.size(); ++i) {
+        DecodedImage &image = data.images[i];
+        bool isVirtual = data.virtualImages[i];
+
+        Texture texture;
+        texture.type = data.textures[i].type;
+        texture.path = data.textures[i].path;
+
+        // Material textures go into a layer of their slot's array instead, uploaded right away: the uploader and the streamer
+        // work on 2D textures of their own
+        int slot = materialSlotFromType(texture.type);
+        if (ta::ENABLED && slot >= 0 && !isVirtual) {
+            TextureLayer layer = textureArrays.acquire(slot, data.textureKeys[i], data.textureHashes[i], image);
+            texture.id = layer.array;
+            texture.layer = layer.layer;
+
+            texturesLoaded.push_back(texture);
+            continue;
+        }
+
+        texture.id = textureCache.acquire(data.textureKeys[i], data.textureHashes[i], [&image, isVirtual](size_t &byteSize) {
+            // Virtual textures only take their page table; their tiles live in the system's shared cache
+            if (isVirtual && mdl::VIRTUAL_TEXTURES) {
+                if (unsigned int pageTable = mdl::VIRTUAL_TEXTURES->create(image.path)) {
+                    byteSize = 0;
+                    return pageTable;
+                }
+            }
+
+            // Streamed textures load their levels in the background, decoding the image themselves if it isn't yet
+            if (mdl::TEXTURE_STREAMER) {
+                byteSize = 0;
+                return mdl::TEXTURE_STREAMER->create(std::move(image));
+            }
+
+            // Skipped at import because it was resident, but released since then
+            if (!image.isLoaded())
+                image = decodeImage(image.path);
+
+            byteSize = image.getByteSize();
+            return mdl::TEXTURE_UPLOADER ? mdl::TEXTURE_UPLOADER->enqueue(std::move(image)) : uploadTexture(image);
+        });
+        if (mdl::VIRTUAL_TEXTURES)
+            texture.virtualTexture = mdl::VIRTUAL_TEXTURES->find(texture.id);
+
+        texturesLoaded.push_back(texture);
+    }
+
+    meshes.reserve(data.meshes.size());
+    for (MeshData &meshData : data.meshes) {
+        sourceMeshCount += meshData.sourceMeshCount;
+
+        std::vector<Texture> textures;
+        textures.reserve(meshData.textureIndices.size());
+
+        std::vector<unsigned int> textureIDs;
+        for (size_t index : meshData.textureIndices) {
+            textures.push_back(texturesLoaded[index]);
+            // Array handles aren't GL textures and could match a page table
+            if (texturesLoaded[index].layer < 0)
+                textureIDs.push_back(texturesLoaded[index].id);
+        }
+
+        if (meshData.vertexData)
+            meshes.emplace_back(data.cacheFile, meshData.vertexData, meshData.vertexCount, meshData.indexData, meshData.indexCount, std::move(textures),
+                                mdl::VERTEX_FORMAT, data.attributes, std::move(meshData.lods), std::move(meshData.meshlets));
+        else
+            meshes.emplace_back(std::move(meshData.vertices), std::move(meshData.indices), std::move(textures), mdl::VERTEX_FORMAT, data.attributes,
+                                std::move(meshData.lods), std::move(meshData.meshlets));
+
+        meshes.back().applyRetention(mdl::RETENTION);
+        if (mdl::VIRTUAL_TEXTURES)
+            meshes.back().setVirtualMaterial(mdl::VIRTUAL_TEXTURES->getMaterial(textureIDs));
+    }
+
+    loadTimeMs = importTimeMs + std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+Model::~Model() {
+    releaseTextures();
+    glDeleteBuffers(1, &instanceBuffer);
+}
+
+Model::Model(Model &&other) noexcept
+    : meshes(std::move(other.meshes)), directory(std::move(other.directory)), texturesLoaded(std::move(other.texturesLoaded)),
+      sourceMeshCount(other.sourceMeshCount), instanceBuffer(other.instanceBuffer), instanceBufferCapacity(other.instanceBufferCapacity),
+      loadedFromCache(other.loadedFromCache), importTimeMs(other.importTimeMs), loadTimeMs(other.loadTimeMs), fileReads(std::move(other.fileReads))
+{
+    other.texturesLoaded.clear();
+    other.instanceBuffer = 0;
+    other.instanceBufferCapacity = 0;
+}
+
+Model& Model::operator=(Model &&other) noexcept {
+    if (this != &other) {
+        releaseTextures();
+
+        meshes = std::move(other.meshes);
+        directory = std::move(other.directory);
+        texturesLoaded = std::move(other.texturesLoaded);
+        sourceMeshCount = other.sourceMeshCount;
+        loadedFromCache = other.loadedFromCache;
+        importTimeMs = other.importTimeMs;
+        loadTimeMs = other.loadTimeMs;
+        fileReads = std::move(other.fileReads);
+
+        glDeleteBuffers(1, &instanceBuffer);
+        instanceBuffer = other.instanceBuffer;
+        instanceBufferCapacity = other.instanceBufferCapacity;
+
+        other.texturesLoaded.clear();
+        other.instanceBuffer = 0;
+        other.instanceBufferCapacity = 0;
+    }
+
+    return *this;
+}
+
+void Model::applyRetention(MeshRetention retention) {
+    for (Mesh &mesh : meshes)
+        mesh.applyRetention(retention);
+}
+
+size_t Model::getCpuBytes() const {
+    size_t bytes = 0;
+    for (const Mesh &mesh : meshes)
+        bytes += mesh.getCpuBytes();
+
+    return bytes;
+}
+
+size_t Model::getGeometryGpuBytes() const {
+    size_t bytes = 0;
+    for (const Mesh &mesh : meshes)
+        bytes += mesh.getGpuBytes();
+
+    return bytes;
+}
+
+size_t Model::getDrawnTriangleCount() const {
+    size_t count = 0;
+    for (const Mesh &mesh : meshes)
+        count += mesh.getDrawnIndexCount() / 3;
+
+    return count;
+}
+
+size_t Model::getTriangleCount() const {
+    size_t count = 0;
+    for (const Mesh &mesh : meshes)
+        count += mesh.getLodIndexCount(0) / 3;
+
+    return count;
+}
+
+size_t Model::getShortIndexMeshCount() const {
+    size_t count = 0;
+    for (const Mesh &mesh : meshes)
+        count += mesh.getIndexType() == GL_UNSIGNED_SHORT ? 1 : 0;
+
+    return count;
+}
+
+size_t Model::getTextureGpuBytes() const {
+    const TextureCache &textureCache = TextureCache::shared();
+
+    size_t bytes = 0;
+    for (const Texture &texture : texturesLoaded) {
+        // Virtual textures hold their page table, the tiles are counted by the system; streamed ones whatever levels are resident right now
+        if (texture.layer >= 0)
+            bytes += TextureArrayManager::shared().getLayerBytes(texture.id);
+        else if (texture.virtualTexture)
+            bytes += texture.virtualTexture->getPageTableBytes();
+        else if (mdl::TEXTURE_STREAMER && mdl::TEXTURE_STREAMER->isStreamed(texture.id))
+            bytes += mdl::TEXTURE_STREAMER->getResidentBytes(texture.id);
+        else
+            bytes += textureCache.getByteSize(texture.id);
+    }
+
+    return bytes;
+}
+
+void Model::releaseTextures() {
+    TextureCache &textureCache = TextureCache::shared();
+
+    for (const Texture &texture : texturesLoaded) {
+        if (texture.layer >= 0) {
+            TextureArrayManager::shared().release({ texture.id, texture.layer });
+            continue;
+        }
+
+        // The last reference is gone: make sure the uploader and the streamer don't stream into a deleted texture
+        if (textureCache.release(texture.id)) {
+            if (mdl::TEXTURE_UPLOADER)
+                mdl::TEXTURE_UPLOADER->cancel(texture.id);
+            if (mdl::TEXTURE_STREAMER)
+                mdl::TEXTURE_STREAMER->release(texture.id);
+            if (mdl::VIRTUAL_TEXTURES)
+                mdl::VIRTUAL_TEXTURES->release(texture.id);
+        }
+    }
+
+    texturesLoaded.clear();
+}
 
 void Model::Draw(const ShaderProgram &shaderProgram) {
     shaderProgram.use();
 
     for (unsigned int i = 0; i < meshes.size(); ++i)
         meshes[i].Draw(shaderProgram);
+
+    glBindVertexArray(0);
 }
 
-void Model::loadModel(const std::string &path, unsigned int flags) {
-    Assimp::Importer importer;
-    const aiScene* scene = importer.ReadFile(path, flags);
+void Model::DrawInstanced(const ShaderProgram &shaderProgram, ArrayView<InstanceData> instances) {
+    if (instances.empty())
+        return;
+
+    shaderProgram.use();
+
+    if (!instanceBuffer)
+        glGenBuffers(1, &instanceBuffer);
+
+    // Grown to the largest instance count seen so far, then only rewritten
+    size_t bytes = instances.size() * sizeof(InstanceData);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    if (bytes > instanceBufferCapacity) {
+        glBufferData(GL_ARRAY_BUFFER, bytes, instances.data(), GL_STREAM_DRAW);
+        instanceBufferCapacity = bytes;
+    }
+    else
+        glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, instances.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    for (Mesh &mesh : meshes)
+        mesh.DrawInstanced(shaderProgram, instanceBuffer, instances.size());
+
+    glBindVertexArray(0);
+}
+
+void Model::selectLod(const glm::mat4 &modelMatrix, const glm::vec3 &cameraPosition, const glm::mat4 &projection, float viewportHeight) {
+    // Errors are in object space; the largest axis scale turns them into world units
+    float scale = std::sqrt(std::max(std::max(glm::dot(glm::vec3(modelMatrix[0]), glm::vec3(modelMatrix[0])),
+                                              glm::dot(glm::vec3(modelMatrix[1]), glm::vec3(modelMatrix[1]))),
+                                     glm::dot(glm::vec3(modelMatrix[2]), glm::vec3(modelMatrix[2]))));
+
+    // projection[1][1] is cot(fovY / 2) for a perspective projection and 2 / height for an orthographic one
+    bool perspective = projection[2][3] != 0.0f;
+    float pixelsPerUnit = 0.5f * viewportHeight * projection[1][1] * scale;
+
+    for (Mesh &mesh : meshes) {
+        if (mesh.getLodCount() == 1)
+            continue;
+
+        float pixels = pixelsPerUnit;
+        if (perspective) {
+            // Measured at the point of the bounding sphere closest to the camera, so a level never pops in up close
+            glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(0.5f * (mesh.getBoundsMin() + mesh.getBoundsMax()), 1.0f));
+            float radius = 0.5f * glm::length(mesh.getBoundsMax() - mesh.getBoundsMin()) * scale;
+            float distance = glm::length(center - cameraPosition) - radius;
+
+            pixels = distance > 0.0f ? pixelsPerUnit / distance : std::numeric_limits<float>::max();
+        }
 
-    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
-        std::cout << "ERROR::ASSIMP::" << importer.GetErrorString() << std::endl;
+        mesh.selectLod(pixels, lod::PIXEL_ERROR);
+    }
+}
+
+void Model::selectLod(ArrayView<InstanceData> instances, const glm::vec3 &cameraPosition, const glm::mat4 &projection, float viewportHeight) {
+    if (instances.empty())
+        return;
+
+    std::vector<size_t> finest(meshes.size(), std::numeric_limits<size_t>::max());
+    for (const InstanceData &instance : instances) {
+        selectLod(instance.model, cameraPosition, projection, viewportHeight);
+
+        for (size_t i = 0; i < meshes.size(); ++i)
+            finest[i] = std::min(finest[i], meshes[i].getLodLevel());
+    }
+
+    for (size_t i = 0; i < meshes.size(); ++i)
+        meshes[i].setLodLevel(finest[i]);
+}
+
+void Model::requestTextureDetail(const glm::mat4 &modelMatrix, const glm::vec3 &cameraPosition, const glm::mat4 &projection, float viewportHeight) {
+    if (!mdl::TEXTURE_STREAMER || meshes.empty())
         return;
+
+    glm::vec3 boundsMin = meshes.front().getBoundsMin();
+    glm::vec3 boundsMax = meshes.front().getBoundsMax();
+    for (const Mesh &mesh : meshes) {
+        boundsMin = glm::min(boundsMin, mesh.getBoundsMin());
+        boundsMax = glm::max(boundsMax, mesh.getBoundsMax());
+    }
+
+    // Same measure as selectLod, but of the whole model: its textures cover all of it
+    float scale = std::sqrt(std::max(std::max(glm::dot(glm::vec3(modelMatrix[0]), glm::vec3(modelMatrix[0])),
+                                              glm::dot(glm::vec3(modelMatrix[1]), glm::vec3(modelMatrix[1]))),
+                                     glm::dot(glm::vec3(modelMatrix[2]), glm::vec3(modelMatrix[2]))));
+    float radius = 0.5f * glm::length(boundsMax - boundsMin) * scale;
+    float pixels = viewportHeight * projection[1][1] * radius;
+
+    if (projection[2][3] != 0.0f) {
+        glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(0.5f * (boundsMin + boundsMax), 1.0f));
+        float distance = glm::length(center - cameraPosition) - radius;
+
+        pixels = distance > 0.0f ? pixels / distance : std::numeric_limits<float>::max();
+    }
+
+    for (const Texture &texture : texturesLoaded) {
+        if (texture.layer < 0)
+            mdl::TEXTURE_STREAMER->request(texture.id, pixels);
     }
-    directory = path.substr(0, path.find_last_of('\\'));
+}
 
-    processNode(scene->mRootNode, scene);
+void Model::requestTextureDetail(ArrayView<InstanceData> instances, const glm::vec3 &cameraPosition, const glm::mat4 &projection, float viewportHeight) {
+    // The streamer keeps the largest request of a frame
+    for (const InstanceData &instance : instances)
+        requestTextureDetail(instance.model, cameraPosition, projection, viewportHeight);
 }
 
-void Model::processNode(aiNode *node, const aiScene *scene) {
+void Model::cullMeshlets(const glm::mat4 &modelMatrix, const glm::mat4 &view, const glm::mat4 &projection) {
+    if (!mlt::CULLING)
+        return;
+
+    MeshletCullView cullView = MeshletCullView::make(modelMatrix, view, projection);
+    for (Mesh &mesh : meshes)
+        mesh.cullMeshlets(cullView);
+}
+
+ModelData Model::importData(const std::string &path, unsigned int flags, unsigned int attributes) {
+    auto startTime = std::chrono::steady_clock::now();
+
+    int removedComponents = 0;
+
+    ModelData data;
+    data.path = path;
+    data.flags = importFlags(flags, attributes, removedComponents);
+    data.attributes = attributes;
+    data.directory = path.substr(0, path.find_last_of('\\'));
+
+    // Warm start: skip Assimp if there is a valid processed copy of this model on disk
+    std::string cachePath;
+    MeshCacheKey cacheKey;
+    if (mc::ENABLED) {
+        cacheKey.sourceHash = hashSourceFiles(path);
+        cacheKey.flags = data.flags;
+        cacheKey.attributes = attributes;
+        cacheKey.options = (mdl::OPTIMIZE_MESHES ? mc::OPTION_OPTIMIZED : 0) | (mdl::BATCH_MESHES ? mc::OPTION_BATCHED : 0) |
+                           (mdl::GENERATE_LODS ? mc::OPTION_LODS : 0) | (mdl::BUILD_MESHLETS ? mc::OPTION_MESHLETS : 0) |
+                           (mdl::NATIVE_OBJ && isObjPath(path) ? mc::OPTION_NATIVE_OBJ : 0) |
+                           (mdl::NATIVE_GLTF && isGltfPath(path) ? mc::OPTION_NATIVE_GLTF : 0);
+        cachePath = meshCachePath(path, cacheKey);
+
+        if (cacheKey.sourceHash != 0 && loadFromCache(data, cachePath, cacheKey))
+            data.fromCache = true;
+    }
+
+    if (!data.fromCache) {
+        auto sceneStartTime = std::chrono::steady_clock::now();
+
+        std::string gltfError;
+        data.nativeLoader = mdl::NATIVE_GLTF && isGltfPath(path) && importGltf(data, gltfError);
+        if (!gltfError.empty())
+            std::cout << "ERROR::GLTF::" << gltfError << ", importing " << path << " with Assimp" << std::endl;
+
+        std::string objError;
+        if (!data.nativeLoader)
+            data.nativeLoader = mdl::NATIVE_OBJ && isObjPath(path) && importObj(data, objError);
+        if (!objError.empty())
+            std::cout << "ERROR::OBJ::" << objError << ", importing " << path << " with Assimp" << std::endl;
+
+        if (!data.nativeLoader) {
+            Assimp::Importer importer;
+            if (removedComponents != 0)
+                importer.SetPropertyInteger(AI_CONFIG_PP_RVC_FLAGS, removedComponents);
+
+            // The importer owns and deletes the file system, so its statistics are copied out while the importer is alive
+            MappedIOSystem *ioSystem = mio::ENABLED ? new MappedIOSystem() : nullptr;
+            if (ioSystem)
+                importer.SetIOHandler(ioSystem);
+
+            const aiScene* scene = importer.ReadFile(path, data.flags);
+            if (ioSystem)
+                data.fileReads = ioSystem->getFileStats();
+
+            if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
+                std::cout << "ERROR::ASSIMP::" << importer.GetErrorString() << std::endl;
+                return data;
+            }
+
+            processNode(data, scene->mRootNode, scene);
+        }
+
+        data.sceneTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - sceneStartTime).count();
+
+        MeshCacheWriter writer;
+        MeshCacheWriter* cacheWriter = (mc::ENABLED && cacheKey.sourceHash != 0) ? &writer : nullptr;
+
+        if (mdl::BATCH_MESHES)
+            batchMeshes(data.meshes);
+
+        // Optimized after batching, so the vertex cache order spans the merged mesh
+        for (MeshData &meshData : data.meshes) {
+            if (mdl::OPTIMIZE_MESHES && meshData.trianglesOnly)
+                data.optimizationStats.add(optimizeMesh(meshData.vertices, meshData.indices));
+
+            // Levels share the vertices, so they come after welding and the fetch remap
+            if (mdl::GENERATE_LODS && meshData.trianglesOnly)
+                generateLods(meshData.vertices, meshData.indices, meshData.lods);
+
+            if (mdl::BUILD_MESHLETS && meshData.trianglesOnly) {
+                if (meshData.lods.empty())
+                    buildMeshlets(meshData.vertices, meshData.indices, 0, meshData.indices.size(), meshData.meshlets);
+                for (const MeshLod &lod : meshData.lods)
+                    buildMeshlets(meshData.vertices, meshData.indices, lod.indexOffset, lod.indexCount, meshData.meshlets);
+            }
+
+            if (cacheWriter) {
+                std::vector<TextureRef> textures;
+                for (size_t index : meshData.textureIndices)
+                    textures.push_back(data.textures[index]);
+
+                cacheWriter->addMesh(meshData.vertices.data(), meshData.vertices.size(), meshData.indices.data(), meshData.indices.size(),
+                                     textures, meshData.sourceMeshCount, meshData.lods, meshData.meshlets);
+            }
+        }
+
+        if (cacheWriter)
+            writer.save(cachePath, cacheKey);
+    }
+
+    // Decoding is the expensive part of texture loading, so it's done here rather than at upload time.
+    // Images some other model has already loaded are skipped.
+    TextureCache &textureCache = TextureCache::shared();
+    const TextureArrayManager &textureArrays = TextureArrayManager::shared();
+
+    size_t textureCount = data.textures.size();
+    data.textureKeys.resize(textureCount);
+    data.textureHashes.resize(textureCount, 0);
+    data.images.resize(textureCount);
+    data.virtualImages.resize(textureCount, false);
+
+    std::vector<std::string> decodePaths;
+    std::vector<size_t> decodeIndices;
+    for (size_t i = 0; i < textureCount; ++i) {
+        std::string fullPath = data.directory + '\\' + data.textures[i].path;
+
+        data.textureKeys[i] = TextureCache::normalizePath(fullPath);
+        if (tc::HASH_CONTENTS)
+            data.textureHashes[i] = hashFileContents(fullPath);
+        data.images[i].path = fullPath;
+        data.virtualImages[i] = mdl::VIRTUAL_TEXTURES && isVirtualTextureCandidate(fullPath);
+
+        int slot = materialSlotFromType(data.textures[i].type);
+        bool resident = ta::ENABLED && slot >= 0 ? textureArrays.contains(slot, data.textureKeys[i], data.textureHashes[i])
+                                                 : textureCache.contains(data.textureKeys[i], data.textureHashes[i]);
+        if (!data.virtualImages[i] && !resident) {
+            decodePaths.push_back(fullPath);
+            decodeIndices.push_back(i);
+        }
+    }
+
+    std::vector<DecodedImage> decoded = decodeImages(decodePaths);
+    if (imgdec::LOG_TIMINGS)
+        logDecodeTimings(path, decoded);
+
+    for (size_t i = 0; i < decoded.size(); ++i)
+        data.images[decodeIndices[i]] = std::move(decoded[i]);
+
+    data.valid = true;
+    data.importTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+    return data;
+}
+
+uint64_t Model::hashSourceFiles(const std::string &path) {
+    uint64_t hash = hashFileContents(path);
+    if (hash == 0)
+        return 0;
+
+    std::vector<std::string> dependencies;
+    if (isGltfPath(path))
+        dependencies = getGltfBufferPaths(path);
+    else if (isObjPath(path))
+        dependencies = getObjLibraryPaths(path);
+
+    // A missing file hashes to 0, which still changes the key once it appears
+    for (const std::string &dependency : dependencies) {
+        uint64_t dependencyHash = hashFileContents(dependency);
+        hash = hashBytes(&dependencyHash, sizeof(dependencyHash), hash);
+    }
+
+    return hash;
+}
+
+unsigned int Model::importFlags(unsigned int flags, unsigned int attributes, int &removedComponents) {
+    removedComponents = 0;
+
+    bool needsTangents = (attributes & (va::TANGENT | va::BITANGENT)) != 0;
+    if (!needsTangents) {
+        flags &= ~aiProcess_CalcTangentSpace;
+        removedComponents |= aiComponent_TANGENTS_AND_BITANGENTS;
+    }
+
+    // Tangent space generation needs normals and UVs even if the shader doesn't
+    if (!(attributes & va::NORMAL) && !needsTangents) {
+        flags &= ~(aiProcess_GenNormals | aiProcess_GenSmoothNormals);
+        removedComponents |= aiComponent_NORMALS;
+    }
+    if (!(attributes & va::TEXCOORDS) && !needsTangents) {
+        flags &= ~(aiProcess_GenUVCoords | aiProcess_TransformUVCoords | aiProcess_FlipUVs);
+        removedComponents |= aiComponent_TEXCOORDS;
+    }
+
+    // Drop unused streams right after loading, so the remaining steps don't process them
+    if (removedComponents != 0)
+        flags |= aiProcess_RemoveComponent;
+
+    return flags;
+}
+
+bool Model::loadFromCache(ModelData &data, const std::string &cachePath, const MeshCacheKey &key) {
+    MappedFile file(cachePath);
+    std::vector<CachedMeshView> views;
+
+    if (!readMeshCache(file, key, views))
+        return false;
+
+    data.meshes.reserve(views.size());
+    for (const CachedMeshView &view : views) {
+        MeshData meshData;
+        meshData.vertexData = view.vertices;
+        meshData.vertexCount = view.vertexCount;
+        meshData.indexData = view.indices;
+        meshData.indexCount = view.indexCount;
+        meshData.sourceMeshCount = view.sourceMeshCount;
+        meshData.lods = view.lods;
+        meshData.meshlets = view.meshlets;
+
+        for (const TextureRef &texture : view.textures)
+            meshData.textureIndices.push_back(addTextureRef(data, texture.path, texture.type));
+
+        data.meshes.push_back(std::move(meshData));
+    }
+
+    data.cacheFile = std::make_shared<const MappedFile>(std::move(file));
+
+    return true;
+}
+
+void Model::processNode(ModelData &data, aiNode *node, const aiScene *scene) {
     // Process all meshes (if any) for the selected node
     for (unsigned int i = 0; i < node->mNumMeshes; ++i) {
         aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-        meshes.push_back(processMesh(mesh, scene));
+        data.meshes.push_back(processMesh(data, mesh, scene));
     }
     // And do the same for all child nodes
     for (unsigned int i = 0; i < node->mNumChildren; ++i) {
-        processNode(node->mChildren[i], scene);
+        processNode(data, node->mChildren[i], scene);
     }
 }
 
-Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene) {
-    std::vector<Vertex> vertices;
-    std::vector<unsigned int> indices;
-    std::vector<Texture> textures;
+MeshData Model::processMesh(ModelData &data, aiMesh *mesh, const aiScene *scene) {
+    MeshData meshData;
+    std::vector<Vertex> &vertices = meshData.vertices;
+    std::vector<unsigned int> &indices = meshData.indices;
 
+    // Streams that weren't imported, or won't be uploaded, stay zero
+    const aiVector3D* normals    = (data.attributes & va::NORMAL)    ? mesh->mNormals : nullptr;
+    const aiVector3D* texCoords  = (data.attributes & va::TEXCOORDS) ? mesh->mTextureCoords[0] : nullptr;
+    const aiVector3D* tangents   = (data.attributes & va::TANGENT)   ? mesh->mTangents : nullptr;
+    const aiVector3D* bitangents = (data.attributes & va::BITANGENT) ? mesh->mBitangents : nullptr;
+
+    // Vertices are written in place, the vector is allocated exactly once
+    vertices.resize(mesh->mNumVertices);
     for (unsigned int i = 0; i < mesh->mNumVertices; ++i) {
         // Processing vertex coordinates, normals and texture coordinates
-        Vertex vertex;
+        Vertex &vertex = vertices[i];
         vertex.Position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
-        vertex.Normal   = glm::vec3( mesh->mNormals[i].x,  mesh->mNormals[i].y,  mesh->mNormals[i].z);
-
-        // Does mesh contain texture coords? 
-        if (mesh->mTextureCoords[0])
-            vertex.TexCoords = glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
-        else
-            vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-
-        vertex.Tangent   = glm::vec3(  mesh->mTangents[i].x,   mesh->mTangents[i].y,   mesh->mTangents[i].z);
-        vertex.Bitangent = glm::vec3(mesh->mBitangents[i].x, mesh->mBitangents[i].y, mesh->mBitangents[i].z);
 
-        vertices.push_back(vertex);
+        if (normals)
+            vertex.Normal = glm::vec3(normals[i].x, normals[i].y, normals[i].z);
+        if (texCoords)
+            vertex.TexCoords = glm::vec2(texCoords[i].x, texCoords[i].y);
+        if (tangents)
+            vertex.Tangent = glm::vec3(tangents[i].x, tangents[i].y, tangents[i].z);
+        if (bitangents)
+            vertex.Bitangent = glm::vec3(bitangents[i].x, bitangents[i].y, bitangents[i].z);
     }
-    
+
     // Processing indices
+    indices.reserve(static_cast<size_t>(mesh->mNumFaces) * 3);
     for (unsigned int i = 0; i < mesh->mNumFaces; ++i) {
-        aiFace face = mesh->mFaces[i];
+        // By reference: copying an aiFace allocates its index array
+        const aiFace &face = mesh->mFaces[i];
 
         for (unsigned int j = 0; j < face.mNumIndices; ++j)
             indices.push_back(face.mIndices[j]);
     }
 
+    meshData.trianglesOnly = mesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE;
+
     // Processing textures
     if (mesh->mMaterialIndex >= 0) {
         aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-        
-        std::vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-        
-        std::vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
 
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-        textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+        loadMaterialTextures(data, meshData, material, aiTextureType_DIFFUSE, "texture_diffuse");
+        loadMaterialTextures(data, meshData, material, aiTextureType_SPECULAR, "texture_specular");
+        loadMaterialTextures(data, meshData, material, aiTextureType_HEIGHT, "texture_normal");
+        loadMaterialTextures(data, meshData, material, aiTextureType_AMBIENT, "texture_height");
+        loadMaterialTextures(data, meshData, material, aiTextureType_EMISSIVE, "texture_emissive");
+    }
+
+    return meshData;
+}
+
+bool Model::importGltf(ModelData &data, std::string &error) {
+    // Post-processing steps the native loader doesn't need, because glTF already is a triangulated, indexed, right-handed scene
+    constexpr unsigned int handledFlags = aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace | aiProcess_RemoveComponent |
+                                          aiProcess_GenNormals | aiProcess_GenSmoothNormals;
+    if (data.flags & ~handledFlags) {
+        error = unsupportedFlagsError(data.flags & ~handledFlags);
+        return false;
+    }
+
+    GltfAsset asset;
+    if (!asset.open(data.path, error))
+        return false;
+
+    const JsonValue &document = asset.getDocument();
+    const JsonValue &scene = document["scenes"][document["scene"].asIndex(0)];
 
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-        textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+    bool imported = scene.isObject();
+    if (!imported)
+        error = "no scene";
 
-        std::vector<Texture> emissiveMaps = loadMaterialTextures(material, aiTextureType_EMISSIVE, "texture_emissive");
-        textures.insert(textures.end(), emissiveMaps.begin(), emissiveMaps.end());
+    for (size_t i = 0; imported && i < scene["nodes"].size(); ++i)
+        imported = processGltfNode(data, asset, scene["nodes"][i].asIndex(~static_cast<size_t>(0)), 0, error);
+
+    // Nothing of a partial import is kept, Assimp starts over
+    if (!imported) {
+        data.meshes.clear();
+        data.textures.clear();
+        data.textureIndexByPath.clear();
     }
 
-    return Mesh(vertices, indices, textures);
+    return imported;
 }
 
-std::vector<Texture> Model::loadMaterialTextures(aiMaterial *mat, aiTextureType type, const std::string &typeName) {
-    std::vector<Texture> textures;
+bool Model::processGltfNode(ModelData &data, const GltfAsset &asset, size_t nodeIndex, int depth, std::string &error) {
+    const JsonValue &node = asset.getDocument()["nodes"][nodeIndex];
 
-    for (unsigned int i = 0; i < mat->GetTextureCount(type); ++i) {
-        aiString strPath;
-        mat->GetTexture(type, i, &strPath);
+    // glTF node trees can't have cycles, but a broken file could
+    if (!node.isObject() || depth > 256) {
+        error = "invalid node " + std::to_string(nodeIndex);
+        return false;
+    }
 
-        std::vector<Texture>::iterator it = std::find_if(texturesLoaded.begin(), texturesLoaded.end(), [&](const Texture &texture) {
-            return (texture.path.compare(strPath.C_Str()) == 0);
-        });
+    // Every primitive becomes its own mesh, the same split Assimp makes
+    if (node.has("mesh")) {
+        const JsonValue &mesh = asset.getDocument()["meshes"][node["mesh"].asIndex(~static_cast<size_t>(0))];
+        if (!mesh.isObject()) {
+            error = "node " + std::to_string(nodeIndex) + " has an invalid mesh";
+            return false;
+        }
 
-        if (it != texturesLoaded.end()) {
-            textures.push_back(*it);
+        for (const JsonValue &primitive : mesh["primitives"].getElements()) {
+            if (!processGltfPrimitive(data, asset, primitive, error))
+                return false;
         }
-        else {
-            Texture texture;
-            texture.id = TextureFromFile(directory + '\\' + strPath.C_Str());
-            texture.type = typeName;
-            texture.path = strPath.C_Str();
+    }
 
-            textures.push_back(texture);
-            texturesLoaded.push_back(texture);
+    for (const JsonValue &child : node["children"].getElements()) {
+        if (!processGltfNode(data, asset, child.asIndex(~static_cast<size_t>(0)), depth + 1, error))
+            return false;
+    }
+
+    return true;
+}
+
+bool Model::processGltfPrimitive(ModelData &data, const GltfAsset &asset, const JsonValue &primitive, std::string &error) {
+    if (primitive["mode"].asIndex(gltf::MODE_TRIANGLES) != gltf::MODE_TRIANGLES) {
+        error = "primitive that isn't a triangle list";
+        return false;
+    }
+
+    const JsonValue &attributes = primitive["attributes"];
+    constexpr size_t missing = ~static_cast<size_t>(0);
+
+    GltfAccessor positions;
+    if (!asset.getAccessor(attributes["POSITION"].asIndex(missing), positions, error))
+        return false;
+
+    MeshData meshData;
+    std::vector<Vertex> &vertices = meshData.vertices;
+    std::vector<unsigned int> &indices = meshData.indices;
+
+    // One pass per stream straight from the mapped buffer into the interleaved vertices, allocated exactly once
+    vertices.resize(positions.count);
+    unsigned char* vertexBytes = reinterpret_cast<unsigned char*>(vertices.data());
+
+    bool needsTangentSpace = (data.attributes & (va::TANGENT | va::BITANGENT)) != 0;
+    bool needsGeneratedNormals = (data.flags & (aiProcess_GenNormals | aiProcess_GenSmoothNormals)) != 0 || needsTangentSpace;
+
+    // Streams are read only as far as the vertex count of the positions goes
+    auto readStream = [&asset, &attributes, &positions, &error](const char *name, GltfAccessor &accessor) {
+        if (!asset.getAccessor(attributes[name].asIndex(missing), accessor, error))
+            return false;
+        if (accessor.count < positions.count) {
+            error = std::string(name) + " has fewer elements than POSITION";
+            return false;
+        }
+        accessor.count = positions.count;
+        return true;
+    };
+
+    bool read = positions.readFloats(3, vertexBytes + offsetof(Vertex, Position), sizeof(Vertex));
+
+    if (read && ((data.attributes & va::NORMAL) || needsTangentSpace)) {
+        GltfAccessor normals;
+        if (attributes.has("NORMAL")) {
+            read = readStream("NORMAL", normals) && normals.readFloats(3, vertexBytes + offsetof(Vertex, Normal), sizeof(Vertex));
+        }
+        else if (needsGeneratedNormals) {
+            error = "no normals to generate tangents from";
+            return false;
+        }
+    }
+
+    if (read && (data.attributes & va::TEXCOORDS) && attributes.has("TEXCOORD_0")) {
+        GltfAccessor texCoords;
+        read = readStream("TEXCOORD_0", texCoords) && texCoords.readFloats(2, vertexBytes + offsetof(Vertex, TexCoords), sizeof(Vertex));
+
+        // glTF puts the UV origin at the top left. Assimp flips it to the bottom left and aiProcess_FlipUVs flips it back.
+        if (!(data.flags & aiProcess_FlipUVs)) {
+            for (Vertex &vertex : vertices)
+                vertex.TexCoords.y = 1.0f - vertex.TexCoords.y;
         }
     }
 
-    return textures;
+    if (read && needsTangentSpace) {
+        if (!attributes.has("TANGENT")) {
+            error = "no tangents, Assimp generates them";
+            return false;
+        }
+
+        // xyz is the tangent, w the handedness of the bitangent
+        GltfAccessor tangentAccessor;
+        std::vector<glm::vec4> tangents(positions.count);
+        read = readStream("TANGENT", tangentAccessor) && tangentAccessor.readFloats(4, reinterpret_cast<unsigned char*>(tangents.data()), sizeof(glm::vec4));
+
+        for (size_t i = 0; read && i < vertices.size(); ++i) {
+            if (data.attributes & va::TANGENT)
+                vertices[i].Tangent = glm::vec3(tangents[i]);
+            if (data.attributes & va::BITANGENT)
+                vertices[i].Bitangent = glm::cross(vertices[i].Normal, glm::vec3(tangents[i])) * tangents[i].w;
+        }
+
+        // Normals only read for the bitangents aren't uploaded
+        if (!(data.attributes & va::NORMAL)) {
+            for (Vertex &vertex : vertices)
+                vertex.Normal = glm::vec3(0.0f);
+        }
+    }
+
+    if (!read) {
+        if (error.empty())
+            error = "vertex stream that isn't float";
+        return false;
+    }
+
+    if (primitive.has("indices")) {
+        GltfAccessor indexAccessor;
+        if (!asset.getAccessor(primitive["indices"].asIndex(missing), indexAccessor, error))
+            return false;
+        if (!indexAccessor.readIndices(indices)) {
+            error = "indices that aren't unsigned integers";
+            return false;
+        }
+    }
+    else {
+        indices.resize(vertices.size());
+        for (size_t i = 0; i < indices.size(); ++i)
+            indices[i] = static_cast<unsigned int>(i);
+    }
+
+    if (indices.size() % 3 != 0 || std::any_of(indices.begin(), indices.end(), [&vertices](unsigned int index) { return index >= vertices.size(); })) {
+        error = "indices out of range";
+        return false;
+    }
+
+    // Texture slots as Assimp's glTF importer maps them: base color (or the specular-glossiness diffuse) is the diffuse texture
+    const JsonValue &material = asset.getDocument()["materials"][primitive["material"].asIndex(missing)];
+    const JsonValue &specularGlossiness = material["extensions"]["KHR_materials_pbrSpecularGlossiness"];
+
+    const JsonValue *diffuse = &material["pbrMetallicRoughness"]["baseColorTexture"];
+    if (specularGlossiness.has("diffuseTexture"))
+        diffuse = &specularGlossiness["diffuseTexture"];
+
+    std::pair<const JsonValue*, const char*> slots[] = {
+        { diffuse, "texture_diffuse" },
+        { &specularGlossiness["specularGlossinessTexture"], "texture_specular" },
+        { &material["emissiveTexture"], "texture_emissive" },
+    };
+    for (const auto &slot : slots) {
+        if (!slot.first->isObject())
+            continue;
+
+        std::string texturePath = asset.getTexturePath((*slot.first)["index"].asIndex(missing));
+        if (texturePath.empty()) {
+            error = "embedded or missing image";
+            return false;
+        }
+
+        meshData.textureIndices.push_back(addTextureRef(data, texturePath, slot.second));
+    }
+
+    data.meshes.push_back(std::move(meshData));
+    return true;
 }
 
+bool Model::importObj(ModelData &data, std::string &error) {
+    constexpr unsigned int handledFlags = aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace | aiProcess_RemoveComponent |
+                                          aiProcess_GenNormals | aiProcess_GenSmoothNormals;
+    if (data.flags & ~handledFlags) {
+        error = unsupportedFlagsError(data.flags & ~handledFlags);
+        return false;
+    }
 
-unsigned int TextureFromFile(const std::string &path) {
+    if (data.attributes & (va::TANGENT | va::BITANGENT)) {
+        error = "tangents, Assimp generates them";
+        return false;
+    }
+
+    ObjScene scene;
+    if (!loadObj(data.path, data.attributes, (data.flags & aiProcess_FlipUVs) != 0, scene, error))
+        return false;
+
+    bool needsGeneratedNormals = (data.flags & (aiProcess_GenNormals | aiProcess_GenSmoothNormals)) != 0;
+    if ((data.attributes & va::NORMAL) && needsGeneratedNormals && !(scene.attributes & va::NORMAL)) {
+        error = "no normals, Assimp generates them";
+        return false;
+    }
+
+    data.meshes.reserve(scene.meshes.size());
+    for (ObjMesh &mesh : scene.meshes) {
+        MeshData meshData;
+        meshData.vertices = std::move(mesh.vertices);
+        meshData.indices = std::move(mesh.indices);
+
+        // Texture slots in the order processMesh asks Assimp's OBJ importer for them
+        if (mesh.material >= 0) {
+            const ObjMaterial &material = scene.materials[mesh.material];
+
+            std::pair<const std::string*, const char*> slots[] = {
+                { &material.diffuseMap, "texture_diffuse" },
+                { &material.specularMap, "texture_specular" },
+                { &material.bumpMap, "texture_normal" },
+                { &material.ambientMap, "texture_height" },
+                { &material.emissiveMap, "texture_emissive" },
+            };
+            for (const auto &slot : slots) {
+                if (!slot.first->empty())
+                    meshData.textureIndices.push_back(addTextureRef(data, *slot.first, slot.second));
+            }
+        }
+
+        data.meshes.push_back(std::move(meshData));
+    }
+
+    return true;
+}
+
+void Model::batchMeshes(std::vector<MeshData> &meshes) {
+    std::vector<MeshData> batches;
+    batches.reserve(meshes.size());
+    std::map<std::vector<size_t>, size_t> batchByTextures;
+
+    for (MeshData &meshData : meshes) {
+        // Lines and points keep their own draw call
+        if (!meshData.trianglesOnly) {
+            batches.push_back(std::move(meshData));
+            continue;
+        }
+
+        auto inserted = batchByTextures.emplace(meshData.textureIndices, batches.size());
+        if (inserted.second) {
+            batches.push_back(std::move(meshData));
+            continue;
+        }
+
+        MeshData &batch = batches[inserted.first->second];
+        unsigned int baseVertex = static_cast<unsigned int>(batch.vertices.size());
+
+        batch.vertices.insert(batch.vertices.end(), meshData.vertices.begin(), meshData.vertices.end());
+        batch.indices.reserve(batch.indices.size() + meshData.indices.size());
+        for (unsigned int index : meshData.indices)
+            batch.indices.push_back(baseVertex + index);
+
+        batch.sourceMeshCount += meshData.sourceMeshCount;
+    }
+
+    meshes = std::move(batches);
+}
+
+void Model::loadMaterialTextures(ModelData &data, MeshData &meshData, aiMaterial *mat, aiTextureType type, const std::string &typeName) {
+    for (unsigned int i = 0; i < mat->GetTextureCount(type); ++i) {
+        aiString strPath;
+        mat->GetTexture(type, i, &strPath);
+
+        meshData.textureIndices.push_back(addTextureRef(data, strPath.C_Str(), typeName));
+    }
+}
+
+size_t Model::addTextureRef(ModelData &data, const std::string &relPath, const std::string &typeName) {
+    auto inserted = data.textureIndexByPath.emplace(relPath, data.textures.size());
+
+    if (inserted.second)
+        data.textures.push_back({ typeName, relPath });
+
+    return inserted.first->second;
+}
+
+
+unsigned int uploadTexture(const DecodedImage &image) {
     unsigned int textureID;
     glGenTextures(1, &textureID);
 
-    int width, height, nrComponents;
-
-    unsigned char* data = stbi_load(path.c_str(), &width, &height, &nrComponents, 0);
-    
-    if (data) {
+    if (image.baked) {
+        // The container holds the whole mip chain, nothing to generate
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        uploadBakedLevels(*image.baked, GL_TEXTURE_2D);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(image.baked->getLevels().size()) - 1);
+    }
+    else if (image.pixels) {
         GLenum format;
-        if (nrComponents == 1)
+        if (image.components == 1)
             format = GL_RED;
-        else if (nrComponents == 3)
+        else if (image.components == 3)
             format = GL_RGB;
-        else if (nrComponents == 4)
+        else if (image.components == 4)
             format = GL_RGBA;
 
         glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels.get());
         glGenerateMipmap(GL_TEXTURE_2D);
+    }
 
+    if (image.isLoaded()) {
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-        stbi_image_free(data);
     }
     else {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
+        std::cout << "Texture failed to load at path: " << image.path << std::endl;
     }
 
     return textureID;
+}
+
+unsigned int TextureFromFile(const std::string &path) {
+    return uploadTexture(decodeImage(path));
 }
\ No newline at end of file
@@ -0,0 +1,102 @@
+#include "auxiliary/ModelLoader.h"
+
+#include <iostream>
+#include <optional>
+
+
+ModelLoader::ModelLoader(ThreadPool &pool)
+    : pool(pool)
+{}
+
+ModelLoader::~ModelLoader() {
+    std::unique_lock<std::mutex> lock(completedMutex);
+    completedCondition.wait(lock, [this]() { return pushedCount == enqueuedCount; });
+}
+
+size_t ModelLoader::enqueue(const std::string &path, unsigned int flags, unsigned int attributes) {
+    size_t ticket = enqueuedCount++;
+
+    pool.submit([this, ticket, path, flags, attributes]() {
+        ModelData data;
+        try {
+            data = Model::importData(path, flags, attributes);
+        }
+        catch (const std::exception &e) {
+            // An empty ModelData still has to reach the queue, otherwise waitAll() would never return
+            std::cout << "ERROR::MODEL_LOADER::" << path << ": " << e.what() << std::endl;
+        }
+        catch (...) {
+            std::cout << "ERROR::MODEL_LOADER::" << path << ": unknown exception" << std::endl;
+        }
+
+        // Notified under the lock: once pushedCount is seen, the destructor may run and take the condition variable with it
+        std::lock_guard<std::mutex> lock(completedMutex);
+        completed.emplace(ticket, std::move(data));
+        ++pushedCount;
+        completedCondition.notify_all();
+    });
+
+    return ticket;
+}
+
+void ModelLoader::finish(std::pair<size_t, ModelData> &&entry, const LoadedCallback &onLoaded) {
+    ++finishedCount;
+    onLoaded(entry.first, Model(std::move(entry.second)));
+}
+
+size_t ModelLoader::pollCompleted(const LoadedCallback &onLoaded) {
+    size_t count = 0;
+
+    while (true) {
+        std::pair<size_t, ModelData> entry;
+        {
+            std::lock_guard<std::mutex> lock(completedMutex);
+            if (completed.empty())
+                break;
+
+            entry = std::move(completed.front());
+            completed.pop();
+        }
+
+        // GL uploads happen outside the lock, so workers can keep pushing results meanwhile
+        finish(std::move(entry), onLoaded);
+        ++count;
+    }
+
+    return count;
+}
+
+void ModelLoader::waitAll(const LoadedCallback &onLoaded) {
+    while (getPendingCount() > 0) {
+        std::pair<size_t, ModelData> entry;
+        {
+            std::unique_lock<std::mutex> lock(completedMutex);
+            completedCondition.wait(lock, [this]() { return !completed.empty(); });
+
+            entry = std::move(completed.front());
+            completed.pop();
+        }
+
+        finish(std::move(entry), onLoaded);
+    }
+}
+
+std::vector<Model> ModelLoader::loadAll(const std::vector<std::string> &paths, unsigned int flags, unsigned int attributes) {
+    std::vector<std::optional<Model>> slots(paths.size());
+
+    size_t firstTicket = enqueuedCount;
+    for (const std::string &path : paths)
+        enqueue(path, flags, attributes);
+
+    waitAll([&](size_t ticket, Model &&model) {
+        if (ticket >= firstTicket && ticket - firstTicket < slots.size())
+            slots[ticket - firstTicket].emplace(std::move(model));
+    });
+
+    std::vector<Model> models;
+    models.reserve(paths.size());
+    for (std::optional<Model> &slot : slots)
+        models.push_back(std::move(*slot));
+
+    return models;
+}
\ No newline at end of file
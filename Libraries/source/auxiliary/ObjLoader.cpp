@@ -0,0 +1,647 @@
+#include "auxiliary/ObjLoader.h"
+#include "auxiliary/AssetPack.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+
+namespace {
+    // Corner index that wasn't given (v//vn has no vt)
+    constexpr int64_t NONE = std::numeric_limits<int64_t>::min();
+    // Negative indices count back from the element before the face. A chunk doesn't know how many elements the chunks
+    // before it had, so it stores them relative to its own first element, offset by this, and they're resolved later.
+    constexpr int64_t RELATIVE = int64_t(1) << 48;
+
+    enum Stream {
+        POSITIONS,
+        TEXCOORDS,
+        NORMALS
+    };
+
+    struct Event {
+        enum Kind {
+            MATERIAL,
+            GROUP,
+            LIBRARY
+        };
+
+        size_t face;        // number of faces in the chunk before it
+        Kind kind;
+        std::string name;
+    };
+
+    // What one chunk of the file parses into, before indices are resolved
+    struct Chunk {
+        const char *begin = nullptr;
+        const char *end = nullptr;
+
+        std::vector<float> positions;   // 3 per element
+        std::vector<float> texCoords;   // 2
+        std::vector<float> normals;     // 3
+        size_t counts[3] = { 0, 0, 0 };
+
+        std::vector<int64_t> corners;   // v, vt, vn per corner, 0-based
+        std::vector<uint32_t> faceSizes;
+        std::vector<Event> events;
+
+        std::string error;
+    };
+
+
+    inline bool isSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    inline void skipSpaces(const char *&p, const char *end) {
+        while (p < end && isSpace(*p))
+            ++p;
+    }
+
+    inline bool atLineEnd(const char *p, const char *end) {
+        return p >= end || *p == '\n' || *p == '#';
+    }
+
+    // Decimal float without locale lookups or allocations: up to 19 significant digits are gathered into an integer
+    // and scaled once. Good to well under a float ulp for anything an exporter writes.
+    bool parseFloat(const char *&p, const char *end, float &out) {
+        static const double powers[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+            negative = *p++ == '-';
+
+        uint64_t mantissa = 0;
+        int digits = 0;
+        int exponent = 0;
+        bool any = false;
+
+        for (; p < end && *p >= '0' && *p <= '9'; ++p, any = true) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits += mantissa != 0 ? 1 : 0;
+            }
+            else
+                ++exponent;
+        }
+        if (p < end && *p == '.') {
+            for (++p; p < end && *p >= '0' && *p <= '9'; ++p, any = true) {
+                if (digits < 19) {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    digits += mantissa != 0 ? 1 : 0;
+                    --exponent;
+                }
+            }
+        }
+        if (!any)
+            return false;
+
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            ++p;
+            bool negativeExponent = false;
+            if (p < end && (*p == '-' || *p == '+'))
+                negativeExponent = *p++ == '-';
+
+            int value = 0;
+            bool exponentDigits = false;
+            for (; p < end && *p >= '0' && *p <= '9'; ++p, exponentDigits = true)
+                value = std::min(value * 10 + (*p - '0'), 10000);
+            if (!exponentDigits)
+                return false;
+
+            exponent += negativeExponent ? -value : value;
+        }
+
+        double value = static_cast<double>(mantissa);
+        if (exponent < 0)
+            value = -exponent <= 22 ? value / powers[-exponent] : value * std::pow(10.0, exponent);
+        else if (exponent > 0)
+            value = exponent <= 22 ? value * powers[exponent] : value * std::pow(10.0, exponent);
+
+        out = static_cast<float>(negative ? -value : value);
+        return true;
+    }
+
+    bool parseInt(const char *&p, const char *end, int64_t &out) {
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+            negative = *p++ == '-';
+
+        if (p >= end || *p < '0' || *p > '9')
+            return false;
+
+        int64_t value = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; ++p)
+            value = std::min<int64_t>(value * 10 + (*p - '0'), RELATIVE / 2);
+
+        out = negative ? -value : value;
+        return true;
+    }
+
+    // Reads 'count' floats, and ignores whatever follows them on the line (w, vertex colors)
+    bool parseFloats(const char *&p, const char *end, int count, int required, std::vector<float> *out) {
+        float values[3] = { 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < count; ++i) {
+            skipSpaces(p, end);
+            if (atLineEnd(p, end) && i >= required)
+                break;
+            if (!parseFloat(p, end, values[i]))
+                return false;
+        }
+
+        if (out)
+            out->insert(out->end(), values, values + count);
+        return true;
+    }
+
+    std::string restOfLine(const char *&p, const char *end) {
+        skipSpaces(p, end);
+        const char *start = p;
+        while (p < end && *p != '\n' && *p != '#')
+            ++p;
+
+        const char *last = p;
+        while (last > start && isSpace(last[-1]))
+            --last;
+
+        return std::string(start, last);
+    }
+
+    // 1-based absolute or negative relative index as stored in Chunk::corners
+    inline int64_t storeIndex(int64_t index, size_t count) {
+        return index > 0 ? index - 1 : RELATIVE + static_cast<int64_t>(count) + index;
+    }
+
+    inline bool keyword(const char *p, const char *end, const char *word, size_t length) {
+        return static_cast<size_t>(end - p) > length && std::memcmp(p, word, length) == 0 && isSpace(p[length]);
+    }
+
+    void parseChunk(Chunk &chunk, unsigned int attributes) {
+        const char *p = chunk.begin;
+        const char *end = chunk.end;
+
+        std::vector<float>* texCoords = (attributes & va::TEXCOORDS) ? &chunk.texCoords : nullptr;
+        std::vector<float>* normals = (attributes & va::NORMAL) ? &chunk.normals : nullptr;
+
+        while (p < end && chunk.error.empty()) {
+            skipSpaces(p, end);
+            const char *line = p;
+
+            if (p < end && *p == 'v' && p + 1 < end && isSpace(p[1])) {
+                p += 2;
+                if (!parseFloats(p, end, 3, 3, &chunk.positions))
+                    chunk.error = "invalid vertex";
+                ++chunk.counts[POSITIONS];
+            }
+            else if (keyword(p, end, "vt", 2)) {
+                p += 3;
+                if (!parseFloats(p, end, 2, 1, texCoords))
+                    chunk.error = "invalid texture coordinate";
+                ++chunk.counts[TEXCOORDS];
+            }
+            else if (keyword(p, end, "vn", 2)) {
+                p += 3;
+                if (!parseFloats(p, end, 3, 3, normals))
+                    chunk.error = "invalid normal";
+                ++chunk.counts[NORMALS];
+            }
+            else if (p < end && *p == 'f' && p + 1 < end && isSpace(p[1])) {
+                p += 2;
+                uint32_t size = 0;
+
+                while (true) {
+                    skipSpaces(p, end);
+                    if (atLineEnd(p, end))
+                        break;
+
+                    int64_t v, vt = NONE, vn = NONE;
+                    if (!parseInt(p, end, v)) {
+                        chunk.error = "invalid face";
+                        break;
+                    }
+                    if (p < end && *p == '/') {
+                        ++p;
+                        if (p < end && *p != '/' && !parseInt(p, end, vt)) {
+                            chunk.error = "invalid face";
+                            break;
+                        }
+                        if (p < end && *p == '/') {
+                            ++p;
+                            if (!parseInt(p, end, vn)) {
+                                chunk.error = "invalid face";
+                                break;
+                            }
+                        }
+                    }
+
+                    chunk.corners.push_back(storeIndex(v, chunk.counts[POSITIONS]));
+                    chunk.corners.push_back(vt == NONE ? NONE : storeIndex(vt, chunk.counts[TEXCOORDS]));
+                    chunk.corners.push_back(vn == NONE ? NONE : storeIndex(vn, chunk.counts[NORMALS]));
+                    ++size;
+                }
+
+                if (chunk.error.empty() && size < 3)
+                    chunk.error = "face with fewer than 3 corners";
+                chunk.faceSizes.push_back(size);
+            }
+            else if (keyword(p, end, "usemtl", 6)) {
+                p += 7;
+                chunk.events.push_back({ chunk.faceSizes.size(), Event::MATERIAL, restOfLine(p, end) });
+            }
+            else if (keyword(p, end, "mtllib", 6)) {
+                p += 7;
+                chunk.events.push_back({ chunk.faceSizes.size(), Event::LIBRARY, restOfLine(p, end) });
+            }
+            else if (p < end && (*p == 'o' || *p == 'g') && p + 1 < end && isSpace(p[1])) {
+                p += 2;
+                chunk.events.push_back({ chunk.faceSizes.size(), Event::GROUP, restOfLine(p, end) });
+            }
+            else if (p < end && (*p == 'l' || *p == 'p') && p + 1 < end && isSpace(p[1])) {
+                chunk.error = "lines and points";
+            }
+            else if (keyword(p, end, "curv", 4) || keyword(p, end, "surf", 4) || keyword(p, end, "cstype", 6)) {
+                chunk.error = "free-form geometry";
+            }
+
+            // Anything else (comments, smoothing groups, vp, ...) is skipped with the rest of the line
+            while (p < end && *p != '\n')
+                ++p;
+            if (p < end)
+                ++p;
+
+            if (!chunk.error.empty())
+                chunk.error += " at \"" + std::string(line, std::min<size_t>(p - line, 40)) + "\"";
+        }
+    }
+
+    // Shared between the caller and helper jobs; helpers that start after all chunks are claimed just return
+    struct ParseBatch {
+        std::vector<Chunk> chunks;
+        unsigned int attributes = 0;
+
+        std::atomic<size_t> nextIndex { 0 };
+        size_t doneCount = 0;
+        std::mutex doneMutex;
+        std::condition_variable doneCondition;
+
+        void work() {
+            while (true) {
+                size_t index = nextIndex.fetch_add(1);
+                if (index >= chunks.size())
+                    return;
+
+                parseChunk(chunks[index], attributes);
+
+                {
+                    std::lock_guard<std::mutex> lock(doneMutex);
+                    ++doneCount;
+                }
+                doneCondition.notify_all();
+            }
+        }
+    };
+
+    std::string directoryOf(const std::string &path) {
+        size_t slash = path.find_last_of("\\/");
+        return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+    }
+
+    // File name of a map statement, after options like "-bm 0.5" or "-o 0 0 0"
+    std::string mapPath(const char *&p, const char *end) {
+        std::string rest = restOfLine(p, end);
+        const char *q = rest.data();
+        const char *restEnd = q + rest.size();
+
+        while (true) {
+            skipSpaces(q, restEnd);
+            if (q >= restEnd || *q != '-')
+                break;
+
+            // The option name, then its numeric or on/off arguments
+            while (q < restEnd && !isSpace(*q))
+                ++q;
+            while (true) {
+                skipSpaces(q, restEnd);
+                const char *argument = q;
+                float number;
+                if (parseFloat(q, restEnd, number) && (q >= restEnd || isSpace(*q)))
+                    continue;
+
+                q = argument;
+                if (keyword(q, restEnd, "on", 2) || keyword(q, restEnd, "off", 3)) {
+                    while (q < restEnd && !isSpace(*q))
+                        ++q;
+                    continue;
+                }
+                break;
+            }
+        }
+
+        return std::string(q, restEnd);
+    }
+
+    bool loadMtl(const std::string &path, std::vector<ObjMaterial> &materials, std::unordered_map<std::string, int> &materialByName) {
+        std::shared_ptr<const VfsFile> file = AssetVfs::shared().read(path);
+        if (!file)
+            return false;
+
+        const char *p = reinterpret_cast<const char*>(file->getData());
+        const char *end = p + file->getSize();
+        ObjMaterial *material = nullptr;
+
+        while (p < end) {
+            skipSpaces(p, end);
+
+            if (keyword(p, end, "newmtl", 6)) {
+                p += 7;
+                std::string name = restOfLine(p, end);
+
+                auto inserted = materialByName.emplace(name, static_cast<int>(materials.size()));
+                if (inserted.second) {
+                    materials.emplace_back();
+                    materials.back().name = name;
+                }
+                material = &materials[inserted.first->second];
+            }
+            else if (material && keyword(p, end, "map_Kd", 6)) {
+                p += 7;
+                material->diffuseMap = mapPath(p, end);
+            }
+            else if (material && keyword(p, end, "map_Ks", 6)) {
+                p += 7;
+                material->specularMap = mapPath(p, end);
+            }
+            else if (material && keyword(p, end, "map_Ka", 6)) {
+                p += 7;
+                material->ambientMap = mapPath(p, end);
+            }
+            else if (material && keyword(p, end, "map_Ke", 6)) {
+                p += 7;
+                material->emissiveMap = mapPath(p, end);
+            }
+            else if (material && (keyword(p, end, "map_bump", 8) || keyword(p, end, "map_Bump", 8))) {
+                p += 9;
+                material->bumpMap = mapPath(p, end);
+            }
+            else if (material && keyword(p, end, "bump", 4)) {
+                p += 5;
+                material->bumpMap = mapPath(p, end);
+            }
+
+            while (p < end && *p != '\n')
+                ++p;
+            if (p < end)
+                ++p;
+        }
+
+        return true;
+    }
+}
+
+
+bool loadObj(const std::string &path, unsigned int attributes, bool flipUVs, ObjScene &scene, std::string &error, ThreadPool &pool) {
+    std::shared_ptr<const VfsFile> file = AssetVfs::shared().read(path, pool);
+    if (!file) {
+        error = "can't open " + path;
+        return false;
+    }
+
+    const char *data = reinterpret_cast<const char*>(file->getData());
+    size_t size = file->getSize();
+
+    // Chunks end after a newline, so no line is split between two of them
+    auto batch = std::make_shared<ParseBatch>();
+    batch->attributes = attributes;
+
+    size_t chunkCount = std::max<size_t>(1, size / obj::CHUNK_BYTES);
+    const char *chunkBegin = data;
+    for (size_t i = 1; i <= chunkCount && chunkBegin < data + size; ++i) {
+        const char *chunkEnd = i == chunkCount ? data + size : data + size * i / chunkCount;
+        if (chunkEnd < chunkBegin)
+            chunkEnd = chunkBegin;
+
+        const char *newline = static_cast<const char*>(std::memchr(chunkEnd, '\n', data + size - chunkEnd));
+        chunkEnd = newline ? newline + 1 : data + size;
+
+        batch->chunks.emplace_back();
+        batch->chunks.back().begin = chunkBegin;
+        batch->chunks.back().end = chunkEnd;
+        chunkBegin = chunkEnd;
+    }
+
+    size_t helperCount = std::min(batch->chunks.size() - (batch->chunks.empty() ? 0 : 1), pool.getThreadCount());
+    for (size_t i = 0; i < helperCount; ++i)
+        pool.submit([batch]() { batch->work(); });
+
+    batch->work();
+
+    {
+        std::unique_lock<std::mutex> lock(batch->doneMutex);
+        batch->doneCondition.wait(lock, [&batch]() { return batch->doneCount == batch->chunks.size(); });
+    }
+
+    std::vector<Chunk> &chunks = batch->chunks;
+    for (const Chunk &chunk : chunks) {
+        if (!chunk.error.empty()) {
+            error = chunk.error;
+            return false;
+        }
+    }
+
+    // Element offsets of the chunks, and all elements in file order
+    std::vector<size_t> firstElement[3];
+    size_t totals[3] = { 0, 0, 0 };
+    for (const Chunk &chunk : chunks) {
+        for (int stream = 0; stream < 3; ++stream) {
+            firstElement[stream].push_back(totals[stream]);
+            totals[stream] += chunk.counts[stream];
+        }
+    }
+
+    std::vector<float> positions, texCoords, normals;
+    positions.reserve(totals[POSITIONS] * 3);
+    texCoords.reserve((attributes & va::TEXCOORDS) ? totals[TEXCOORDS] * 2 : 0);
+    normals.reserve((attributes & va::NORMAL) ? totals[NORMALS] * 3 : 0);
+    for (Chunk &chunk : chunks) {
+        positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+        texCoords.insert(texCoords.end(), chunk.texCoords.begin(), chunk.texCoords.end());
+        normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+        std::vector<float>().swap(chunk.positions);
+        std::vector<float>().swap(chunk.texCoords);
+        std::vector<float>().swap(chunk.normals);
+    }
+
+    bool useTexCoords = (attributes & va::TEXCOORDS) && totals[TEXCOORDS] > 0;
+    bool useNormals = (attributes & va::NORMAL) && totals[NORMALS] > 0;
+    scene.attributes = va::POSITION | (useTexCoords ? va::TEXCOORDS : 0) | (useNormals ? va::NORMAL : 0);
+
+    // Materials come first, usemtl can only be resolved against them
+    std::unordered_map<std::string, int> materialByName;
+    std::string directory = directoryOf(path);
+    for (const Chunk &chunk : chunks) {
+        for (const Event &event : chunk.events) {
+            if (event.kind == Event::LIBRARY && !loadMtl(directory + event.name, scene.materials, materialByName))
+                error = "can't open " + directory + event.name;
+        }
+    }
+    // A missing library only costs the textures, like in Assimp
+    error.clear();
+
+    // Vertices already made for a position in the current mesh, chained through 'next'
+    struct Corner {
+        int64_t v, vt, vn;
+        uint32_t next;
+    };
+    constexpr uint32_t END = std::numeric_limits<uint32_t>::max();
+
+    std::vector<uint32_t> firstCorner(totals[POSITIONS], END);
+    std::vector<uint32_t> cornerMesh(totals[POSITIONS], END);
+    std::vector<Corner> meshCorners;
+
+    ObjMesh *mesh = nullptr;
+    int material = -1;
+
+    auto finishMesh = [&]() {
+        if (!mesh)
+            return;
+
+        mesh->vertices.resize(meshCorners.size());
+        for (size_t i = 0; i < meshCorners.size(); ++i) {
+            const Corner &corner = meshCorners[i];
+            Vertex &vertex = mesh->vertices[i];
+
+            std::memcpy(&vertex.Position, &positions[corner.v * 3], sizeof(glm::vec3));
+            if (corner.vt != NONE) {
+                vertex.TexCoords = glm::vec2(texCoords[corner.vt * 2], texCoords[corner.vt * 2 + 1]);
+                if (flipUVs)
+                    vertex.TexCoords.y = 1.0f - vertex.TexCoords.y;
+            }
+            if (corner.vn != NONE)
+                std::memcpy(&vertex.Normal, &normals[corner.vn * 3], sizeof(glm::vec3));
+        }
+
+        meshCorners.clear();
+        mesh = nullptr;
+    };
+
+    for (size_t c = 0; c < chunks.size(); ++c) {
+        const Chunk &chunk = chunks[c];
+        size_t nextEvent = 0;
+        size_t cornerIndex = 0;
+
+        for (size_t f = 0; f <= chunk.faceSizes.size(); ++f) {
+            // New object, group or material: the following faces start a new mesh
+            for (; nextEvent < chunk.events.size() && chunk.events[nextEvent].face == f; ++nextEvent) {
+                const Event &event = chunk.events[nextEvent];
+                if (event.kind == Event::LIBRARY)
+                    continue;
+
+                finishMesh();
+                if (event.kind == Event::MATERIAL) {
+                    auto inserted = materialByName.emplace(event.name, static_cast<int>(scene.materials.size()));
+                    if (inserted.second) {
+                        scene.materials.emplace_back();
+                        scene.materials.back().name = event.name;
+                    }
+                    material = inserted.first->second;
+                }
+            }
+            if (f == chunk.faceSizes.size())
+                break;
+
+            if (!mesh) {
+                scene.meshes.emplace_back();
+                mesh = &scene.meshes.back();
+                mesh->material = material;
+            }
+
+            uint32_t faceSize = chunk.faceSizes[f];
+            uint32_t faceVertices[3] = { 0, 0, 0 };
+
+            for (uint32_t k = 0; k < faceSize; ++k, cornerIndex += 3) {
+                int64_t indices[3];
+                for (int stream = 0; stream < 3; ++stream) {
+                    int64_t index = chunk.corners[cornerIndex + stream];
+                    if (index != NONE && index >= RELATIVE / 2)
+                        index = index - RELATIVE + static_cast<int64_t>(firstElement[stream][c]);
+
+                    if (index != NONE && (index < 0 || index >= static_cast<int64_t>(totals[stream]))) {
+                        error = "face index out of range";
+                        return false;
+                    }
+                    indices[stream] = index;
+                }
+
+                // Streams that aren't kept don't tell corners apart
+                if (!useTexCoords)
+                    indices[TEXCOORDS] = NONE;
+                if (!useNormals)
+                    indices[NORMALS] = NONE;
+
+                size_t v = static_cast<size_t>(indices[POSITIONS]);
+                if (cornerMesh[v] != scene.meshes.size()) {
+                    cornerMesh[v] = static_cast<uint32_t>(scene.meshes.size());
+                    firstCorner[v] = END;
+                }
+
+                uint32_t vertex = firstCorner[v];
+                while (vertex != END && (meshCorners[vertex].vt != indices[TEXCOORDS] || meshCorners[vertex].vn != indices[NORMALS]))
+                    vertex = meshCorners[vertex].next;
+
+                if (vertex == END) {
+                    vertex = static_cast<uint32_t>(meshCorners.size());
+                    meshCorners.push_back({ indices[POSITIONS], indices[TEXCOORDS], indices[NORMALS], firstCorner[v] });
+                    firstCorner[v] = vertex;
+                }
+
+                // Polygons become fans around their first corner
+                if (k < 2) {
+                    faceVertices[k] = vertex;
+                    continue;
+                }
+                faceVertices[2] = vertex;
+                mesh->indices.insert(mesh->indices.end(), faceVertices, faceVertices + 3);
+                faceVertices[1] = vertex;
+            }
+        }
+    }
+    finishMesh();
+
+    return true;
+}
+
+std::vector<std::string> getObjLibraryPaths(const std::string &path) {
+    std::vector<std::string> paths;
+    std::shared_ptr<const VfsFile> file = AssetVfs::shared().read(path);
+    if (!file)
+        return paths;
+
+    const char *p = reinterpret_cast<const char*>(file->getData());
+    const char *end = p + file->getSize();
+    std::string directory = directoryOf(path);
+
+    while (p < end) {
+        skipSpaces(p, end);
+        if (keyword(p, end, "mtllib", 6)) {
+            p += 7;
+            paths.push_back(directory + restOfLine(p, end));
+        }
+
+        while (p < end && *p != '\n')
+            ++p;
+        if (p < end)
+            ++p;
+    }
+
+    return paths;
+}
\ No newline at end of file
@@ -1,39 +1,43 @@
 #include "auxiliary/ShaderProgram.h"
 
 
-ShaderProgram::ShaderProgram(const char* vertexPath, const char* fragmentPath) {
-	// 1. Retrieve the vertex/fragment source code from filePath
+// GLSL wants #version before anything but comments, so the defines go on the line after it
+static void insertDefines(std::string &code, const std::vector<std::string> &defines) {
+	if (defines.empty())
+		return;
+
+	size_t position = 0;
+	size_t version = code.find("#version");
+	if (version != std::string::npos) {
+		size_t lineEnd = code.find('\n', version);
+		position = lineEnd == std::string::npos ? code.size() : lineEnd + 1;
+	}
+
+	std::string block;
+	for (const std::string &define : defines)
+		block += "#define " + define + "\n";
+	code.insert(position, block);
+}
+
+
+ShaderProgram::ShaderProgram(const char* vertexPath, const char* fragmentPath, const std::vector<std::string> &defines) {
+	// 1. Retrieve the vertex/fragment source code from filePath, through the VFS so that shaders can come from the asset pack
 	std::string vertexCode;
 	std::string fragmentCode;
-	std::ifstream vShaderFile;
-	std::ifstream fShaderFile;
+	std::shared_ptr<const VfsFile> vShaderFile = AssetVfs::shared().read(vertexPath);
+	std::shared_ptr<const VfsFile> fShaderFile = AssetVfs::shared().read(fragmentPath);
 
-	// Ensure ifstream objects can throw exceptions:
-	vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-	fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-	
-	try {
-		// Open files
-		vShaderFile.open(vertexPath);
-		fShaderFile.open(fragmentPath);
-		std::stringstream vShaderStream, fShaderStream;
-
-		// Read files buffer contents into streams
-		vShaderStream << vShaderFile.rdbuf();
-		fShaderStream << fShaderFile.rdbuf();
-
-		// Close file handlers
-		vShaderFile.close();
-		fShaderFile.close();
-
-		// Convert stream into string
-		vertexCode = vShaderStream.str();
-		fragmentCode = fShaderStream.str();
+	if (vShaderFile && fShaderFile) {
+		vertexCode.assign(reinterpret_cast<const char*>(vShaderFile->getData()), vShaderFile->getSize());
+		fragmentCode.assign(reinterpret_cast<const char*>(fShaderFile->getData()), fShaderFile->getSize());
 	}
-	catch (std::ifstream::failure e) {
+	else {
 		std::cerr << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
 	}
 
+	insertDefines(vertexCode, defines);
+	insertDefines(fragmentCode, defines);
+
 	const char* vertShaderCode = vertexCode.c_str();
 	const char* fragShaderCode = fragmentCode.c_str();
 
@@ -80,4 +84,24 @@ ShaderProgram::ShaderProgram(const char* vertexPath, const char* fragmentPath) {
 	// Delete shaders; theyre linked into our program and no longer necessary
 	glDeleteShader(vertexShader);
 	glDeleteShader(fragmentShader);
+}
+
+unsigned int ShaderProgram::getActiveAttributeMask() const {
+	int attributeCount = 0;
+	glGetProgramiv(programID, GL_ACTIVE_ATTRIBUTES, &attributeCount);
+
+	unsigned int mask = 0;
+	char name[sp::logSize];
+	for (int i = 0; i < attributeCount; ++i) {
+		int size;
+		GLenum type;
+		glGetActiveAttrib(programID, i, sp::logSize, NULL, &size, &type, name);
+
+		// Built-ins like gl_VertexID are active too, but have no location
+		int location = glGetAttribLocation(programID, name);
+		if (location >= 0 && location < 32)
+			mask |= 1u << location;
+	}
+
+	return mask;
 }
\ No newline at end of file
@@ -0,0 +1,323 @@
+#include "auxiliary/TextureArrayManager.h"
+
+#include <algorithm>
+#include <iostream>
+
+
+namespace ta {
+    bool ENABLED = false;
+}
+
+
+int materialSlotFromType(const std::string &type) {
+    if (type == "texture_diffuse")
+        return ta::DIFFUSE;
+    else if (type == "texture_specular")
+        return ta::SPECULAR;
+    else if (type == "texture_emissive")
+        return ta::EMISSIVE;
+
+    return -1;
+}
+
+
+size_t TextureArrayManager::TextureArray::getLayerBytes() const {
+    size_t bytes = 0;
+    for (size_t size : levelSizes)
+        bytes += size;
+
+    return bytes;
+}
+
+std::string TextureArrayManager::makeKey(int slot, const std::string &key) {
+    return std::to_string(slot) + ":" + key;
+}
+
+std::string TextureArrayManager::makeHashKey(int slot, uint64_t contentHash) {
+    return std::to_string(slot) + "#" + std::to_string(contentHash);
+}
+
+bool TextureArrayManager::findLocked(int slot, const std::string &key, uint64_t contentHash, uint64_t &found) const {
+    auto byKey = layerByKey.find(makeKey(slot, key));
+    if (byKey == layerByKey.end() && contentHash != 0)
+        byKey = layerByKey.find(makeHashKey(slot, contentHash));
+    if (byKey == layerByKey.end())
+        return false;
+
+    found = byKey->second;
+    return true;
+}
+
+bool TextureArrayManager::contains(int slot, const std::string &key, uint64_t contentHash) const {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    uint64_t found;
+    return findLocked(slot, key, contentHash, found);
+}
+
+TextureLayer TextureArrayManager::acquire(int slot, const std::string &key, uint64_t contentHash, DecodedImage &image) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        uint64_t found;
+        if (findLocked(slot, key, contentHash, found)) {
+            LayerEntry &entry = layers[found];
+            ++entry.refCount;
+
+            // Same image under another path: remember the alias for the next lookup
+            std::string slotKey = makeKey(slot, key);
+            if (layerByKey.emplace(slotKey, found).second)
+                entry.keys.push_back(slotKey);
+
+            return { static_cast<unsigned int>(found >> 32), static_cast<int>(found & 0xFFFFFFFFu) };
+        }
+    }
+
+    // Skipped at import because it was resident, but released since then
+    if (!image.isLoaded())
+        image = decodeImage(image.path);
+
+    // Every layer of an array has the same levels, so images that weren't baked get their chain built here rather than by the driver
+    std::shared_ptr<const BakedTexture> chain = image.baked;
+    if (!chain && image.pixels)
+        chain = BakedTexture::fromImage(image.pixels.get(), image.width, image.height, image.components);
+    if (!chain) {
+        std::cout << "Texture failed to load at path: " << image.path << std::endl;
+        return TextureLayer();
+    }
+
+    unsigned int handle = findArray(slot, *chain);
+    TextureArray &array = arrays.at(handle);
+
+    int layer;
+    if (!array.freeLayers.empty()) {
+        layer = array.freeLayers.back();
+        array.freeLayers.pop_back();
+    }
+    else
+        layer = array.layerCount++;
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, array.texture);
+    uploadBakedLayer(*chain, layer);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    // The upload went through whichever unit was active
+    std::fill(std::begin(boundArrays), std::end(boundArrays), 0);
+
+    ++uploadCount;
+    uploadedBytes += array.getLayerBytes();
+
+    uint64_t id = (static_cast<uint64_t>(handle) << 32) | static_cast<uint32_t>(layer);
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    LayerEntry &entry = layers[id];
+    entry.refCount = 1;
+    entry.keys.push_back(makeKey(slot, key));
+    layerByKey[entry.keys.back()] = id;
+
+    if (contentHash != 0 && layerByKey.emplace(makeHashKey(slot, contentHash), id).second)
+        entry.keys.push_back(makeHashKey(slot, contentHash));
+
+    return { handle, layer };
+}
+
+unsigned int TextureArrayManager::findArray(int slot, const BakedTexture &texture) {
+    GLenum internalFormat = getUploadFormat(texture);
+    const std::vector<BakedTexture::Level> &levels = texture.getLevels();
+
+    GLint maxLayers;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+
+    unsigned int growable = 0;
+    for (auto &entry : arrays) {
+        const TextureArray &array = entry.second;
+        if (array.slot != slot || array.width != texture.getWidth() || array.height != texture.getHeight() || array.internalFormat != internalFormat
+            || array.levelSizes.size() != levels.size())
+            continue;
+
+        if (!array.freeLayers.empty() || array.layerCount < array.capacity)
+            return entry.first;
+        if (array.capacity < maxLayers)
+            growable = entry.first;
+    }
+
+    if (growable) {
+        TextureArray &array = arrays.at(growable);
+        grow(array, std::min(array.capacity * 2, static_cast<int>(maxLayers)));
+        return growable;
+    }
+
+    unsigned int handle = nextHandle++;
+    TextureArray &array = arrays[handle];
+    array.slot = slot;
+    array.width = texture.getWidth();
+    array.height = texture.getHeight();
+    array.internalFormat = internalFormat;
+
+    // Levels decoded for a driver without S3TC are uploaded as RGBA
+    bool decoded = texture.getFormat() != BakedFormat::UNCOMPRESSED && internalFormat != texture.getInternalFormat();
+    array.pixelFormat = texture.getFormat() == BakedFormat::UNCOMPRESSED ? texture.getPixelFormat() : decoded ? GL_RGBA : 0;
+    for (const BakedTexture::Level &level : levels)
+        array.levelSizes.push_back(decoded ? static_cast<size_t>(level.width) * level.height * 4 : level.size);
+
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    allocate(array, textureID, std::min(ta::INITIAL_LAYERS, static_cast<int>(maxLayers)));
+
+    return handle;
+}
+
+void TextureArrayManager::allocate(TextureArray &array, unsigned int texture, int capacity) {
+    array.texture = texture;
+    array.capacity = capacity;
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    for (size_t i = 0; i < array.levelSizes.size(); ++i) {
+        GLint level = static_cast<GLint>(i);
+        int width = std::max(1, array.width >> level);
+        int height = std::max(1, array.height >> level);
+
+        if (array.pixelFormat)
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, level, array.internalFormat, width, height, capacity, 0, array.pixelFormat, GL_UNSIGNED_BYTE, nullptr);
+        else
+            glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, array.internalFormat, width, height, capacity, 0,
+                                   static_cast<GLsizei>(array.levelSizes[i] * capacity), nullptr);
+    }
+
+    // Sampled like the textures uploadTexture creates
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(array.levelSizes.size()) - 1);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+void TextureArrayManager::grow(TextureArray &array, int capacity) {
+    unsigned int oldTexture = array.texture;
+    int oldCapacity = array.capacity;
+
+    unsigned int newTexture;
+    glGenTextures(1, &newTexture);
+    allocate(array, newTexture, capacity);
+
+    // GL 3.3 has no glCopyImageSubData: every level is read into a buffer and written back from it, without leaving the GPU
+    unsigned int buffer;
+    glGenBuffers(1, &buffer);
+    for (size_t i = 0; i < array.levelSizes.size(); ++i) {
+        GLint level = static_cast<GLint>(i);
+        int width = std::max(1, array.width >> level);
+        int height = std::max(1, array.height >> level);
+        size_t bytes = array.levelSizes[i] * oldCapacity;
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_COPY);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, oldTexture);
+        if (array.pixelFormat)
+            glGetTexImage(GL_TEXTURE_2D_ARRAY, level, array.pixelFormat, GL_UNSIGNED_BYTE, nullptr);
+        else
+            glGetCompressedTexImage(GL_TEXTURE_2D_ARRAY, level, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, newTexture);
+        if (array.pixelFormat)
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, 0, width, height, oldCapacity, array.pixelFormat, GL_UNSIGNED_BYTE, nullptr);
+        else
+            glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, 0, width, height, oldCapacity, array.internalFormat,
+                                      static_cast<GLsizei>(bytes), nullptr);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    glDeleteBuffers(1, &buffer);
+    glDeleteTextures(1, &oldTexture);
+
+    ++grownCount;
+}
+
+void TextureArrayManager::release(const TextureLayer &layer) {
+    if (layer.array == 0)
+        return;
+
+    uint64_t id = (static_cast<uint64_t>(layer.array) << 32) | static_cast<uint32_t>(layer.layer);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto it = layers.find(id);
+        if (it == layers.end() || --it->second.refCount > 0)
+            return;
+
+        for (const std::string &key : it->second.keys)
+            layerByKey.erase(key);
+        layers.erase(it);
+    }
+
+    auto found = arrays.find(layer.array);
+    if (found == arrays.end())
+        return;
+
+    TextureArray &array = found->second;
+    array.freeLayers.push_back(layer.layer);
+    if (static_cast<int>(array.freeLayers.size()) < array.layerCount)
+        return;
+
+    glDeleteTextures(1, &array.texture);
+    arrays.erase(found);
+
+    for (unsigned int &bound : boundArrays) {
+        if (bound == layer.array)
+            bound = 0;
+    }
+}
+
+void TextureArrayManager::bind(int slot, unsigned int array) {
+    if (boundArrays[slot] == array) {
+        ++skippedBindCount;
+        return;
+    }
+
+    auto found = arrays.find(array);
+    glActiveTexture(GL_TEXTURE0 + ta::FIRST_UNIT + slot);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, found != arrays.end() ? found->second.texture : 0);
+
+    boundArrays[slot] = array;
+    ++bindCount;
+}
+
+size_t TextureArrayManager::getLayerBytes(unsigned int array) const {
+    auto found = arrays.find(array);
+    return found != arrays.end() ? found->second.getLayerBytes() : 0;
+}
+
+size_t TextureArrayManager::getArrayCount() const {
+    return arrays.size();
+}
+
+size_t TextureArrayManager::getResidentBytes() const {
+    size_t bytes = 0;
+    for (const auto &entry : arrays)
+        bytes += entry.second.getLayerBytes() * entry.second.capacity;
+
+    return bytes;
+}
+
+void TextureArrayManager::logStats() const {
+    constexpr double MB = 1024.0 * 1024.0;
+    static const char *slotNames[ta::SLOT_COUNT] = { "diffuse", "specular", "emissive" };
+
+    std::cout << "TEXTURE ARRAYS: " << getArrayCount() << " arrays (" << getResidentBytes() / MB << " MB), " << uploadCount << " layers uploaded ("
+        << uploadedBytes / MB << " MB), " << grownCount << " arrays grown, " << bindCount << " binds, " << skippedBindCount << " binds skipped" << std::endl;
+
+    for (const auto &entry : arrays) {
+        const TextureArray &array = entry.second;
+        std::cout << "  " << slotNames[array.slot] << " " << array.width << "x" << array.height << ", " << array.levelSizes.size() << " levels, "
+            << array.layerCount - array.freeLayers.size() << "/" << array.capacity << " layers, "
+            << array.getLayerBytes() * array.capacity / MB << " MB" << std::endl;
+    }
+}
+
+TextureArrayManager& TextureArrayManager::shared() {
+    static TextureArrayManager manager;
+    return manager;
+}
\ No newline at end of file
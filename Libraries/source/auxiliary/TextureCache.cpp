@@ -0,0 +1,147 @@
+#include "auxiliary/TextureCache.h"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <iostream>
+
+
+namespace tc {
+    bool HASH_CONTENTS = false;
+}
+
+
+std::string TextureCache::normalizePath(const std::string &path) {
+    std::error_code error;
+    std::filesystem::path absolute = std::filesystem::absolute(path, error);
+    if (error)
+        absolute = path;
+
+    std::string normalized = absolute.lexically_normal().make_preferred().string();
+#ifdef _WIN32
+    std::transform(normalized.begin(), normalized.end(), normalized.begin(), [](unsigned char c) {
+        return static_cast<char>(std::tolower(c));
+    });
+#endif
+
+    return normalized;
+}
+
+unsigned int TextureCache::findLocked(const std::string &key, uint64_t contentHash) const {
+    auto byKey = idByKey.find(key);
+    if (byKey != idByKey.end())
+        return byKey->second;
+
+    if (contentHash != 0) {
+        auto byHash = idByHash.find(contentHash);
+        if (byHash != idByHash.end())
+            return byHash->second;
+    }
+
+    return 0;
+}
+
+bool TextureCache::contains(const std::string &path, uint64_t contentHash) const {
+    std::string key = normalizePath(path);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    return findLocked(key, contentHash) != 0;
+}
+
+unsigned int TextureCache::acquire(const std::string &key, uint64_t contentHash,
+                                   const std::function<unsigned int(size_t &byteSize)> &upload, GLenum target) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        unsigned int textureID = findLocked(key, contentHash);
+        if (textureID != 0) {
+            Entry &entry = entries[textureID];
+            ++entry.refCount;
+
+            // Same image under another path: remember the alias for O(1) lookups next time
+            if (idByKey.emplace(key, textureID).second)
+                entry.keys.push_back(key);
+
+            ++savedUploadCount;
+            savedBytes += entry.byteSize;
+            return textureID;
+        }
+    }
+
+    // Only the GL thread acquires, so nobody can insert the same key while the lock is released for the upload
+    size_t byteSize = 0;
+    unsigned int textureID = upload(byteSize);
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    Entry &entry = entries[textureID];
+    entry.refCount = 1;
+    entry.byteSize = byteSize;
+    entry.contentHash = contentHash;
+    entry.target = target;
+    entry.keys.push_back(key);
+
+    idByKey[key] = textureID;
+    if (contentHash != 0)
+        idByHash.emplace(contentHash, textureID);
+
+    ++uploadCount;
+    uploadedBytes += byteSize;
+
+    return textureID;
+}
+
+bool TextureCache::release(unsigned int textureID) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = entries.find(textureID);
+    if (it == entries.end() || --it->second.refCount > 0)
+        return false;
+
+    for (const std::string &key : it->second.keys)
+        idByKey.erase(key);
+
+    auto byHash = idByHash.find(it->second.contentHash);
+    if (byHash != idByHash.end() && byHash->second == textureID)
+        idByHash.erase(byHash);
+
+    entries.erase(it);
+    glDeleteTextures(1, &textureID);
+
+    return true;
+}
+
+size_t TextureCache::getByteSize(unsigned int textureID) const {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = entries.find(textureID);
+    return it != entries.end() ? it->second.byteSize : 0;
+}
+
+size_t TextureCache::getResidentCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}
+
+size_t TextureCache::getResidentBytes() const {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    size_t bytes = 0;
+    for (const auto &entry : entries)
+        bytes += entry.second.byteSize;
+
+    return bytes;
+}
+
+void TextureCache::logStats() const {
+    constexpr double MB = 1024.0 * 1024.0;
+
+    std::cout << "TEXTURE CACHE: " << getResidentCount() << " textures resident (" << getResidentBytes() / MB << " MB), "
+        << uploadCount << " uploads (" << uploadedBytes / MB << " MB), "
+        << savedUploadCount << " uploads saved (" << savedBytes / MB << " MB)" << std::endl;
+}
+
+TextureCache& TextureCache::shared() {
+    static TextureCache cache;
+    return cache;
+}
\ No newline at end of file
@@ -0,0 +1,885 @@
+#include <glad/glad.h>
+
+#include "auxiliary/TextureContainer.h"
+
+#include "stb_image.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <sstream>
+#include <utility>
+
+
+namespace ktx {
+    bool ENABLED = true;
+    bool COMPRESS = true;
+}
+
+
+namespace {
+    const unsigned char IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+    constexpr uint32_t ENDIANNESS = 0x04030201;
+
+    // glad is generated for the core profile only, which leaves out the S3TC extension's enums
+    constexpr uint32_t COMPRESSED_RGB_S3TC_DXT1 = 0x83F0;
+    constexpr uint32_t COMPRESSED_RGBA_S3TC_DXT5 = 0x83F3;
+
+    // Follows the identifier
+    struct KtxHeader {
+        uint32_t endianness;
+        uint32_t glType;
+        uint32_t glTypeSize;
+        uint32_t glFormat;
+        uint32_t glInternalFormat;
+        uint32_t glBaseInternalFormat;
+        uint32_t pixelWidth;
+        uint32_t pixelHeight;
+        uint32_t pixelDepth;
+        uint32_t numberOfArrayElements;
+        uint32_t numberOfFaces;
+        uint32_t numberOfMipmapLevels;
+        uint32_t bytesOfKeyValueData;
+    };
+
+    uint32_t pixelFormatFromComponents(int components) {
+        if (components == 1)
+            return GL_RED;
+        else if (components == 2)
+            return GL_RG;
+        else if (components == 3)
+            return GL_RGB;
+
+        return GL_RGBA;
+    }
+
+    uint32_t sizedFormatFromComponents(int components) {
+        if (components == 1)
+            return GL_R8;
+        else if (components == 2)
+            return GL_RG8;
+        else if (components == 3)
+            return GL_RGB8;
+
+        return GL_RGBA8;
+    }
+
+    // Uncompressed rows are padded to 4 bytes, as KTX requires and GL_UNPACK_ALIGNMENT expects by default
+    size_t getLevelSize(BakedFormat format, int components, int width, int height) {
+        if (format == BakedFormat::UNCOMPRESSED)
+            return ((static_cast<size_t>(width) * components + 3) & ~size_t(3)) * height;
+
+        size_t blockCount = static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4);
+        return blockCount * (format == BakedFormat::BC1 ? 8 : 16);
+    }
+
+    inline uint16_t read16(const unsigned char *p) {
+        return static_cast<uint16_t>(p[0] | (p[1] << 8));
+    }
+
+    inline void write16(unsigned char *p, uint16_t value) {
+        p[0] = static_cast<unsigned char>(value & 0xFF);
+        p[1] = static_cast<unsigned char>(value >> 8);
+    }
+
+    inline uint16_t packRgb565(const float *color) {
+        auto quantize = [](float value, int maximum) {
+            return static_cast<int>(std::clamp(value, 0.0f, 255.0f) * maximum / 255.0f + 0.5f);
+        };
+        return static_cast<uint16_t>((quantize(color[0], 31) << 11) | (quantize(color[1], 63) << 5) | quantize(color[2], 31));
+    }
+
+    inline void unpackRgb565(uint16_t packed, int *color) {
+        int r = (packed >> 11) & 31;
+        int g = (packed >> 5) & 63;
+        int b = packed & 31;
+        color[0] = (r << 3) | (r >> 2);
+        color[1] = (g << 2) | (g >> 4);
+        color[2] = (b << 3) | (b >> 2);
+    }
+
+    // Endpoints at the extremes of the block's principal axis, each pixel snapped to the nearest of the four colors between them.
+    // The endpoints are ordered so the block decodes in four-color mode, which is also the only mode BC3 color blocks have.
+    void encodeColorBlock(const unsigned char *rgba, unsigned char *block) {
+        float mean[3] = {};
+        for (int i = 0; i < 16; ++i) {
+            for (int c = 0; c < 3; ++c)
+                mean[c] += rgba[i * 4 + c] / 16.0f;
+        }
+
+        float covariance[6] = {};
+        for (int i = 0; i < 16; ++i) {
+            float r = rgba[i * 4] - mean[0];
+            float g = rgba[i * 4 + 1] - mean[1];
+            float b = rgba[i * 4 + 2] - mean[2];
+            covariance[0] += r * r;
+            covariance[1] += r * g;
+            covariance[2] += r * b;
+            covariance[3] += g * g;
+            covariance[4] += g * b;
+            covariance[5] += b * b;
+        }
+
+        // Power iteration for the principal axis, started from the channel that varies most. A fixed start like grey never
+        // leaves the plane orthogonal to it when the axis lies there, as for red against green, and the block comes out flat.
+        int channel = covariance[0] >= covariance[3] ? (covariance[0] >= covariance[5] ? 0 : 2) : (covariance[3] >= covariance[5] ? 1 : 2);
+        float axis[3] = {};
+        axis[channel] = 1.0f;
+        for (int iteration = 0; iteration < 8; ++iteration) {
+            float next[3] = {
+                covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+                covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+                covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2],
+            };
+            float largest = std::max({ std::abs(next[0]), std::abs(next[1]), std::abs(next[2]) });
+            if (largest < 1e-6f)
+                break;
+            for (int c = 0; c < 3; ++c)
+                axis[c] = next[c] / largest;
+        }
+        float length = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+        for (int c = 0; c < 3; ++c)
+            axis[c] /= length;
+
+        float minProjection = 0.0f;
+        float maxProjection = 0.0f;
+        for (int i = 0; i < 16; ++i) {
+            float projection = (rgba[i * 4] - mean[0]) * axis[0] + (rgba[i * 4 + 1] - mean[1]) * axis[1] + (rgba[i * 4 + 2] - mean[2]) * axis[2];
+            minProjection = std::min(minProjection, projection);
+            maxProjection = std::max(maxProjection, projection);
+        }
+
+        float maxEnd[3];
+        float minEnd[3];
+        for (int c = 0; c < 3; ++c) {
+            maxEnd[c] = mean[c] + axis[c] * maxProjection;
+            minEnd[c] = mean[c] + axis[c] * minProjection;
+        }
+
+        uint16_t color0 = packRgb565(maxEnd);
+        uint16_t color1 = packRgb565(minEnd);
+        if (color0 < color1)
+            std::swap(color0, color1);
+
+        write16(block, color0);
+        write16(block + 2, color1);
+
+        uint32_t indices = 0;
+        if (color0 != color1) {
+            int palette[4][3];
+            unpackRgb565(color0, palette[0]);
+            unpackRgb565(color1, palette[1]);
+            for (int c = 0; c < 3; ++c) {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+
+            for (int i = 0; i < 16; ++i) {
+                int bestDistance = INT_MAX;
+                uint32_t bestIndex = 0;
+                for (uint32_t p = 0; p < 4; ++p) {
+                    int dr = rgba[i * 4] - palette[p][0];
+                    int dg = rgba[i * 4 + 1] - palette[p][1];
+                    int db = rgba[i * 4 + 2] - palette[p][2];
+                    int distance = dr * dr + dg * dg + db * db;
+                    if (distance < bestDistance) {
+                        bestDistance = distance;
+                        bestIndex = p;
+                    }
+                }
+                indices |= bestIndex << (2 * i);
+            }
+        }
+
+        for (int i = 0; i < 4; ++i)
+            block[4 + i] = static_cast<unsigned char>(indices >> (8 * i));
+    }
+
+    void decodeColorBlock(const unsigned char *block, unsigned char *rgba, bool fourColorsOnly) {
+        uint16_t color0 = read16(block);
+        uint16_t color1 = read16(block + 2);
+
+        int palette[4][3];
+        unpackRgb565(color0, palette[0]);
+        unpackRgb565(color1, palette[1]);
+        for (int c = 0; c < 3; ++c) {
+            if (color0 > color1 || fourColorsOnly) {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+            else {
+                // Three-color mode; the fourth is black, opaque in the RGB variant of BC1 that's baked here
+                palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+                palette[3][c] = 0;
+            }
+        }
+
+        uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) | (static_cast<uint32_t>(block[7]) << 24);
+        for (int i = 0; i < 16; ++i) {
+            const int *color = palette[(indices >> (2 * i)) & 3];
+            rgba[i * 4] = static_cast<unsigned char>(color[0]);
+            rgba[i * 4 + 1] = static_cast<unsigned char>(color[1]);
+            rgba[i * 4 + 2] = static_cast<unsigned char>(color[2]);
+            rgba[i * 4 + 3] = 255;
+        }
+    }
+
+    // Two endpoint alphas and six interpolated ones between them, three bits per pixel
+    void encodeAlphaBlock(const unsigned char *rgba, unsigned char *block) {
+        int alpha0 = 0;
+        int alpha1 = 255;
+        for (int i = 0; i < 16; ++i) {
+            alpha0 = std::max<int>(alpha0, rgba[i * 4 + 3]);
+            alpha1 = std::min<int>(alpha1, rgba[i * 4 + 3]);
+        }
+
+        block[0] = static_cast<unsigned char>(alpha0);
+        block[1] = static_cast<unsigned char>(alpha1);
+
+        uint64_t indices = 0;
+        if (alpha0 != alpha1) {
+            int palette[8] = { alpha0, alpha1 };
+            for (int p = 2; p < 8; ++p)
+                palette[p] = ((8 - p) * alpha0 + (p - 1) * alpha1) / 7;
+
+            for (int i = 0; i < 16; ++i) {
+                int bestDistance = INT_MAX;
+                uint64_t bestIndex = 0;
+                for (uint64_t p = 0; p < 8; ++p) {
+                    int distance = std::abs(rgba[i * 4 + 3] - palette[p]);
+                    if (distance < bestDistance) {
+                        bestDistance = distance;
+                        bestIndex = p;
+                    }
+                }
+                indices |= bestIndex << (3 * i);
+            }
+        }
+
+        for (int i = 0; i < 6; ++i)
+            block[2 + i] = static_cast<unsigned char>(indices >> (8 * i));
+    }
+
+    void decodeAlphaBlock(const unsigned char *block, unsigned char *rgba) {
+        int alpha0 = block[0];
+        int alpha1 = block[1];
+
+        int palette[8] = { alpha0, alpha1 };
+        if (alpha0 > alpha1) {
+            for (int p = 2; p < 8; ++p)
+                palette[p] = ((8 - p) * alpha0 + (p - 1) * alpha1) / 7;
+        }
+        else {
+            for (int p = 2; p < 6; ++p)
+                palette[p] = ((6 - p) * alpha0 + (p - 1) * alpha1) / 5;
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+
+        uint64_t indices = 0;
+        for (int i = 0; i < 6; ++i)
+            indices |= static_cast<uint64_t>(block[2 + i]) << (8 * i);
+        for (int i = 0; i < 16; ++i)
+            rgba[i * 4 + 3] = static_cast<unsigned char>(palette[(indices >> (3 * i)) & 7]);
+    }
+
+    // Edge blocks of levels that aren't a multiple of 4 repeat their last row and column
+    std::vector<unsigned char> encodeLevel(const unsigned char *pixels, int width, int height, int components, BakedFormat format) {
+        size_t blockSize = format == BakedFormat::BC1 ? 8 : 16;
+        int blocksX = (width + 3) / 4;
+        int blocksY = (height + 3) / 4;
+        std::vector<unsigned char> blocks(static_cast<size_t>(blocksX) * blocksY * blockSize);
+
+        unsigned char rgba[64];
+        for (int by = 0; by < blocksY; ++by) {
+            for (int bx = 0; bx < blocksX; ++bx) {
+                for (int i = 0; i < 16; ++i) {
+                    int x = std::min(bx * 4 + i % 4, width - 1);
+                    int y = std::min(by * 4 + i / 4, height - 1);
+                    const unsigned char *pixel = pixels + (static_cast<size_t>(y) * width + x) * components;
+
+                    rgba[i * 4] = pixel[0];
+                    rgba[i * 4 + 1] = pixel[1];
+                    rgba[i * 4 + 2] = pixel[2];
+                    rgba[i * 4 + 3] = components == 4 ? pixel[3] : 255;
+                }
+
+                unsigned char *block = blocks.data() + (static_cast<size_t>(by) * blocksX + bx) * blockSize;
+                if (format == BakedFormat::BC1)
+                    encodeBc1Block(rgba, block);
+                else
+                    encodeBc3Block(rgba, block);
+            }
+        }
+
+        return blocks;
+    }
+
+    std::vector<unsigned char> padRows(const unsigned char *pixels, int width, int height, int components) {
+        size_t rowSize = static_cast<size_t>(width) * components;
+        size_t paddedRowSize = (rowSize + 3) & ~size_t(3);
+
+        std::vector<unsigned char> padded(paddedRowSize * height, 0);
+        for (int y = 0; y < height; ++y)
+            std::memcpy(padded.data() + y * paddedRowSize, pixels + y * rowSize, rowSize);
+
+        return padded;
+    }
+
+    // Decodes a BC1 or BC3 level back to RGBA8, for drivers without S3TC
+    std::vector<unsigned char> decodeLevel(const BakedTexture::Level &level, BakedFormat format) {
+        size_t blockSize = format == BakedFormat::BC1 ? 8 : 16;
+        int blocksX = (level.width + 3) / 4;
+        int blocksY = (level.height + 3) / 4;
+        std::vector<unsigned char> pixels(static_cast<size_t>(level.width) * level.height * 4);
+
+        unsigned char rgba[64];
+        for (int by = 0; by < blocksY; ++by) {
+            for (int bx = 0; bx < blocksX; ++bx) {
+                const unsigned char *block = level.data + (static_cast<size_t>(by) * blocksX + bx) * blockSize;
+                if (format == BakedFormat::BC1)
+                    decodeBc1Block(block, rgba);
+                else
+                    decodeBc3Block(block, rgba);
+
+                for (int i = 0; i < 16; ++i) {
+                    int x = bx * 4 + i % 4;
+                    int y = by * 4 + i / 4;
+                    if (x < level.width && y < level.height)
+                        std::memcpy(pixels.data() + (static_cast<size_t>(y) * level.width + x) * 4, rgba + i * 4, 4);
+                }
+            }
+        }
+
+        return pixels;
+    }
+
+    bool hasImageExtension(const std::filesystem::path &path) {
+        std::string extension = path.extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) {
+            return static_cast<char>(std::tolower(c));
+        });
+
+        return extension == ".png" || extension == ".jpg" || extension == ".jpeg" || extension == ".tga" || extension == ".bmp";
+    }
+}
+
+
+void encodeBc1Block(const unsigned char *rgba, unsigned char *block) {
+    encodeColorBlock(rgba, block);
+}
+
+void encodeBc3Block(const unsigned char *rgba, unsigned char *block) {
+    encodeAlphaBlock(rgba, block);
+    encodeColorBlock(rgba, block + 8);
+}
+
+void decodeBc1Block(const unsigned char *block, unsigned char *rgba) {
+    decodeColorBlock(block, rgba, false);
+}
+
+void decodeBc3Block(const unsigned char *block, unsigned char *rgba) {
+    decodeColorBlock(block + 8, rgba, true);
+    decodeAlphaBlock(block, rgba);
+}
+
+
+std::shared_ptr<const BakedTexture> BakedTexture::parse(std::shared_ptr<const VfsFile> file, std::string &error) {
+    error.clear();
+
+    const unsigned char *data = file->getData();
+    size_t size = file->getSize();
+
+    KtxHeader header;
+    if (size < sizeof(IDENTIFIER) + sizeof(header) || std::memcmp(data, IDENTIFIER, sizeof(IDENTIFIER)) != 0) {
+        error = "not a KTX 1.1 file";
+        return nullptr;
+    }
+    std::memcpy(&header, data + sizeof(IDENTIFIER), sizeof(header));
+
+    if (header.endianness != ENDIANNESS) {
+        error = "byte order doesn't match this machine's";
+        return nullptr;
+    }
+    if (header.pixelDepth != 0 || header.numberOfArrayElements != 0 || header.numberOfFaces != 1 || header.pixelWidth == 0 || header.pixelHeight == 0
+        || header.pixelWidth > INT_MAX || header.pixelHeight > INT_MAX) {
+        error = "not a 2D texture";
+        return nullptr;
+    }
+
+    auto texture = std::make_shared<BakedTexture>();
+    texture->internalFormat = header.glInternalFormat;
+    texture->pixelFormat = header.glFormat;
+
+    if (header.glType == 0 && header.glInternalFormat == COMPRESSED_RGB_S3TC_DXT1) {
+        texture->format = BakedFormat::BC1;
+        texture->components = 3;
+    }
+    else if (header.glType == 0 && header.glInternalFormat == COMPRESSED_RGBA_S3TC_DXT5) {
+        texture->format = BakedFormat::BC3;
+        texture->components = 4;
+    }
+    else if (header.glType == GL_UNSIGNED_BYTE) {
+        for (int components = 1; components <= 4; ++components) {
+            if (header.glFormat == pixelFormatFromComponents(components) && header.glInternalFormat == sizedFormatFromComponents(components))
+                texture->components = components;
+        }
+    }
+    if (texture->components == 0) {
+        error = "unsupported format " + std::to_string(header.glInternalFormat);
+        return nullptr;
+    }
+
+    // Zero levels would ask the loader to generate them, which is what baking is meant to avoid
+    uint32_t fullChainLength = 1;
+    for (uint32_t extent = std::max(header.pixelWidth, header.pixelHeight); extent > 1; extent /= 2)
+        ++fullChainLength;
+    if (header.numberOfMipmapLevels == 0 || header.numberOfMipmapLevels > fullChainLength) {
+        error = "has " + std::to_string(header.numberOfMipmapLevels) + " mip levels";
+        return nullptr;
+    }
+
+    size_t offset = sizeof(IDENTIFIER) + sizeof(header);
+    if (header.bytesOfKeyValueData > size - offset) {
+        error = "is truncated";
+        return nullptr;
+    }
+    offset += header.bytesOfKeyValueData;
+
+    int width = static_cast<int>(header.pixelWidth);
+    int height = static_cast<int>(header.pixelHeight);
+    for (uint32_t i = 0; i < header.numberOfMipmapLevels; ++i) {
+        uint32_t imageSize;
+        if (size - offset < sizeof(imageSize)) {
+            error = "is truncated";
+            return nullptr;
+        }
+        std::memcpy(&imageSize, data + offset, sizeof(imageSize));
+        offset += sizeof(imageSize);
+
+        size_t expectedSize = getLevelSize(texture->format, texture->components, width, height);
+        if (imageSize != expectedSize) {
+            error = "level " + std::to_string(i) + " has " + std::to_string(imageSize) + " bytes instead of " + std::to_string(expectedSize);
+            return nullptr;
+        }
+        if (size - offset < imageSize) {
+            error = "is truncated";
+            return nullptr;
+        }
+
+        texture->levels.push_back({ width, height, data + offset, imageSize });
+
+        // Levels start 4-byte aligned
+        offset += std::min<size_t>(size - offset, (imageSize + 3) & ~uint32_t(3));
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+
+    texture->file = std::move(file);
+    return texture;
+}
+
+std::shared_ptr<const BakedTexture> BakedTexture::fromImage(const unsigned char *pixels, int width, int height, int components) {
+    auto texture = std::make_shared<BakedTexture>();
+    texture->format = BakedFormat::UNCOMPRESSED;
+    texture->components = components;
+    texture->internalFormat = sizedFormatFromComponents(components);
+    texture->pixelFormat = pixelFormatFromComponents(components);
+
+    // Sized up front, so the levels can point into the storage while it's filled
+    size_t totalSize = 0;
+    for (int levelWidth = width, levelHeight = height; ; levelWidth = std::max(1, levelWidth / 2), levelHeight = std::max(1, levelHeight / 2)) {
+        totalSize += getLevelSize(BakedFormat::UNCOMPRESSED, components, levelWidth, levelHeight);
+        if (levelWidth == 1 && levelHeight == 1)
+            break;
+    }
+    texture->storage.resize(totalSize);
+
+    std::vector<unsigned char> current;
+    const unsigned char *levelPixels = pixels;
+    int levelWidth = width;
+    int levelHeight = height;
+    size_t offset = 0;
+    while (true) {
+        std::vector<unsigned char> padded = padRows(levelPixels, levelWidth, levelHeight, components);
+        std::memcpy(texture->storage.data() + offset, padded.data(), padded.size());
+        texture->levels.push_back({ levelWidth, levelHeight, texture->storage.data() + offset, padded.size() });
+        offset += padded.size();
+
+        if (levelWidth == 1 && levelHeight == 1)
+            break;
+
+        int nextWidth, nextHeight;
+        current = downsampleImage(levelPixels, levelWidth, levelHeight, components, nextWidth, nextHeight);
+        levelPixels = current.data();
+        levelWidth = nextWidth;
+        levelHeight = nextHeight;
+    }
+
+    return texture;
+}
+
+size_t BakedTexture::getByteSize() const {
+    size_t bytes = 0;
+    for (const Level &level : levels)
+        bytes += level.size;
+
+    return bytes;
+}
+
+const char* BakedTexture::getFormatName() const {
+    if (format == BakedFormat::BC1)
+        return "BC1";
+    else if (format == BakedFormat::BC3)
+        return "BC3";
+
+    return components == 1 ? "R8" : components == 2 ? "RG8" : components == 3 ? "RGB8" : "RGBA8";
+}
+
+
+std::shared_ptr<const BakedTexture> loadBakedTexture(const std::string &imagePath) {
+    std::string bakedPath = imagePath + ktx::EXTENSION;
+    AssetVfs &vfs = AssetVfs::shared();
+    if (!vfs.exists(bakedPath))
+        return nullptr;
+
+    // Loose images may have been edited since they were baked; packed ones are only ever packed together with what was baked from them
+    if (!vfs.isPacked(bakedPath) && !vfs.isPacked(imagePath)) {
+        std::error_code imageError, bakedError;
+        std::filesystem::file_time_type imageTime = std::filesystem::last_write_time(imagePath, imageError);
+        std::filesystem::file_time_type bakedTime = std::filesystem::last_write_time(bakedPath, bakedError);
+        if (!imageError && !bakedError && bakedTime < imageTime) {
+            std::cout << "ERROR::TEXTURE_CONTAINER::STALE: " << bakedPath << " is older than its image, decoding the image instead" << std::endl;
+            return nullptr;
+        }
+    }
+
+    std::shared_ptr<const VfsFile> file = vfs.read(bakedPath);
+    if (!file)
+        return nullptr;
+
+    std::string error;
+    std::shared_ptr<const BakedTexture> texture = BakedTexture::parse(std::move(file), error);
+    if (!texture)
+        std::cout << "ERROR::TEXTURE_CONTAINER::" << bakedPath << " " << error << ", decoding the image instead" << std::endl;
+
+    return texture;
+}
+
+void uploadBakedLevels(const BakedTexture &texture, unsigned int target, size_t firstLevel, size_t lastLevel) {
+    BakedFormat format = texture.getFormat();
+    bool decode = format != BakedFormat::UNCOMPRESSED && !isS3tcSupported();
+
+    const std::vector<BakedTexture::Level> &levels = texture.getLevels();
+    for (size_t i = firstLevel; i < levels.size() && i <= lastLevel; ++i) {
+        const BakedTexture::Level &level = levels[i];
+        GLint levelIndex = static_cast<GLint>(i);
+
+        if (format == BakedFormat::UNCOMPRESSED) {
+            glTexImage2D(target, levelIndex, texture.getInternalFormat(), level.width, level.height, 0, pixelFormatFromComponents(texture.getComponents()),
+                         GL_UNSIGNED_BYTE, level.data);
+        }
+        else if (!decode) {
+            glCompressedTexImage2D(target, levelIndex, texture.getInternalFormat(), level.width, level.height, 0, static_cast<GLsizei>(level.size), level.data);
+        }
+        else {
+            std::vector<unsigned char> pixels = decodeLevel(level, format);
+            glTexImage2D(target, levelIndex, getUploadFormat(texture), level.width, level.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        }
+    }
+}
+
+uint32_t getUploadFormat(const BakedTexture &texture) {
+    if (texture.getFormat() == BakedFormat::UNCOMPRESSED || isS3tcSupported())
+        return texture.getInternalFormat();
+
+    return texture.getFormat() == BakedFormat::BC1 ? GL_RGB8 : GL_RGBA8;
+}
+
+void uploadBakedLayer(const BakedTexture &texture, int layer) {
+    BakedFormat format = texture.getFormat();
+    bool decode = format != BakedFormat::UNCOMPRESSED && !isS3tcSupported();
+
+    const std::vector<BakedTexture::Level> &levels = texture.getLevels();
+    for (size_t i = 0; i < levels.size(); ++i) {
+        const BakedTexture::Level &level = levels[i];
+        GLint levelIndex = static_cast<GLint>(i);
+
+        if (format == BakedFormat::UNCOMPRESSED) {
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, levelIndex, 0, 0, layer, level.width, level.height, 1, texture.getPixelFormat(), GL_UNSIGNED_BYTE,
+                            level.data);
+        }
+        else if (!decode) {
+            glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, levelIndex, 0, 0, layer, level.width, level.height, 1, texture.getInternalFormat(),
+                                      static_cast<GLsizei>(level.size), level.data);
+        }
+        else {
+            std::vector<unsigned char> pixels = decodeLevel(level, format);
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, levelIndex, 0, 0, layer, level.width, level.height, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        }
+    }
+}
+
+bool isS3tcSupported() {
+    static const bool supported = []() {
+        GLint extensionCount = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+
+        for (GLint i = 0; i < extensionCount; ++i) {
+            const char *extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+            if (extension && std::strcmp(extension, "GL_EXT_texture_compression_s3tc") == 0)
+                return true;
+        }
+
+        std::cout << "ERROR::TEXTURE_CONTAINER::NO_S3TC: baked textures are decoded to RGBA8 before upload" << std::endl;
+        return false;
+    }();
+
+    return supported;
+}
+
+// Box filter down to half the size; odd sizes average their last row or column with itself
+std::vector<unsigned char> downsampleImage(const unsigned char *pixels, int width, int height, int components, int &outWidth, int &outHeight) {
+    outWidth = std::max(1, width / 2);
+    outHeight = std::max(1, height / 2);
+
+    std::vector<unsigned char> result(static_cast<size_t>(outWidth) * outHeight * components);
+    for (int y = 0; y < outHeight; ++y) {
+        int y0 = std::min(y * 2, height - 1);
+        int y1 = std::min(y * 2 + 1, height - 1);
+
+        for (int x = 0; x < outWidth; ++x) {
+            int x0 = std::min(x * 2, width - 1);
+            int x1 = std::min(x * 2 + 1, width - 1);
+
+            for (int c = 0; c < components; ++c) {
+                int sum = pixels[(static_cast<size_t>(y0) * width + x0) * components + c] + pixels[(static_cast<size_t>(y0) * width + x1) * components + c]
+                        + pixels[(static_cast<size_t>(y1) * width + x0) * components + c] + pixels[(static_cast<size_t>(y1) * width + x1) * components + c];
+                result[(static_cast<size_t>(y) * outWidth + x) * components + c] = static_cast<unsigned char>((sum + 2) / 4);
+            }
+        }
+    }
+
+    return result;
+}
+
+
+BakeStats bakeTexture(const std::string &imagePath, std::string &error) {
+    auto startTime = std::chrono::steady_clock::now();
+    error.clear();
+
+    BakeStats stats;
+    stats.path = imagePath;
+    stats.failed = true;
+
+    std::shared_ptr<const VfsFile> source = AssetVfs::shared().read(imagePath);
+    if (!source || source->getSize() > INT_MAX) {
+        error = "can't read " + imagePath;
+        return stats;
+    }
+    stats.sourceBytes = source->getSize();
+
+    int width, height, components;
+    std::unique_ptr<unsigned char, void(*)(void*)> pixels(
+        stbi_load_from_memory(source->getData(), static_cast<int>(source->getSize()), &width, &height, &components, 0), stbi_image_free);
+    stats.decodeTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    if (!pixels) {
+        error = "can't decode " + imagePath + ": " + stbi_failure_reason();
+        return stats;
+    }
+
+    BakedFormat format = BakedFormat::UNCOMPRESSED;
+    if (ktx::COMPRESS && components >= 3) {
+        format = BakedFormat::BC1;
+        if (components == 4) {
+            size_t pixelCount = static_cast<size_t>(width) * height;
+            for (size_t i = 0; i < pixelCount && format == BakedFormat::BC1; ++i) {
+                if (pixels.get()[i * 4 + 3] != 255)
+                    format = BakedFormat::BC3;
+            }
+        }
+    }
+
+    KtxHeader header = {};
+    header.endianness = ENDIANNESS;
+    header.pixelWidth = static_cast<uint32_t>(width);
+    header.pixelHeight = static_cast<uint32_t>(height);
+    header.numberOfFaces = 1;
+    if (format == BakedFormat::UNCOMPRESSED) {
+        header.glType = GL_UNSIGNED_BYTE;
+        header.glTypeSize = 1;
+        header.glFormat = pixelFormatFromComponents(components);
+        header.glInternalFormat = sizedFormatFromComponents(components);
+        header.glBaseInternalFormat = header.glFormat;
+    }
+    else {
+        header.glTypeSize = 1;
+        header.glInternalFormat = format == BakedFormat::BC1 ? COMPRESSED_RGB_S3TC_DXT1 : COMPRESSED_RGBA_S3TC_DXT5;
+        header.glBaseInternalFormat = format == BakedFormat::BC1 ? GL_RGB : GL_RGBA;
+    }
+
+    // Every level down to 1x1, each filtered from the one above like glGenerateMipmap does
+    std::vector<std::vector<unsigned char>> levels;
+    std::vector<unsigned char> current;
+    const unsigned char *levelPixels = pixels.get();
+    int levelWidth = width;
+    int levelHeight = height;
+    while (true) {
+        stats.rawGpuBytes += static_cast<size_t>(levelWidth) * levelHeight * components;
+
+        if (format == BakedFormat::UNCOMPRESSED)
+            levels.push_back(padRows(levelPixels, levelWidth, levelHeight, components));
+        else
+            levels.push_back(encodeLevel(levelPixels, levelWidth, levelHeight, components, format));
+
+        if (levelWidth == 1 && levelHeight == 1)
+            break;
+
+        int nextWidth, nextHeight;
+        current = downsampleImage(levelPixels, levelWidth, levelHeight, components, nextWidth, nextHeight);
+        levelPixels = current.data();
+        levelWidth = nextWidth;
+        levelHeight = nextHeight;
+    }
+    pixels.reset();
+    header.numberOfMipmapLevels = static_cast<uint32_t>(levels.size());
+
+    // Written next to the image under a temporary name first, so an interrupted bake never leaves a truncated container behind
+    std::string bakedPath = imagePath + ktx::EXTENSION;
+    std::string tempPath = bakedPath + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(IDENTIFIER), sizeof(IDENTIFIER));
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        for (const std::vector<unsigned char> &level : levels) {
+            uint32_t imageSize = static_cast<uint32_t>(level.size());
+            const char zeros[3] = {};
+            out.write(reinterpret_cast<const char*>(&imageSize), sizeof(imageSize));
+            out.write(reinterpret_cast<const char*>(level.data()), level.size());
+            out.write(zeros, (4 - level.size() % 4) % 4);
+            stats.bakedBytes += level.size();
+        }
+
+        if (!out) {
+            error = "can't write " + tempPath;
+            out.close();
+            std::error_code removeError;
+            std::filesystem::remove(tempPath, removeError);
+            return stats;
+        }
+    }
+
+    std::error_code fsError;
+    std::filesystem::rename(tempPath, bakedPath, fsError);
+    if (fsError) {
+        error = "can't replace " + bakedPath + ": " + fsError.message();
+        std::filesystem::remove(tempPath, fsError);
+        return stats;
+    }
+
+    stats.width = width;
+    stats.height = height;
+    stats.levelCount = static_cast<int>(levels.size());
+    stats.bakeTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+    // What the runtime will pay instead of decoding: reading the container back and checking it
+    auto loadStartTime = std::chrono::steady_clock::now();
+    std::shared_ptr<const BakedTexture> baked;
+    if (std::shared_ptr<const VfsFile> file = AssetVfs::shared().read(bakedPath))
+        baked = BakedTexture::parse(std::move(file), error);
+    stats.loadTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStartTime).count();
+
+    if (!baked) {
+        error = bakedPath + " doesn't read back: " + error;
+        return stats;
+    }
+
+    stats.formatName = baked->getFormatName();
+    stats.failed = false;
+    return stats;
+}
+
+size_t bakeTextures(const std::string &directory, const std::vector<std::string> &excluded, ThreadPool &pool) {
+    std::vector<std::string> excludedKeys;
+    for (const std::string &path : excluded)
+        excludedKeys.push_back(AssetVfs::normalizePath(path) + '/');
+
+    std::vector<std::string> imagePaths;
+    std::error_code fsError;
+    for (auto it = std::filesystem::recursive_directory_iterator(directory, fsError); !fsError && it != std::filesystem::recursive_directory_iterator();
+         it.increment(fsError)) {
+        if (!it->is_regular_file(fsError) || !hasImageExtension(it->path()))
+            continue;
+
+        std::string path = it->path().string();
+        std::string key = AssetVfs::normalizePath(path);
+        bool skip = std::any_of(excludedKeys.begin(), excludedKeys.end(), [&key](const std::string &prefix) {
+            return key.compare(0, prefix.size(), prefix) == 0;
+        });
+        if (!skip)
+            imagePaths.push_back(path);
+    }
+    if (fsError) {
+        std::cout << "ERROR::TEXTURE_CONTAINER::can't list " << directory << ": " << fsError.message() << std::endl;
+        return 0;
+    }
+    std::sort(imagePaths.begin(), imagePaths.end());
+
+    auto startTime = std::chrono::steady_clock::now();
+
+    std::vector<std::future<std::pair<BakeStats, std::string>>> jobs;
+    for (const std::string &path : imagePaths) {
+        jobs.push_back(pool.submit([path]() {
+            std::string error;
+            BakeStats stats = bakeTexture(path, error);
+            return std::make_pair(std::move(stats), std::move(error));
+        }));
+    }
+
+    std::vector<BakeStats> baked;
+    for (auto &job : jobs) {
+        std::pair<BakeStats, std::string> result = job.get();
+        if (result.first.failed)
+            std::cout << "ERROR::TEXTURE_CONTAINER::" << result.second << std::endl;
+        else
+            baked.push_back(std::move(result.first));
+    }
+
+    // Slowest decode first: those are the images baking saves the most load time on
+    std::sort(baked.begin(), baked.end(), [](const BakeStats &a, const BakeStats &b) {
+        return a.decodeTimeMs > b.decodeTimeMs;
+    });
+
+    constexpr double MB = 1024.0 * 1024.0;
+    size_t rawBytes = 0;
+    size_t bakedBytes = 0;
+    double decodeMs = 0.0;
+    double loadMs = 0.0;
+    for (const BakeStats &stats : baked) {
+        rawBytes += stats.rawGpuBytes;
+        bakedBytes += stats.bakedBytes;
+        decodeMs += stats.decodeTimeMs;
+        loadMs += stats.loadTimeMs;
+    }
+
+    std::ostringstream out;
+    out << "TEXTURE BAKE: " << baked.size() << "/" << imagePaths.size() << " images in "
+        << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count() << " ms, GPU "
+        << rawBytes / MB << " MB -> " << bakedBytes / MB << " MB, load " << decodeMs << " ms -> " << loadMs << " ms\n";
+    for (const BakeStats &stats : baked) {
+        out << "  " << stats.width << "x" << stats.height << " " << stats.formatName << ", " << stats.levelCount << " levels  GPU "
+            << stats.rawGpuBytes / MB << " MB -> " << stats.bakedBytes / MB << " MB, load " << stats.decodeTimeMs << " ms -> "
+            << stats.loadTimeMs << " ms, baked in " << stats.bakeTimeMs << " ms  " << stats.path << "\n";
+    }
+    std::cout << out.str() << std::flush;
+
+    return baked.size();
+}
\ No newline at end of file
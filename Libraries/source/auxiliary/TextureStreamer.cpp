@@ -0,0 +1,301 @@
+#include "auxiliary/TextureStreamer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <functional>
+#include <iostream>
+#include <sstream>
+
+
+TextureStreamer::TextureStreamer(size_t budget, ThreadPool &pool, size_t frameBudget)
+    : budget(budget), frameBudget(frameBudget), pool(pool)
+{}
+
+unsigned int TextureStreamer::create(DecodedImage &&image) {
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+
+    StreamedTexture &texture = textures[textureID];
+    texture.path = image.path;
+    texture.image = std::move(image);
+
+    return textureID;
+}
+
+void TextureStreamer::request(unsigned int textureID, float pixels) {
+    auto found = textures.find(textureID);
+    if (found == textures.end())
+        return;
+
+    StreamedTexture &texture = found->second;
+    if (texture.lastUse != frame) {
+        texture.lastUse = frame;
+        texture.wantedTexels = 0.0f;
+    }
+    texture.wantedTexels = std::max(texture.wantedTexels, pixels * ts::TEXELS_PER_PIXEL);
+}
+
+int TextureStreamer::getWantedLevel(const StreamedTexture &texture) const {
+    if (texture.lastUse != frame)
+        return texture.tailLevel;
+
+    // The coarsest level that still has as many texels as asked for
+    int level = 0;
+    float extent = static_cast<float>(std::max(texture.width, texture.height));
+    while (level < texture.tailLevel && extent * 0.5f >= texture.wantedTexels) {
+        extent *= 0.5f;
+        ++level;
+    }
+
+    return level;
+}
+
+size_t TextureStreamer::getLevelBytes(const StreamedTexture &texture, int firstLevel, int endLevel) const {
+    size_t bytes = 0;
+    for (int level = firstLevel; level < endLevel; ++level)
+        bytes += texture.levelSizes[level];
+
+    return bytes;
+}
+
+int TextureStreamer::getAffordableLevel(const StreamedTexture &texture, int wantedLevel) const {
+    size_t reclaimable = 0;
+    for (const auto &entry : textures) {
+        const StreamedTexture &other = entry.second;
+        if (&other == &texture || other.levelSizes.empty())
+            continue;
+
+        int keepLevel = getWantedLevel(other);
+        if (other.residentLevel < keepLevel)
+            reclaimable += getLevelBytes(other, other.residentLevel, keepLevel);
+    }
+
+    size_t available = budget + reclaimable > residentBytes ? budget + reclaimable - residentBytes : 0;
+
+    // The tail is loaded whatever the budget says
+    int level = wantedLevel;
+    while (level < texture.residentLevel && level < texture.tailLevel && getLevelBytes(texture, level, texture.residentLevel) > available)
+        ++level;
+
+    return level;
+}
+
+void TextureStreamer::makeRoom(size_t bytes, const StreamedTexture *except, bool evictWanted) {
+    while (residentBytes + bytes > budget) {
+        unsigned int victimID = 0;
+        StreamedTexture *victim = nullptr;
+
+        for (auto &entry : textures) {
+            StreamedTexture &texture = entry.second;
+            int keepLevel = evictWanted ? texture.tailLevel : getWantedLevel(texture);
+            if (&texture == except || texture.levelSizes.empty() || texture.residentLevel >= keepLevel)
+                continue;
+
+            // Among textures used as recently, the one holding the most goes first
+            if (!victim || texture.lastUse < victim->lastUse || (texture.lastUse == victim->lastUse && texture.residentBytes > victim->residentBytes)) {
+                victimID = entry.first;
+                victim = &texture;
+            }
+        }
+
+        if (!victim)
+            return;
+
+        evictLevel(victimID, *victim);
+    }
+}
+
+void TextureStreamer::evictLevel(unsigned int textureID, StreamedTexture &texture) {
+    int level = texture.residentLevel;
+
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level + 1);
+    // Below the base level the image no longer counts for completeness, so any format does to redefine it as empty and free it
+    glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    size_t bytes = texture.levelSizes[level];
+    texture.residentLevel = level + 1;
+    texture.residentBytes -= bytes;
+    residentBytes -= bytes;
+    ++evictedLevelCount;
+}
+
+void TextureStreamer::startLoad(StreamedTexture &texture) {
+    // Baked images come with their levels; others are decoded unless the import already did, and their chain is built on the pool
+    texture.load = pool.submit([path = texture.path, image = std::move(texture.image)]() mutable -> std::shared_ptr<const BakedTexture> {
+        if (!image.isLoaded())
+            image = decodeImage(path);
+
+        if (image.baked)
+            return image.baked;
+        if (!image.pixels)
+            return nullptr;
+
+        return BakedTexture::fromImage(image.pixels.get(), image.width, image.height, image.components);
+    });
+
+    texture.loading = true;
+    ++loadsInFlight;
+}
+
+void TextureStreamer::finishLoad(unsigned int textureID, StreamedTexture &texture) {
+    std::shared_ptr<const BakedTexture> chain = texture.load.get();
+    texture.loading = false;
+    --loadsInFlight;
+    ++loadCount;
+
+    if (!chain) {
+        std::cout << "Texture failed to load at path: " << texture.path << std::endl;
+        texture.failed = true;
+        return;
+    }
+
+    const std::vector<BakedTexture::Level> &levels = chain->getLevels();
+    texture.chain = std::move(chain);
+
+    for (const BakedTexture::Level &level : levels)
+        texture.levelSizes.push_back(level.size);
+
+    texture.width = levels.front().width;
+    texture.height = levels.front().height;
+    texture.residentLevel = texture.getLevelCount();
+    texture.tailLevel = texture.getLevelCount() - 1;
+    for (int level = 0; level < texture.getLevelCount(); ++level) {
+        if (std::max(levels[level].width, levels[level].height) <= ts::MIN_RESIDENT_SIZE) {
+            texture.tailLevel = level;
+            break;
+        }
+    }
+
+    // Sampled like the textures uploadTexture creates
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, texture.getLevelCount() - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void TextureStreamer::uploadLevels(unsigned int textureID, StreamedTexture &texture, size_t &frameBytes) {
+    // Decided now rather than when the levels were asked for, as the camera and the other textures may have moved on since
+    int wantedLevel = getAffordableLevel(texture, getWantedLevel(texture));
+
+    int firstLevel = texture.residentLevel;
+    while (firstLevel > wantedLevel && (frameBytes == 0 || frameBytes + texture.levelSizes[firstLevel - 1] <= frameBudget)) {
+        --firstLevel;
+        frameBytes += texture.levelSizes[firstLevel];
+    }
+    if (firstLevel == texture.residentLevel)
+        return;
+
+    size_t bytes = getLevelBytes(texture, firstLevel, texture.residentLevel);
+    makeRoom(bytes, &texture, false);
+
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    uploadBakedLevels(*texture.chain, GL_TEXTURE_2D, firstLevel, texture.residentLevel - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, firstLevel);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    texture.residentLevel = firstLevel;
+    texture.residentBytes += bytes;
+    residentBytes += bytes;
+    uploadedBytes += bytes;
+}
+
+void TextureStreamer::update() {
+    for (auto &entry : textures) {
+        StreamedTexture &texture = entry.second;
+        if (texture.loading && texture.load.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+            finishLoad(entry.first, texture);
+    }
+
+    // In case the budget was lowered below what is in use: then even levels the last frame needed go, down to the tails
+    makeRoom(0, nullptr, true);
+
+    // Textures that have never been loaded go first, then those missing the most levels. Loaded ones upload from their chain.
+    std::vector<std::pair<int, unsigned int>> candidates;
+    for (auto &entry : textures) {
+        StreamedTexture &texture = entry.second;
+        if (texture.loading || texture.failed)
+            continue;
+
+        if (texture.levelSizes.empty()) {
+            candidates.emplace_back(INT_MAX, entry.first);
+            continue;
+        }
+
+        int firstLevel = getAffordableLevel(texture, getWantedLevel(texture));
+        if (firstLevel < texture.residentLevel)
+            candidates.emplace_back(texture.residentLevel - firstLevel, entry.first);
+    }
+    std::sort(candidates.begin(), candidates.end(), std::greater<std::pair<int, unsigned int>>());
+
+    size_t frameBytes = 0;
+    for (const auto &candidate : candidates) {
+        StreamedTexture &texture = textures[candidate.second];
+        if (texture.chain) {
+            if (frameBytes < frameBudget)
+                uploadLevels(candidate.second, texture, frameBytes);
+        }
+        else if (loadsInFlight < ts::MAX_LOADS_IN_FLIGHT)
+            startLoad(texture);
+    }
+
+    ++frame;
+}
+
+void TextureStreamer::release(unsigned int textureID) {
+    auto found = textures.find(textureID);
+    if (found == textures.end())
+        return;
+
+    if (found->second.loading)
+        --loadsInFlight;
+    residentBytes -= found->second.residentBytes;
+
+    textures.erase(found);
+}
+
+size_t TextureStreamer::getChainBytes() const {
+    size_t bytes = 0;
+    for (const auto &entry : textures) {
+        if (entry.second.chain)
+            bytes += entry.second.chain->getByteSize();
+    }
+
+    return bytes;
+}
+
+size_t TextureStreamer::getResidentBytes(unsigned int textureID) const {
+    auto found = textures.find(textureID);
+    return found != textures.end() ? found->second.residentBytes : 0;
+}
+
+void TextureStreamer::logStats() const {
+    constexpr double MB = 1024.0 * 1024.0;
+
+    size_t fullBytes = 0;
+    std::ostringstream details;
+    for (const auto &entry : textures) {
+        const StreamedTexture &texture = entry.second;
+        size_t textureBytes = getLevelBytes(texture, 0, texture.getLevelCount());
+        fullBytes += textureBytes;
+
+        details << "  ";
+        if (texture.levelSizes.empty())
+            details << (texture.failed ? "failed" : "loading");
+        else if (texture.residentLevel == texture.getLevelCount())
+            details << "nothing resident";
+        else
+            details << "level " << texture.residentLevel << "/" << texture.getLevelCount() - 1 << " (" << std::max(1, texture.width >> texture.residentLevel)
+                << "x" << std::max(1, texture.height >> texture.residentLevel) << "), " << texture.residentBytes / MB << "/" << textureBytes / MB << " MB";
+        details << "  " << texture.path << "\n";
+    }
+
+    std::cout << "TEXTURE STREAMER: " << textures.size() << " textures, " << residentBytes / MB << " MB resident of " << budget / MB << " MB budget ("
+        << fullBytes / MB << " MB at full detail), " << loadCount << " loads, " << getChainBytes() / MB << " MB of chains kept, "
+        << uploadedBytes / MB << " MB uploaded at up to " << frameBudget / MB << " MB per frame, " << evictedLevelCount << " levels evicted\n" << details.str() << std::flush;
+}
\ No newline at end of file
@@ -0,0 +1,196 @@
+#include "auxiliary/TextureUploader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+
+namespace {
+    GLenum formatFromComponents(int components) {
+        if (components == 1)
+            return GL_RED;
+        else if (components == 2)
+            return GL_RG;
+        else if (components == 3)
+            return GL_RGB;
+
+        return GL_RGBA;
+    }
+}
+
+
+TextureUploader::TextureUploader(size_t stagingSize, size_t ringSize, size_t frameBudget)
+    : stagingSize(stagingSize), frameBudget(frameBudget)
+{
+    ring.resize(std::max<size_t>(1, ringSize));
+
+    for (StagingBuffer &staging : ring) {
+        glGenBuffers(1, &staging.pbo);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging.pbo);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, stagingSize, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+TextureUploader::~TextureUploader() {
+    for (StagingBuffer &staging : ring) {
+        if (staging.fence)
+            glDeleteSync(staging.fence);
+        glDeleteBuffers(1, &staging.pbo);
+    }
+}
+
+unsigned int TextureUploader::enqueue(DecodedImage &&image) {
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+
+    if (!image.isLoaded()) {
+        std::cout << "Texture failed to load at path: " << image.path << std::endl;
+        return textureID;
+    }
+
+    // Baked textures are a fraction of the decoded size and need no mipmap generation, so they skip the staging ring
+    if (image.baked) {
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        uploadBakedLevels(*image.baked, GL_TEXTURE_2D);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(image.baked->getLevels().size()) - 1);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        bytesUploaded += image.getByteSize();
+        ++texturesCompleted;
+        return textureID;
+    }
+
+    GLenum format = formatFromComponents(image.components);
+
+    // Allocate storage only, the pixels follow through the staging ring
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, nullptr);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    size_t rowSize = static_cast<size_t>(image.width) * image.components;
+    if (rowSize > stagingSize) {
+        // Not even one row fits into a staging buffer: fall back to a direct upload
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.width, image.height, format, GL_UNSIGNED_BYTE, image.pixels.get());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glGenerateMipmap(GL_TEXTURE_2D);
+
+        bytesUploaded += image.getByteSize();
+        ++texturesCompleted;
+        return textureID;
+    }
+
+    PendingUpload upload { std::move(image), textureID, format, 0 };
+    pending.push_back(std::move(upload));
+
+    return textureID;
+}
+
+bool TextureUploader::isStagingFree(StagingBuffer &staging) {
+    if (!staging.fence)
+        return true;
+
+    GLenum status = glClientWaitSync(staging.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+        return false;
+
+    glDeleteSync(staging.fence);
+    staging.fence = nullptr;
+
+    return true;
+}
+
+void TextureUploader::finishUpload(PendingUpload &upload) {
+    glBindTexture(GL_TEXTURE_2D, upload.textureID);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    ++texturesCompleted;
+}
+
+void TextureUploader::update() {
+    size_t budgetLeft = frameBudget;
+
+    while (!pending.empty() && budgetLeft > 0) {
+        PendingUpload &upload = pending.front();
+        StagingBuffer &staging = ring[ringIndex];
+
+        if (!isStagingFree(staging)) {
+            // The GPU hasn't consumed this buffer yet; try again next frame rather than block
+            ++fenceStalls;
+            break;
+        }
+
+        const DecodedImage &image = upload.image;
+        size_t rowSize = static_cast<size_t>(image.width) * image.components;
+        size_t maxBytes = std::min(budgetLeft, stagingSize);
+        int rows = std::min(image.height - upload.nextRow, static_cast<int>(std::max<size_t>(1, maxBytes / rowSize)));
+        size_t bytes = static_cast<size_t>(rows) * rowSize;
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging.pbo);
+        // The fence has signaled, so the old contents can be discarded without synchronizing
+        void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (!mapped) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            break;
+        }
+
+        std::memcpy(mapped, image.pixels.get() + static_cast<size_t>(upload.nextRow) * rowSize, bytes);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+        // Rows of RGB images aren't necessarily 4-byte aligned
+        glBindTexture(GL_TEXTURE_2D, upload.textureID);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, upload.nextRow, image.width, rows, upload.format, GL_UNSIGNED_BYTE, nullptr);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        staging.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        ringIndex = (ringIndex + 1) % ring.size();
+        upload.nextRow += rows;
+        bytesUploaded += bytes;
+        budgetLeft -= std::min(bytes, budgetLeft);
+
+        if (upload.nextRow >= image.height) {
+            finishUpload(upload);
+            pending.pop_front();
+        }
+    }
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void TextureUploader::flush() {
+    size_t savedBudget = frameBudget;
+    frameBudget = std::numeric_limits<size_t>::max();
+
+    while (!pending.empty()) {
+        update();
+
+        StagingBuffer &staging = ring[ringIndex];
+        if (!pending.empty() && staging.fence) {
+            glClientWaitSync(staging.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        }
+    }
+
+    frameBudget = savedBudget;
+}
+
+void TextureUploader::cancel(unsigned int textureID) {
+    pending.erase(std::remove_if(pending.begin(), pending.end(), [textureID](const PendingUpload &upload) {
+        return upload.textureID == textureID;
+    }), pending.end());
+}
\ No newline at end of file
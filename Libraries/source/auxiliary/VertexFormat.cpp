@@ -0,0 +1,202 @@
+#include "auxiliary/VertexFormat.h"
+#include "auxiliary/Mesh.h"
+
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+
+namespace {
+    // An attribute of a source vertex struct (Vertex or CompactVertex) and its GL description
+    struct SourceAttribute {
+        unsigned int bit;
+        int components;
+        GLenum type;
+        bool normalized;
+        size_t offset;
+        size_t size;
+    };
+
+    const SourceAttribute FLOAT_ATTRIBUTES[] = {
+        { va::POSITION,  3, GL_FLOAT, false, offsetof(Vertex, Position),  sizeof(glm::vec3) },
+        { va::NORMAL,    3, GL_FLOAT, false, offsetof(Vertex, Normal),    sizeof(glm::vec3) },
+        { va::TEXCOORDS, 2, GL_FLOAT, false, offsetof(Vertex, TexCoords), sizeof(glm::vec2) },
+        { va::TANGENT,   3, GL_FLOAT, false, offsetof(Vertex, Tangent),   sizeof(glm::vec3) },
+        { va::BITANGENT, 3, GL_FLOAT, false, offsetof(Vertex, Bitangent), sizeof(glm::vec3) },
+    };
+
+    // The bitangent sign isn't listed: it lives in the padding of the position and is copied with it
+    const SourceAttribute COMPACT_ATTRIBUTES[] = {
+        { va::POSITION,  3, GL_UNSIGNED_SHORT, true,  offsetof(CompactVertex, Position),  4 * sizeof(uint16_t) },
+        { va::NORMAL,    2, GL_SHORT,          true,  offsetof(CompactVertex, Normal),    2 * sizeof(int16_t) },
+        { va::TEXCOORDS, 2, GL_HALF_FLOAT,     false, offsetof(CompactVertex, TexCoords), 2 * sizeof(uint16_t) },
+        { va::TANGENT,   2, GL_SHORT,          true,  offsetof(CompactVertex, Tangent),   2 * sizeof(int16_t) },
+    };
+
+    constexpr size_t FLOAT_ATTRIBUTE_COUNT = sizeof(FLOAT_ATTRIBUTES) / sizeof(SourceAttribute);
+    constexpr size_t COMPACT_ATTRIBUTE_COUNT = sizeof(COMPACT_ATTRIBUTES) / sizeof(SourceAttribute);
+
+    // Attributes whose bytes go into the buffer: the compact bitangent sign needs the position block
+    unsigned int storedAttributes(VertexFormat format, unsigned int attributes) {
+        if (format == VertexFormat::COMPACT && (attributes & va::BITANGENT))
+            attributes |= va::POSITION;
+
+        return attributes;
+    }
+
+    void copyAttributes(const unsigned char *source, size_t sourceStride, const SourceAttribute *table, size_t tableSize,
+                        unsigned int attributes, size_t count, size_t stride, unsigned char *out) {
+        for (size_t i = 0; i < count; ++i) {
+            const unsigned char* vertex = source + i * sourceStride;
+
+            size_t offset = 0;
+            for (size_t a = 0; a < tableSize; ++a) {
+                if (!(attributes & table[a].bit))
+                    continue;
+
+                std::memcpy(out + i * stride + offset, vertex + table[a].offset, table[a].size);
+                offset += table[a].size;
+            }
+        }
+    }
+
+    int16_t toSnorm16(float value) {
+        return static_cast<int16_t>(std::round(glm::clamp(value, -1.0f, 1.0f) * 32767.0f));
+    }
+
+    float fromSnorm16(int16_t value) {
+        return std::max(static_cast<float>(value) / 32767.0f, -1.0f);
+    }
+
+    uint16_t toUnorm16(float value) {
+        return static_cast<uint16_t>(std::round(glm::clamp(value, 0.0f, 1.0f) * 65535.0f));
+    }
+
+    // Unit vectors that aren't (e.g. missing normals) still have to encode to something valid
+    glm::vec3 safeNormalize(const glm::vec3 &v) {
+        float length = glm::length(v);
+        return length > 1e-8f ? v / length : glm::vec3(0.0f, 0.0f, 1.0f);
+    }
+}
+
+
+void octEncode(const glm::vec3 &n, int16_t out[2]) {
+    glm::vec3 v = n / (std::abs(n.x) + std::abs(n.y) + std::abs(n.z));
+
+    glm::vec2 e(v.x, v.y);
+    if (v.z < 0.0f) {
+        // Fold the lower hemisphere over the diagonals
+        e = glm::vec2((1.0f - std::abs(v.y)) * (v.x >= 0.0f ? 1.0f : -1.0f),
+                      (1.0f - std::abs(v.x)) * (v.y >= 0.0f ? 1.0f : -1.0f));
+    }
+
+    out[0] = toSnorm16(e.x);
+    out[1] = toSnorm16(e.y);
+}
+
+glm::vec3 octDecode(const int16_t in[2]) {
+    glm::vec2 e(fromSnorm16(in[0]), fromSnorm16(in[1]));
+
+    glm::vec3 v(e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y));
+    float t = std::max(-v.z, 0.0f);
+    v.x += v.x >= 0.0f ? -t : t;
+    v.y += v.y >= 0.0f ? -t : t;
+
+    return glm::normalize(v);
+}
+
+VertexLayout makeVertexLayout(VertexFormat format, unsigned int attributes) {
+    bool compact = format == VertexFormat::COMPACT;
+    const SourceAttribute* table = compact ? COMPACT_ATTRIBUTES : FLOAT_ATTRIBUTES;
+    size_t tableSize = compact ? COMPACT_ATTRIBUTE_COUNT : FLOAT_ATTRIBUTE_COUNT;
+    unsigned int stored = storedAttributes(format, attributes);
+
+    VertexLayout layout;
+    for (size_t location = 0; location < tableSize; ++location) {
+        const SourceAttribute &source = table[location];
+        if (!(stored & source.bit))
+            continue;
+
+        if (attributes & source.bit)
+            layout.attributes.push_back({ static_cast<unsigned int>(location), source.components, source.type, source.normalized, layout.stride });
+        layout.stride += source.size;
+    }
+
+    // Position always comes first, so the sign is at a fixed place
+    if (compact && (attributes & va::BITANGENT))
+        layout.attributes.push_back({ 4, 1, GL_UNSIGNED_SHORT, true, offsetof(CompactVertex, BitangentSign) });
+
+    return layout;
+}
+
+void packVertices(const Vertex *vertices, size_t count, VertexFormat format, unsigned int attributes,
+                  const glm::vec3 &boundsMin, const glm::vec3 &boundsMax, std::vector<unsigned char> &out) {
+    VertexLayout layout = makeVertexLayout(format, attributes);
+    unsigned int stored = storedAttributes(format, attributes);
+
+    out.resize(count * layout.stride);
+
+    if (format == VertexFormat::COMPACT) {
+        std::vector<CompactVertex> compact;
+        encodeCompactVertices(vertices, count, boundsMin, boundsMax, compact);
+
+        copyAttributes(reinterpret_cast<const unsigned char*>(compact.data()), sizeof(CompactVertex), COMPACT_ATTRIBUTES, COMPACT_ATTRIBUTE_COUNT,
+                       stored, count, layout.stride, out.data());
+    }
+    else {
+        copyAttributes(reinterpret_cast<const unsigned char*>(vertices), sizeof(Vertex), FLOAT_ATTRIBUTES, FLOAT_ATTRIBUTE_COUNT,
+                       stored, count, layout.stride, out.data());
+    }
+}
+
+glm::vec3 compactPositionScale(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax) {
+    return glm::max(boundsMax - boundsMin, glm::vec3(1e-8f));
+}
+
+void encodeCompactVertices(const Vertex *vertices, size_t count, const glm::vec3 &boundsMin, const glm::vec3 &boundsMax,
+                           std::vector<CompactVertex> &out) {
+    glm::vec3 invScale = 1.0f / compactPositionScale(boundsMin, boundsMax);
+
+    out.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        const Vertex &vertex = vertices[i];
+        CompactVertex &compact = out[i];
+
+        glm::vec3 position = (vertex.Position - boundsMin) * invScale;
+        compact.Position[0] = toUnorm16(position.x);
+        compact.Position[1] = toUnorm16(position.y);
+        compact.Position[2] = toUnorm16(position.z);
+
+        glm::vec3 normal = safeNormalize(vertex.Normal);
+        glm::vec3 tangent = safeNormalize(vertex.Tangent);
+        octEncode(normal, compact.Normal);
+        octEncode(tangent, compact.Tangent);
+
+        // Only the handedness of the bitangent is kept, its direction follows from the normal and tangent
+        compact.BitangentSign = glm::dot(glm::cross(normal, tangent), vertex.Bitangent) < 0.0f ? 0 : 65535;
+
+        compact.TexCoords[0] = glm::packHalf1x16(vertex.TexCoords.x);
+        compact.TexCoords[1] = glm::packHalf1x16(vertex.TexCoords.y);
+    }
+}
+
+QuantizationError measureQuantizationError(const Vertex *vertices, const CompactVertex *compact, size_t count,
+                                           const glm::vec3 &boundsMin, const glm::vec3 &boundsMax) {
+    glm::vec3 scale = compactPositionScale(boundsMin, boundsMax);
+
+    QuantizationError error;
+    for (size_t i = 0; i < count; ++i) {
+        glm::vec3 position = glm::vec3(compact[i].Position[0], compact[i].Position[1], compact[i].Position[2]) / 65535.0f * scale + boundsMin;
+        error.position = std::max(error.position, glm::length(position - vertices[i].Position));
+
+        float cosAngle = glm::clamp(glm::dot(octDecode(compact[i].Normal), safeNormalize(vertices[i].Normal)), -1.0f, 1.0f);
+        error.normalDegrees = std::max(error.normalDegrees, glm::degrees(std::acos(cosAngle)));
+
+        glm::vec2 texCoords(glm::unpackHalf1x16(compact[i].TexCoords[0]), glm::unpackHalf1x16(compact[i].TexCoords[1]));
+        error.texCoord = std::max(error.texCoord, glm::length(texCoords - vertices[i].TexCoords));
+    }
+
+    return error;
+}
\ No newline at end of file
@@ -0,0 +1,807 @@
+#include "auxiliary/VirtualTexture.h"
+
+#include "stb_image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <utility>
+
+
+namespace vt {
+    int MIN_SIZE = 8192;
+    int CACHE_TILES = 32;
+}
+
+
+namespace {
+    // glad is generated for the core profile only, which leaves out the S3TC extension's enums
+    constexpr uint32_t COMPRESSED_RGB_S3TC_DXT1 = 0x83F0;
+
+    constexpr int BLOCKS_PER_TILE_ROW = vt::CACHE_TILE_SIZE / 4;
+    constexpr size_t BC1_TILE_BYTES = static_cast<size_t>(BLOCKS_PER_TILE_ROW) * BLOCKS_PER_TILE_ROW * 8;
+    constexpr size_t RGBA_TILE_BYTES = static_cast<size_t>(vt::CACHE_TILE_SIZE) * vt::CACHE_TILE_SIZE * 4;
+
+    inline size_t getTileBytes(BakedFormat format) {
+        return format == BakedFormat::BC1 ? BC1_TILE_BYTES : RGBA_TILE_BYTES;
+    }
+
+    inline int getTileCount(int size, int level) {
+        int levelSize = std::max(1, size >> level);
+        return (levelSize + vt::TILE_SIZE - 1) / vt::TILE_SIZE;
+    }
+
+    // Levels down to the first that fits into a single tile
+    int getVirtualLevelCount(int width, int height) {
+        int level = 0;
+        while (getTileCount(width, level) > 1 || getTileCount(height, level) > 1)
+            ++level;
+
+        return level + 1;
+    }
+
+    int nextPowerOfTwo(int value) {
+        int result = 1;
+        while (result < value)
+            result *= 2;
+
+        return result;
+    }
+
+    std::string getTilePath(const std::string &imagePath) {
+        return imagePath + vt::EXTENSION;
+    }
+
+    bool readHeader(const VfsFile &file, VirtualTextureHeader &header) {
+        if (file.getSize() < sizeof(header))
+            return false;
+
+        std::memcpy(&header, file.getData(), sizeof(header));
+        return header.magic == vt::MAGIC && header.version == vt::VERSION;
+    }
+
+    // Size from the image header, or from the tile file if only that is there
+    bool readVirtualTextureSize(const std::string &imagePath, int &width, int &height) {
+        AssetVfs &vfs = AssetVfs::shared();
+
+        if (std::shared_ptr<const VfsFile> image = vfs.read(imagePath)) {
+            int components;
+            if (image->getSize() <= INT_MAX && stbi_info_from_memory(image->getData(), static_cast<int>(image->getSize()), &width, &height, &components))
+                return true;
+        }
+
+        VirtualTextureHeader header;
+        std::shared_ptr<const VfsFile> tiles = vfs.read(getTilePath(imagePath));
+        if (!tiles || !readHeader(*tiles, header))
+            return false;
+
+        width = static_cast<int>(header.width);
+        height = static_cast<int>(header.height);
+        return true;
+    }
+
+    // Loose images may have been edited since their tiles were cut; packed ones are only ever packed together with their tiles
+    bool isTileFileCurrent(const std::string &imagePath) {
+        std::string tilePath = getTilePath(imagePath);
+        AssetVfs &vfs = AssetVfs::shared();
+        if (!vfs.exists(tilePath))
+            return false;
+        if (vfs.isPacked(tilePath) || vfs.isPacked(imagePath))
+            return true;
+
+        std::error_code imageError, tileError;
+        std::filesystem::file_time_type imageTime = std::filesystem::last_write_time(imagePath, imageError);
+        std::filesystem::file_time_type tileTime = std::filesystem::last_write_time(tilePath, tileError);
+        return imageError || tileError || tileTime >= imageTime;
+    }
+
+    // One cache tile of a level, its border wrapping around like GL_REPEAT does, as RGBA8
+    void cutTile(const unsigned char *pixels, int width, int height, int tileX, int tileY, unsigned char *tile) {
+        for (int y = 0; y < vt::CACHE_TILE_SIZE; ++y) {
+            int sourceY = ((tileY * vt::TILE_SIZE - vt::BORDER + y) % height + height) % height;
+            const unsigned char *row = pixels + static_cast<size_t>(sourceY) * width * 4;
+
+            for (int x = 0; x < vt::CACHE_TILE_SIZE; ++x) {
+                int sourceX = ((tileX * vt::TILE_SIZE - vt::BORDER + x) % width + width) % width;
+                std::memcpy(tile + (static_cast<size_t>(y) * vt::CACHE_TILE_SIZE + x) * 4, row + static_cast<size_t>(sourceX) * 4, 4);
+            }
+        }
+    }
+
+    void encodeTile(const unsigned char *rgba, unsigned char *blocks) {
+        unsigned char block[64];
+        for (int blockY = 0; blockY < BLOCKS_PER_TILE_ROW; ++blockY) {
+            for (int blockX = 0; blockX < BLOCKS_PER_TILE_ROW; ++blockX) {
+                for (int row = 0; row < 4; ++row)
+                    std::memcpy(block + row * 16, rgba + ((static_cast<size_t>(blockY) * 4 + row) * vt::CACHE_TILE_SIZE + blockX * 4) * 4, 16);
+
+                encodeBc1Block(block, blocks + (static_cast<size_t>(blockY) * BLOCKS_PER_TILE_ROW + blockX) * 8);
+            }
+        }
+    }
+
+    void decodeTile(const unsigned char *blocks, unsigned char *rgba) {
+        unsigned char block[64];
+        for (int blockY = 0; blockY < BLOCKS_PER_TILE_ROW; ++blockY) {
+            for (int blockX = 0; blockX < BLOCKS_PER_TILE_ROW; ++blockX) {
+                decodeBc1Block(blocks + (static_cast<size_t>(blockY) * BLOCKS_PER_TILE_ROW + blockX) * 8, block);
+
+                for (int row = 0; row < 4; ++row)
+                    std::memcpy(rgba + ((static_cast<size_t>(blockY) * 4 + row) * vt::CACHE_TILE_SIZE + blockX * 4) * 4, block + row * 16, 16);
+            }
+        }
+    }
+}
+
+
+int VirtualTexture::getTilesX(int level) const {
+    return getTileCount(width, level);
+}
+
+int VirtualTexture::getTilesY(int level) const {
+    return getTileCount(height, level);
+}
+
+unsigned int VirtualTexture::getCacheTexture() const {
+    return system->getCacheTexture();
+}
+
+size_t VirtualTexture::getPageTableBytes() const {
+    size_t bytes = 0;
+    for (const std::vector<uint32_t> &level : pageEntries)
+        bytes += level.size() * sizeof(uint32_t);
+
+    return bytes;
+}
+
+
+VirtualTextureSystem::VirtualTextureSystem(int cacheTiles, ThreadPool &pool)
+    : pool(pool)
+{
+    // A page table texel holds the cache column and row in a byte each
+    int maxTextureSize;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    this->cacheTiles = std::max(1, std::min({ cacheTiles, 256, maxTextureSize / vt::CACHE_TILE_SIZE }));
+
+    // Tiles are compressed in the cache like everything baked, if the driver can sample that
+    cacheFormat = ktx::COMPRESS && isS3tcSupported() ? BakedFormat::BC1 : BakedFormat::UNCOMPRESSED;
+    slots.resize(static_cast<size_t>(this->cacheTiles) * this->cacheTiles);
+
+    int size = this->cacheTiles * vt::CACHE_TILE_SIZE;
+    glGenTextures(1, &cacheTexture);
+    glBindTexture(GL_TEXTURE_2D, cacheTexture);
+    if (cacheFormat == BakedFormat::BC1) {
+        std::vector<unsigned char> empty(slots.size() * BC1_TILE_BYTES, 0);
+        glCompressedTexImage2D(GL_TEXTURE_2D, 0, COMPRESSED_RGB_S3TC_DXT1, size, size, 0, static_cast<GLsizei>(empty.size()), empty.data());
+    }
+    else
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+    // A single level: the shaders pick the virtual level themselves, the borders keep bilinear filtering inside a tile
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenBuffers(2, readbackBuffers);
+}
+
+VirtualTextureSystem::~VirtualTextureSystem() {
+    // Page tables belong to the texture cache, which deletes them with the models using them
+    for (GLsync fence : readbackFences) {
+        if (fence)
+            glDeleteSync(fence);
+    }
+    glDeleteBuffers(2, readbackBuffers);
+    glDeleteFramebuffers(1, &feedbackFramebuffer);
+    glDeleteRenderbuffers(1, &feedbackColor);
+    glDeleteRenderbuffers(1, &feedbackDepth);
+    glDeleteTextures(1, &cacheTexture);
+}
+
+uint32_t VirtualTextureSystem::makeTileKey(int level, int x, int y) {
+    return (static_cast<uint32_t>(level) << 26) | (static_cast<uint32_t>(y) << 13) | static_cast<uint32_t>(x);
+}
+
+void VirtualTextureSystem::splitTileKey(uint32_t key, int &level, int &x, int &y) {
+    level = static_cast<int>(key >> 26);
+    y = static_cast<int>((key >> 13) & 0x1FFF);
+    x = static_cast<int>(key & 0x1FFF);
+}
+
+unsigned int VirtualTextureSystem::create(const std::string &imagePath) {
+    int width, height;
+    if (!readVirtualTextureSize(imagePath, width, height)) {
+        std::cout << "ERROR::VIRTUAL_TEXTURE::can't read the size of " << imagePath << std::endl;
+        return 0;
+    }
+
+    unsigned int pageTable;
+    glGenTextures(1, &pageTable);
+
+    VirtualTexture &texture = textures[pageTable];
+    texture.path = imagePath;
+    texture.system = this;
+    texture.pageTable = pageTable;
+    texture.width = width;
+    texture.height = height;
+    texture.levelCount = getVirtualLevelCount(width, height);
+
+    // Power-of-two sides, so that every level's tiles fit into the page table's level of the same index
+    texture.pageTableWidth = nextPowerOfTwo(texture.getTilesX(0));
+    texture.pageTableHeight = nextPowerOfTwo(texture.getTilesY(0));
+
+    glBindTexture(GL_TEXTURE_2D, pageTable);
+    for (int level = 0; level < texture.levelCount; ++level) {
+        int levelWidth = std::max(1, texture.pageTableWidth >> level);
+        int levelHeight = std::max(1, texture.pageTableHeight >> level);
+        texture.pageEntries.emplace_back(static_cast<size_t>(levelWidth) * levelHeight, 0);
+        glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, levelWidth, levelHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, texture.pageEntries.back().data());
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, texture.levelCount - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    if (isTileFileCurrent(imagePath)) {
+        openTileFile(texture);
+    }
+    else {
+        std::cout << "VIRTUAL TEXTURE: cutting " << imagePath << " (" << width << "x" << height << ") into tiles" << std::endl;
+        texture.build = pool.submit([imagePath]() {
+            std::string error;
+            bakeVirtualTexture(imagePath, error);
+            return error;
+        });
+        texture.building = true;
+    }
+
+    return pageTable;
+}
+
+bool VirtualTextureSystem::openTileFile(VirtualTexture &texture) {
+    std::string tilePath = getTilePath(texture.path);
+    std::shared_ptr<const VfsFile> file = AssetVfs::shared().read(tilePath);
+
+    VirtualTextureHeader header;
+    std::string error;
+    if (!file || !readHeader(*file, header))
+        error = "isn't a tile file of version " + std::to_string(vt::VERSION);
+    else if (static_cast<int>(header.width) != texture.width || static_cast<int>(header.height) != texture.height)
+        error = "doesn't have the size of its image";
+    else if (static_cast<int>(header.levelCount) != texture.levelCount || header.tileSize != vt::TILE_SIZE || header.border != vt::BORDER)
+        error = "has a different tile layout";
+    else if (header.format != static_cast<uint32_t>(BakedFormat::BC1) && header.format != static_cast<uint32_t>(BakedFormat::UNCOMPRESSED))
+        error = "has an unknown tile format";
+
+    if (error.empty()) {
+        texture.fileFormat = static_cast<BakedFormat>(header.format);
+        texture.tileBytes = getTileBytes(texture.fileFormat);
+
+        size_t tileCount = 0;
+        texture.levelFirstTile.clear();
+        for (int level = 0; level < texture.levelCount; ++level) {
+            texture.levelFirstTile.push_back(tileCount);
+            tileCount += static_cast<size_t>(texture.getTilesX(level)) * texture.getTilesY(level);
+        }
+
+        if (file->getSize() != sizeof(header) + tileCount * texture.tileBytes)
+            error = "is truncated";
+    }
+
+    if (!error.empty()) {
+        std::cout << "ERROR::VIRTUAL_TEXTURE::" << tilePath << " " << error << std::endl;
+        texture.failed = true;
+        return false;
+    }
+
+    texture.file = std::move(file);
+
+    // The coarsest level is all there is to fall back on
+    startLoad(texture, makeTileKey(texture.levelCount - 1, 0, 0), true);
+    return true;
+}
+
+void VirtualTextureSystem::release(unsigned int pageTable) {
+    auto found = textures.find(pageTable);
+    if (found == textures.end())
+        return;
+
+    for (const auto &tile : found->second.residentTiles)
+        slots[tile.second] = CacheSlot();
+
+    // Loads still running are dropped when they complete
+    pendingTiles.erase(std::remove_if(pendingTiles.begin(), pendingTiles.end(), [pageTable](const PendingTile &tile) {
+        return tile.owner == pageTable;
+    }), pendingTiles.end());
+
+    textures.erase(found);
+}
+
+const VirtualTexture* VirtualTextureSystem::find(unsigned int pageTable) const {
+    auto found = textures.find(pageTable);
+    return found != textures.end() ? &found->second : nullptr;
+}
+
+unsigned int VirtualTextureSystem::getMaterial(const std::vector<unsigned int> &textureIDs) {
+    std::vector<unsigned int> pageTables;
+    for (unsigned int id : textureIDs) {
+        if (textures.count(id) && std::find(pageTables.begin(), pageTables.end(), id) == pageTables.end())
+            pageTables.push_back(id);
+    }
+    if (pageTables.empty())
+        return 0;
+
+    std::sort(pageTables.begin(), pageTables.end());
+    auto found = std::find(materials.begin(), materials.end(), pageTables);
+    if (found != materials.end())
+        return static_cast<unsigned int>(found - materials.begin()) + 1;
+
+    materials.push_back(std::move(pageTables));
+    return static_cast<unsigned int>(materials.size());
+}
+
+void VirtualTextureSystem::resizeFeedback(int width, int height) {
+    if (!feedbackFramebuffer) {
+        glGenFramebuffers(1, &feedbackFramebuffer);
+        glGenRenderbuffers(1, &feedbackColor);
+        glGenRenderbuffers(1, &feedbackDepth);
+    }
+
+    feedbackWidth = width;
+    feedbackHeight = height;
+
+    glBindRenderbuffer(GL_RENDERBUFFER, feedbackColor);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA16UI, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, feedbackDepth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, feedbackFramebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, feedbackColor);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, feedbackDepth);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "ERROR::VIRTUAL_TEXTURE::FEEDBACK_FRAMEBUFFER_INCOMPLETE" << std::endl;
+}
+
+void VirtualTextureSystem::beginFeedback(int screenWidth, int screenHeight) {
+    int width = std::max(1, screenWidth / vt::FEEDBACK_SCALE);
+    int height = std::max(1, screenHeight / vt::FEEDBACK_SCALE);
+
+    glGetIntegerv(GL_VIEWPORT, savedViewport);
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &savedFramebuffer);
+
+    if (width != feedbackWidth || height != feedbackHeight)
+        resizeFeedback(width, height);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, feedbackFramebuffer);
+    glViewport(0, 0, width, height);
+
+    const GLuint nothing[4] = { 0, 0, 0, 0 };
+    const GLfloat farDepth = 1.0f;
+    glClearBufferuiv(GL_COLOR, 0, nothing);
+    glClearBufferfv(GL_DEPTH, 0, &farDepth);
+}
+
+void VirtualTextureSystem::endFeedback() {
+    // Read into whichever buffer has been processed; if both are still in flight, this frame's feedback is dropped
+    for (int i = 0; i < 2; ++i) {
+        if (readbackFences[i])
+            continue;
+
+        size_t bytes = static_cast<size_t>(feedbackWidth) * feedbackHeight * 4 * sizeof(uint16_t);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffers[i]);
+        if (readbackSizes[i][0] != feedbackWidth || readbackSizes[i][1] != feedbackHeight)
+            glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        glReadPixels(0, 0, feedbackWidth, feedbackHeight, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        readbackFences[i] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        readbackSizes[i][0] = feedbackWidth;
+        readbackSizes[i][1] = feedbackHeight;
+        break;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, savedFramebuffer);
+    glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+}
+
+void VirtualTextureSystem::update() {
+    for (auto &entry : textures) {
+        VirtualTexture &texture = entry.second;
+        if (!texture.building || texture.build.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            continue;
+
+        texture.building = false;
+        std::string error = texture.build.get();
+        if (!error.empty()) {
+            std::cout << "ERROR::VIRTUAL_TEXTURE::" << error << std::endl;
+            texture.failed = true;
+            continue;
+        }
+        openTileFile(texture);
+    }
+
+    // Feedback whose copy has completed, without waiting for any
+    for (int i = 0; i < 2; ++i) {
+        if (!readbackFences[i])
+            continue;
+
+        GLenum status = glClientWaitSync(readbackFences[i], 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            continue;
+
+        glDeleteSync(readbackFences[i]);
+        readbackFences[i] = nullptr;
+
+        size_t pixelCount = static_cast<size_t>(readbackSizes[i][0]) * readbackSizes[i][1];
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffers[i]);
+        const void *pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, pixelCount * 4 * sizeof(uint16_t), GL_MAP_READ_BIT);
+        if (pixels) {
+            processFeedback(static_cast<const uint16_t*>(pixels), pixelCount);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    for (size_t i = 0; i < pendingTiles.size(); ) {
+        if (pendingTiles[i].data.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            ++i;
+            continue;
+        }
+
+        finishLoad(pendingTiles[i]);
+        pendingTiles[i] = std::move(pendingTiles.back());
+        pendingTiles.pop_back();
+    }
+
+    for (auto &entry : textures) {
+        if (entry.second.pageTableDirty)
+            updatePageTable(entry.second);
+    }
+}
+
+void VirtualTextureSystem::processFeedback(const uint16_t *pixels, size_t pixelCount) {
+    ++feedbackFrame;
+    touchedTiles.clear();
+    missingTiles.clear();
+
+    for (size_t i = 0; i < pixelCount; ++i) {
+        const uint16_t *pixel = pixels + i * 4;
+        unsigned int material = pixel[3];
+        if (material == 0 || material > materials.size())
+            continue;
+
+        // Written by virtualFeedback.frag: wrapped UVs and -log2 of the UV footprint of a screen pixel, in 1/256ths
+        float u = pixel[0] / 65535.0f;
+        float v = pixel[1] / 65535.0f;
+        float footprint = pixel[2] / 256.0f;
+
+        for (unsigned int pageTable : materials[material - 1]) {
+            auto found = textures.find(pageTable);
+            if (found == textures.end() || !found->second.isReady())
+                continue;
+
+            VirtualTexture &texture = found->second;
+            float lod = std::floor(std::log2(static_cast<float>(std::max(texture.width, texture.height))) - footprint);
+            int level = static_cast<int>(std::max(0.0f, std::min(lod, static_cast<float>(texture.levelCount - 1))));
+
+            int levelWidth = std::max(1, texture.width >> level);
+            int levelHeight = std::max(1, texture.height >> level);
+            int x = std::min(static_cast<int>(u * levelWidth) / vt::TILE_SIZE, texture.getTilesX(level) - 1);
+            int y = std::min(static_cast<int>(v * levelHeight) / vt::TILE_SIZE, texture.getTilesY(level) - 1);
+            touchTile(texture, level, x, y);
+        }
+    }
+    visibleTileCount = touchedTiles.size();
+
+    // Only as many loads as there are slots to take them, or finished fine tiles could leave no room for the coarse ones
+    size_t freeSlots = 0;
+    for (const CacheSlot &slot : slots) {
+        if (slot.owner == 0 || (!slot.pinned && slot.lastUse < feedbackFrame))
+            ++freeSlots;
+    }
+    freeSlots = freeSlots > pendingTiles.size() ? freeSlots - pendingTiles.size() : 0;
+
+    // Coarse levels first: each one loaded improves a larger area, and finer ones then fall back to it
+    std::sort(missingTiles.begin(), missingTiles.end(), std::greater<std::pair<int, uint64_t>>());
+    for (const auto &missing : missingTiles) {
+        if (pendingTiles.size() >= vt::MAX_LOADS_IN_FLIGHT || freeSlots == 0)
+            break;
+        --freeSlots;
+
+        auto found = textures.find(static_cast<unsigned int>(missing.second >> 32));
+        startLoad(found->second, static_cast<uint32_t>(missing.second), false);
+    }
+}
+
+void VirtualTextureSystem::touchTile(VirtualTexture &texture, int level, int x, int y) {
+    for (; level < texture.levelCount; ++level) {
+        uint32_t key = makeTileKey(level, x, y);
+
+        // Its ancestors were handled along with it
+        if (!touchedTiles.insert((static_cast<uint64_t>(texture.pageTable) << 32) | key).second)
+            return;
+
+        auto resident = texture.residentTiles.find(key);
+        if (resident != texture.residentTiles.end())
+            slots[resident->second].lastUse = feedbackFrame;
+        else if (!texture.loadingTiles.count(key))
+            missingTiles.emplace_back(level, (static_cast<uint64_t>(texture.pageTable) << 32) | key);
+
+        if (level + 1 < texture.levelCount) {
+            x = std::min(x / 2, texture.getTilesX(level + 1) - 1);
+            y = std::min(y / 2, texture.getTilesY(level + 1) - 1);
+        }
+    }
+}
+
+void VirtualTextureSystem::startLoad(VirtualTexture &texture, uint32_t key, bool pinned) {
+    int level, x, y;
+    splitTileKey(key, level, x, y);
+    size_t tileIndex = texture.levelFirstTile[level] + static_cast<size_t>(y) * texture.getTilesX(level) + x;
+
+    // Reading the tile out of the mapping is what may touch the disk; converting it is only needed if the cache format differs
+    PendingTile tile;
+    tile.owner = texture.pageTable;
+    tile.key = key;
+    tile.pinned = pinned;
+    tile.data = pool.submit([file = texture.file, offset = sizeof(VirtualTextureHeader) + tileIndex * texture.tileBytes, tileBytes = texture.tileBytes,
+                             fileFormat = texture.fileFormat, cacheFormat = cacheFormat]() {
+        const unsigned char *source = file->getData() + offset;
+        if (fileFormat == cacheFormat)
+            return std::vector<unsigned char>(source, source + tileBytes);
+
+        std::vector<unsigned char> converted(getTileBytes(cacheFormat));
+        if (cacheFormat == BakedFormat::BC1)
+            encodeTile(source, converted.data());
+        else
+            decodeTile(source, converted.data());
+
+        return converted;
+    });
+
+    texture.loadingTiles.insert(key);
+    pendingTiles.push_back(std::move(tile));
+}
+
+void VirtualTextureSystem::finishLoad(PendingTile &tile) {
+    std::vector<unsigned char> data = tile.data.get();
+
+    auto found = textures.find(tile.owner);
+    if (found == textures.end())
+        return;
+
+    VirtualTexture &texture = found->second;
+    texture.loadingTiles.erase(tile.key);
+
+    size_t slot = allocateSlot();
+    if (slot == SIZE_MAX) {
+        if (tile.pinned)
+            std::cout << "ERROR::VIRTUAL_TEXTURE::CACHE_FULL: no room for the coarsest level of " << texture.path << std::endl;
+        return;
+    }
+
+    int cacheX = static_cast<int>(slot % cacheTiles) * vt::CACHE_TILE_SIZE;
+    int cacheY = static_cast<int>(slot / cacheTiles) * vt::CACHE_TILE_SIZE;
+
+    glBindTexture(GL_TEXTURE_2D, cacheTexture);
+    if (cacheFormat == BakedFormat::BC1)
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, cacheX, cacheY, vt::CACHE_TILE_SIZE, vt::CACHE_TILE_SIZE, COMPRESSED_RGB_S3TC_DXT1,
+                                  static_cast<GLsizei>(data.size()), data.data());
+    else
+        glTexSubImage2D(GL_TEXTURE_2D, 0, cacheX, cacheY, vt::CACHE_TILE_SIZE, vt::CACHE_TILE_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, data.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    CacheSlot &cacheSlot = slots[slot];
+    cacheSlot.owner = texture.pageTable;
+    cacheSlot.key = tile.key;
+    cacheSlot.lastUse = feedbackFrame;
+    cacheSlot.pinned = tile.pinned;
+
+    texture.residentTiles[tile.key] = slot;
+    texture.pageTableDirty = true;
+    ++loadedTileCount;
+}
+
+size_t VirtualTextureSystem::allocateSlot() {
+    size_t victim = SIZE_MAX;
+    for (size_t i = 0; i < slots.size(); ++i) {
+        const CacheSlot &slot = slots[i];
+        if (slot.owner == 0)
+            return i;
+
+        if (!slot.pinned && slot.lastUse < feedbackFrame && (victim == SIZE_MAX || slot.lastUse < slots[victim].lastUse))
+            victim = i;
+    }
+    if (victim == SIZE_MAX)
+        return SIZE_MAX;
+
+    VirtualTexture &owner = textures.at(slots[victim].owner);
+    owner.residentTiles.erase(slots[victim].key);
+    owner.pageTableDirty = true;
+    slots[victim] = CacheSlot();
+    ++evictedTileCount;
+
+    return victim;
+}
+
+void VirtualTextureSystem::updatePageTable(VirtualTexture &texture) {
+    texture.pageTableDirty = false;
+
+    // From the coarsest level down, so every page can take its parent's entry when its own tile isn't there
+    glBindTexture(GL_TEXTURE_2D, texture.pageTable);
+    for (int level = texture.levelCount - 1; level >= 0; --level) {
+        int rowLength = std::max(1, texture.pageTableWidth >> level);
+        int parentRowLength = std::max(1, texture.pageTableWidth >> (level + 1));
+        std::vector<uint32_t> &entries = texture.pageEntries[level];
+
+        for (int y = 0; y < texture.getTilesY(level); ++y) {
+            for (int x = 0; x < texture.getTilesX(level); ++x) {
+                uint32_t &entry = entries[static_cast<size_t>(y) * rowLength + x];
+
+                auto resident = texture.residentTiles.find(makeTileKey(level, x, y));
+                if (resident != texture.residentTiles.end()) {
+                    // RGBA8 texel: cache tile column, row, the level it holds, and "mapped"
+                    uint32_t column = static_cast<uint32_t>(resident->second % cacheTiles);
+                    uint32_t row = static_cast<uint32_t>(resident->second / cacheTiles);
+                    entry = column | (row << 8) | (static_cast<uint32_t>(level) << 16) | 0xFF000000u;
+                }
+                else if (level + 1 < texture.levelCount) {
+                    int parentX = std::min(x / 2, texture.getTilesX(level + 1) - 1);
+                    int parentY = std::min(y / 2, texture.getTilesY(level + 1) - 1);
+                    entry = texture.pageEntries[level + 1][static_cast<size_t>(parentY) * parentRowLength + parentX];
+                }
+                else
+                    entry = 0;
+            }
+        }
+
+        glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, rowLength, std::max(1, texture.pageTableHeight >> level), GL_RGBA, GL_UNSIGNED_BYTE,
+                        entries.data());
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+size_t VirtualTextureSystem::getCacheBytes() const {
+    return slots.size() * getTileBytes(cacheFormat);
+}
+
+size_t VirtualTextureSystem::getUsedSlotCount() const {
+    return static_cast<size_t>(std::count_if(slots.begin(), slots.end(), [](const CacheSlot &slot) { return slot.owner != 0; }));
+}
+
+void VirtualTextureSystem::logStats() const {
+    constexpr double MB = 1024.0 * 1024.0;
+
+    std::ostringstream details;
+    for (const auto &entry : textures) {
+        const VirtualTexture &texture = entry.second;
+
+        details << "  " << texture.width << "x" << texture.height << ", " << texture.levelCount << " levels, ";
+        if (texture.failed)
+            details << "failed";
+        else if (texture.building)
+            details << "cutting into tiles";
+        else
+            details << texture.residentTiles.size() << " tiles resident, " << texture.loadingTiles.size() << " loading";
+        details << "  " << texture.path << "\n";
+    }
+
+    std::cout << "VIRTUAL TEXTURES: " << textures.size() << " textures, " << getUsedSlotCount() << "/" << slots.size() << " cache tiles used ("
+        << getCacheBytes() / MB << " MB " << (cacheFormat == BakedFormat::BC1 ? "BC1" : "RGBA8") << "), " << visibleTileCount << " tiles visible, "
+        << loadedTileCount << " loaded, " << evictedTileCount << " evicted\n" << details.str() << std::flush;
+}
+
+
+bool isVirtualTextureCandidate(const std::string &imagePath) {
+    int width, height;
+    return readVirtualTextureSize(imagePath, width, height) && std::max(width, height) >= vt::MIN_SIZE;
+}
+
+bool bakeVirtualTexture(const std::string &imagePath, std::string &error) {
+    auto startTime = std::chrono::steady_clock::now();
+    error.clear();
+
+    std::shared_ptr<const VfsFile> source = AssetVfs::shared().read(imagePath);
+    if (!source || source->getSize() > INT_MAX) {
+        error = "can't read " + imagePath;
+        return false;
+    }
+
+    // Tiles are always cut from RGBA, whatever the image has
+    int width, height, components;
+    std::unique_ptr<unsigned char, void(*)(void*)> pixels(
+        stbi_load_from_memory(source->getData(), static_cast<int>(source->getSize()), &width, &height, &components, 4), stbi_image_free);
+    source.reset();
+    if (!pixels) {
+        error = "can't decode " + imagePath + ": " + stbi_failure_reason();
+        return false;
+    }
+
+    VirtualTextureHeader header = {};
+    header.magic = vt::MAGIC;
+    header.version = vt::VERSION;
+    header.width = static_cast<uint32_t>(width);
+    header.height = static_cast<uint32_t>(height);
+    header.levelCount = static_cast<uint32_t>(getVirtualLevelCount(width, height));
+    header.tileSize = vt::TILE_SIZE;
+    header.border = vt::BORDER;
+    header.format = static_cast<uint32_t>(ktx::COMPRESS ? BakedFormat::BC1 : BakedFormat::UNCOMPRESSED);
+
+    // Written next to the image under a temporary name first, so an interrupted cut never leaves a truncated tile file behind
+    std::string tilePath = getTilePath(imagePath);
+    std::string tempPath = tilePath + ".tmp";
+    size_t tileCount = 0;
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        std::vector<unsigned char> tile(RGBA_TILE_BYTES);
+        std::vector<unsigned char> blocks(BC1_TILE_BYTES);
+        std::vector<unsigned char> current;
+        const unsigned char *levelPixels = pixels.get();
+        int levelWidth = width;
+        int levelHeight = height;
+
+        for (uint32_t level = 0; level < header.levelCount && out; ++level) {
+            for (int y = 0; y < getTileCount(height, level); ++y) {
+                for (int x = 0; x < getTileCount(width, level); ++x) {
+                    cutTile(levelPixels, levelWidth, levelHeight, x, y, tile.data());
+                    if (header.format == static_cast<uint32_t>(BakedFormat::BC1)) {
+                        encodeTile(tile.data(), blocks.data());
+                        out.write(reinterpret_cast<const char*>(blocks.data()), blocks.size());
+                    }
+                    else
+                        out.write(reinterpret_cast<const char*>(tile.data()), tile.size());
+                    ++tileCount;
+                }
+            }
+
+            if (level + 1 < header.levelCount) {
+                int nextWidth, nextHeight;
+                std::vector<unsigned char> next = downsampleImage(levelPixels, levelWidth, levelHeight, 4, nextWidth, nextHeight);
+                current = std::move(next);
+                levelPixels = current.data();
+                levelWidth = nextWidth;
+                levelHeight = nextHeight;
+
+                // The full-size image isn't needed past the first level
+                pixels.reset();
+            }
+        }
+
+        if (!out) {
+            error = "can't write " + tempPath;
+            out.close();
+            std::error_code removeError;
+            std::filesystem::remove(tempPath, removeError);
+            return false;
+        }
+    }
+
+    std::error_code fsError;
+    std::filesystem::rename(tempPath, tilePath, fsError);
+    if (fsError) {
+        error = "can't replace " + tilePath + ": " + fsError.message();
+        std::filesystem::remove(tempPath, fsError);
+        return false;
+    }
+
+    std::cout << "VIRTUAL TEXTURE: " << tilePath << ": " << tileCount << " tiles in " << header.levelCount << " levels, "
+        << (sizeof(header) + tileCount * getTileBytes(static_cast<BakedFormat>(header.format))) / (1024.0 * 1024.0) << " MB, cut in "
+        << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count() << " ms" << std::endl;
+    return true;
+}
\ No newline at end of file